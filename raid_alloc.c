@@ -0,0 +1,280 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_alloc.c
+//  Description    : This is the implementation of the allocator of RAID blocks
+//                   of the TAGLINE driver.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+// ****************************************************************************
+// Blocks are handed out in extents: a tagline reserves a run of free blocks of
+// one disk and takes its new blocks from it one after the other, so blocks
+// written one after the other end up next to each other on the disk and are
+// read and written back with multi-block transfers.
+//
+// Each disk has two bitmaps (one bit per block): the blocks allocated, and the
+// blocks reserved by an extent. A new extent goes on the disk with the most
+// blocks neither allocated nor reserved, at the first run of them long enough
+// (or else the longest one). Once every free block is reserved, extents are
+// carved out of the free blocks reserved by other extents, so the array can
+// fill up completely; an extent whose next block was taken that way is given
+// up and replaced by its tagline.
+
+
+// Includes
+#include <string.h>
+
+// Project includes
+#include <cmpsc311_log.h>
+#include <raid_alloc.h>
+
+// Defines
+#define ALLOC_WORD_BITS		64				// blocks per word of a bitmap
+#define ALLOC_WORDS		(RAID_DISKBLOCKS / ALLOC_WORD_BITS)	// words of the bitmap of a disk
+#define ALLOC_BIT(blk)		((uint64_t)1 << ((blk) % ALLOC_WORD_BITS))
+
+// Function Prototypes:
+int alloc_next_bit(RAIDDiskID dsk, RAIDBlockID from, int busy, int reserved_busy);
+int alloc_find_run(RAIDDiskID dsk, uint32_t want, int reserved_busy, RAIDBlockID *start, uint32_t *blocks);
+int alloc_pick_disk(RAIDDiskID avoid, const uint32_t *counts);
+// -----------------------------
+
+// Data Structures - Declarations
+static uint64_t			allocated[RAID_DISKS][ALLOC_WORDS];	// bit set for each block allocated
+static uint64_t			reserved[RAID_DISKS][ALLOC_WORDS];	// bit set for each block of an extent
+static uint32_t			free_blocks[RAID_DISKS];		// blocks not allocated
+static uint32_t			open_blocks[RAID_DISKS];		// blocks neither allocated nor reserved
+// -----------------------------
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : init_raid_alloc
+// Description  : Every block of every disk is free
+//
+// Inputs       : N/A
+// Outputs      : N/A
+void init_raid_alloc(void) {
+	RAIDDiskID dsk;
+
+	memset(allocated, 0, sizeof(allocated));
+	memset(reserved, 0, sizeof(reserved));
+	for (dsk = 0; dsk < RAID_DISKS; dsk++) {
+		free_blocks[dsk] = RAID_DISKBLOCKS;
+		open_blocks[dsk] = RAID_DISKBLOCKS;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_alloc_extent
+// Description  : Reserve a run of up to want free blocks, on the disk (other
+//                than avoid) with the most blocks no extent holds, or once
+//                they are all reserved on the disk with the most free blocks
+//
+// Inputs       : avoid - disk not to use, or RAID_ALLOC_ANY_DISK
+//                want - the number of blocks wanted
+//                dsk - set to the disk of the extent
+//                start - set to the first block of the extent
+//                blocks - set to the number of blocks of the extent (at least 1)
+// Outputs      : 0 if successful, -1 if every disk but avoid is full
+int raid_alloc_extent(RAIDDiskID avoid, uint32_t want, RAIDDiskID *dsk, RAIDBlockID *start, uint32_t *blocks) {
+	int		disk;
+	int		reserved_busy = 1;
+	RAIDBlockID	blk;
+
+	disk = alloc_pick_disk(avoid, open_blocks);
+	if (disk < 0) {
+		// every free block is reserved, take some of another extent
+		reserved_busy = 0;
+		disk = alloc_pick_disk(avoid, free_blocks);
+		if (disk < 0) {
+			logMessage(LOG_ERROR_LEVEL, "RAID allocator : All Disks are full!");
+			return(-1);
+		}
+	}
+	if (alloc_find_run(disk, want, reserved_busy, start, blocks) != 0) {
+		return(-1);
+	}
+	for (blk = *start; blk < *start + *blocks; blk++) {
+		if (!(reserved[disk][blk / ALLOC_WORD_BITS] & ALLOC_BIT(blk))) {
+			reserved[disk][blk / ALLOC_WORD_BITS] |= ALLOC_BIT(blk);
+			open_blocks[disk]--;
+		}
+	}
+	*dsk = disk;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_alloc_claim
+// Description  : Allocate a block (of an extent), unless another extent
+//                already took it
+//
+// Inputs       : dsk - this is the disk number of the block
+//                blk - this is the block number of the block
+// Outputs      : 0 if successful, -1 if the block is already allocated
+int raid_alloc_claim(RAIDDiskID dsk, RAIDBlockID blk) {
+	if ((dsk >= RAID_DISKS) || (blk >= RAID_DISKBLOCKS) ||
+			(allocated[dsk][blk / ALLOC_WORD_BITS] & ALLOC_BIT(blk))) {
+		return(-1);
+	}
+	allocated[dsk][blk / ALLOC_WORD_BITS] |= ALLOC_BIT(blk);
+	free_blocks[dsk]--;
+	if (!(reserved[dsk][blk / ALLOC_WORD_BITS] & ALLOC_BIT(blk))) {
+		open_blocks[dsk]--;
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_alloc_unclaim
+// Description  : Give back a block claimed for a write that failed, it stays
+//                reserved for its extent if it was
+//
+// Inputs       : dsk - this is the disk number of the block
+//                blk - this is the block number of the block
+// Outputs      : N/A
+void raid_alloc_unclaim(RAIDDiskID dsk, RAIDBlockID blk) {
+	if ((dsk >= RAID_DISKS) || (blk >= RAID_DISKBLOCKS) ||
+			!(allocated[dsk][blk / ALLOC_WORD_BITS] & ALLOC_BIT(blk))) {
+		return;
+	}
+	allocated[dsk][blk / ALLOC_WORD_BITS] &= ~ALLOC_BIT(blk);
+	free_blocks[dsk]++;
+	if (!(reserved[dsk][blk / ALLOC_WORD_BITS] & ALLOC_BIT(blk))) {
+		open_blocks[dsk]++;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_alloc_release
+// Description  : Give back the blocks of an extent that were never allocated
+//
+// Inputs       : dsk - this is the disk number of the extent
+//                start - the first block to give back
+//                end - the block after the last one of the extent
+// Outputs      : N/A
+void raid_alloc_release(RAIDDiskID dsk, RAIDBlockID start, RAIDBlockID end) {
+	RAIDBlockID blk;
+
+	for (blk = start; (blk < end) && (blk < RAID_DISKBLOCKS); blk++) {
+		if ((reserved[dsk][blk / ALLOC_WORD_BITS] & ALLOC_BIT(blk)) &&
+				!(allocated[dsk][blk / ALLOC_WORD_BITS] & ALLOC_BIT(blk))) {
+			open_blocks[dsk]++;
+		}
+		reserved[dsk][blk / ALLOC_WORD_BITS] &= ~ALLOC_BIT(blk);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_alloc_free
+// Description  : Number of blocks of a disk not allocated yet
+//
+// Inputs       : dsk - this is the disk number
+// Outputs      : the number of free blocks
+uint32_t raid_alloc_free(RAIDDiskID dsk) {
+	return((dsk < RAID_DISKS) ? free_blocks[dsk] : 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : alloc_pick_disk
+// Description  : Find the disk (other than avoid) with the largest count
+//
+// Inputs       : avoid - disk not to use, or RAID_ALLOC_ANY_DISK
+//                counts - count of blocks of each disk
+// Outputs      : the disk, -1 if the counts of all other disks are 0
+int alloc_pick_disk(RAIDDiskID avoid, const uint32_t *counts) {
+	int dsk, best = -1;
+
+	for (dsk = 0; dsk < RAID_DISKS; dsk++) {
+		if ((dsk != avoid) && (counts[dsk] > 0) && ((best < 0) || (counts[dsk] > counts[best]))) {
+			best = dsk;
+		}
+	}
+	return(best);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : alloc_find_run
+// Description  : Find the first run of want available blocks of a disk, or
+//                the longest run of them if there is none that long
+//
+// Inputs       : dsk - this is the disk number
+//                want - the number of blocks wanted
+//                reserved_busy - 1 if reserved blocks are not available
+//                start - set to the first block of the run
+//                blocks - set to the number of blocks of the run
+// Outputs      : 0 if successful, -1 if no block is available
+int alloc_find_run(RAIDDiskID dsk, uint32_t want, int reserved_busy, RAIDBlockID *start, uint32_t *blocks) {
+	int		first, end;
+	uint32_t	best = 0;
+
+	first = alloc_next_bit(dsk, 0, 0, reserved_busy);
+	while (first >= 0) {
+		end = alloc_next_bit(dsk, first, 1, reserved_busy);
+		if (end < 0) {
+			end = RAID_DISKBLOCKS;
+		}
+		if ((uint32_t)(end - first) > best) {
+			*start = first;
+			best = end - first;
+			if (best >= want) {
+				*blocks = want;
+				return(0);
+			}
+		}
+		first = alloc_next_bit(dsk, end, 0, reserved_busy);
+	}
+	if (best == 0) {
+		return(-1);
+	}
+	*blocks = best;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : alloc_next_bit
+// Description  : Find the first block at or after a block of a disk that is
+//                available (or not), a word at a time
+//
+// Inputs       : dsk - this is the disk number
+//                from - the first block to look at
+//                busy - 1 to look for a block not available, 0 for one available
+//                reserved_busy - 1 if reserved blocks are not available
+// Outputs      : the block found, -1 if there is none
+int alloc_next_bit(RAIDDiskID dsk, RAIDBlockID from, int busy, int reserved_busy) {
+	uint32_t	word;
+	uint64_t	bits;
+
+	if (from >= RAID_DISKBLOCKS) {
+		return(-1);
+	}
+	word = from / ALLOC_WORD_BITS;
+	// the bits of the blocks before from are masked out of the first word
+	bits = allocated[dsk][word] | (reserved_busy ? reserved[dsk][word] : 0);
+	bits = (busy ? bits : ~bits) & (~(uint64_t)0 << (from % ALLOC_WORD_BITS));
+	while (bits == 0) {
+		if (++word == ALLOC_WORDS) {
+			return(-1);
+		}
+		bits = allocated[dsk][word] | (reserved_busy ? reserved[dsk][word] : 0);
+		bits = busy ? bits : ~bits;
+	}
+	return(word * ALLOC_WORD_BITS + __builtin_ctzll(bits));
+}
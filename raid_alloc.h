@@ -0,0 +1,43 @@
+#ifndef RAID_ALLOC_INCLUDED
+#define RAID_ALLOC_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_alloc.h
+//  Description    : This is the header file for the allocator of RAID blocks
+//                   of the TAGLINE driver.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+//
+
+// Includes
+#include <tagline_driver.h>
+
+// Defines
+#define RAID_ALLOC_ANY_DISK	RAID_DISKS	// no disk to stay away from
+
+///
+// Allocator Interfaces
+// The allocator has no lock of its own, the driver calls it while scheduling
+// blocks (under its scheduling lock).
+
+void init_raid_alloc(void);
+	// Every block of every disk is free
+
+int raid_alloc_extent(RAIDDiskID avoid, uint32_t want, RAIDDiskID *dsk, RAIDBlockID *start, uint32_t *blocks);
+	// Reserve a run of up to want free blocks on a disk other than avoid
+
+int raid_alloc_claim(RAIDDiskID dsk, RAIDBlockID blk);
+	// Allocate a block (of an extent), unless another extent already took it
+
+void raid_alloc_unclaim(RAIDDiskID dsk, RAIDBlockID blk);
+	// Give back a block claimed for a write that failed (it stays in its extent)
+
+void raid_alloc_release(RAIDDiskID dsk, RAIDBlockID start, RAIDBlockID end);
+	// Give back the blocks of an extent that were never allocated
+
+uint32_t raid_alloc_free(RAIDDiskID dsk);
+	// Number of blocks of a disk not allocated yet
+
+#endif
@@ -7,230 +7,512 @@
 //  Author         : Raquel Alvarez
 //  Last Modified  : Thursday, November 19th 2015
 // ****************************************************************************
-// The following code implements an LRU cache. A hash table, with HASHTABLE_SIZE
-// number of entries, maps to a doubly-linked list (with 2*TAGLINE_CACHE_SIZE). 
-// The doubly-linked list will be performing the task of a queue, where the first 
-// item is the block least recently read/written.
-// To decide how many entries the hash table should have, I wrote a short program
-// (https://www.github.com/rva5120/hashalyzer). The program will 
-// calculate the distribution of hash values (using a modular hash function).
-// For this assignment, I started by analyzing constant access time and comparing
-// values reducing the number of buckets by 2 until a good balance in between 
-// memory allocation and access time was reached.
-// 
-//	Buckets	   O(x)		  Time		 Power
-//		Worst Case   (10,000 accesses)		
-//     ------------------------------------------------
-//	 36864	   O(1)		10,000		  --
-//	 32768	   O(2)		20,000		 2^15
-//	 18432	   O(3)		30,000		  --
-//	 16384	   O(4)		40,000		 2^14
-//	  9216	   O(6)		60,000		  --
-//	  8192	   O(5)		50,000		 2^13
-//	  4608	   O(9)		90,000		  --
-//	  4096	   O(9)		90,000		 2^12
-//	  2304	   O(18)       180,000		  --
-//	  2048	   O(18)       180,000		 2^11
-//
-// Based on the results, I decided to go with 8192 buckets (which is 2*blocks_per_disk)
-// because we get a better time, for less memory. After that point, the rest
-// of the values are not as efficient access timewise, and the amount of memory
-// saved is not worth the extra access time. Since this is a cache implementation,
-// we should be prioritizing the optimization of access time more than memory
-// allocation. So we go with 2*RAID_DISKBLOCKS buckets on the hash table.
-// Each bucket on the hash table will have a linked-list of extra values to fix
-// any collision issue (which will happen since the number of buckets is less than
-// the total number of addressable block).
-// Each bucket has a pointer to a node on the queue or a null pointer. The queue is
-// organized so the front of the queue is the least recently accessed block, and the 
-// back of the queue is the last accessed block. Each node has a corresponding bucket
-// mapped to it.
+// The following code implements a block cache with a choice of replacement
+// policies. A hash table maps each disk,block pair to a cache node, and the
+// policy decides which node is evicted when the cache is full:
+//
+//   LRU   - a doubly-linked list performs the task of a queue, where the front
+//           of the queue is the block least recently read/written and the back
+//           the last accessed block. Every hit moves its node to the back.
+//   CLOCK - a hand sweeps over the slab of nodes, skipping (and clearing) the
+//           nodes whose reference bit (the age_bit) was set by a hit since the
+//           hand last passed. A hit only sets the bit, there is no list surgery.
+//   2Q    - new blocks enter a FIFO (A1in) holding up to a quarter of the cache;
+//           blocks pushed out of it leave their key in a ghost FIFO (A1out) of
+//           half the cache size, and only a block coming back while its key is
+//           still in A1out goes to the main LRU queue (Am). A scan then only
+//           cycles through A1in and leaves the blocks in Am alone.
+//
+// The cache is split in raid_cache_shards shards, and the disk,block pair of a
+// block picks its shard. Every shard is a cache of its own, with its share of the
+// blocks, its hash table, its policy queues and statistics, and a mutex taken by
+// every call on one of its blocks, so threads working on blocks of different
+// shards do not wait for each other.
+// The hash table uses open addressing with Robin Hood probing: the disk,block pair
+// is packed in a 64-bit key, mixed into a hash value, and each entry is stored in
+// the first free slot from its home slot, taking over the slot of any entry that
+// is closer to its own home (so probe lengths stay short and even). The table has
+// a power of two number of slots, at least twice the cache size, so it is never
+// more than half full. An evicted block is deleted from the table by shifting the
+// entries that follow it back by one slot, so there are no tombstones. The ghost
+// keys of 2Q are kept in a second table of the same kind.
+// Dirty blocks are written back ahead of their eviction, by a flusher thread: when
+// fewer than a low watermark of the slots of a shard are free or clean, the insert
+// marks the shard and wakes the flusher, which locks the shard, gathers a batch of
+// the dirty blocks the policy would evict first, sorts them by disk and block, and
+// writes them with one multi-block RAID_WRITE per run of adjacent blocks. The
+// writes are detached (pipelined, nobody waits for them), and the blocks are clean
+// when they reach the eviction end, so an insert rarely has to write back the
+// block it evicts (and never a batch of others).
+// A mirrored block is cached once, under its primary disk,block pair, and its node
+// also records where the copy of the block goes: writing it back (flushed or
+// evicted) writes both, the copies of a flushed batch being sorted and merged into
+// runs of their own, and all the writes go out together in one pipelined batch.
+// The driver copies its hits out while the shard is locked (one lock and one copy
+// each). A block can also be pinned and its cache buffer used in place; a pinned
+// block is passed over by the policies until it is unpinned.
+// No memory is allocated for a block once the cache is initialized: the queue nodes
+// and the block buffers are preallocated (one page-aligned arena for the buffers,
+// one slab for the nodes, split between the shards) and recycled through a
+// freelist on eviction.
+// A node does not own a buffer: a block filled with a single byte value (a zeroed
+// block, or the repeated bytes most of our data is made of) points to a read-only
+// page of that byte shared by the whole cache, and with raid_cache_dedup set a
+// block whose contents are those of a buffer of its shard already shares that
+// buffer (found by the checksum of its contents in a table of the shard, compared
+// before it is shared). A buffer is counted by the nodes holding it and goes back
+// to the freelist with the last of them; a node given new contents gets a buffer
+// of its own (or a shared one) anew. A shard has CACHE_ENTRY_RATIO times as many
+// nodes as buffers, and evicts once either runs out, so the blocks that take no
+// buffer of their own multiply the blocks the cache holds.
+// With raid_cache_memory set, the cache is sized by a budget of memory instead of
+// a number of blocks, and the budget of every shard is split between two tiers:
+// the buffers above (the first tier), and a second tier keeping the blocks the
+// first evicts compressed (LZ4), in chunks of TIER2_CHUNK bytes of an arena of the
+// shard, until it evicts them in turn (its least recently evicted first). A block
+// of the second tier is decompressed back to the first when it is used again, and
+// is always clean (a dirty block is written back as it leaves the first tier), so
+// the second tier drops blocks without I/O. Each tier remembers the keys of the
+// blocks it lost in a ghost list (the first tier, the blocks too large compressed
+// for the second; the second, the blocks it evicted), and a miss on a block in
+// one of them moves a block worth of memory to that tier, which would have kept
+// it, within bounds that leave each tier some memory to learn from. The budget
+// can be changed while the cache runs (resize_raid_cache), up to the one it was
+// initialized with: the memory of that budget is reserved at init, and a smaller
+// one leaves some of it unused.
 
 
 // Includes
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <sys/time.h>
 
 // Project includes
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 #include <raid_cache.h>
+#include <raid_opcode.h>
+#include <raid_stats.h>
+#include <raid_checksum.h>
+#include <raid_compress.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 // Defines
-#define HASHTABLE_SIZE	8192
-#define RAIDOpCode_c	uint64_t
-
-struct hash_node;
+#define HASH_MIN_SLOTS		16	// smallest hash table
+#define HASH_KEY(dsk, blk)	(((uint64_t)(dsk) << 32) | (uint64_t)(blk))	// packed disk,block pair
+#define ARENA_ALIGNMENT		4096	// block buffers start on a page boundary
+#define PIN_SLOTS		16	// most pinned blocks over the size of a shard
+#define FLUSH_BATCH		64	// most dirty blocks written back by a flush
+#define FLUSH_SCAN		(4*FLUSH_BATCH)	// most blocks looked at to find them
+#define CACHE_ENTRY_RATIO	4	// nodes of a shard for each of its buffers
+#define UNIFORM_PAGES		256	// a page for each byte value
+#define TIER2_CHUNK		128	// bytes of a chunk of the second tier
+#define TIER2_END		-1	// chunk after the last of a block (or of the freelist)
 
 // Data Structures Definitions
+//	Queue a node is on
+typedef enum {
+	CACHE_LIST_FREE  = 0,	// not in the cache
+	CACHE_LIST_LRU   = 1,	// LRU queue
+	CACHE_LIST_CLOCK = 2,	// swept by the CLOCK hand
+	CACHE_LIST_A1IN  = 3,	// 2Q first-time FIFO
+	CACHE_LIST_AM    = 4,	// 2Q main LRU queue
+} CACHE_LIST;
+//	Block buffers, held by one node or shared by nodes with the same contents
+typedef struct cache_buffer {
+	char			*data;		// RAID_BLOCK_SIZE bytes of the arena
+	int			refs;		// nodes holding the buffer, 0 if free
+	int			indexed;	// 1 if it is the buffer of its checksum in the dedup table
+	uint32_t		hash;		// checksum of the contents, once indexed
+	struct cache_buffer	*next_free;	// next buffer of the freelist
+} CACHE_BUFFER;
 //	Nodes for queue
 // next_node: points towards the front of the queue (LRU)
 // prev_node: points towards the back of the queue (MRU)
 typedef struct queue_node {
-	char			*value_buf;
-	int			age_bit;
+	char			*value_buf;	// contents of the block (a uniform page or the data of buffer)
+	CACHE_BUFFER		*buffer;	// buffer holding the contents, NULL for a uniform page
+	int			age_bit;	// CLOCK reference bit
+	int			dirty;		// 1 if the disk does not hold the contents yet
+	int			pins;		// pins held on the block, not evicted while any
+	CACHE_LIST		list;
+	RAIDDiskID		disk;
+	RAIDBlockID		block;
+	RAIDDiskID		copy_disk;	// where the copy of the block goes, RAID_CACHE_NO_COPY if none
+	RAIDBlockID		copy_block;
 	struct queue_node	*next_node;
 	struct queue_node	*prev_node;
-	struct hash_node	*parent_hash_node;
 } QUEUE_NODE;
-//	Nodes for hashtable
-typedef struct hash_node {
-	RAIDDiskID		disk;
-	RAIDBlockID		block;
-	QUEUE_NODE		*cache_block_ptr;
-	struct hash_node	*next_node;
-} HASH_NODE;
+//	Slots of a hashtable
+typedef struct {
+	uint64_t		key;		// packed disk,block pair
+	void			*value;		// value of the key, NULL if the slot is free
+} HASH_SLOT;
+//	Hashtable
+typedef struct {
+	HASH_SLOT		*slots;
+	uint64_t		mask;		// number of slots minus one
+} HASH_TABLE;
 // 	Queue structure
 typedef struct {
 	int 		capacity;
 	QUEUE_NODE 	*back_ptr;
 	QUEUE_NODE	*front_ptr;
 } QUEUE;
-// -----------------------------
-// Structures to add to separate file later on
+//	Ghost list, the keys of the last blocks lost, in a FIFO
+typedef struct {
+	HASH_TABLE	table;		// keys in the FIFO, valued by their slot
+	uint64_t	*keys;		// FIFO of keys
+	int		max;		// size of the FIFO, 0 if there is none
+	int		head;		// oldest key in the FIFO
+	int		count;		// keys in the FIFO
+} GHOST_LIST;
+//	Blocks of the second tier, compressed in a chain of chunks
+typedef struct tier2_entry {
+	uint64_t		key;		// packed disk,block pair
+	int			chunk;		// first chunk of the compressed contents
+	int			length;		// bytes of the compressed contents
+	struct tier2_entry	*next;		// towards the back of the queue (the newer blocks)
+	struct tier2_entry	*prev;		// towards the front (the older blocks)
+} TIER2_ENTRY;
+//	Cache statistics
+typedef struct {
+	int		inserts;
+	int		gets;
+	int		hits;
+	int		misses;
+	int		write_backs;		// dirty blocks written back on eviction
+	int		copy_writes;		// writes of the copies of the blocks written back
+	int		flushed_blocks;		// dirty blocks written back ahead of eviction
+	int		flush_writes;		// writes issued for them
+	int		clean_evictions;	// clean blocks dropped without I/O
+	int		uniform_blocks;		// contents stored as a uniform page
+	int		shared_blocks;		// contents stored in the buffer of another block
+	int		tier2_stores;		// evicted blocks kept in the second tier
+	int		tier2_rejects;		// evicted blocks too large compressed to keep
+	int		tier2_hits;		// blocks brought back from the second tier
+	int		tier1_ghost_hits;	// misses on blocks the second tier could not keep
+	int		tier2_ghost_hits;	// misses on blocks the second tier evicted
+} CACHE_STATS;
+//	Shard of the cache, every field is protected by the lock
 typedef struct {
-	uint8_t		request_type;		// 8 bits
-	uint8_t		number_of_blocks;	// 8 bits
-	RAIDDiskID 	disk_number;		// 8 bits
-	uint8_t		reserved;		// 6 bits
-	uint8_t		status;			// 1 bit
-	RAIDBlockID	blockid;		// 31 bits
-} RAID_REQUEST_c, RAID_RESPONSE_c;
+	pthread_mutex_t	lock;
+	QUEUE		cache_queue;		// LRU queue (Am for 2Q)
+	QUEUE		a1in_queue;		// 2Q first-time FIFO
+	HASH_TABLE	hashtable;		// blocks in the shard
+	int		memory;			// blocks worth of memory of the shard, for both tiers
+	int		max_cache_size;		// buffers the shard fills (the first tier)
+	int		tier1_min;		// fewest buffers the first tier is given
+	int		tier1_max;		// most buffers the first tier is given
+	int		max_entries;		// blocks the shard holds (not all of them fill a buffer)
+	int		cache_blocks;		// blocks in the shard
+	int		cache_buffers;		// buffers in use
+	int		dirty_blocks;		// dirty blocks in the shard
+	int		flush_watermark;	// free or clean slots kept by flushing
+	int		flush_pending;		// the flusher was woken for the shard
+	int		flush_failed;		// a flush of the shard failed, reported by its inserts
+	QUEUE_NODE	*queue_slab;		// queue nodes of the shard
+	int		slab_size;		// nodes in the slab
+	QUEUE_NODE	*free_queue_nodes;	// unused queue nodes, linked by next_node
+	CACHE_BUFFER	*buffers;		// block buffers of the shard
+	int		buffer_count;		// buffers in the shard
+	CACHE_BUFFER	*free_buffers;		// unused buffers, linked by next_free
+	HASH_TABLE	dedup_table;		// buffers by checksum of their contents (raid_cache_dedup)
+	int		clock_hand;		// next slab node the CLOCK hand looks at
+	int		a1in_max;		// 2Q blocks kept in A1in
+	GHOST_LIST	a1out;			// 2Q keys evicted from A1in
+	TIER2_ENTRY	*tier2_entries;		// blocks of the second tier
+	TIER2_ENTRY	*tier2_free_entries;	// unused entries, linked by next
+	TIER2_ENTRY	*tier2_front;		// least recently evicted from the first tier
+	TIER2_ENTRY	*tier2_back;		// most recently evicted from the first tier
+	HASH_TABLE	tier2_table;		// blocks in the second tier
+	char		*tier2_arena;		// chunks of the second tier
+	int		*tier2_links;		// next chunk of each chunk, in its block or the freelist
+	int		tier2_free;		// first free chunk
+	int		tier2_count;		// chunks of the second tier, 0 if there is none
+	int		tier2_max;		// chunks the second tier fills
+	int		tier2_chunks;		// chunks in use
+	GHOST_LIST	tier1_ghosts;		// keys of blocks the second tier could not keep
+	GHOST_LIST	tier2_ghosts;		// keys of blocks the second tier evicted
+	CACHE_STATS	stats;
+	char		flush_buf[FLUSH_BATCH*RAID_BLOCK_SIZE];	// a run of blocks being written back
+} CACHE_SHARD;
+//	Replacement policy
+typedef struct {
+	void		(*insert)(CACHE_SHARD *s, QUEUE_NODE *n);	// a new block enters the cache
+	void		(*touch)(CACHE_SHARD *s, QUEUE_NODE *n);	// a block in the cache is used again
+	QUEUE_NODE *	(*victim)(CACHE_SHARD *s);			// take out the block to evict
+	int		(*cold)(CACHE_SHARD *s, QUEUE_NODE **n, int max);	// dirty blocks, next victims first
+} CACHE_POLICY_OPS;
 // -----------------------------
 
-// Data Structures - Declarations
-static QUEUE			cache_queue;
-static HASH_NODE		*hashtable[HASHTABLE_SIZE] = {[0 ... HASHTABLE_SIZE-1] = NULL};
-static int			max_cache_size;
-static RAID_REQUEST_c		*write = NULL;
-static RAID_RESPONSE_c		*write_response = NULL;
-static RAID_REQUEST_c		*read = NULL;
-static RAID_RESPONSE_c		*read_response = NULL;
-static RAIDOpCode_c		write_opcode;
-static RAIDOpCode_c		write_opcode_response;
-static RAID_REQUEST_TYPES	read_request_code;
-static RAID_REQUEST_TYPES	write_request_code;
-static int 			total_cache_inserts = 0;
-static int			total_cache_gets = 0;
-static int			total_cache_hits = 0;
-static int			total_cache_misses = 0;
-static double			cache_efficiency = 0;
+// Function Prototypes:
+uint64_t hashfunction (uint64_t key);
+int hash_init(HASH_TABLE *t, uint64_t entries);
+void *hash_lookup(HASH_TABLE *t, uint64_t key);
+void hash_insert(HASH_TABLE *t, uint64_t key, void *value);
+void hash_delete(HASH_TABLE *t, uint64_t key);
+CACHE_SHARD *cache_shard(RAIDDiskID dsk, RAIDBlockID blk);
+int init_cache_shard(CACHE_SHARD *s, int max_items, QUEUE_NODE *slab, CACHE_BUFFER *buffers, char *arena);
+int cache_insert(RAIDDiskID dsk, RAIDBlockID blk, RAIDDiskID copy_dsk, RAIDBlockID copy_blk, void *buf, int dirty);
+QUEUE_NODE *cache_node(CACHE_SHARD *s, RAIDDiskID dsk, RAIDBlockID blk, int *added);
+QUEUE_NODE *cache_add(CACHE_SHARD *s, RAIDDiskID dsk, RAIDBlockID blk);
+void shard_memory(CACHE_SHARD *s, int memory, int tier1);
+void shard_split(CACHE_SHARD *s, int tier1);
+void cache_adapt(CACHE_SHARD *s, uint64_t key);
+int cache_store(CACHE_SHARD *s, QUEUE_NODE *n, const void *buf);
+int cache_private(CACHE_SHARD *s, QUEUE_NODE *n);
+void cache_drop(CACHE_SHARD *s, QUEUE_NODE *n);
+int block_uniform(const void *buf, int *byte);
+int cache_settle(CACHE_SHARD *s);
+int evict_block(CACHE_SHARD *s);
+int flush_dirty_blocks(CACHE_SHARD *s);
+void wake_flusher(CACHE_SHARD *s);
+void *cache_flusher(void *arg);
+int write_back(RAIDDiskID dsk, RAIDBlockID blk, uint8_t blks, char *buf);
+int compare_nodes(const void *a, const void *b);
+int compare_copies(const void *a, const void *b);
+int write_back_runs(CACHE_SHARD *s, QUEUE_NODE **nodes, int count, int copies);
+void queue_push_back(QUEUE *q, QUEUE_NODE *n);
+void queue_remove(QUEUE *q, QUEUE_NODE *n);
+QUEUE_NODE *queue_unpinned(QUEUE *q);
+int queue_cold(QUEUE *q, QUEUE_NODE **n, int found, int max, int *scanned);
+QUEUE_NODE *alloc_queue_node(CACHE_SHARD *s);
+void release_queue_node(CACHE_SHARD *s, QUEUE_NODE *n);
+CACHE_BUFFER *alloc_buffer(CACHE_SHARD *s);
+void release_buffer(CACHE_SHARD *s, QUEUE_NODE *n);
+void index_buffer(CACHE_SHARD *s, CACHE_BUFFER *b, uint32_t hash);
+void unindex_buffer(CACHE_SHARD *s, CACHE_BUFFER *b);
+void lru_insert(CACHE_SHARD *s, QUEUE_NODE *n);
+void lru_touch(CACHE_SHARD *s, QUEUE_NODE *n);
+QUEUE_NODE *lru_victim(CACHE_SHARD *s);
+int lru_cold(CACHE_SHARD *s, QUEUE_NODE **n, int max);
+void clock_insert(CACHE_SHARD *s, QUEUE_NODE *n);
+void clock_touch(CACHE_SHARD *s, QUEUE_NODE *n);
+QUEUE_NODE *clock_victim(CACHE_SHARD *s);
+int clock_cold(CACHE_SHARD *s, QUEUE_NODE **n, int max);
+void twoq_insert(CACHE_SHARD *s, QUEUE_NODE *n);
+void twoq_touch(CACHE_SHARD *s, QUEUE_NODE *n);
+QUEUE_NODE *twoq_victim(CACHE_SHARD *s);
+int twoq_cold(CACHE_SHARD *s, QUEUE_NODE **n, int max);
+int ghost_init(GHOST_LIST *g, int max);
+void ghost_add(GHOST_LIST *g, uint64_t key);
+int ghost_take(GHOST_LIST *g, uint64_t key);
+void ghost_free(GHOST_LIST *g);
+int tier2_init(CACHE_SHARD *s, int memory);
+void tier2_free(CACHE_SHARD *s);
+void tier2_put(CACHE_SHARD *s, uint64_t key, const char *buf);
+QUEUE_NODE *tier2_promote(CACHE_SHARD *s, RAIDDiskID dsk, RAIDBlockID blk);
+int tier2_peek(CACHE_SHARD *s, uint64_t key, char *buf);
+int tier2_read(CACHE_SHARD *s, TIER2_ENTRY *e, char *buf);
+void tier2_remove(CACHE_SHARD *s, TIER2_ENTRY *e);
+void tier2_evict(CACHE_SHARD *s);
 // -----------------------------
 
-// Function Prototypes:
-int hashfunction (RAIDDiskID, RAIDBlockID);
-void free_hash_nodes (HASH_NODE *n);
-int evict_lru();
-int update_block_in_queue(QUEUE_NODE *n);
-int insert_in_queue(QUEUE_NODE *n);
+// Data Structures - Declarations
+const char *RAID_CACHE_POLICY_LABELS[RAID_CACHE_POLICY_MAXVAL] = { "lru", "clock", "2q" };
+RAID_CACHE_POLICY		raid_cache_policy = RAID_CACHE_LRU;	// policy used by init_raid_cache
+unsigned short			raid_cache_shards = RAID_CACHE_DEFAULT_SHARDS;	// shards made by init_raid_cache
+int				raid_cache_dedup = 0;		// blocks with the same contents share a buffer
+size_t				raid_cache_memory = 0;		// memory budget of the cache in bytes, 0 for none
+static const CACHE_POLICY_OPS	policies[RAID_CACHE_POLICY_MAXVAL] = {
+	{ lru_insert,   lru_touch,   lru_victim,   lru_cold   },
+	{ clock_insert, clock_touch, clock_victim, clock_cold },
+	{ twoq_insert,  twoq_touch,  twoq_victim,  twoq_cold  },
+};
+static RAID_CACHE_POLICY	cache_policy;			// policy of the cache
+static const CACHE_POLICY_OPS	*policy = NULL;			// operations of the policy
+static CACHE_SHARD		*shards = NULL;			// the shards of the cache
+static int			num_shards = 0;			// shards in the cache
+static int			max_cache_size;			// blocks in all the shards
+static int			reserved_blocks;		// blocks the memory was reserved for at init
+static int			cache_tiers;			// 1 if the blocks are split between two tiers
+static char			*block_arena = NULL;		// data of all the buffers
+static CACHE_BUFFER		*buffer_slab = NULL;		// all the buffers
+static QUEUE_NODE		*queue_slab = NULL;		// all the queue nodes
+static char			*uniform_pages = NULL;		// a block filled with each byte value
+static pthread_t		flusher;			// writes back the dirty blocks of the shards
+static pthread_mutex_t		flusher_lock = PTHREAD_MUTEX_INITIALIZER;	// protects the flusher fields below
+static pthread_cond_t		flusher_wake = PTHREAD_COND_INITIALIZER;	// a shard wants flushing, or stop
+static int			flusher_requests = 0;		// shards marked since the flusher last looked
+static int			flusher_stop = 0;		// 1 once close wants the flusher to exit
+static int			flusher_running = 0;		// 1 if the flusher thread was started
 // -----------------------------
 
 
-// AUXILIARY FUNCTIONS - Might get moved to a separate file shared with tagline driver
-// ----------------------------------------------------------------------
-// Function     : generate_RAIDOpCode
-// Description  : generate a raid opcode for a particular set of values
-//
-// Inputs       : opcode - pointer to a structure that contains the fields that make up the opcode
-// Outputs      : generated_opcode - RAIDOpCode type that has the final opcode bits
-RAIDOpCode_c generate_RAIDOpCode_c (RAID_REQUEST_c *opcode) {
-	RAIDOpCode_c generated_opcode = 0;
-		
-	// add request type
-	generated_opcode = opcode->request_type;			// 0000 0000 0000 0012
-	generated_opcode = generated_opcode << 8;			// 0000 0000 0000 1200
-	generated_opcode = generated_opcode + opcode->number_of_blocks; // 0000 0000 0000 1234
-	generated_opcode = generated_opcode << 8;			// 0000 0000 0012 3400
-	generated_opcode = generated_opcode + opcode->disk_number;	// 0000 0000 0012 3456
-	generated_opcode = generated_opcode << 7;			// 0000 0000 1234 5600
-	generated_opcode = generated_opcode + opcode->reserved;		// 0000 0000 1234 5678
-	generated_opcode = generated_opcode << 1;			// 0000 0000 2468 xxxx
-	generated_opcode = generated_opcode + opcode->status;		// 0000 0000 xxxx xxxx
-	generated_opcode = generated_opcode << 32;			// xxxx xxxx 0000 0000
-	generated_opcode = generated_opcode + opcode->blockid;
-	//generated_opcode = 0x0080050000000000;
-
-	return(generated_opcode);
-}
-
-
-//////////////////////////////////////////////////////////////////////////////////
-// Function     : decode_RAIDOpCode
-// Description  : decode a raid opcode into its fields
-//
-// Inputs       : opcode - RAIDOpCode to decode
-//		  response - pointer to a struct that will store the decoded values
-// Outputs      : N/A
-void decode_RAIDOpCode_c (RAIDOpCode_c opcode, RAID_RESPONSE_c *response) {
+// TAGLINE Cache interface
+
 
-	// extract block ID
-	response->blockid = opcode & 0x00000000FFFFFFFF;	// get the value of the last 31 bits and store it in block ID
-	opcode = opcode >> 32;					// move left by 31 bits to get rid of bits already read
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : init_raid_cache
+// Description  : Initialize the cache and note maximum blocks, replacing blocks
+//                with the policy in raid_cache_policy
+//
+// Inputs       : max_items - the maximum number of items your cache can hold
+// Outputs      : 0 if successful, -1 if failure
 
-	// extract status
-	response->status = opcode & 0x0000000000000001;		// get the value of the last bit and store it in status
-	opcode = opcode >> 1;
+int init_raid_cache(uint32_t max_items) {
+	return( init_raid_cache_policy(max_items, raid_cache_policy) );
+}
 
-	// extract reserved
-	response->reserved = opcode & 0x000000000000003F;	// get the last 6 bits and store them in reserved
-	opcode = opcode >> 7;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : init_raid_cache_policy
+// Description  : Initialize the cache, note maximum blocks and the replacement
+//                policy, splitting it in raid_cache_shards shards (with
+//                raid_cache_memory set, the blocks its budget holds, split
+//                between two tiers)
+//
+// Inputs       : max_items - the maximum number of items your cache can hold
+//                pol - the replacement policy
+// Outputs      : 0 if successful, -1 if failure
 
-	// extract disk number
-	response->disk_number = opcode & 0x00000000000000FF;	// get the last 8 bits and store them in disk number
-	opcode = opcode >> 8;
-	
-	// extract number of blocks
-	response->number_of_blocks = opcode & 0x00000000000000FF;	// get the last 8 bits and store them in number of blocks
-	opcode = opcode >> 8;
+int init_raid_cache_policy(uint32_t max_items, RAID_CACHE_POLICY pol) {
 
-	// extract request type
-	response->request_type = opcode;				// no need to mask since it will only take the last 8 bits anyway
-}
-// ----------------------------------------------------------------------
+	int	i, size, slab_size, buffer_count, offset, buffer_offset;
 
+	num_shards = (raid_cache_shards == 0) ? RAID_CACHE_DEFAULT_SHARDS : raid_cache_shards;
+	cache_tiers = (raid_cache_memory != 0);
+	if (cache_tiers) {
+		max_items = (raid_cache_memory / RAID_BLOCK_SIZE < INT32_MAX) ? raid_cache_memory / RAID_BLOCK_SIZE : INT32_MAX;
+	}
+	if ((pol >= RAID_CACHE_POLICY_MAXVAL) || (max_items == 0) || (max_items > INT32_MAX / CACHE_ENTRY_RATIO) ||
+			(num_shards > RAID_CACHE_MAX_SHARDS) || (max_items < (uint32_t)num_shards)) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Bad cache policy (%d), size (%u) or shards (%d)", pol, max_items, num_shards);
+		return(-1);
+	}
+	cache_policy = pol;
+	policy = &policies[pol];
+	max_cache_size = reserved_blocks = max_items;
+
+	// Preallocate the buffers of every shard, one more than its maximum since a
+	// block is inserted before the victim is evicted, and room for pinned blocks
+	// (which cannot be evicted) over that, and CACHE_ENTRY_RATIO times as many nodes
+	buffer_count = max_cache_size + num_shards * (1 + PIN_SLOTS);
+	slab_size = CACHE_ENTRY_RATIO * max_cache_size + num_shards * (1 + PIN_SLOTS);
+	shards = calloc(num_shards, sizeof(CACHE_SHARD));
+	queue_slab = calloc(slab_size, sizeof(QUEUE_NODE));
+	buffer_slab = calloc(buffer_count, sizeof(CACHE_BUFFER));
+	uniform_pages = malloc(UNIFORM_PAGES * RAID_BLOCK_SIZE);
+	if ((shards == NULL) || (queue_slab == NULL) || (buffer_slab == NULL) || (uniform_pages == NULL) ||
+			(posix_memalign((void **)&block_arena, ARENA_ALIGNMENT, (size_t)buffer_count * RAID_BLOCK_SIZE) != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Error allocating %d cache blocks", max_cache_size);
+		free(shards);
+		free(queue_slab);
+		free(buffer_slab);
+		free(uniform_pages);
+		shards = NULL;
+		queue_slab = NULL;
+		buffer_slab = NULL;
+		uniform_pages = NULL;
+		block_arena = NULL;
+		return(-1);
+	}
+	for (i = 0; i < UNIFORM_PAGES; i++) {
+		memset(&uniform_pages[(size_t)i * RAID_BLOCK_SIZE], i, RAID_BLOCK_SIZE);
+	}
 
+	// Split the blocks between the shards
+	for (i = 0, offset = 0, buffer_offset = 0; i < num_shards; i++) {
+		size = max_cache_size / num_shards + ((i < max_cache_size % num_shards) ? 1 : 0);
+		if (init_cache_shard(&shards[i], size, &queue_slab[offset], &buffer_slab[buffer_offset],
+				&block_arena[(size_t)buffer_offset * RAID_BLOCK_SIZE]) != 0) {
+			return(-1);
+		}
+		offset += shards[i].slab_size;
+		buffer_offset += shards[i].buffer_count;
+	}
 
-// TAGLINE Cache interface
+	// Start the flusher, it sleeps until a shard reaches its low watermark
+	flusher_requests = 0;
+	flusher_stop = 0;
+	if (pthread_create(&flusher, NULL, cache_flusher, NULL) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Error starting the flusher thread");
+		return(-1);
+	}
+	flusher_running = 1;
 
+	// Return successfully
+	return(0);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : init_raid_cache
-// Description  : Initialize the cache and note maximum blocks
+// Function     : init_cache_shard
+// Description  : Initialize an empty shard of the cache
 //
-// Inputs       : max_items - the maximum number of items your cache can hold
+// Inputs       : s - the shard
+//                max_items - the maximum number of buffers the shard fills (or,
+//                            with two tiers, the blocks worth of its memory)
+//                slab - the queue nodes of the shard
+//                buffers - the block buffers of the shard
+//                arena - the data of those buffers
 // Outputs      : 0 if successful, -1 if failure
 
-int init_raid_cache(uint32_t max_items) {
+int init_cache_shard(CACHE_SHARD *s, int max_items, QUEUE_NODE *slab, CACHE_BUFFER *buffers, char *arena) {
 
-	// Initialize queue
-	cache_queue.capacity = 0;	// no items have been stored in the cache yet
-	cache_queue.back_ptr = NULL;	// no nodes have been allocated yet
-	cache_queue.front_ptr = NULL;	
+	int	i;
 
-	// Set max number of cache blocks based on requirements
-	max_cache_size = max_items;
+	if (pthread_mutex_init(&s->lock, NULL) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Error initializing the lock of a shard");
+		return(-1);
+	}
 
-	// Init raid_bus variables
-	write = malloc(sizeof(RAID_REQUEST_c));
-	write_response = malloc(sizeof(RAID_RESPONSE_c));
-	read = malloc(sizeof(RAID_REQUEST_c));
-	read_response = malloc(sizeof(RAID_RESPONSE_c));
+	// Initialize queues
+	memset(&s->cache_queue, 0, sizeof(s->cache_queue));	// no nodes have been allocated yet
+	memset(&s->a1in_queue, 0, sizeof(s->a1in_queue));
+	memset(&s->stats, 0, sizeof(s->stats));
+	s->cache_blocks = 0;					// no items have been stored in the cache yet
+	s->cache_buffers = 0;
+	s->dirty_blocks = 0;
+	s->flush_pending = 0;
+	s->flush_failed = 0;
+	s->clock_hand = 0;
+
+	// Link the nodes and the buffers of the shard in their freelists
+	s->queue_slab = slab;
+	s->slab_size = CACHE_ENTRY_RATIO * max_items + 1 + PIN_SLOTS;
+	s->free_queue_nodes = NULL;
+	for (i = s->slab_size - 1; i >= 0; i--) {
+		slab[i].value_buf = NULL;
+		slab[i].buffer = NULL;
+		slab[i].next_node = s->free_queue_nodes;
+		s->free_queue_nodes = &slab[i];
+	}
+	s->buffers = buffers;
+	s->buffer_count = max_items + 1 + PIN_SLOTS;
+	s->free_buffers = NULL;
+	for (i = s->buffer_count - 1; i >= 0; i--) {
+		buffers[i].data = &arena[(size_t)i * RAID_BLOCK_SIZE];
+		buffers[i].next_free = s->free_buffers;
+		s->free_buffers = &buffers[i];
+	}
 
-	if (read == NULL) {
-		logMessage(LOG_INFO_LEVEL, "READ is null in cache!");
+	// Size the hashtables to be at most half full
+	if ((hash_init(&s->hashtable, s->slab_size) != 0) ||
+			(raid_cache_dedup && (hash_init(&s->dedup_table, s->buffer_count) != 0))) {
 		return(-1);
 	}
-	else {
-		logMessage(LOG_INFO_LEVEL, "REAd is not null %p", read);
-	}
 
-	// Initialize request codes
-	read_request_code = RAID_READ;
-	write_request_code = RAID_WRITE;
+	// 2Q remembers half the cache in A1out
+	if ((cache_policy == RAID_CACHE_2Q) && (ghost_init(&s->a1out, (max_items / 2 > 0) ? max_items / 2 : 1) != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Error allocating 2Q ghost keys");
+		return(-1);
+	}
 
-	// Return successfully
+	// The second tier, and the share of the memory of each tier (half of it to
+	// start with)
+	if (cache_tiers && (tier2_init(s, max_items) != 0)) {
+		return(-1);
+	}
+	shard_memory(s, max_items, max_items / 2);
 	return(0);
 }
 
@@ -244,437 +526,1911 @@ int init_raid_cache(uint32_t max_items) {
 
 int close_raid_cache(void) {
 
-	// Loop Through Hashtable and free queue node
-	int 		entry = 0;
-	HASH_NODE	*current_node = NULL;
+	CACHE_STATS	total;
+	double		cache_efficiency;
+	int		i, tier1;
+
+	// Stop the flusher (the batch it is writing is finished first)
+	if (flusher_running) {
+		pthread_mutex_lock(&flusher_lock);
+		flusher_stop = 1;
+		pthread_cond_signal(&flusher_wake);
+		pthread_mutex_unlock(&flusher_lock);
+		pthread_join(flusher, NULL);
+		flusher_running = 0;
+	}
+
+	// Wait for the pending write backs of evicted and flushed blocks
+	if ((client_raid_bus_drain() != 0) || (client_raid_bus_failures(RAID_DETACHED_CACHE) != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Error writing evicted blocks to the disks");
+		return(-1);
+	}
+
+	for (i = 0; i < num_shards; i++) {
+		if (shards[i].flush_failed) {
+			logMessage(LOG_ERROR_LEVEL, "CACHE : Error flushing dirty blocks to the disks");
+			return(-1);
+		}
+	}
 
-	for (entry = 0; entry < HASHTABLE_SIZE; entry++) {
-		current_node = hashtable[entry];
-		if (current_node != NULL) {
-			free_hash_nodes(current_node);
-		}	
+	// Release the hashtables of the shards, the arena and the node slab
+	memset(&total, 0, sizeof(total));
+	for (i = 0, tier1 = 0; i < num_shards; i++) {
+		total.inserts += shards[i].stats.inserts;
+		total.gets += shards[i].stats.gets;
+		total.hits += shards[i].stats.hits;
+		total.misses += shards[i].stats.misses;
+		total.write_backs += shards[i].stats.write_backs;
+		total.copy_writes += shards[i].stats.copy_writes;
+		total.flushed_blocks += shards[i].stats.flushed_blocks;
+		total.flush_writes += shards[i].stats.flush_writes;
+		total.clean_evictions += shards[i].stats.clean_evictions;
+		total.uniform_blocks += shards[i].stats.uniform_blocks;
+		total.shared_blocks += shards[i].stats.shared_blocks;
+		total.tier2_stores += shards[i].stats.tier2_stores;
+		total.tier2_rejects += shards[i].stats.tier2_rejects;
+		total.tier2_hits += shards[i].stats.tier2_hits;
+		total.tier1_ghost_hits += shards[i].stats.tier1_ghost_hits;
+		total.tier2_ghost_hits += shards[i].stats.tier2_ghost_hits;
+		tier1 += shards[i].max_cache_size;
+		free(shards[i].hashtable.slots);
+		free(shards[i].dedup_table.slots);
+		ghost_free(&shards[i].a1out);
+		tier2_free(&shards[i]);
+		pthread_mutex_destroy(&shards[i].lock);
 	}
-	
+	free(shards);
+	free(queue_slab);
+	free(buffer_slab);
+	free(block_arena);
+	free(uniform_pages);
+	shards = NULL;
+	queue_slab = NULL;
+	buffer_slab = NULL;
+	block_arena = NULL;
+	uniform_pages = NULL;
+
 	logMessage(LOG_INFO_LEVEL, "CACHE : HashTable and Queue Blocks Free'd");
 
-	cache_efficiency = ((double)total_cache_hits/(total_cache_hits+total_cache_misses))*100;
+	cache_efficiency = ((double)total.hits/(total.hits+total.misses))*100;
 
 	logMessage(LOG_OUTPUT_LEVEL, "** Cache Statistics **");
-	logMessage(LOG_OUTPUT_LEVEL, "Total cache inserts: %7d", total_cache_inserts);
-	logMessage(LOG_OUTPUT_LEVEL, "Total cache gets: %7d", total_cache_gets);
-	logMessage(LOG_OUTPUT_LEVEL, "Total cache hits: %7d", total_cache_hits);
-	logMessage(LOG_OUTPUT_LEVEL, "Total cache misses: %7d", total_cache_misses);
+	logMessage(LOG_OUTPUT_LEVEL, "Cache policy: %7s (%d blocks, %d shards)", RAID_CACHE_POLICY_LABELS[cache_policy],
+			max_cache_size, num_shards);
+	logMessage(LOG_OUTPUT_LEVEL, "Total cache inserts: %7d", total.inserts);
+	logMessage(LOG_OUTPUT_LEVEL, "Total cache gets: %7d", total.gets);
+	logMessage(LOG_OUTPUT_LEVEL, "Total cache hits: %7d", total.hits);
+	logMessage(LOG_OUTPUT_LEVEL, "Total cache misses: %7d", total.misses);
 	logMessage(LOG_OUTPUT_LEVEL, "Cache efficiency:  %.2f%%", cache_efficiency);
+	logMessage(LOG_OUTPUT_LEVEL, "Total write backs: %7d", total.write_backs);
+	logMessage(LOG_OUTPUT_LEVEL, "Total clean evictions: %7d", total.clean_evictions);
+	logMessage(LOG_OUTPUT_LEVEL, "Total flushed blocks: %7d (%d writes)", total.flushed_blocks, total.flush_writes);
+	logMessage(LOG_OUTPUT_LEVEL, "Total writes of copies: %7d", total.copy_writes);
+	logMessage(LOG_OUTPUT_LEVEL, "Total uniform blocks: %7d (%d shared)", total.uniform_blocks, total.shared_blocks);
+	if (cache_tiers) {
+		logMessage(LOG_OUTPUT_LEVEL, "Cache memory: %7d blocks (%d in the first tier)", max_cache_size, tier1);
+		logMessage(LOG_OUTPUT_LEVEL, "Total compressed blocks: %7d (%d hits, %d incompressible)", total.tier2_stores,
+				total.tier2_hits, total.tier2_rejects);
+		logMessage(LOG_OUTPUT_LEVEL, "Total ghost hits: %7d first tier, %d second tier", total.tier1_ghost_hits,
+				total.tier2_ghost_hits);
+	}
+	num_shards = 0;
+
 
-	
 	// Return successfully
 	return(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : put_raid_cache
-// Description  : Put an object into the block cache
+// Function     : resize_raid_cache
+// Description  : Change the memory budget of the cache while it runs, up to the
+//                one it was initialized with (each tier keeps its share, the
+//                blocks over the new size are evicted)
 //
-// Inputs       : dsk - this is the disk number of the block to cache
-//                blk - this is the block number of the block to cache
-//                buf - the buffer to insert into the cache
+// Inputs       : bytes - the budget, in bytes
 // Outputs      : 0 if successful, -1 if failure
 
-int put_raid_cache(RAIDDiskID dsk, RAIDBlockID blk, void *buf)  {
-	// Variables
-	int hash_value = 0;
-	HASH_NODE *current_hash_node = NULL;	// used to iterate through nodes attached to hashtable indexes	
-	HASH_NODE *prev_hash_node = NULL;	// used to keep track of the previous node, 
-						// useful to add a new node when current_hash_node is NULL
-//	int null_node = 0;
-	HASH_NODE 	*new_hash_node = NULL;
-	QUEUE_NODE 	*new_queue_node = NULL;
-
-	logMessage(LOG_INFO_LEVEL, "Disk %d  Block %d", dsk, blk);
-
-	// Call hashfunction to get the corresponding index on the hashtable for the disk,block pair
-	hash_value = hashfunction(dsk,blk);
-
-	//total_cache_gets++;
-	
-	// Go to the hashtable and check if the disk and block pair has an entry on the table
-	if (hashtable[hash_value] == NULL) {	// Not disk,block entry found
-		// Add node to hashtable index
-		logMessage(LOG_INFO_LEVEL, "Adding a new node to the hashtable");
-		new_hash_node = malloc(sizeof(HASH_NODE));
-		new_hash_node->disk = dsk;
-		new_hash_node->block = blk;
-		new_hash_node->cache_block_ptr = NULL;
-		new_hash_node->next_node = NULL;
-
-		hashtable[hash_value] = new_hash_node;
-
-		// Add a new entry to the queue
-		logMessage(LOG_INFO_LEVEL, "Adding a new entry to the queue");
-		new_queue_node = malloc(sizeof(QUEUE_NODE));
-		new_queue_node->value_buf = malloc(sizeof(char)*RAID_BLOCK_SIZE);
-		memcpy(new_queue_node->value_buf, buf, sizeof(char)*RAID_BLOCK_SIZE);
-		logMessage(LOG_INFO_LEVEL, "Current value in buffer of block: %c",*( new_queue_node->value_buf ));
-		new_queue_node->parent_hash_node = new_hash_node;
-		new_queue_node->age_bit = 0; //will be updated at insertion
-		new_queue_node->next_node = NULL;
-		new_queue_node->prev_node = NULL;
-		new_hash_node->cache_block_ptr = new_queue_node;
-		
-		if (cache_queue.capacity == 0) {
-			// set front and back pointers
-			logMessage(LOG_INFO_LEVEL, "Adding first element to the cache");
-			cache_queue.front_ptr = new_queue_node;
-			cache_queue.back_ptr = new_queue_node;
-			cache_queue.capacity++;
-			total_cache_misses++;
-			total_cache_inserts++;
-		}
-		else if (cache_queue.capacity == 1) {
-			logMessage(LOG_INFO_LEVEL, "Adding second element to the cache");
-			cache_queue.back_ptr = new_queue_node;
-			cache_queue.front_ptr->prev_node = new_queue_node;
-			new_queue_node->next_node = cache_queue.front_ptr;
-			cache_queue.capacity++;
-			total_cache_misses++;
-			total_cache_inserts++;
-		}	
-		else {
-			logMessage(LOG_INFO_LEVEL, "Adding a new element to the cache - Disk %d Block %d", new_hash_node->disk, new_hash_node->block);
-			total_cache_inserts++;
-			total_cache_misses++;
-			if (insert_in_queue(new_queue_node)) {
-				logMessage(LOG_INFO_LEVEL, "Error inserting new node on the queue!\n");
-				return(-1);
-			}
-		}
-	}	
-	else { // hashtable[hash_value] != NULL 	
-		
-		// There are entries on the map, check to see if disk,block pair is present
-		// Loop through nodes in hashtable entry to see if disk,block pair is found
-		current_hash_node = hashtable[hash_value];	// current_hash_node points at the node pointed at by hashtable[hash_value]
-		prev_hash_node = hashtable[hash_value];		// prev_hash_node will keep track of the node before the current
-
-		int i = 0;
-
-		while ( current_hash_node != NULL ) {
-			if (current_hash_node->disk == dsk && current_hash_node->block == blk) {
-				break;
-			}
-			logMessage(LOG_INFO_LEVEL, "%d", i);
-			i++;
-			prev_hash_node = current_hash_node;
-			current_hash_node = current_hash_node->next_node;
-			logMessage(LOG_INFO_LEVEL, "%x", current_hash_node);
-		}
-		// disk,block pair was not found in hashtable
-		if (current_hash_node == NULL) {
-			logMessage(LOG_INFO_LEVEL, "Already an entry in hashtable, but not pair wanted, adding it now");
-			// add pair to hash table
-			// create a new node		
-			new_hash_node = malloc(sizeof(HASH_NODE));
-			new_hash_node->disk = dsk;
-			new_hash_node->block = blk;
-			new_hash_node->next_node = NULL;
-			// add it to the end of the list of nodes for that hashtable index
-			prev_hash_node->next_node = new_hash_node;
-			// create a new queue node for this hash node and insert it on the queue
-			new_queue_node = malloc(sizeof(QUEUE_NODE));
-			new_queue_node->value_buf = malloc(sizeof(char)*RAID_BLOCK_SIZE);
-			new_queue_node->parent_hash_node = new_hash_node;
-			new_hash_node->cache_block_ptr = new_queue_node;
-			memcpy(new_queue_node->value_buf, buf, sizeof(char)*RAID_BLOCK_SIZE);
-			new_queue_node->age_bit = 0;
-			new_queue_node->next_node = NULL;
-			new_queue_node->prev_node = NULL;
-			//insert it into the queue
-			logMessage(LOG_INFO_LEVEL, "Adding the new pair to the queue");
-			total_cache_inserts++;
-			total_cache_misses++;
-			if (insert_in_queue(new_queue_node) != 0) {
-				logMessage(LOG_INFO_LEVEL, "Error inserting node in queue! For new appended hashtable hash node");
-				return(-1);
-			}
-		} 
-		else {  // disk,block pair was found
-			// check to see if this disk,block pair has an entry in the cache queue
-			if (current_hash_node->cache_block_ptr == NULL) {
-				logMessage(LOG_INFO_LEVEL, "The disk-block pair is in hashtable, and has a node, but it's not in the cache, so we add it");
-				// if the pair is not currently in the cache, add it
-				new_queue_node = malloc(sizeof(QUEUE_NODE));
-				new_queue_node->value_buf = malloc(sizeof(char)*RAID_BLOCK_SIZE);
-				new_queue_node->parent_hash_node = current_hash_node;
-				memcpy(new_queue_node->value_buf, buf, sizeof(char)*RAID_BLOCK_SIZE);
-				new_queue_node->age_bit = 0;
-				new_queue_node->next_node = NULL;
-				new_queue_node->prev_node = NULL;
-				current_hash_node->cache_block_ptr = new_queue_node;
-				// insert node
-				total_cache_inserts++;
-				total_cache_misses++;
-				if (insert_in_queue(new_queue_node) != 0) {
-					logMessage(LOG_INFO_LEVEL, "Error adding a new node to the queue, from existing node in hashtable!");
-					return(-1);
-				}
-			}
-			else {
-				// if the pair is already on the cache, update it
-				total_cache_hits++;
-				logMessage(LOG_INFO_LEVEL, "The block is in the cache, so we move it to the end.");
-				memcpy(current_hash_node->cache_block_ptr->value_buf, buf, RAID_BLOCK_SIZE);
-				if (update_block_in_queue(current_hash_node->cache_block_ptr) != 0) {
-					logMessage(LOG_INFO_LEVEL, "Error updating cache value");
-					return(-1);
-				}
-			}
+int resize_raid_cache(size_t bytes) {
+
+	CACHE_SHARD	*s;
+	uint64_t	blocks = bytes / RAID_BLOCK_SIZE;
+	int		i, size, result = 0;
+
+	if ((shards == NULL) || (blocks < (uint64_t)num_shards) || (blocks > (uint64_t)reserved_blocks)) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Bad cache size (%lu blocks, %d reserved)", (unsigned long)blocks, reserved_blocks);
+		return(-1);
+	}
+
+	// Split the blocks between the shards, as init did
+	for (i = 0; i < num_shards; i++) {
+		s = &shards[i];
+		size = blocks / num_shards + (((uint64_t)i < blocks % num_shards) ? 1 : 0);
+		pthread_mutex_lock(&s->lock);
+		shard_memory(s, size, (int)((int64_t)s->max_cache_size * size / s->memory));
+		if (cache_settle(s) != 0) {
+			result = -1;
 		}
+		pthread_mutex_unlock(&s->lock);
 	}
-	// Return successfully
-	logMessage(LOG_INFO_LEVEL, "Value successfully put/updated in cache");
-	return(0);
+	max_cache_size = blocks;
+	logMessage(LOG_INFO_LEVEL, "CACHE : Resized to %d blocks", max_cache_size);
+	return(result);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : shard_memory
+// Description  : Set the memory of a shard, and the share of its first tier
+//                (within the bounds that memory leaves it)
+//
+// Inputs       : s - the shard (locked)
+//                memory - blocks worth of memory of the shard
+//                tier1 - buffers of the first tier
+// Outputs      : N/A
+
+void shard_memory(CACHE_SHARD *s, int memory, int tier1) {
+
+	// the second tier keeps an eighth of the memory, the first a quarter, so
+	// both have blocks to lose (and learn from their ghosts)
+	s->memory = memory;
+	if (s->tier2_count > 0) {
+		s->tier1_min = (memory / 4 > 0) ? memory / 4 : 1;
+		s->tier1_max = (memory - memory / 8 > s->tier1_min) ? memory - memory / 8 : s->tier1_min;
+	}
+	else {
+		s->tier1_min = s->tier1_max = memory;
+	}
+	shard_split(s, (tier1 < s->tier1_min) ? s->tier1_min : (tier1 > s->tier1_max) ? s->tier1_max : tier1);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : get_raid_cache
-// Description  : Get an object from the cache (and return it)
+// Function     : shard_split
+// Description  : Give the first tier of a shard a number of buffers, and the
+//                second the rest of the memory (evicting from the second tier
+//                what is over, the first tier is evicted by the next settle)
 //
-// Inputs       : dsk - this is the disk number of the block to find
-//                blk - this is the block number of the block to find
-// Outputs      : pointer to cached object or NULL if not found
-void * get_raid_cache(RAIDDiskID dsk, RAIDBlockID blk) {
+// Inputs       : s - the shard (locked)
+//                tier1 - buffers of the first tier
+// Outputs      : N/A
 
-	int hash_value = 0;
-	HASH_NODE *current_hash_node = NULL;	// used to iterate through nodes attached to hashtable indexes	
+void shard_split(CACHE_SHARD *s, int tier1) {
 
-	total_cache_gets++;
+	int	tier2;
 
-	// Get corresponding entry in hashtable
-	hash_value = hashfunction(dsk,blk);
+	// an eighth of the first tier is kept free or clean by the flusher, and 2Q
+	// keeps a quarter of it in A1in
+	s->max_cache_size = tier1;
+	s->max_entries = CACHE_ENTRY_RATIO * tier1;
+	s->flush_watermark = (tier1 / 8 > 0) ? tier1 / 8 : 1;
+	s->a1in_max = (tier1 / 4 > 0) ? tier1 / 4 : 1;
 
-	
-	// Check to see if the disk block pair is present in the hashtable
-	if (hashtable[hash_value] == NULL) {
-		total_cache_misses++;
-		return(NULL);
-	}	
-	else { // hashtable[hash_value] != NULL 	
-		
-		// There are entries on the map, check to see if disk,block pair is present
-		// Loop through nodes in hashtable entry to see if disk,block pair is found
-		current_hash_node = hashtable[hash_value];	// current_hash_node points at the node pointed at by hashtable[hash_value]
-		while ( current_hash_node != NULL ) { 
-			if (current_hash_node->disk == dsk && current_hash_node->block == blk) {
-				break;	
-			}
-			current_hash_node = current_hash_node->next_node;
+	tier2 = (int)((int64_t)(s->memory - tier1) * RAID_BLOCK_SIZE / TIER2_CHUNK);
+	s->tier2_max = (tier2 < s->tier2_count) ? tier2 : s->tier2_count;
+	while (s->tier2_chunks > s->tier2_max) {
+		tier2_evict(s);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_adapt
+// Description  : A block missed the cache: if a tier lost it not long ago (its
+//                key is in the ghost list of the tier), a block worth of memory
+//                moves to that tier
+//
+// Inputs       : s - the shard (locked)
+//                key - packed disk,block pair of the block
+// Outputs      : N/A
+
+void cache_adapt(CACHE_SHARD *s, uint64_t key) {
+
+	if (s->tier2_count == 0) {
+		return;
+	}
+	if (ghost_take(&s->tier2_ghosts, key)) {
+		s->stats.tier2_ghost_hits++;
+		if (s->max_cache_size > s->tier1_min) {
+			shard_split(s, s->max_cache_size - 1);
 		}
-		//logMessage(LOG_INFO_LEVEL, "After while loop: disk %d block %d vs %d %d", current_hash_node->disk, current_hash_node->block, dsk, blk);
-		// disk,block pair was not found in hashtable
-		if (current_hash_node == NULL) {
-			total_cache_misses++;	
-			return(NULL);
-		} 
-		else {  // disk,block pair was found
-			// check to see if this disk,block pair has an entry in the cache queue
-			if (current_hash_node->cache_block_ptr == NULL) {
-				total_cache_misses++;
-				return(NULL);
-			}
-			else {
-				// if the pair is already on the cache, update it
-				total_cache_hits++;
-				logMessage(LOG_INFO_LEVEL, "Disk: %d  Block: %d on read", current_hash_node->disk, current_hash_node->block);
-				logMessage(LOG_INFO_LEVEL, "Print value in buffer: %c", *(current_hash_node->cache_block_ptr->value_buf));
-				return(current_hash_node->cache_block_ptr->value_buf); 
-			}
+	}
+	else if (ghost_take(&s->tier1_ghosts, key)) {
+		s->stats.tier1_ghost_hits++;
+		if (s->max_cache_size < s->tier1_max) {
+			shard_split(s, s->max_cache_size + 1);
 		}
 	}
+}
 
-	logMessage(LOG_INFO_LEVEL, "ERROR in GET_RAID!!");
-	return(NULL);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_shard
+// Description  : Find the shard of a block, from the high bits of its hash (the
+//                low bits pick its slot in the hashtable of the shard)
+//
+// Inputs       : dsk - this is the disk number of the block
+//                blk - this is the block number of the block
+// Outputs      : pointer to the shard
+
+CACHE_SHARD *cache_shard(RAIDDiskID dsk, RAIDBlockID blk) {
+	return( &shards[(hashfunction(HASH_KEY(dsk, blk)) >> 32) % num_shards] );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : put_raid_cache
+// Description  : Put an object into the block cache, as written by the driver
+//                (the block is dirty until it is written back)
+//
+// Inputs       : dsk - this is the disk number of the block to cache
+//                blk - this is the block number of the block to cache
+//                buf - the buffer to insert into the cache
+// Outputs      : 0 if successful, -1 if failure
+
+int put_raid_cache(RAIDDiskID dsk, RAIDBlockID blk, void *buf)  {
+	return( cache_insert(dsk, blk, RAID_CACHE_NO_COPY, 0, buf, 1) );
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : put_raid_cache_mirrored
+// Description  : Put a mirrored object into the block cache, as written by the
+//                driver: one buffer under its primary, written back to both the
+//                primary and the copy
+//
+// Inputs       : dsk - this is the disk number of the primary of the block
+//                blk - this is the block number of the primary of the block
+//                copy_dsk - this is the disk number of the copy of the block
+//                copy_blk - this is the block number of the copy of the block
+//                buf - the buffer to insert into the cache
+// Outputs      : 0 if successful, -1 if failure
+
+int put_raid_cache_mirrored(RAIDDiskID dsk, RAIDBlockID blk, RAIDDiskID copy_dsk, RAIDBlockID copy_blk, void *buf)  {
+	return( cache_insert(dsk, blk, copy_dsk, copy_blk, buf, 1) );
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : insert_in_queue
-// Description  : Insert a node in the back of the queue
+// Function     : fill_raid_cache
+// Description  : Put an object just read from its disk into the block cache
+//                (the block is clean; if it is in the cache already, that copy
+//                is kept, it may have been written since the disk was read)
 //
-// Inputs       : node - a pointer to the node to add
-// Outputs      : 0 if successful, -1 otherwise
-int insert_in_queue(QUEUE_NODE *node) {
-	//int last_age_bit = 0;
-	// Add node to the back of the queue
-	node->next_node = cache_queue.back_ptr;
-	node->prev_node = NULL;
-	cache_queue.back_ptr->prev_node = node;
-	//node->age_bit = (cache_queue.back_ptr->age_bit) + 1;
-	cache_queue.back_ptr = node;
-	cache_queue.capacity++;
-	// if the cache is larger than the alloted amount, evict front item
-	if (cache_queue.capacity > TAGLINE_CACHE_SIZE) {
-		logMessage(LOG_INFO_LEVEL, "Evicting LRU after insert");
-		if (evict_lru() != 0) {
-			logMessage(LOG_INFO_LEVEL, "Error trying to evict a node from the queue!");
-			return(-1);
+// Inputs       : dsk - this is the disk number of the block to cache
+//                blk - this is the block number of the block to cache
+//                buf - the buffer to insert into the cache
+// Outputs      : 0 if successful, -1 if failure
+
+int fill_raid_cache(RAIDDiskID dsk, RAIDBlockID blk, void *buf)  {
+	return( cache_insert(dsk, blk, RAID_CACHE_NO_COPY, 0, buf, 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_insert
+// Description  : Put an object into the block cache, evicting as necessary
+//
+// Inputs       : dsk - this is the disk number of the block to cache
+//                blk - this is the block number of the block to cache
+//                copy_dsk - the disk number of the copy of the block (RAID_CACHE_NO_COPY
+//                           leaves the copy the node has, if any)
+//                copy_blk - the block number of the copy of the block
+//                buf - the buffer to insert into the cache
+//                dirty - 1 if the disk does not hold these contents
+// Outputs      : 0 if successful, -1 if failure
+
+int cache_insert(RAIDDiskID dsk, RAIDBlockID blk, RAIDDiskID copy_dsk, RAIDBlockID copy_blk, void *buf, int dirty)  {
+	// Variables
+	CACHE_SHARD	*s = cache_shard(dsk, blk);
+	QUEUE_NODE 	*queue_node = NULL;
+	int		added, result;
+
+	pthread_mutex_lock(&s->lock);
+
+	// Find the entry of the disk and block pair, or add one
+	queue_node = cache_node(s, dsk, blk, &added);
+	if (queue_node == NULL) {
+		pthread_mutex_unlock(&s->lock);
+		return(-1);
+	}
+	if ((dirty || added) && (cache_store(s, queue_node, buf) != 0)) {
+		if (added) {
+			cache_drop(s, queue_node);
 		}
+		pthread_mutex_unlock(&s->lock);
+		return(-1);
+	}
+	if (copy_dsk != RAID_CACHE_NO_COPY) {
+		queue_node->copy_disk = copy_dsk;
+		queue_node->copy_block = copy_blk;
+	}
+	if (dirty && !queue_node->dirty) {
+		queue_node->dirty = 1;
+		s->dirty_blocks++;
 	}
+	result = cache_settle(s);
 
-	return(0);
+	pthread_mutex_unlock(&s->lock);
+
+	// Return successfully
+	return(result);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : update_block_in_queue
-// Description  : Modify age-bit and move block to the back of the queue
+// Function     : cache_node
+// Description  : Find the node of a block in its shard (bringing it back from
+//		  the second tier if it is there), adding a (clean) one if the
+//		  block is not there; the block is not evicted yet (bringing it
+//		  back may evict others)
 //
-// Inputs       : node - a pointer to the node to add
-// Outputs      : 0 if successful, -1 otherwise
-int update_block_in_queue(QUEUE_NODE *node) {
-	
-	// move block to the back of the queue
-	// set prev_node ptr to next_node ptr
-	
-	if (node->prev_node == NULL && node->next_node == NULL) {
-		// new node to add
-		cache_queue.back_ptr->prev_node = node;
-		node->next_node = cache_queue.back_ptr;
-		node->prev_node = NULL;
-		cache_queue.back_ptr = node;
-	}
-	else if (node->prev_node == NULL && node->next_node != NULL) {
-		// updating the back of the queue
-		// nothing to do, already at the LRU position
-	}
-	else if (node->prev_node != NULL && node->next_node == NULL) {
-		// updating the front of the queue
-		cache_queue.front_ptr->next_node = cache_queue.back_ptr;
-		cache_queue.back_ptr->prev_node = cache_queue.front_ptr;
-		cache_queue.front_ptr->prev_node->next_node = NULL;
-		cache_queue.back_ptr = cache_queue.front_ptr;
-		cache_queue.front_ptr = cache_queue.front_ptr->prev_node;
-		cache_queue.back_ptr->prev_node = NULL;
+// Inputs       : s - the shard of the block (locked)
+//                dsk - this is the disk number of the block
+//                blk - this is the block number of the block
+//                added - set to 1 if the node was added, 0 if it was found
+// Outputs      : pointer to the node, NULL if no node is free
+
+QUEUE_NODE *cache_node(CACHE_SHARD *s, RAIDDiskID dsk, RAIDBlockID blk, int *added) {
+
+	uint64_t	key = HASH_KEY(dsk, blk);
+	QUEUE_NODE	*queue_node = NULL;
+
+	// Check if the disk and block pair has an entry on the table
+	*added = 0;
+	queue_node = hash_lookup(&s->hashtable, key);
+	if (queue_node != NULL) {
+		// if the pair is already on the cache, it is updated
+		s->stats.hits++;
+		RAID_LOG_HOT("The block is in the cache, updating it - Disk %d Block %d", dsk, blk);
+		policy->touch(s, queue_node);
+		return(queue_node);
 	}
-	else {
-		// updating from the middle of the queue
-		node->prev_node->next_node = node->next_node;
-		node->next_node->prev_node = node->prev_node;
-		cache_queue.back_ptr->prev_node = node;
-		node->next_node = cache_queue.back_ptr;
-		node->prev_node = NULL;
-		cache_queue.back_ptr = node;
+	queue_node = tier2_promote(s, dsk, blk);
+	if (queue_node != NULL) {
+		s->stats.hits++;
+		return(queue_node);
 	}
 
-	return(0);
+	// Add a new entry to the cache and the hashtable
+	RAID_LOG_HOT("Adding a new entry to the cache - Disk %d Block %d", dsk, blk);
+	queue_node = cache_add(s, dsk, blk);
+	if (queue_node == NULL) {
+		return(NULL);
+	}
+	s->stats.inserts++;
+	s->stats.misses++;
+	*added = 1;
+	return(queue_node);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : evict_lru
-// Description  : Eject the LRU item fromt the cache
+// Function     : cache_add
+// Description  : Add a (clean) node for a block, which is not in the shard, to
+//		  the hashtable and the policy, without contents yet
 //
-// Inputs       : N/A
-// Outputs      : 0 if successful, -1 otherwise
-int evict_lru() {
+// Inputs       : s - the shard (locked)
+//                dsk - this is the disk number of the block
+//                blk - this is the block number of the block
+// Outputs      : pointer to the node, NULL if no node is free
 
-	QUEUE_NODE 	*eject_queue_node;
-	RAIDDiskID	disk;
-	RAIDBlockID	block;
+QUEUE_NODE *cache_add(CACHE_SHARD *s, RAIDDiskID dsk, RAIDBlockID blk) {
 
-	eject_queue_node = cache_queue.front_ptr;			// record the location in the queue of the block to evict
-	if (cache_queue.front_ptr != NULL) {
-		disk = eject_queue_node->parent_hash_node->disk;			// save disk and block to perform a write to the RAID
-		block = eject_queue_node->parent_hash_node->block;		
-		
-		logMessage(LOG_INFO_LEVEL, "Disk %d and Block %d to be updated in disk by eviction", disk, block);
+	QUEUE_NODE	*queue_node;
 
+	queue_node = alloc_queue_node(s);
+	if (queue_node == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Too many pinned blocks to add disk %d block %d", dsk, blk);
+		return(NULL);
 	}
-	else {
-		logMessage(LOG_ERROR_LEVEL, "Parent hash node null!!");
+	queue_node->disk = dsk;
+	queue_node->block = blk;
+	queue_node->value_buf = NULL;
+	queue_node->buffer = NULL;
+	queue_node->copy_disk = RAID_CACHE_NO_COPY;
+	queue_node->copy_block = 0;
+	queue_node->age_bit = 0;
+	queue_node->dirty = 0;
+	queue_node->pins = 0;
+	queue_node->next_node = NULL;
+	queue_node->prev_node = NULL;
+	hash_insert(&s->hashtable, HASH_KEY(dsk, blk), queue_node);
+	policy->insert(s, queue_node);
+	s->cache_blocks++;
+	return(queue_node);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_settle
+// Description  : Write back cold dirty blocks and evict blocks until the shard
+//		  is within its size (less what is pinned)
+//
+// Inputs       : s - the shard (locked)
+// Outputs      : 0 if successful, -1 if failure
+
+int cache_settle(CACHE_SHARD *s) {
+
+	int result;
+
+	// Have the flusher write back the coldest dirty blocks before the clean ones
+	// run out, once the buffers or the nodes are about to
+	if (s->flush_failed) {
+		logMessage(LOG_ERROR_LEVEL, "Error writing back dirty blocks!");
 		return(-1);
 	}
+	if ((s->cache_blocks - s->dirty_blocks < s->flush_watermark) &&
+			((s->cache_buffers + s->flush_watermark > s->max_cache_size) ||
+			 (s->cache_blocks + s->flush_watermark > s->max_entries))) {
+		wake_flusher(s);
+	}
 
-	// Update the evicted block on the disk
-	write->request_type = write_request_code;
-	write->number_of_blocks = 1;
-	write->disk_number = disk;		
-	write->reserved = 0;
-	write->status = 0;
-	write->blockid = block;
-												
-	write_opcode = generate_RAIDOpCode_c(write);						
-	write_opcode_response = client_raid_bus_request(write_opcode, eject_queue_node->value_buf);	// WRITE block to RAID Disk
-	decode_RAIDOpCode_c(write_opcode_response, write_response);
-	
-	if (write_response->status != 0) {
-		logMessage(LOG_INFO_LEVEL, "Error writing to the disk an evicted block!");
-		return(-1);
+	// if the shard fills more buffers, or holds more blocks, than alloted, evict blocks
+	while ((s->cache_buffers > s->max_cache_size) || (s->cache_blocks > s->max_entries)) {
+		result = evict_block(s);
+		if (result < 0) {
+			logMessage(LOG_INFO_LEVEL, "Error trying to evict a node from the cache!");
+			return(-1);
+		}
+		if (result > 0) {
+			break;		// the rest is pinned, evicted once unpinned
+		}
 	}
+	return(0);
+}
+
 
-	// update queue
-	cache_queue.front_ptr = eject_queue_node->prev_node;		// update front pointer
-	eject_queue_node->prev_node->next_node = NULL;			// update new front pointer
-	eject_queue_node->parent_hash_node->cache_block_ptr = NULL;	// update node on hashtable	
-	eject_queue_node->parent_hash_node = NULL;
-	eject_queue_node->prev_node = NULL;
-	free(eject_queue_node->value_buf);	
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : get_raid_cache
+// Description  : Get an object from the cache (and return it); the buffer may be
+//                evicted by the next call on the cache, threads sharing the
+//                cache pin the block instead
+//
+// Inputs       : dsk - this is the disk number of the block to find
+//                blk - this is the block number of the block to find
+// Outputs      : pointer to cached object or NULL if not found
+void * get_raid_cache(RAIDDiskID dsk, RAIDBlockID blk) {
 
-	cache_queue.capacity = cache_queue.capacity - 1;
+	CACHE_SHARD	*s = cache_shard(dsk, blk);
+	QUEUE_NODE	*queue_node;
 
-	free(eject_queue_node);		// free memory of evicted block
+	pthread_mutex_lock(&s->lock);
+	s->stats.gets++;
 
-	return(0);
+	// Check to see if the disk block pair is present in the hashtable, or in the
+	// second tier
+	queue_node = hash_lookup(&s->hashtable, HASH_KEY(dsk, blk));
+	if ((queue_node == NULL) && ((queue_node = tier2_promote(s, dsk, blk)) == NULL)) {
+		s->stats.misses++;
+		cache_adapt(s, HASH_KEY(dsk, blk));
+		pthread_mutex_unlock(&s->lock);
+		return(NULL);
+	}
+
+	s->stats.hits++;
+	RAID_LOG_HOT("Disk: %d  Block: %d on read", dsk, blk);
+	policy->touch(s, queue_node);
+	pthread_mutex_unlock(&s->lock);
+	return(queue_node->value_buf);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : free_hash_nodes
-// Description  : Frees every node in the hash table and every queue node (and value_buf)
-//		  associated with each hash node
+// Function     : copy_raid_cache
+// Description  : Get an object from the cache, copied out under the lock of its
+//		  shard (one lock and one copy for a hit, nothing to unpin)
 //
-// Inputs       : first hash node of the entry, and next nodes recursively until the last one
-// Outputs      : N/A
-void free_hash_nodes(HASH_NODE *node) {
-	
-	if (node->next_node != NULL) {
-		free_hash_nodes(node->next_node);
+// Inputs       : dsk - this is the disk number of the block to find
+//                blk - this is the block number of the block to find
+//                buf - memory to copy the block into
+// Outputs      : 0 if the block was copied, -1 if not found
+int copy_raid_cache(RAIDDiskID dsk, RAIDBlockID blk, void *buf) {
+
+	CACHE_SHARD	*s = cache_shard(dsk, blk);
+	QUEUE_NODE	*queue_node;
+
+	pthread_mutex_lock(&s->lock);
+	s->stats.gets++;
+	queue_node = hash_lookup(&s->hashtable, HASH_KEY(dsk, blk));
+	if ((queue_node == NULL) && ((queue_node = tier2_promote(s, dsk, blk)) == NULL)) {
+		s->stats.misses++;
+		cache_adapt(s, HASH_KEY(dsk, blk));
+		pthread_mutex_unlock(&s->lock);
+		return(-1);
 	}
+	s->stats.hits++;
+	policy->touch(s, queue_node);
+	memcpy(buf, queue_node->value_buf, RAID_BLOCK_SIZE);
+	pthread_mutex_unlock(&s->lock);
+	return(0);
+}
+
 
-	// free value_buf in queue node and queue node
-	if (node->cache_block_ptr != NULL) {
-		free(node->cache_block_ptr->value_buf);
-		free(node->cache_block_ptr);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : peek_raid_cache
+// Description  : Copy a block out of the cache if it is there, without counting
+//		  it as a use (the policy and the statistics are left alone)
+//
+// Inputs       : dsk - this is the disk number of the block to find
+//                blk - this is the block number of the block to find
+//                buf - memory to copy the block into
+// Outputs      : 0 if the block was copied, -1 if not found
+int peek_raid_cache(RAIDDiskID dsk, RAIDBlockID blk, void *buf) {
+
+	CACHE_SHARD	*s = cache_shard(dsk, blk);
+	QUEUE_NODE	*queue_node;
+	int		result = 0;
+
+	pthread_mutex_lock(&s->lock);
+	queue_node = hash_lookup(&s->hashtable, HASH_KEY(dsk, blk));
+	if (queue_node != NULL) {
+		memcpy(buf, queue_node->value_buf, RAID_BLOCK_SIZE);
+	}
+	else {
+		result = tier2_peek(s, HASH_KEY(dsk, blk), buf);	// left in the second tier
 	}
+	pthread_mutex_unlock(&s->lock);
+	return(result);
+}
 
-	// free hash node
-	free(node);
-	
-	return;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pin_raid_cache
+// Description  : Get an object from the cache without copying it; the buffer
+//		  is read-only and stays valid until the block is unpinned (a
+//		  block can be pinned more than once)
+//
+// Inputs       : dsk - this is the disk number of the block to find
+//                blk - this is the block number of the block to find
+// Outputs      : pointer to cached object or NULL if not found
+void * pin_raid_cache(RAIDDiskID dsk, RAIDBlockID blk) {
+
+	CACHE_SHARD	*s = cache_shard(dsk, blk);
+	QUEUE_NODE	*queue_node;
+
+	pthread_mutex_lock(&s->lock);
+	s->stats.gets++;
+	queue_node = hash_lookup(&s->hashtable, HASH_KEY(dsk, blk));
+	if ((queue_node == NULL) && ((queue_node = tier2_promote(s, dsk, blk)) == NULL)) {
+		s->stats.misses++;
+		cache_adapt(s, HASH_KEY(dsk, blk));
+		pthread_mutex_unlock(&s->lock);
+		return(NULL);
+	}
+	s->stats.hits++;
+	policy->touch(s, queue_node);
+	queue_node->pins++;
+	pthread_mutex_unlock(&s->lock);
+	return(queue_node->value_buf);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : hashfunction
-// Description  : Returns the corresponding hash value for a disk and block pair
+// Function     : unpin_raid_cache
+// Description  : Let a block pinned by pin_raid_cache be evicted again
 //
-// Inputs       : disk, block
-// Outputs      : hash value
-int hashfunction(RAIDDiskID disk, RAIDBlockID block) {
+// Inputs       : dsk - this is the disk number of the block
+//                blk - this is the block number of the block
+// Outputs      : N/A
+void unpin_raid_cache(RAIDDiskID dsk, RAIDBlockID blk) {
 
-	int hash_value = 0;
-	int temp = 0;
+	CACHE_SHARD	*s = cache_shard(dsk, blk);
+	QUEUE_NODE	*queue_node;
 
-	temp = disk*10000;
-	temp = temp + block;
-	hash_value = temp % HASHTABLE_SIZE;	
+	pthread_mutex_lock(&s->lock);
+	queue_node = hash_lookup(&s->hashtable, HASH_KEY(dsk, blk));
+	if ((queue_node != NULL) && (queue_node->pins > 0)) {
+		queue_node->pins--;
+	}
+	pthread_mutex_unlock(&s->lock);
+}
 
-	return(hash_value);
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : drop_raid_cache
+// Description  : Drop a block from the cache (either tier) without writing it
+//		  back (e.g., a new block whose write failed, its RAID blocks are
+//		  given back)
+//
+// Inputs       : dsk - this is the disk number of the block
+//                blk - this is the block number of the block
+// Outputs      : N/A
+void drop_raid_cache(RAIDDiskID dsk, RAIDBlockID blk) {
+
+	CACHE_SHARD	*s = cache_shard(dsk, blk);
+	QUEUE_NODE	*queue_node;
+	TIER2_ENTRY	*entry;
+
+	pthread_mutex_lock(&s->lock);
+	queue_node = hash_lookup(&s->hashtable, HASH_KEY(dsk, blk));
+	if (queue_node != NULL) {
+		cache_drop(s, queue_node);
+	}
+	else if ((s->tier2_count > 0) && ((entry = hash_lookup(&s->tier2_table, HASH_KEY(dsk, blk))) != NULL)) {
+		tier2_remove(s, entry);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_drop
+// Description  : Take a block out of its shard without writing it back (its
+//		  contents are lost)
+//
+// Inputs       : s - the shard (locked)
+//                node - the node of the block
+// Outputs      : N/A
+void cache_drop(CACHE_SHARD *s, QUEUE_NODE *node) {
+
+	// take it out of the policy queues (CLOCK only looks at the list)
+	if ((node->list == CACHE_LIST_LRU) || (node->list == CACHE_LIST_AM)) {
+		queue_remove(&s->cache_queue, node);
+	}
+	else if (node->list == CACHE_LIST_A1IN) {
+		queue_remove(&s->a1in_queue, node);
+	}
+	if (node->dirty) {
+		s->dirty_blocks--;
+	}
+	hash_delete(&s->hashtable, HASH_KEY(node->disk, node->block));
+	release_queue_node(s, node);
+	s->cache_blocks--;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_store
+// Description  : Give a block new contents: a block of a single byte value points
+//		  to its uniform page, a block like the contents of a buffer of the
+//		  shard shares it (raid_cache_dedup), any other block is copied to a
+//		  buffer of its own (the one it has, if no other block shares it)
+//
+// Inputs       : s - the shard (locked)
+//                node - the node of the block
+//                buf - the contents
+// Outputs      : 0 if successful, -1 if no buffer is free
+
+int cache_store(CACHE_SHARD *s, QUEUE_NODE *node, const void *buf) {
+
+	CACHE_BUFFER	*buffer = NULL;
+	uint32_t	hash = 0;
+	int		byte;
+
+	if (block_uniform(buf, &byte)) {
+		release_buffer(s, node);
+		node->value_buf = &uniform_pages[(size_t)byte * RAID_BLOCK_SIZE];
+		s->stats.uniform_blocks++;
+		return(0);
+	}
+	if (raid_cache_dedup) {
+		hash = raid_checksum(buf, RAID_BLOCK_SIZE);
+		buffer = hash_lookup(&s->dedup_table, hash);
+		if ((buffer != NULL) && (memcmp(buffer->data, buf, RAID_BLOCK_SIZE) == 0)) {
+			if (buffer != node->buffer) {
+				buffer->refs++;
+				release_buffer(s, node);
+				node->buffer = buffer;
+				node->value_buf = buffer->data;
+				s->stats.shared_blocks++;
+			}
+			return(0);
+		}
+	}
+
+	// contents of its own
+	if (cache_private(s, node) != 0) {
+		return(-1);
+	}
+	memcpy(node->value_buf, buf, RAID_BLOCK_SIZE);
+	if (raid_cache_dedup) {
+		index_buffer(s, node->buffer, hash);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_private
+// Description  : Make sure a block has a buffer no other block shares, to give
+//		  it new contents (what the buffer holds is undefined)
+//
+// Inputs       : s - the shard (locked)
+//                node - the node of the block
+// Outputs      : 0 if successful, -1 if no buffer is free
+
+int cache_private(CACHE_SHARD *s, QUEUE_NODE *node) {
+
+	CACHE_BUFFER	*buffer;
+
+	if ((node->buffer != NULL) && (node->buffer->refs == 1)) {
+		unindex_buffer(s, node->buffer);	// its contents are changing
+		return(0);
+	}
+	buffer = alloc_buffer(s);
+	if (buffer == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Too many pinned blocks to fill disk %d block %d", node->disk, node->block);
+		return(-1);
+	}
+	release_buffer(s, node);
+	node->buffer = buffer;
+	node->value_buf = buffer->data;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : block_uniform
+// Description  : Checks whether a block is filled with a single byte value, 64
+//		  bytes at a time (SSE2/NEON where there is), stopping at the
+//		  first 64 bytes that are not
+//
+// Inputs       : buf - the block
+//                byte - set to the byte value of a uniform block
+// Outputs      : 1 if the block is uniform, 0 if not
+
+int block_uniform(const void *buf, int *byte) {
+
+	const uint8_t	*p = buf;
+	int		i;
+#if defined(__SSE2__)
+	__m128i		fill = _mm_set1_epi8((char)p[0]), diff;
+
+	for (i = 0; i < RAID_BLOCK_SIZE; i += 64) {
+		diff = _mm_or_si128(_mm_or_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *)&p[i]), fill),
+				_mm_xor_si128(_mm_loadu_si128((const __m128i *)&p[i + 16]), fill)),
+				_mm_or_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *)&p[i + 32]), fill),
+				_mm_xor_si128(_mm_loadu_si128((const __m128i *)&p[i + 48]), fill)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF) {
+			return(0);
+		}
+	}
+#elif defined(__ARM_NEON)
+	uint8x16_t	fill = vdupq_n_u8(p[0]), diff;
+
+	for (i = 0; i < RAID_BLOCK_SIZE; i += 64) {
+		diff = vorrq_u8(vorrq_u8(veorq_u8(vld1q_u8(&p[i]), fill), veorq_u8(vld1q_u8(&p[i + 16]), fill)),
+				vorrq_u8(veorq_u8(vld1q_u8(&p[i + 32]), fill), veorq_u8(vld1q_u8(&p[i + 48]), fill)));
+		if (vmaxvq_u8(diff) != 0) {
+			return(0);
+		}
+	}
+#else
+	uint64_t	fill = p[0] * 0x0101010101010101ULL, word, diff;
+	int		j;
+
+	for (i = 0; i < RAID_BLOCK_SIZE; i += 64) {
+		for (j = 0, diff = 0; j < 64; j += sizeof(word)) {
+			memcpy(&word, &p[i + j], sizeof(word));
+			diff |= word ^ fill;
+		}
+		if (diff != 0) {
+			return(0);
+		}
+	}
+#endif
+	*byte = p[0];
+	return(1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : evict_block
+// Description  : Eject the block chosen by the policy from a shard, writing it
+//		  back to its disk (and its copy) if it is dirty, to the second
+//		  tier if there is one
+//
+// Inputs       : s - the shard (locked)
+// Outputs      : 0 if successful, 1 if every block is pinned, -1 otherwise
+int evict_block(CACHE_SHARD *s) {
+
+	QUEUE_NODE 	*eject_queue_node;
+	RAIDDiskID	disk;
+	RAIDBlockID	block;
+	int		result = 0;
+
+	eject_queue_node = policy->victim(s);			// take the block to evict out of the policy queues
+	if (eject_queue_node == NULL) {
+		return(1);
+	}
+	disk = eject_queue_node->disk;				// save disk and block to perform a write to the RAID
+	block = eject_queue_node->block;
+
+	// A clean block is on its disk already, just drop it
+	if (!eject_queue_node->dirty) {
+		s->stats.clean_evictions++;
+	}
+	else {
+		// the flusher did not get to this one, update it on the disk now
+		RAID_LOG_HOT("Disk %d and Block %d to be updated in disk by eviction", disk, block);
+		s->stats.write_backs++;
+		s->dirty_blocks--;
+		if (write_back(disk, block, 1, eject_queue_node->value_buf) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "Error writing to the disk an evicted block!");
+			result = -1;
+		}
+		if ((result == 0) && (eject_queue_node->copy_disk != RAID_CACHE_NO_COPY)) {
+			s->stats.copy_writes++;
+			if (write_back(eject_queue_node->copy_disk, eject_queue_node->copy_block, 1, eject_queue_node->value_buf) != 0) {
+				logMessage(LOG_ERROR_LEVEL, "Error writing to the disk the copy of an evicted block!");
+				result = -1;
+			}
+		}
+	}
+
+	// the block leaves the first tier either way, clean
+	if ((result == 0) && (s->tier2_count > 0)) {
+		tier2_put(s, HASH_KEY(disk, block), eject_queue_node->value_buf);
+	}
+	hash_delete(&s->hashtable, HASH_KEY(disk, block));
+	release_queue_node(s, eject_queue_node);	// recycle the slot of the evicted block
+	s->cache_blocks--;
+
+	return(result);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : wake_flusher
+// Description  : Mark a shard for the flusher and wake it, unless the shard is
+//		  marked already
+//
+// Inputs       : s - the shard (locked)
+// Outputs      : N/A
+void wake_flusher(CACHE_SHARD *s) {
+
+	if (s->flush_pending) {
+		return;
+	}
+	s->flush_pending = 1;
+	pthread_mutex_lock(&flusher_lock);
+	flusher_requests++;
+	pthread_cond_signal(&flusher_wake);
+	pthread_mutex_unlock(&flusher_lock);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_flusher
+// Description  : The flusher thread: sleep until shards are marked, then write
+//		  back a batch of each marked shard still under its watermark,
+//		  until close_raid_cache stops it
+//
+// Inputs       : arg - unused
+// Outputs      : NULL
+void *cache_flusher(void *arg) {
+
+	CACHE_SHARD	*s;
+	int		i;
+
+	pthread_mutex_lock(&flusher_lock);
+	while (!flusher_stop) {
+		if (flusher_requests == 0) {
+			pthread_cond_wait(&flusher_wake, &flusher_lock);
+			continue;
+		}
+		flusher_requests = 0;
+		pthread_mutex_unlock(&flusher_lock);
+
+		// the shards are not locked while the flusher waits, nor the flusher
+		// lock while it writes
+		for (i = 0; i < num_shards; i++) {
+			s = &shards[i];
+			pthread_mutex_lock(&s->lock);
+			if (s->flush_pending) {
+				s->flush_pending = 0;
+				if ((s->cache_blocks - s->dirty_blocks < s->flush_watermark) && (flush_dirty_blocks(s) != 0)) {
+					logMessage(LOG_ERROR_LEVEL, "CACHE : Error flushing the dirty blocks of a shard");
+					s->flush_failed = 1;
+				}
+			}
+			pthread_mutex_unlock(&s->lock);
+		}
+		pthread_mutex_lock(&flusher_lock);
+	}
+	pthread_mutex_unlock(&flusher_lock);
+
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : flush_dirty_blocks
+// Description  : Write back the dirty blocks the policy would evict first from
+//		  a shard, and their copies, one RAID_WRITE per run of adjacent
+//		  blocks of a disk; the blocks stay in the cache, clean
+//
+// Inputs       : s - the shard (locked)
+// Outputs      : 0 if successful, -1 otherwise
+int flush_dirty_blocks(CACHE_SHARD *s) {
+
+	QUEUE_NODE	*nodes[FLUSH_BATCH];
+	int		count, i, copies;
+
+	count = policy->cold(s, nodes, FLUSH_BATCH);
+	for (i = 0, copies = 0; i < count; i++) {
+		nodes[i]->dirty = 0;
+		copies += (nodes[i]->copy_disk != RAID_CACHE_NO_COPY);
+	}
+	s->dirty_blocks -= count;
+	s->stats.flushed_blocks += count;
+
+	// the primaries, then the copies (the blocks without one sort last)
+	qsort(nodes, count, sizeof(QUEUE_NODE *), compare_nodes);
+	if (write_back_runs(s, nodes, count, 0) != 0) {
+		return(-1);
+	}
+	qsort(nodes, count, sizeof(QUEUE_NODE *), compare_copies);
+	if (write_back_runs(s, nodes, copies, 1) != 0) {
+		return(-1);
+	}
+
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_back_runs
+// Description  : Write sorted blocks back with one RAID_WRITE per run of adjacent
+//		  blocks of a disk, where the blocks or their copies go
+//
+// Inputs       : s - the shard (locked)
+//		  nodes - the blocks, sorted by disk and block (of their copies if copies)
+//		  count - number of blocks
+//		  copies - 1 to write the copies of the blocks, 0 the blocks
+// Outputs      : 0 if successful, -1 otherwise
+int write_back_runs(CACHE_SHARD *s, QUEUE_NODE **nodes, int count, int copies) {
+
+	RAIDDiskID	disk;
+	RAIDBlockID	block;
+	int		first, last, i;
+
+	for (first = 0; first < count; first = last) {
+		disk = (copies) ? nodes[first]->copy_disk : nodes[first]->disk;
+		block = (copies) ? nodes[first]->copy_block : nodes[first]->block;
+		// extend the run while the next block follows on the same disk
+		for (last = first + 1; (last < count) &&
+				(((copies) ? nodes[last]->copy_disk : nodes[last]->disk) == disk) &&
+				(((copies) ? nodes[last]->copy_block : nodes[last]->block) == block + (last - first)); last++);
+
+		for (i = first; i < last; i++) {
+			memcpy(&s->flush_buf[(size_t)(i - first) * RAID_BLOCK_SIZE], nodes[i]->value_buf, RAID_BLOCK_SIZE);
+		}
+		if (copies) {
+			s->stats.copy_writes++;
+		}
+		else {
+			s->stats.flush_writes++;
+		}
+
+		if (write_back(disk, block, last - first, s->flush_buf) != 0) {
+			return(-1);
+		}
+	}
+
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_back
+// Description  : Write contiguous blocks to a disk without waiting for it, the
+//		  write is ordered before any later request for the blocks, and its
+//		  response is collected by the client
+//
+// Inputs       : dsk - the disk
+//		  blk - the first block
+//		  blks - number of blocks
+//		  buf - contents of the blocks (copied or sent before returning)
+// Outputs      : 0 if successful, -1 otherwise
+int write_back(RAIDDiskID dsk, RAIDBlockID blk, uint8_t blks, char *buf) {
+
+	if (client_raid_bus_submit(raid_opcode(RAID_WRITE, blks, dsk, blk), buf, RAID_DETACHED_CACHE) < 0) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Error writing back %d blocks of disk %d at %d", blks, dsk, blk);
+		return(-1);
+	}
+
+	// Any earlier write back that failed?
+	if (client_raid_bus_failures(RAID_DETACHED_CACHE) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : An earlier write back failed");
+		return(-1);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_nodes
+// Description  : qsort order of queue nodes, by disk then block
+//
+// Inputs       : a, b - pointers to the two node pointers
+// Outputs      : <0, 0 or >0 as a goes before, with or after b
+int compare_nodes(const void *a, const void *b) {
+
+	const QUEUE_NODE *x = *(QUEUE_NODE * const *)a;
+	const QUEUE_NODE *y = *(QUEUE_NODE * const *)b;
+	uint64_t kx = HASH_KEY(x->disk, x->block), ky = HASH_KEY(y->disk, y->block);
+
+	return((kx > ky) - (kx < ky));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_copies
+// Description  : qsort order of queue nodes, by disk then block of their copies
+//		  (RAID_CACHE_NO_COPY is past every disk, those nodes go last)
+//
+// Inputs       : a, b - pointers to the two node pointers
+// Outputs      : <0, 0 or >0 as a goes before, with or after b
+int compare_copies(const void *a, const void *b) {
+
+	const QUEUE_NODE *x = *(QUEUE_NODE * const *)a;
+	const QUEUE_NODE *y = *(QUEUE_NODE * const *)b;
+	uint64_t kx = HASH_KEY(x->copy_disk, x->copy_block), ky = HASH_KEY(y->copy_disk, y->copy_block);
+
+	return((kx > ky) - (kx < ky));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : queue_push_back
+// Description  : Insert a node in the back of a queue
+//
+// Inputs       : q - the queue
+//		  node - a pointer to the node to add
+// Outputs      : N/A
+void queue_push_back(QUEUE *q, QUEUE_NODE *node) {
+
+	node->prev_node = NULL;
+	node->next_node = q->back_ptr;
+	if (q->back_ptr != NULL) {
+		q->back_ptr->prev_node = node;
+	}
+	else {
+		q->front_ptr = node;	// first node of the queue
+	}
+	q->back_ptr = node;
+	q->capacity++;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : queue_remove
+// Description  : Take a node out of a queue, from wherever it is
+//
+// Inputs       : q - the queue
+//		  node - a pointer to the node to remove
+// Outputs      : N/A
+void queue_remove(QUEUE *q, QUEUE_NODE *node) {
+
+	if (node->prev_node != NULL) {
+		node->prev_node->next_node = node->next_node;
+	}
+	else {
+		q->back_ptr = node->next_node;
+	}
+	if (node->next_node != NULL) {
+		node->next_node->prev_node = node->prev_node;
+	}
+	else {
+		q->front_ptr = node->prev_node;
+	}
+	node->next_node = NULL;
+	node->prev_node = NULL;
+	q->capacity--;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : queue_unpinned
+// Description  : Find the node closest to the front of a queue that is not
+//		  pinned
+//
+// Inputs       : q - the queue
+// Outputs      : pointer to the node, NULL if all of them are pinned
+QUEUE_NODE *queue_unpinned(QUEUE *q) {
+
+	QUEUE_NODE *node = q->front_ptr;
+
+	while ((node != NULL) && (node->pins > 0)) {
+		node = node->prev_node;
+	}
+	return(node);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : queue_cold
+// Description  : Collect the dirty nodes of a queue, from the front
+//
+// Inputs       : q - the queue
+//		  nodes - array receiving the nodes
+//		  found - nodes already in the array
+//		  max - size of the array
+//		  scanned - nodes looked at so far, stops at FLUSH_SCAN
+// Outputs      : number of nodes in the array
+int queue_cold(QUEUE *q, QUEUE_NODE **nodes, int found, int max, int *scanned) {
+
+	QUEUE_NODE *node;
+
+	for (node = q->front_ptr; (node != NULL) && (found < max) && (*scanned < FLUSH_SCAN); node = node->prev_node) {
+		if (node->dirty && (node->pins == 0)) {
+			nodes[found++] = node;
+		}
+		(*scanned)++;
+	}
+	return(found);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lru_insert, lru_touch, lru_victim, lru_cold
+// Description  : LRU policy: new and used blocks go to the back of the queue,
+//		  the victim is the block at the front
+//
+// Inputs       : s - the shard (locked)
+//		  node - the block entering the cache, or used again
+//		  nodes, max - array receiving the next dirty victims, and its size
+// Outputs      : lru_victim returns the block to evict, lru_cold the number
+//		  of dirty blocks put in nodes
+void lru_insert(CACHE_SHARD *s, QUEUE_NODE *node) {
+	node->list = CACHE_LIST_LRU;
+	queue_push_back(&s->cache_queue, node);
+}
+
+void lru_touch(CACHE_SHARD *s, QUEUE_NODE *node) {
+	if (s->cache_queue.back_ptr != node) {
+		queue_remove(&s->cache_queue, node);
+		queue_push_back(&s->cache_queue, node);
+	}
+}
+
+QUEUE_NODE *lru_victim(CACHE_SHARD *s) {
+	QUEUE_NODE *node = queue_unpinned(&s->cache_queue);
+
+	if (node != NULL) {
+		queue_remove(&s->cache_queue, node);
+	}
+	return(node);
+}
+
+int lru_cold(CACHE_SHARD *s, QUEUE_NODE **nodes, int max) {
+	int scanned = 0;
+
+	return(queue_cold(&s->cache_queue, nodes, 0, max, &scanned));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : clock_insert, clock_touch, clock_victim, clock_cold
+// Description  : CLOCK policy: a block used since the hand last passed it gets
+//		  a second chance, the victim is the first block the hand finds
+//		  that was not
+//
+// Inputs       : s - the shard (locked)
+//		  node - the block entering the cache, or used again
+//		  nodes, max - array receiving the next dirty victims, and its size
+// Outputs      : clock_victim returns the block to evict, clock_cold the
+//		  number of dirty blocks put in nodes
+void clock_insert(CACHE_SHARD *s, QUEUE_NODE *node) {
+	node->list = CACHE_LIST_CLOCK;
+	node->age_bit = 1;	// not the next victim right away
+}
+
+void clock_touch(CACHE_SHARD *s, QUEUE_NODE *node) {
+	node->age_bit = 1;
+}
+
+QUEUE_NODE *clock_victim(CACHE_SHARD *s) {
+	QUEUE_NODE	*node;
+	int		turns;
+
+	// every node is used or passed over once, so at most two turns of the hand
+	// (unless all of them are pinned)
+	for (turns = 0; turns < 2 * s->slab_size; turns++) {
+		node = &s->queue_slab[s->clock_hand];
+		s->clock_hand = (s->clock_hand + 1) % s->slab_size;
+		if ((node->list != CACHE_LIST_CLOCK) || (node->pins > 0)) {
+			continue;
+		}
+		if (node->age_bit) {
+			node->age_bit = 0;
+			continue;
+		}
+		return(node);
+	}
+	return(NULL);
+}
+
+int clock_cold(CACHE_SHARD *s, QUEUE_NODE **nodes, int max) {
+	QUEUE_NODE	*node;
+	int		found = 0, scanned;
+
+	// the blocks in front of the hand are looked at first
+	for (scanned = 0; (scanned < FLUSH_SCAN) && (scanned < s->slab_size) && (found < max); scanned++) {
+		node = &s->queue_slab[(s->clock_hand + scanned) % s->slab_size];
+		if ((node->list == CACHE_LIST_CLOCK) && node->dirty && (node->pins == 0)) {
+			nodes[found++] = node;
+		}
+	}
+	return(found);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : twoq_insert, twoq_touch, twoq_victim, twoq_cold
+// Description  : 2Q policy: a block seen for the first time goes to A1in, a
+//		  block whose key is still in A1out goes to Am. A1in is evicted
+//		  first (remembering the key in A1out) once over its share.
+//
+// Inputs       : s - the shard (locked)
+//		  node - the block entering the cache, or used again
+//		  nodes, max - array receiving the next dirty victims, and its size
+// Outputs      : twoq_victim returns the block to evict, twoq_cold the
+//		  number of dirty blocks put in nodes
+void twoq_insert(CACHE_SHARD *s, QUEUE_NODE *node) {
+	if (ghost_take(&s->a1out, HASH_KEY(node->disk, node->block))) {
+		// seen not long ago, keep it
+		node->list = CACHE_LIST_AM;
+		queue_push_back(&s->cache_queue, node);
+	}
+	else {
+		node->list = CACHE_LIST_A1IN;
+		queue_push_back(&s->a1in_queue, node);
+	}
+}
+
+void twoq_touch(CACHE_SHARD *s, QUEUE_NODE *node) {
+	// a hit in A1in does not promote it, A1in hits are usually correlated
+	if ((node->list == CACHE_LIST_AM) && (s->cache_queue.back_ptr != node)) {
+		queue_remove(&s->cache_queue, node);
+		queue_push_back(&s->cache_queue, node);
+	}
+}
+
+QUEUE_NODE *twoq_victim(CACHE_SHARD *s) {
+	QUEUE_NODE	*node;
+
+	// A1in goes first once over its share (or if Am has nothing to evict)
+	node = NULL;
+	if ((s->a1in_queue.capacity > s->a1in_max) || (s->cache_queue.capacity == 0)) {
+		node = queue_unpinned(&s->a1in_queue);
+	}
+	if ((node == NULL) && ((node = queue_unpinned(&s->cache_queue)) != NULL)) {
+		queue_remove(&s->cache_queue, node);
+		return(node);
+	}
+	if ((node != NULL) || ((node = queue_unpinned(&s->a1in_queue)) != NULL)) {
+		queue_remove(&s->a1in_queue, node);
+		ghost_add(&s->a1out, HASH_KEY(node->disk, node->block));	// remember the key in A1out
+	}
+	return(node);
+}
+
+int twoq_cold(CACHE_SHARD *s, QUEUE_NODE **nodes, int max) {
+	int found, scanned = 0;
+
+	// A1in is usually evicted first, then Am
+	found = queue_cold(&s->a1in_queue, nodes, 0, max, &scanned);
+	return(queue_cold(&s->cache_queue, nodes, found, max, &scanned));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : ghost_init, ghost_add, ghost_take, ghost_free
+// Description  : Ghost lists: a FIFO of the keys of the last blocks a queue or
+//		  a tier lost, and a table of the keys in it (valued by their slot
+//		  of the FIFO, so a key taken or added again since is left in the
+//		  table when its old slot is forgotten)
+//
+// Inputs       : g - the ghost list
+//		  max - the keys it remembers
+//		  key - packed disk,block pair
+// Outputs      : ghost_init returns 0 if successful, -1 otherwise; ghost_take
+//		  returns 1 if the key was in the list (and takes it out), 0 if not
+int ghost_init(GHOST_LIST *g, int max) {
+	g->keys = calloc(max, sizeof(uint64_t));
+	if ((g->keys == NULL) || (hash_init(&g->table, max) != 0)) {
+		return(-1);
+	}
+	g->max = max;
+	g->head = g->count = 0;
+	return(0);
+}
+
+void ghost_add(GHOST_LIST *g, uint64_t key) {
+	uint64_t *slot;
+
+	if (g->max == 0) {
+		return;
+	}
+
+	// forget the oldest key if full
+	if (g->count == g->max) {
+		slot = &g->keys[g->head];
+		if (hash_lookup(&g->table, *slot) == slot) {
+			hash_delete(&g->table, *slot);
+		}
+		g->head = (g->head + 1) % g->max;
+		g->count--;
+	}
+	slot = &g->keys[(g->head + g->count) % g->max];
+	*slot = key;
+	if (hash_lookup(&g->table, key) != NULL) {
+		hash_delete(&g->table, key);
+	}
+	hash_insert(&g->table, key, slot);
+	g->count++;
+}
+
+int ghost_take(GHOST_LIST *g, uint64_t key) {
+	if ((g->max == 0) || (hash_lookup(&g->table, key) == NULL)) {
+		return(0);
+	}
+	hash_delete(&g->table, key);	// its stale FIFO slot is skipped later
+	return(1);
+}
+
+void ghost_free(GHOST_LIST *g) {
+	free(g->table.slots);
+	free(g->keys);
+	g->table.slots = NULL;
+	g->keys = NULL;
+	g->max = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : alloc_queue_node
+// Description  : Take an unused queue node from the slab
+//		  of a shard
+//
+// Inputs       : s - the shard (locked)
+// Outputs      : pointer to the node, NULL if none is left
+QUEUE_NODE *alloc_queue_node(CACHE_SHARD *s) {
+
+	QUEUE_NODE *node = s->free_queue_nodes;
+
+	// the slab only runs out if too many blocks are pinned
+	if (node == NULL) {
+		return(NULL);
+	}
+	s->free_queue_nodes = node->next_node;
+	node->next_node = NULL;
+	return(node);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : release_queue_node
+// Description  : Give a queue node back to the slab of its shard (and its block
+//		  buffer to the freelist, unless another block shares it)
+//
+// Inputs       : s - the shard (locked)
+//		  node - the node to release
+// Outputs      : N/A
+void release_queue_node(CACHE_SHARD *s, QUEUE_NODE *node) {
+
+	release_buffer(s, node);
+	node->list = CACHE_LIST_FREE;
+	node->prev_node = NULL;
+	node->next_node = s->free_queue_nodes;
+	s->free_queue_nodes = node;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : alloc_buffer
+// Description  : Take an unused block buffer of a shard, held by one block
+//
+// Inputs       : s - the shard (locked)
+// Outputs      : pointer to the buffer, NULL if none is free
+CACHE_BUFFER *alloc_buffer(CACHE_SHARD *s) {
+
+	CACHE_BUFFER *buffer = s->free_buffers;
+
+	// the buffers only run out if too many blocks are pinned
+	if (buffer == NULL) {
+		return(NULL);
+	}
+	s->free_buffers = buffer->next_free;
+	buffer->next_free = NULL;
+	buffer->refs = 1;
+	buffer->indexed = 0;
+	s->cache_buffers++;
+	return(buffer);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : release_buffer
+// Description  : A block lets go of its contents, its buffer goes back to the
+//		  freelist if no other block holds it
+//
+// Inputs       : s - the shard (locked)
+//		  node - the node of the block
+// Outputs      : N/A
+void release_buffer(CACHE_SHARD *s, QUEUE_NODE *node) {
+
+	CACHE_BUFFER *buffer = node->buffer;
+
+	node->buffer = NULL;
+	node->value_buf = NULL;
+	if ((buffer == NULL) || (--buffer->refs > 0)) {
+		return;
+	}
+	unindex_buffer(s, buffer);
+	buffer->next_free = s->free_buffers;
+	s->free_buffers = buffer;
+	s->cache_buffers--;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : index_buffer
+// Description  : Enter a buffer in the dedup table of its shard under the
+//		  checksum of its contents, unless a buffer is there already
+//		  (checksums collide, the contents are compared on a match)
+//
+// Inputs       : s - the shard (locked)
+//		  buffer - the buffer
+//		  hash - the checksum of its contents
+// Outputs      : N/A
+void index_buffer(CACHE_SHARD *s, CACHE_BUFFER *buffer, uint32_t hash) {
+
+	if (hash_lookup(&s->dedup_table, hash) != NULL) {
+		return;
+	}
+	hash_insert(&s->dedup_table, hash, buffer);
+	buffer->hash = hash;
+	buffer->indexed = 1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unindex_buffer
+// Description  : Take a buffer out of the dedup table of its shard, if it is in
+//
+// Inputs       : s - the shard (locked)
+//		  buffer - the buffer
+// Outputs      : N/A
+void unindex_buffer(CACHE_SHARD *s, CACHE_BUFFER *buffer) {
+
+	if (buffer->indexed && (hash_lookup(&s->dedup_table, buffer->hash) == buffer)) {
+		hash_delete(&s->dedup_table, buffer->hash);
+	}
+	buffer->indexed = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tier2_init
+// Description  : Allocate the second tier of a shard and its ghost lists, with
+//		  chunks for all the memory the first tier may leave it
+//
+// Inputs       : s - the shard
+//		  memory - blocks worth of memory of the shard
+// Outputs      : 0 if successful, -1 otherwise
+int tier2_init(CACHE_SHARD *s, int memory) {
+
+	int	i, tier1_min = (memory / 4 > 0) ? memory / 4 : 1;
+
+	// every block of the tier fills a chunk at least, so there are as many entries
+	s->tier2_count = (int)((int64_t)(memory - tier1_min) * RAID_BLOCK_SIZE / TIER2_CHUNK);
+	s->tier2_chunks = 0;
+	s->tier2_front = s->tier2_back = NULL;
+	if (s->tier2_count == 0) {
+		return(0);
+	}
+	s->tier2_arena = malloc((size_t)s->tier2_count * TIER2_CHUNK);
+	s->tier2_links = calloc(s->tier2_count, sizeof(int));
+	s->tier2_entries = calloc(s->tier2_count, sizeof(TIER2_ENTRY));
+	if ((s->tier2_arena == NULL) || (s->tier2_links == NULL) || (s->tier2_entries == NULL) ||
+			(hash_init(&s->tier2_table, s->tier2_count) != 0) ||
+			(ghost_init(&s->tier1_ghosts, memory) != 0) || (ghost_init(&s->tier2_ghosts, memory) != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Error allocating a second tier of %d chunks", s->tier2_count);
+		return(-1);
+	}
+
+	// Link the chunks and the entries in their freelists
+	for (i = 0; i < s->tier2_count; i++) {
+		s->tier2_links[i] = (i + 1 < s->tier2_count) ? i + 1 : TIER2_END;
+		s->tier2_entries[i].next = (i + 1 < s->tier2_count) ? &s->tier2_entries[i + 1] : NULL;
+	}
+	s->tier2_free = 0;
+	s->tier2_free_entries = &s->tier2_entries[0];
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tier2_free
+// Description  : Release the second tier of a shard and its ghost lists
+//
+// Inputs       : s - the shard
+// Outputs      : N/A
+void tier2_free(CACHE_SHARD *s) {
+
+	free(s->tier2_arena);
+	free(s->tier2_links);
+	free(s->tier2_entries);
+	free(s->tier2_table.slots);
+	ghost_free(&s->tier1_ghosts);
+	ghost_free(&s->tier2_ghosts);
+	s->tier2_count = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tier2_put
+// Description  : Keep a block evicted from the first tier compressed in the
+//		  second, at the back of its queue (evicting from its front to make
+//		  room), unless compressing it does not save a chunk
+//
+// Inputs       : s - the shard (locked)
+//		  key - packed disk,block pair (not in the second tier)
+//		  buf - the contents of the block, clean
+// Outputs      : N/A
+void tier2_put(CACHE_SHARD *s, uint64_t key, const char *buf) {
+
+	TIER2_ENTRY	*entry;
+	char		packed[RAID_BLOCK_SIZE];
+	int		length, chunks, chunk, offset, *link;
+
+	length = raid_compress(buf, RAID_BLOCK_SIZE, packed, RAID_BLOCK_SIZE - TIER2_CHUNK);
+	chunks = (length + TIER2_CHUNK - 1) / TIER2_CHUNK;
+	if ((length == 0) || (chunks > s->tier2_max)) {
+		s->stats.tier2_rejects++;
+		ghost_add(&s->tier1_ghosts, key);	// only a larger first tier keeps it
+		return;
+	}
+	while (s->tier2_chunks + chunks > s->tier2_max) {
+		tier2_evict(s);
+	}
+
+	// Copy it to a chain of free chunks (the tier never has more blocks than chunks)
+	entry = s->tier2_free_entries;
+	s->tier2_free_entries = entry->next;
+	entry->key = key;
+	entry->length = length;
+	for (offset = 0, link = &entry->chunk; offset < length; offset += TIER2_CHUNK) {
+		chunk = s->tier2_free;
+		s->tier2_free = s->tier2_links[chunk];
+		*link = chunk;
+		link = &s->tier2_links[chunk];
+		memcpy(&s->tier2_arena[(size_t)chunk * TIER2_CHUNK], &packed[offset],
+				(length - offset < TIER2_CHUNK) ? length - offset : TIER2_CHUNK);
+	}
+	*link = TIER2_END;
+	s->tier2_chunks += chunks;
+
+	entry->next = NULL;
+	entry->prev = s->tier2_back;
+	if (s->tier2_back != NULL) {
+		s->tier2_back->next = entry;
+	}
+	else {
+		s->tier2_front = entry;
+	}
+	s->tier2_back = entry;
+	hash_insert(&s->tier2_table, key, entry);
+	s->stats.tier2_stores++;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tier2_promote
+// Description  : Bring a block back from the second tier to the first, evicting
+//		  as necessary (the block itself is pinned meanwhile)
+//
+// Inputs       : s - the shard (locked)
+//		  dsk - this is the disk number of the block
+//		  blk - this is the block number of the block
+// Outputs      : pointer to the node of the block, NULL if it is not in the
+//		  second tier (or could not be brought back, it is on its disk)
+QUEUE_NODE *tier2_promote(CACHE_SHARD *s, RAIDDiskID dsk, RAIDBlockID blk) {
+
+	TIER2_ENTRY	*entry;
+	QUEUE_NODE	*node;
+	char		buf[RAID_BLOCK_SIZE];
+	int		result;
+
+	if ((s->tier2_count == 0) || ((entry = hash_lookup(&s->tier2_table, HASH_KEY(dsk, blk))) == NULL)) {
+		return(NULL);
+	}
+	result = tier2_read(s, entry, buf);
+	tier2_remove(s, entry);
+	if (result != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Bad compressed block, disk %d block %d dropped", dsk, blk);
+		return(NULL);
+	}
+	node = cache_add(s, dsk, blk);
+	if (node == NULL) {
+		return(NULL);
+	}
+	if (cache_store(s, node, buf) != 0) {
+		cache_drop(s, node);
+		return(NULL);
+	}
+	s->stats.tier2_hits++;
+
+	// an error writing back the blocks evicted is reported by the next write back
+	node->pins++;
+	cache_settle(s);
+	node->pins--;
+	return(node);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tier2_peek
+// Description  : Copy a block out of the second tier if it is there, leaving it
+//		  there
+//
+// Inputs       : s - the shard (locked)
+//		  key - packed disk,block pair
+//		  buf - memory to copy the block into
+// Outputs      : 0 if the block was copied, -1 if not found
+int tier2_peek(CACHE_SHARD *s, uint64_t key, char *buf) {
+
+	TIER2_ENTRY	*entry;
+
+	if ((s->tier2_count == 0) || ((entry = hash_lookup(&s->tier2_table, key)) == NULL)) {
+		return(-1);
+	}
+	return(tier2_read(s, entry, buf));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tier2_read
+// Description  : Gather the chunks of a block of the second tier and decompress
+//		  them
+//
+// Inputs       : s - the shard (locked)
+//		  entry - the block
+//		  buf - memory for the block
+// Outputs      : 0 if successful, -1 if the block does not decompress
+int tier2_read(CACHE_SHARD *s, TIER2_ENTRY *entry, char *buf) {
+
+	char	packed[RAID_BLOCK_SIZE];
+	int	chunk, offset;
+
+	for (chunk = entry->chunk, offset = 0; chunk != TIER2_END; chunk = s->tier2_links[chunk], offset += TIER2_CHUNK) {
+		memcpy(&packed[offset], &s->tier2_arena[(size_t)chunk * TIER2_CHUNK],
+				(entry->length - offset < TIER2_CHUNK) ? entry->length - offset : TIER2_CHUNK);
+	}
+	return((raid_decompress(packed, entry->length, buf, RAID_BLOCK_SIZE) == RAID_BLOCK_SIZE) ? 0 : -1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tier2_remove
+// Description  : Take a block out of the second tier, its chunks and entry go
+//		  back to their freelists
+//
+// Inputs       : s - the shard (locked)
+//		  entry - the block
+// Outputs      : N/A
+void tier2_remove(CACHE_SHARD *s, TIER2_ENTRY *entry) {
+
+	int	last, chunks;
+
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	}
+	else {
+		s->tier2_front = entry->next;
+	}
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	}
+	else {
+		s->tier2_back = entry->prev;
+	}
+
+	// the chain goes in front of the free chunks as it is
+	for (last = entry->chunk, chunks = 1; s->tier2_links[last] != TIER2_END; last = s->tier2_links[last], chunks++);
+	s->tier2_links[last] = s->tier2_free;
+	s->tier2_free = entry->chunk;
+	s->tier2_chunks -= chunks;
+
+	hash_delete(&s->tier2_table, entry->key);
+	entry->prev = NULL;
+	entry->next = s->tier2_free_entries;
+	s->tier2_free_entries = entry;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tier2_evict
+// Description  : Drop the block of the second tier least recently evicted from
+//		  the first, remembering its key (it is clean, on its disk)
+//
+// Inputs       : s - the shard (locked, with a block in the second tier)
+// Outputs      : N/A
+void tier2_evict(CACHE_SHARD *s) {
+
+	ghost_add(&s->tier2_ghosts, s->tier2_front->key);
+	tier2_remove(s, s->tier2_front);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hashfunction
+// Description  : Returns the hash value for a packed disk and block pair, mixing
+//		  every bit of the key into the low bits used to pick a slot
+//		  (the 64-bit finalizer of MurmurHash3)
+//
+// Inputs       : key - packed disk,block pair
+// Outputs      : hash value
+uint64_t hashfunction(uint64_t key) {
+
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+
+	return(key);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hash_init
+// Description  : Allocate an empty table with room for a number of entries,
+//		  keeping it at most half full
+//
+// Inputs       : t - the table
+//		  entries - the most entries the table will hold
+// Outputs      : 0 if successful, -1 otherwise
+int hash_init(HASH_TABLE *t, uint64_t entries) {
+
+	uint64_t slots = HASH_MIN_SLOTS;
+
+	while (slots < 2 * entries) {
+		slots *= 2;
+	}
+	t->slots = calloc(slots, sizeof(HASH_SLOT));
+	if (t->slots == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CACHE : Error allocating hashtable of %lu slots", (unsigned long)slots);
+		return(-1);
+	}
+	t->mask = slots - 1;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hash_lookup
+// Description  : Find the value of a disk and block pair
+//
+// Inputs       : t - the table
+//		  key - packed disk,block pair
+// Outputs      : the value, NULL if not in the table
+void *hash_lookup(HASH_TABLE *t, uint64_t key) {
+
+	uint64_t slot = hashfunction(key) & t->mask;
+	uint64_t dist = 0;
+
+	// stop at an entry closer to its home than the key would be, it would have moved
+	while ((t->slots[slot].value != NULL) &&
+			(((slot - hashfunction(t->slots[slot].key)) & t->mask) >= dist)) {
+		if (t->slots[slot].key == key) {
+			return(t->slots[slot].value);
+		}
+		slot = (slot + 1) & t->mask;
+		dist++;
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hash_insert
+// Description  : Add a disk and block pair (not in the table yet) to the table
+//
+// Inputs       : t - the table
+//		  key - packed disk,block pair
+//		  value - the value of the key (not NULL)
+// Outputs      : N/A
+void hash_insert(HASH_TABLE *t, uint64_t key, void *value) {
+
+	uint64_t	slot = hashfunction(key) & t->mask;
+	uint64_t	dist = 0, slot_dist;
+	HASH_SLOT	carried = { key, value }, swap;
+
+	// the table is never more than half full, so a free slot is always found
+	while (t->slots[slot].value != NULL) {
+		slot_dist = (slot - hashfunction(t->slots[slot].key)) & t->mask;
+		if (slot_dist < dist) {
+			// take the slot from the entry closer to home, and carry that one on
+			swap = t->slots[slot];
+			t->slots[slot] = carried;
+			carried = swap;
+			dist = slot_dist;
+		}
+		slot = (slot + 1) & t->mask;
+		dist++;
+	}
+	t->slots[slot] = carried;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hash_delete
+// Description  : Remove a disk and block pair from the table, shifting the
+//		  entries after it one slot back towards their home
+//
+// Inputs       : t - the table
+//		  key - packed disk,block pair
+// Outputs      : N/A
+void hash_delete(HASH_TABLE *t, uint64_t key) {
+
+	uint64_t slot = hashfunction(key) & t->mask;
+	uint64_t next;
+
+	while ((t->slots[slot].value != NULL) && (t->slots[slot].key != key)) {
+		slot = (slot + 1) & t->mask;
+	}
+	if (t->slots[slot].value == NULL) {
+		return;
+	}
+
+	// Move back every following entry that is not in its home slot
+	next = (slot + 1) & t->mask;
+	while ((t->slots[next].value != NULL) && (((next - hashfunction(t->slots[next].key)) & t->mask) != 0)) {
+		t->slots[slot] = t->slots[next];
+		slot = next;
+		next = (next + 1) & t->mask;
+	}
+	t->slots[slot].value = NULL;
 }
@@ -12,24 +12,73 @@
 //
 
 // Includes
+#include <stddef.h>
 #include <tagline_driver.h>
 
 // Defines
 #define TAGLINE_CACHE_SIZE 1024
+#define RAID_CACHE_DEFAULT_SHARDS 1	// shards of the cache, unless raid_cache_shards is set
+#define RAID_CACHE_MAX_SHARDS 64
+#define RAID_CACHE_NO_COPY RAID_DISKS	// copy disk of a block cached without a copy
+
+// Cache replacement policies
+typedef enum {
+	RAID_CACHE_LRU          = 0,	// least recently used
+	RAID_CACHE_CLOCK        = 1,	// second chance with a reference bit
+	RAID_CACHE_2Q           = 2,	// scan resistant 2Q (A1in/A1out/Am)
+	RAID_CACHE_POLICY_MAXVAL = 3,	// Max value
+} RAID_CACHE_POLICY;
+extern const char *RAID_CACHE_POLICY_LABELS[RAID_CACHE_POLICY_MAXVAL];
+extern RAID_CACHE_POLICY raid_cache_policy;	// policy used by init_raid_cache
+extern unsigned short raid_cache_shards;	// shards made by init_raid_cache (0 for the default)
+extern int raid_cache_dedup;			// blocks with the same contents share a buffer (0 by default)
+extern size_t raid_cache_memory;		// memory budget in bytes, split between a plain and a compressed
+						// tier (0 by default, the blocks given to init_raid_cache, plain)
 
 ///
 // Cache Interfaces
+// Every call locks the shard of its block, so threads may share the cache; a
+// buffer returned by get_raid_cache is only safe to use until the next call on
+// the cache, pin the block to keep it for longer. Those buffers are read-only,
+// blocks with the same contents may share one.
 
 int init_raid_cache(uint32_t max_blocks);
 	// Initialize the cache and note maximum blocks
 
+int init_raid_cache_policy(uint32_t max_blocks, RAID_CACHE_POLICY policy);
+	// Initialize the cache, note maximum blocks and the replacement policy
+
 int close_raid_cache(void);
 	// Clear all of the contents of the cache, cleanup
 
+int resize_raid_cache(size_t bytes);
+	// Change the memory of the cache while it runs, up to what it was initialized with
+
 int put_raid_cache(RAIDDiskID dsk, RAIDBlockID blk, void *buf);
 	// Put an object into the object cache, evicting other items as necessary
 
+int put_raid_cache_mirrored(RAIDDiskID dsk, RAIDBlockID blk, RAIDDiskID copy_dsk, RAIDBlockID copy_blk, void *buf);
+	// Put a mirrored object into the cache under its primary, written back to both copies
+
+int fill_raid_cache(RAIDDiskID dsk, RAIDBlockID blk, void *buf);
+	// Put an object just read from the disk into the cache, without marking it dirty
+
 void * get_raid_cache(RAIDDiskID dsk, RAIDBlockID blk);
 	// Get an object from the cache (and return it)
 
+int copy_raid_cache(RAIDDiskID dsk, RAIDBlockID blk, void *buf);
+	// Get an object from the cache, copied out while its shard is locked
+
+int peek_raid_cache(RAIDDiskID dsk, RAIDBlockID blk, void *buf);
+	// Copy an object out of the cache if it is there, leaving the policy and statistics alone
+
+void * pin_raid_cache(RAIDDiskID dsk, RAIDBlockID blk);
+	// Get an object from the cache, kept there (read-only) until it is unpinned
+
+void unpin_raid_cache(RAIDDiskID dsk, RAIDBlockID blk);
+	// Let a pinned object be evicted again
+
+void drop_raid_cache(RAIDDiskID dsk, RAIDBlockID blk);
+	// Drop an object from the cache without writing it back
+
 #endif
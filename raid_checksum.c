@@ -0,0 +1,164 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_checksum.c
+//  Description    : This is the implementation of the checksums of the blocks
+//                   of the TAGLINE driver.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Thursday, October 15th 2026
+// ****************************************************************************
+// Blocks are checksummed with CRC32C (the Castagnoli polynomial), which x86
+// (SSE4.2) and ARMv8 compute with one instruction per 8 bytes, about a tenth
+// of a microsecond for a block, well under what its transfer costs. Splitting
+// a block in lanes checksummed side by side (so several CRC instructions are in
+// flight at once) would need the CRCs of the lanes combined after, which costs
+// more than it saves at the size of a block, so it is checksummed in one go.
+// Machines without the instructions use a byte at a time table; which one is
+// used is picked once by init_raid_checksum (the driver calls it at init).
+
+
+// Includes
+#include <string.h>
+
+// Project includes
+#include <raid_checksum.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#endif
+
+// Defines
+#define CRC32C_POLY		0x82F63B78	// Castagnoli polynomial, reflected
+
+// Function Prototypes:
+uint32_t checksum_table(uint32_t crc, const uint8_t *buf, size_t len);
+#if defined(__x86_64__) || (defined(__aarch64__) && defined(__ARM_FEATURE_CRC32))
+uint32_t checksum_hardware(uint32_t crc, const uint8_t *buf, size_t len);
+#endif
+// -----------------------------
+
+// Data Structures - Declarations
+static uint32_t			crc_table[256];			// CRC of each byte value
+static uint32_t			(*block_crc)(uint32_t, const uint8_t *, size_t) = checksum_table;	// implementation picked
+static const char		*implementation = "table";
+// -----------------------------
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : init_raid_checksum
+// Description  : Build the table, and use the CRC instructions if the machine
+//                has them
+//
+// Inputs       : N/A
+// Outputs      : N/A
+
+void init_raid_checksum(void) {
+
+	uint32_t	value, crc;
+	int		bit;
+
+	for (value = 0; value < 256; value++) {
+		crc = value;
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		}
+		crc_table[value] = crc;
+	}
+	block_crc = checksum_table;
+	implementation = "table";
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		block_crc = checksum_hardware;
+		implementation = "sse4.2";
+	}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+	block_crc = checksum_hardware;
+	implementation = "armv8-crc";
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_checksum
+// Description  : CRC32C of a buffer
+//
+// Inputs       : buf - the buffer
+//                len - its length in bytes
+// Outputs      : the checksum
+
+uint32_t raid_checksum(const void *buf, size_t len) {
+
+	return(~block_crc(~0U, buf, len));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_checksum_implementation
+// Description  : Name of the implementation picked
+//
+// Inputs       : N/A
+// Outputs      : the name
+
+const char *raid_checksum_implementation(void) {
+	return(implementation);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checksum_table
+// Description  : Update a CRC over a buffer, a byte at a time
+//
+// Inputs       : crc - the CRC so far
+//                buf - the buffer
+//                len - its length in bytes
+// Outputs      : the CRC
+
+uint32_t checksum_table(uint32_t crc, const uint8_t *buf, size_t len) {
+
+	while (len-- > 0) {
+		crc = crc_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+	}
+	return(crc);
+}
+
+#if defined(__x86_64__) || (defined(__aarch64__) && defined(__ARM_FEATURE_CRC32))
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checksum_hardware
+// Description  : Update a CRC over a buffer with the CRC32C instructions, 8
+//                bytes at a time
+//
+// Inputs       : crc - the CRC so far
+//                buf - the buffer
+//                len - its length in bytes
+// Outputs      : the CRC
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+#endif
+uint32_t checksum_hardware(uint32_t crc, const uint8_t *buf, size_t len) {
+
+	uint64_t	word, crc64 = crc;
+
+	for (; len >= sizeof(word); len -= sizeof(word), buf += sizeof(word)) {
+		memcpy(&word, buf, sizeof(word));
+#if defined(__x86_64__)
+		crc64 = _mm_crc32_u64(crc64, word);
+#else
+		crc64 = __crc32cd((uint32_t)crc64, word);
+#endif
+	}
+	crc = (uint32_t)crc64;
+	for (; len > 0; len--, buf++) {
+#if defined(__x86_64__)
+		crc = _mm_crc32_u8(crc, *buf);
+#else
+		crc = __crc32cb(crc, *buf);
+#endif
+	}
+	return(crc);
+}
+#endif
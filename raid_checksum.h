@@ -0,0 +1,30 @@
+#ifndef RAID_CHECKSUM_INCLUDED
+#define RAID_CHECKSUM_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_checksum.h
+//  Description    : This is the header file for the checksums of the blocks
+//                   of the TAGLINE driver (CRC32C).
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Thursday, October 15th 2026
+//
+
+// Includes
+#include <stddef.h>
+#include <stdint.h>
+
+///
+// Checksum Interfaces
+
+void init_raid_checksum(void);
+	// Pick the fastest implementation of the machine (the CRC instructions where there are)
+
+uint32_t raid_checksum(const void *buf, size_t len);
+	// CRC32C of a buffer
+
+const char *raid_checksum_implementation(void);
+	// Name of the implementation picked
+
+#endif
@@ -6,28 +6,166 @@
 //  Author        : Raquel Alvarez
 //  Last Modified : December 6th 2015
 //
+// ****************************************************************************
+// Requests are pipelined over the connection to the server. Submitting a
+// request sends it right away and records it in a ring of in-flight requests,
+// without waiting for the response. The server answers requests in the order
+// they were received, so responses are matched to the ring in that same order
+// as they arrive. Each request is identified by a tag (its position in the
+// sequence of submitted requests), which the caller later completes to get
+// the response opcode. Detached requests are never completed by the caller:
+// their responses are collected by the client and failures are only counted,
+// apart for each submitter (RAID_DETACHED_CLASS) so none sees the others'.
+//
+// The server answers every request in full before reading the next one, so
+// the total payload of the responses in flight is bounded: when it would grow
+// beyond RAID_CLIENT_MAX_INFLIGHT_BYTES we first receive the oldest responses,
+// otherwise both ends could block writing to each other.
+//
+// Frames are not written one syscall at a time. Submitting a request only
+// queues its header and payload in an iovec list, which is written with a
+// single writev() when a response is needed (or the caller flushes), so a
+// batch of requests leaves in one syscall. Responses are read with readv()
+// straight into the request buffer, with the rest of what the socket has
+// ready spilling into a receive buffer where it is parsed from next. Short
+// transfers on both sides are resumed where they stopped.
+//
+// The client keeps a pool of raid_network_connections connections (channels)
+// to the server, each with its own pipeline. Requests for a disk are routed to
+// a channel either by disk ID, or round-robin over the channels whenever the
+// disk has nothing in flight, so requests for one disk are always answered
+// in order while different disks are serviced in parallel. INIT and CLOSE
+// act on the whole array: they wait for every channel to be answered, and go
+// out on the first channel. The bundled server only services one connection
+// at a time, which is why the pool has a single channel by default. The other
+// connections of a larger pool would be accepted by the kernel and never read,
+// so once INIT is answered (on the first channel) each other channel is sent a
+// STATUS that must be answered within RAID_CLIENT_PROBE_MSEC, and INIT fails
+// otherwise instead of leaving later requests waiting forever.
+//
+// Threads may share the client: every public function runs with the client
+// lock held (the internal raid_client_* functions assume it is), so requests are
+// submitted and responses received one thread at a time. With several threads,
+// a response may still wait for its caller (another thread) to complete it when
+// its slot comes round again: it is then parked in a small table of the channel
+// (only the opcode, the payload is already in the caller buffer) and the slot
+// is reused, so the threads never wait on each other for slots.
 
 // Include Files
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
 #include <stdint.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <pthread.h>
 
 // Project Include Files
 #include <raid_network.h>
+#include <raid_opcode.h>
+#include <raid_stats.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 
+// Defines
+#define RAID_CLIENT_MAX_INFLIGHT	64				// max requests in the pipeline
+#define RAID_CLIENT_MAX_INFLIGHT_BYTES	(64*RAID_BLOCK_SIZE)		// max response payload in the pipeline
+#define RAID_CLIENT_MAX_IOV		(2*RAID_CLIENT_MAX_INFLIGHT)	// header + payload for each request
+#define RAID_CLIENT_TX_STAGE		(64*RAID_BLOCK_SIZE)		// copied payloads waiting to be sent
+#define RAID_CLIENT_RX_BUFFER		(64*RAID_BLOCK_SIZE)		// received bytes waiting to be parsed
+#define RAID_CLIENT_SOCKET_BUFFER	(256*RAID_BLOCK_SIZE)		// kernel socket buffer size, each way
+#define RAID_CLIENT_MAX_DISKS		256				// disk IDs an opcode can address
+#define RAID_CLIENT_MAX_PARKED		RAID_CLIENT_MAX_INFLIGHT	// responses moved out of the ring
+#define RAID_CLIENT_PROBE_MSEC		2000				// longest wait for each channel to answer at INIT
+#define RAID_TAG(seq, ch)		((seq) * RAID_MAX_CONNECTIONS + (ch))	// tag of a request of a channel
+#define RAID_TAG_CHANNEL(tag)		((tag) % RAID_MAX_CONNECTIONS)		// channel of a tag
+#define RAID_TAG_SEQ(tag)		((tag) / RAID_MAX_CONNECTIONS)		// position of a tag in its channel
+
+// Data Structures Definitions
+typedef enum {
+	RAID_SLOT_FREE     = 0,	// no request, or its response has been completed
+	RAID_SLOT_INFLIGHT = 1,	// request sent, response not received yet
+	RAID_SLOT_DONE     = 2,	// response received, waiting for the caller to complete it
+} RAID_SLOT_STATE;
+//	Request in the pipeline
+typedef struct {
+	RAIDRequestTag	tag;		// tag of the request using the slot
+	RAID_SLOT_STATE	state;		// state of the slot
+	RAID_DETACHED_CLASS detached;	// who submitted it if nobody will complete it (RAID_ATTACHED if not)
+	int		abandoned;	// 1 if the caller gave up on it (its failure is not counted)
+	RAIDDiskID	disk;		// disk the request is for
+	void		*buf;		// buffer receiving the response payload (NULL to discard it)
+	uint64_t	rxlen;		// payload bytes expected in the response
+	RAIDOpCode	response;	// response opcode
+	uint64_t	header[2];	// request opcode and length, in network byte order
+	uint64_t	sent;		// RAID_STATS_NOW when it was submitted
+} RAID_CLIENT_REQUEST;
+//	Response received but not completed yet, moved out of its slot
+typedef struct {
+	RAIDRequestTag	tag;		// tag of the request
+	RAIDOpCode	response;	// response opcode
+} RAID_CLIENT_PARKED;
+//	Connection to the server, with its own pipeline
+typedef struct {
+	int			socket_fd;				// socket of the connection, -1 if closed
+	RAID_CLIENT_REQUEST	requests[RAID_CLIENT_MAX_INFLIGHT];	// ring of requests, indexed by position
+	int64_t			next_seq;				// position of the next request submitted
+	int64_t			next_response;				// position of the next response to arrive
+	uint64_t		inflight_bytes;				// response payload bytes still to arrive
+	struct iovec		tx_iov[RAID_CLIENT_MAX_IOV];		// frames submitted but not sent yet
+	int			tx_iovcnt;				// number of entries used in tx_iov
+	char			tx_stage[RAID_CLIENT_TX_STAGE];		// copies of detached payloads not sent yet
+	uint64_t		tx_stage_used;				// bytes used in tx_stage
+	char			rx_buf[RAID_CLIENT_RX_BUFFER];		// bytes received but not parsed yet
+	uint64_t		rx_head, rx_tail;			// unparsed bytes are rx_buf[rx_head..rx_tail)
+	RAID_CLIENT_PARKED	parked[RAID_CLIENT_MAX_PARKED];		// responses waiting out of the ring
+	int			parked_count;				// number of entries used in parked
+} RAID_CLIENT_CHANNEL;
+
 // Global data
 unsigned char *raid_network_address = NULL; // Address of CRUD server
 unsigned short raid_network_port = 0; // Port of CRUD server
+unsigned short raid_network_connections = 0; // Connections in the pool (0 for the default)
+RAID_NETWORK_ROUTING raid_network_routing = RAID_ROUTE_BY_DISK; // How requests pick a connection
 static int new_connection = 1;
-static int socket_fd = -1;
+static RAID_CLIENT_CHANNEL	channels[RAID_MAX_CONNECTIONS];		// the connection pool
+static int			num_channels = 0;			// channels connected in the pool
+static int			next_channel = 0;			// next channel for round-robin routing
+static int			disk_channel[RAID_CLIENT_MAX_DISKS];	// channel of the last request of each disk
+static uint64_t			disk_inflight[RAID_CLIENT_MAX_DISKS];	// requests in flight for each disk
+static uint64_t			detached_failures[RAID_DETACHED_MAXVAL];	// detached requests that failed, by submitter
+static pthread_mutex_t		client_lock = PTHREAD_MUTEX_INITIALIZER;	// taken by every public function
+
+// Function Prototypes
+static RAIDRequestTag raid_client_submit(RAIDOpCode op, void *buf, RAID_DETACHED_CLASS detached);
+static int raid_client_flush(void);
+static int raid_client_wait(RAIDRequestTag tag, int timeout);
+static int raid_client_wait_either(RAIDRequestTag tag, RAIDRequestTag other, int timeout);
+static int raid_client_shares_channel(RAIDRequestTag tag, RAIDDiskID disk);
+static void raid_client_abandon(RAIDRequestTag tag);
+static RAIDOpCode raid_client_complete(RAIDRequestTag tag);
+static int raid_client_drain(void);
+static uint64_t raid_client_failures(RAID_DETACHED_CLASS detached);
+static int raid_client_connect(void);
+static int raid_channel_connect(RAID_CLIENT_CHANNEL *ch, struct sockaddr_in *addr);
+static int raid_client_probe(void);
+static int raid_channel_probe(RAID_CLIENT_CHANNEL *ch);
+static void raid_client_disconnect(void);
+static int raid_client_route(RAIDOpCode op);
+static int raid_client_receive(RAID_CLIENT_CHANNEL *ch);
+static int raid_channel_drain(RAID_CLIENT_CHANNEL *ch);
+static void raid_tx_queue(RAID_CLIENT_CHANNEL *ch, void *buf, uint64_t len);
+static int raid_tx_flush(RAID_CLIENT_CHANNEL *ch);
+static int raid_rx_bytes(RAID_CLIENT_CHANNEL *ch, void *buf, uint64_t len);
+static int raid_client_unpark(RAID_CLIENT_CHANNEL *ch, RAIDRequestTag tag, RAIDOpCode *response);
 
 //
 // Functions
@@ -40,7 +178,9 @@ static int socket_fd = -1;
 //
 //                1) if INIT make a connection to the server
 //                2) send any request to the server, returning results
-//                3) if CLOSE, will close the connection
+//                3) if INIT made the connection, check every other channel
+//                   of the pool is answered too
+//                4) if CLOSE, will close the connection
 //
 // Inputs       : op - the request opcode for the command
 //                buf - the block to be read/written from (READ/WRITE)
@@ -48,444 +188,1062 @@ static int socket_fd = -1;
 
 RAIDOpCode client_raid_bus_request(RAIDOpCode op, void *buf) {
 
-	// Variables	
-	uint8_t request_type = 0;
-	RAID_REQUEST_TYPES init = RAID_INIT;
-	RAID_REQUEST_TYPES close_req = RAID_CLOSE;
-	RAID_REQUEST_TYPES read_req = RAID_READ;
-	RAID_REQUEST_TYPES write_req = RAID_WRITE;
-	RAID_REQUEST_TYPES format = RAID_FORMAT;
-	// Network Variables
-	char 	*ip = RAID_DEFAULT_IP;
-	struct 	sockaddr_in client_addr;
-	uint64_t data;
-	RAIDOpCode response_op;
+	RAIDRequestTag tag;
+	RAIDOpCode response;
+	int connected = 0, result;
 
-	request_type = (op >> 56);			// Store last 8 bits of opcode (request type)
-	raid_network_port = RAID_DEFAULT_PORT;
-	//*raid_network_address = RAID_DEFAULT_IP;
+	RAID_LOG_HOT("Request type %d", RAID_OPCODE_TYPE(op));
 
-	logMessage(LOG_INFO_LEVEL, "Request type %d", request_type);
+	// Handle INIT command, connecting to the server the first time
+	pthread_mutex_lock(&client_lock);
+	if ( (RAID_OPCODE_TYPE(op) == RAID_INIT) && (new_connection == 1) ) {
+		if ( raid_client_connect() != 0 ) {
+			pthread_mutex_unlock(&client_lock);
+			return(-1);
+		}
+		new_connection = 0; // no need to run this code again for the next INITs
+		connected = 1;
+	}
+	pthread_mutex_unlock(&client_lock);
 
-	if (request_type == init) {		// Handle INIT command
-		
-		if (new_connection == 1) {
+	// Send the request and wait for its response
+	tag = client_raid_bus_submit(op, buf, RAID_ATTACHED);
+	if ( tag < 0 ) {
+		return(-1);
+	}
+	response = client_raid_bus_complete(tag);
+
+	// The INIT was answered on the first channel, the server must answer the others too
+	if ( connected && !RAID_OPCODE_RESULT(response) ) {
+		pthread_mutex_lock(&client_lock);
+		result = raid_client_probe();
+		pthread_mutex_unlock(&client_lock);
+		if ( result != 0 ) {
+			return(-1);
+		}
+	}
+	return( response );
+}
 
-			logMessage(LOG_INFO_LEVEL, "Network : Initializing connection with server....");
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_submit
+// Description  : Send a request to the RAID server without waiting for the
+//                response. The request is only queued, it goes out with the
+//                next flush. INIT and CLOSE first wait for every other
+//                request, and CLOSE closes the connections once answered.
+//
+// Inputs       : op - the request opcode for the command
+//                buf - the block(s) to be read/written from (READ/WRITE),
+//                      must stay valid until the request completes (for a
+//                      detached request, the buffer is free on return)
+//                detached - who submits the request if its response will
+//                           never be completed, RAID_ATTACHED if it will
+// Outputs      : the tag of the request, -1 if failure
 
-			// get address
-			client_addr.sin_family = AF_INET;
-			client_addr.sin_port = htons(raid_network_port);
-			if ( inet_aton(ip, &client_addr.sin_addr) == 0 ) {
-				logMessage(LOG_ERROR_LEVEL, "Network : Error getting address.");
-				return(-1);
-			}
-			logMessage(LOG_INFO_LEVEL, "Network : Address resolved.");		
-	
+RAIDRequestTag client_raid_bus_submit(RAIDOpCode op, void *buf, RAID_DETACHED_CLASS detached) {
 
+	RAIDRequestTag result;
 
-			// create a socket
-			socket_fd = socket(PF_INET, SOCK_STREAM, 0);
-			if ( socket_fd == -1 ) {
-				logMessage(LOG_ERROR_LEVEL, "Network : Error on socket creation.");
-				return(-1);
-			}
-			logMessage(LOG_INFO_LEVEL, "Network : Socket created.");
+	pthread_mutex_lock(&client_lock);
+	result = raid_client_submit(op, buf, detached);
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_submit
+// Description  : client_raid_bus_submit, with the client lock held
+//
+// Inputs       : as client_raid_bus_submit
+// Outputs      : as client_raid_bus_submit
 
-	
-			// connect to the server
-			if ( connect(socket_fd, (const struct sockaddr *)&client_addr, sizeof(client_addr)) == -1 ) {
-				logMessage(LOG_ERROR_LEVEL, "Network : Error connecting to server.");
-				return(-1);
-			}
-			logMessage(LOG_INFO_LEVEL, "Network : ....Successfully connected to server.");		
-			
-			new_connection = 0; // no need to run this code again for the next INITs
-		
-		}
-	
-		// Send INIT commands to RAID Bus	
-		// data transfer to server
-		logMessage(LOG_INFO_LEVEL, "Network : Starting data transfer to server....");
-		// --- opcode transfer ---
-		data = htonll64(op);	// convert opcode to network byte order and send it
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending opcode to server.");
-			return(-1);
-		}
-		logMessage(LOG_INFO_LEVEL, "Network : INIT Opcode sent.");
+static RAIDRequestTag raid_client_submit(RAIDOpCode op, void *buf, RAID_DETACHED_CLASS detached) {
 
-		// --- length transfer ---
-		data = htonll64(0);	// send 0 because buf has 0 length for INIT
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending length of buf to server.");
-			return(-1);
-		}
-		logMessage(LOG_INFO_LEVEL, "Network : Length sent.");
+	RAID_CLIENT_CHANNEL *ch;
+	RAID_CLIENT_REQUEST *request;
+	uint64_t txlen = 0, rxlen = 0;
+	int i, chnum;
 
-		// --- buffer transfer ---
-		// No buffer to transfer for INIT
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully transferred data to server.");
+	if ( num_channels == 0 ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Request submitted with no connection to server.");
+		return(-1);
+	}
+	if ( (detached < RAID_ATTACHED) || (detached >= RAID_DETACHED_MAXVAL) ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Request submitted by unknown submitter %d.", detached);
+		return(-1);
+	}
 
+	// Work out the payload going each way
+	if ( RAID_OPCODE_TYPE(op) == RAID_WRITE ) {
+		txlen = (uint64_t)RAID_OPCODE_NBLOCKS(op) * RAID_BLOCK_SIZE;
+		rxlen = txlen;	// the server echoes the written blocks back
+	} else if ( RAID_OPCODE_TYPE(op) == RAID_READ ) {
+		rxlen = (uint64_t)RAID_OPCODE_NBLOCKS(op) * RAID_BLOCK_SIZE;
+	}
 
-		// data transfer from server
-		logMessage(LOG_INFO_LEVEL, "Network : Starting to receive data from server....");
-		// --- opcode receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving opcode confirmation.");
-			return(-1);
+	// Requests on the whole array wait for every disk
+	if ( (RAID_OPCODE_TYPE(op) == RAID_INIT) || (RAID_OPCODE_TYPE(op) == RAID_CLOSE) ) {
+		for ( i = 0; i < num_channels; i++ ) {
+			if ( raid_channel_drain(&channels[i]) != 0 ) {
+				return(-1);
+			}
 		}
-		response_op = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Opcode received.");
-		
-		// --- length receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving length confirmation.");
+	}
+	chnum = raid_client_route(op);
+	ch = &channels[chnum];
+
+	// Make room in the channel pipeline
+	while ( (ch->next_seq != ch->next_response) &&
+			( (ch->next_seq - ch->next_response == RAID_CLIENT_MAX_INFLIGHT) ||
+			  (ch->inflight_bytes + rxlen > RAID_CLIENT_MAX_INFLIGHT_BYTES) ) ) {
+		if ( raid_client_receive(ch) != 0 ) {
 			return(-1);
 		}
-		data = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Length received.");
+	}
+	request = &ch->requests[ch->next_seq % RAID_CLIENT_MAX_INFLIGHT];
+	if ( (request->state == RAID_SLOT_DONE) && (ch->parked_count < RAID_CLIENT_MAX_PARKED) ) {
+		// its caller has not completed it yet, keep the response aside
+		ch->parked[ch->parked_count].tag = request->tag;
+		ch->parked[ch->parked_count].response = request->response;
+		ch->parked_count++;
+		request->state = RAID_SLOT_FREE;
+	}
+	if ( request->state != RAID_SLOT_FREE ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Too many requests waiting to be completed.");
+		return(-1);
+	}
 
-		// --- buffer receive ---
-		if (data > 0) {
-			if ( read(socket_fd, buf, RAID_BLOCK_SIZE) != RAID_BLOCK_SIZE ) {
-				logMessage(LOG_ERROR_LEVEL, "Network : Error receiving buffer confirmation.");
+	// --- opcode, length and buffer queued for the next flush ---
+	request->header[0] = htonll64(op);	// convert opcode to network byte order
+	request->header[1] = htonll64(txlen);
+	raid_tx_queue(ch, request->header, sizeof(request->header));
+	if ( txlen > 0 ) {
+		if ( detached && (txlen <= sizeof(ch->tx_stage)) ) {
+			// The caller may reuse the buffer right away, send a copy of it
+			if ( (txlen > sizeof(ch->tx_stage) - ch->tx_stage_used) && (raid_tx_flush(ch) != 0) ) {
+				logMessage(LOG_ERROR_LEVEL, "Network : Error sending buffer data to server.");
+				return(-1);
+			}
+			memcpy(&ch->tx_stage[ch->tx_stage_used], buf, txlen);
+			raid_tx_queue(ch, &ch->tx_stage[ch->tx_stage_used], txlen);
+			ch->tx_stage_used += txlen;
+		} else {
+			raid_tx_queue(ch, buf, txlen);
+			if ( detached && (raid_tx_flush(ch) != 0) ) {
+				logMessage(LOG_ERROR_LEVEL, "Network : Error sending buffer data to server.");
 				return(-1);
 			}
-			data = ntohll64(data);
-			logMessage(LOG_INFO_LEVEL, "Network : Buffer received.");
 		}
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully received data from server.");
-		
-		// Return response opcode
-		return( response_op );
+	}
 
+	// Record the request in the pipeline
+	request->tag = RAID_TAG(ch->next_seq, chnum);
+	request->state = RAID_SLOT_INFLIGHT;
+	request->detached = detached;
+	request->abandoned = 0;
+	request->disk = RAID_OPCODE_DISK(op);
+	request->buf = (RAID_OPCODE_TYPE(op) == RAID_WRITE) ? NULL : buf;
+	request->rxlen = rxlen;
+	request->response = 0;
+	request->sent = RAID_STATS_NOW();
+	RAID_STATS_SUBMIT(op, disk_inflight[request->disk]);
+	RAID_STATS_TRACE(RAID_TRACE_SUBMIT, op, request->tag);
+	ch->inflight_bytes += rxlen;
+	disk_inflight[request->disk]++;
+	ch->next_seq++;
+
+	return( request->tag );
+}
 
-	}
-	else if ( request_type == format ) {					// Handle the rest of commands
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_flush
+// Description  : Send every request that was submitted but is still queued
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
 
-		// Send FORMAT commands to the RAID Bus
-		// data transfer to server
-		logMessage(LOG_INFO_LEVEL, "Network : Starting data transfer to server....");
-		// --- opcode transfer ---
-		data = htonll64(op);	// convert opcode to network byte order and send it
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending opcode to server.");
-			return(-1);
-		}
-		logMessage(LOG_INFO_LEVEL, "Network : FORMAT Opcode sent.");
+int client_raid_bus_flush(void) {
 
-		// --- length transfer ---
-		data = htonll64(0);	// send 0 because buf has 0 length for INIT
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending length of buf to server.");
-			return(-1);
-		}
-		logMessage(LOG_INFO_LEVEL, "Network : Length sent.");
+	int result;
 
-		// --- buffer transfer ---
-		// No buffer needs to be transferred for FORMAT
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully transferred data to server.");
+	pthread_mutex_lock(&client_lock);
+	result = raid_client_flush();
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_flush
+// Description  : client_raid_bus_flush, with the client lock held
+//
+// Inputs       : as client_raid_bus_flush
+// Outputs      : as client_raid_bus_flush
 
-		// data transfer from server
-		logMessage(LOG_INFO_LEVEL, "Network : Starting to receive data from server....");
-		// --- opcode receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving opcode confirmation.");
-			return(-1);
-		}
-		response_op = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Opcode received.");
-		
-		// --- length receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving length confirmation.");
+static int raid_client_flush(void) {
+
+	int i;
+
+	for ( i = 0; i < num_channels; i++ ) {
+		if ( (channels[i].tx_iovcnt > 0) && (raid_tx_flush(&channels[i]) != 0) ) {
+			logMessage(LOG_ERROR_LEVEL, "Network : Error sending requests to server.");
 			return(-1);
 		}
-		data = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Length received.");
+	}
+	return(0);
+}
 
-		// --- buffer receive ---
-		if (data > 0) {
-			if ( read(socket_fd, buf, RAID_BLOCK_SIZE) != RAID_BLOCK_SIZE ) {
-				logMessage(LOG_ERROR_LEVEL, "Network : Error receiving buffer confirmation.");
-				return(-1);
-			}
-			data = ntohll64(data);
-			logMessage(LOG_INFO_LEVEL, "Network : Buffer received.");
-		}
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully received data from server.");
-	
-		// Return response opcode
-		return ( response_op );
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_poll
+// Description  : Collect the responses that have already arrived, without
+//                blocking for new ones
+//
+// Inputs       : tag - the request being waited on
+// Outputs      : 1 if the request is complete, 0 if not yet, -1 if failure
+
+int client_raid_bus_poll(RAIDRequestTag tag) {
+
+	int result;
+
+	pthread_mutex_lock(&client_lock);
+	result = raid_client_wait(tag, 0);
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_wait
+// Description  : Collect responses until a request is complete, blocking for
+//                new ones up to a timeout
+//
+// Inputs       : tag - the request being waited on
+//                timeout - the longest wait, in milliseconds
+// Outputs      : 1 if the request is complete, 0 if not yet, -1 if failure
+
+int client_raid_bus_wait(RAIDRequestTag tag, int timeout) {
+
+	int result;
+
+	pthread_mutex_lock(&client_lock);
+	result = raid_client_wait(tag, timeout);
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_wait
+// Description  : client_raid_bus_wait, with the client lock held (a timeout of
+//                0 is client_raid_bus_poll)
+//
+// Inputs       : as client_raid_bus_wait
+// Outputs      : as client_raid_bus_wait
+
+static int raid_client_wait(RAIDRequestTag tag, int timeout) {
 
+	RAID_CLIENT_CHANNEL *ch;
+	struct pollfd pfd;
+	struct timeval start, now;
+	long waited;
 
+	if ( (tag < 0) || (RAID_TAG_CHANNEL(tag) >= num_channels) ) {
+		return(-1);
 	}
-	else if ( request_type == read_req ) {
-		
-		// Send READ command to the RAID Bus
-		// data transfer to server
-		//logMessage(LOG_INFO_LEVEL, "Network : Starting data transfer to server....");
-		// --- opcode transfer ---
-		data = htonll64(op);	// convert opcode to network byte order and send it
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending opcode to server.");
-			return(-1);
+	ch = &channels[RAID_TAG_CHANNEL(tag)];
+	if ( RAID_TAG_SEQ(tag) >= ch->next_seq ) {
+		return(-1);
+	}
+	if ( raid_tx_flush(ch) != 0 ) {
+		return(-1);
+	}
+	gettimeofday(&start, NULL);
+	while ( RAID_TAG_SEQ(tag) >= ch->next_response ) {
+		if ( ch->rx_head != ch->rx_tail ) {
+			// a response has started arriving, the rest of it is on its way
+			if ( raid_client_receive(ch) != 0 ) {
+				return(-1);
+			}
+			continue;
 		}
-		//logMessage(LOG_INFO_LEVEL, "Network : READ Opcode sent.");
-
-		// --- length transfer ---
-		data = htonll64(0);	// send 0 because buf has 0 length for INIT
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending length of buf to server.");
+		gettimeofday(&now, NULL);
+		waited = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000;
+		pfd.fd = ch->socket_fd;
+		pfd.events = POLLIN;
+		if ( poll(&pfd, 1, (waited < timeout) ? timeout - waited : 0) <= 0 ) {
+			return(0);
+		}
+		if ( raid_client_receive(ch) != 0 ) {
 			return(-1);
 		}
-		//logMessage(LOG_INFO_LEVEL, "Network : Length sent.");
+	}
+	return(1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_wait_either
+// Description  : Collect responses until either of two requests is complete,
+//                waiting on both of their channels at once
+//
+// Inputs       : tag, other - the requests being waited on
+//                timeout - the longest wait, in milliseconds (-1 for no limit)
+// Outputs      : 1 if tag is complete, 2 if other is, 0 if neither yet,
+//                -1 if failure
+
+int client_raid_bus_wait_either(RAIDRequestTag tag, RAIDRequestTag other, int timeout) {
+
+	int result;
+
+	pthread_mutex_lock(&client_lock);
+	result = raid_client_wait_either(tag, other, timeout);
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_wait_either
+// Description  : client_raid_bus_wait_either, with the client lock held
+//
+// Inputs       : as client_raid_bus_wait_either
+// Outputs      : as client_raid_bus_wait_either
 
-		// --- buffer transfer ---
-		data = htonll64(0);
-	//	if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-	//		logMessage(LOG_ERROR_LEVEL, "Network : Error sending buffer data to server.");
-	//		return(-1);
-	//	}
-		//logMessage(LOG_INFO_LEVEL, "Network : Buffer sent.");
-		//logMessage(LOG_INFO_LEVEL, "Network : ....Successfully transferred data to server.");
+static int raid_client_wait_either(RAIDRequestTag tag, RAIDRequestTag other, int timeout) {
 
+	RAIDRequestTag tags[2] = { tag, other };
+	RAID_CLIENT_CHANNEL *ch[2];
+	struct pollfd pfd[2];
+	struct timeval start, now;
+	long waited;
+	int i, nfds;
 
-		// data transfer from server
-		//logMessage(LOG_INFO_LEVEL, "Network : Starting to receive data from server....");
-		// --- opcode receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving opcode confirmation.");
+	for ( i = 0; i < 2; i++ ) {
+		if ( (tags[i] < 0) || (RAID_TAG_CHANNEL(tags[i]) >= num_channels) ) {
 			return(-1);
 		}
-		response_op = ntohll64(data);
-		//logMessage(LOG_INFO_LEVEL, "Network : Opcode received.");
-		
-		// --- length receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving length confirmation.");
+		ch[i] = &channels[RAID_TAG_CHANNEL(tags[i])];
+		if ( (RAID_TAG_SEQ(tags[i]) >= ch[i]->next_seq) || (raid_tx_flush(ch[i]) != 0) ) {
 			return(-1);
 		}
-		data = ntohll64(data);
-		//logMessage(LOG_INFO_LEVEL, "Network : Length received.");
-
-		// --- buffer receive ---
-		if (data > 0) {
-			if ( read(socket_fd, buf, RAID_BLOCK_SIZE) != RAID_BLOCK_SIZE ) {
-				logMessage(LOG_ERROR_LEVEL, "Network : Error receiving buffer confirmation.");
-				return(-1);
+	}
+	nfds = (ch[0] == ch[1]) ? 1 : 2;
+	gettimeofday(&start, NULL);
+	while ( 1 ) {
+		for ( i = 0; i < 2; i++ ) {
+			// a response that has started arriving is on its way, the rest of it too
+			while ( (RAID_TAG_SEQ(tags[i]) >= ch[i]->next_response) && (ch[i]->rx_head != ch[i]->rx_tail) ) {
+				if ( raid_client_receive(ch[i]) != 0 ) {
+					return(-1);
+				}
+			}
+			if ( RAID_TAG_SEQ(tags[i]) < ch[i]->next_response ) {
+				return( i + 1 );
 			}
-		//logMessage(LOG_INFO_LEVEL, "Network : Data in buffer %c.", *((char *)buf));
-		//logMessage(LOG_INFO_LEVEL, "Network : Buffer received.");
-		}
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully received data from server.");
-
-		// Return response opcode	
-		return (response_op);
-	
-	}
-	else if ( request_type == write_req ) {
-		
-		// Send WRITE commands to the RAID Bus
-		// data transfer to server
-		//logMessage(LOG_INFO_LEVEL, "Network : Starting data transfer to server....");
-		// --- opcode transfer ---
-		data = htonll64(op);	// convert opcode to network byte order and send it
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending opcode to server.");
-			return(-1);
 		}
-		logMessage(LOG_INFO_LEVEL, "Network : WRITE Opcode sent.");
 
-		// --- length transfer ---
-		data = htonll64(RAID_BLOCK_SIZE);
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending length of buf to server.");
-			return(-1);
+		// one poll on both channels, then one response of the first ready
+		gettimeofday(&now, NULL);
+		waited = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000;
+		for ( i = 0; i < nfds; i++ ) {
+			pfd[i].fd = ch[i]->socket_fd;
+			pfd[i].events = POLLIN;
+			pfd[i].revents = 0;
 		}
-		logMessage(LOG_INFO_LEVEL, "Network : Length sent.");
-
-		// --- buffer transfer ---
-		if ( write(socket_fd, buf, RAID_BLOCK_SIZE) != RAID_BLOCK_SIZE ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending buffer data to server.");
+		if ( poll(pfd, nfds, (timeout < 0) ? -1 : ((waited < timeout) ? timeout - waited : 0)) <= 0 ) {
+			return(0);
+		}
+		i = (pfd[0].revents != 0) ? 0 : 1;
+		if ( raid_client_receive(ch[i]) != 0 ) {
 			return(-1);
 		}
-		logMessage(LOG_INFO_LEVEL, "Network : Buffer sent.");
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully transferred data to server.");
+	}
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_shares_channel
+// Description  : Tell whether a request for a disk, submitted now, would go out
+//                on the channel of a request in flight (so it would only be
+//                answered after it)
+//
+// Inputs       : tag - the request in flight
+//                disk - the disk of the request that would be submitted
+// Outputs      : 1 if it would share the channel, 0 if not
 
-		// data transfer from server
-		logMessage(LOG_INFO_LEVEL, "Network : Starting to receive data from server....");
-		// --- opcode receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving opcode confirmation.");
-			return(-1);
-		}
-		response_op = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Opcode received.");
-		
-		// --- length receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving length confirmation.");
-			return(-1);
-		}
-		data = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Length received %d.", data);
+int client_raid_bus_shares_channel(RAIDRequestTag tag, RAIDDiskID disk) {
 
-		// --- buffer receive ---
-		if (data > 0) {
-			if ( read(socket_fd, buf, RAID_BLOCK_SIZE) != RAID_BLOCK_SIZE ) {
-				logMessage(LOG_ERROR_LEVEL, "Network : Error receiving buffer confirmation.");
-				return(-1);
-			}
-			//logMessage(LOG_INFO_LEVEL, "Network : Data in buffer %c.", *((char *)buf));
-			//logMessage(LOG_INFO_LEVEL, "Network : Buffer received.");
-		}
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully received data from server.");
+	int result;
 
-		// Return response opcode	
-		return (response_op);
+	pthread_mutex_lock(&client_lock);
+	result = raid_client_shares_channel(tag, disk);
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
 
-	
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_shares_channel
+// Description  : client_raid_bus_shares_channel, with the client lock held
+//                (the routing of raid_client_route, without taking a channel)
+//
+// Inputs       : as client_raid_bus_shares_channel
+// Outputs      : as client_raid_bus_shares_channel
+
+static int raid_client_shares_channel(RAIDRequestTag tag, RAIDDiskID disk) {
+
+	int chnum;
+
+	if ( num_channels <= 1 ) {
+		return(1);
 	}
-	else if (request_type == close_req) {
+	if ( raid_network_routing == RAID_ROUTE_BY_DISK ) {
+		chnum = disk % num_channels;
+	} else {
+		chnum = (disk_inflight[disk] == 0) ? next_channel : disk_channel[disk];
+	}
+	return( chnum == RAID_TAG_CHANNEL(tag) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_complete
+// Description  : Wait for the response of a request
+//
+// Inputs       : tag - the request to complete
+// Outputs      : the response opcode, -1 if failure
+
+RAIDOpCode client_raid_bus_complete(RAIDRequestTag tag) {
+
+	RAIDOpCode result;
+
+	pthread_mutex_lock(&client_lock);
+	result = raid_client_complete(tag);
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_complete
+// Description  : client_raid_bus_complete, with the client lock held
+//
+// Inputs       : as client_raid_bus_complete
+// Outputs      : as client_raid_bus_complete
+
+static RAIDOpCode raid_client_complete(RAIDRequestTag tag) {
+
+	RAID_CLIENT_CHANNEL *ch;
+	RAID_CLIENT_REQUEST *request;
+	RAIDOpCode response_op;
 
-		// Send CLOSE commands to RAID Bus
-		// data transfer to server
-		logMessage(LOG_INFO_LEVEL, "Network : Starting data transfer to server....");
-		// --- opcode transfer ---
-		data = htonll64(op);	// convert opcode to network byte order and send it
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending opcode to server.");
+	if ( (tag < 0) || (RAID_TAG_CHANNEL(tag) >= num_channels) ||
+			(RAID_TAG_SEQ(tag) >= channels[RAID_TAG_CHANNEL(tag)].next_seq) ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Completing unknown request %lld.", (long long)tag);
+		return(-1);
+	}
+	ch = &channels[RAID_TAG_CHANNEL(tag)];
+
+	// Receive responses in order until this one arrives
+	while ( RAID_TAG_SEQ(tag) >= ch->next_response ) {
+		if ( raid_client_receive(ch) != 0 ) {
 			return(-1);
 		}
-		logMessage(LOG_INFO_LEVEL, "Network : CLOSE Opcode sent.");
+	}
+	request = &ch->requests[RAID_TAG_SEQ(tag) % RAID_CLIENT_MAX_INFLIGHT];
+	if ( (request->tag == tag) && (request->state == RAID_SLOT_DONE) ) {
+		response_op = request->response;
+		request->state = RAID_SLOT_FREE;
+	} else if ( raid_client_unpark(ch, tag, &response_op) != 0 ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Request %lld was already completed.", (long long)tag);
+		return(-1);
+	}
+
+	// Close connections with server once the CLOSE is answered
+	if ( RAID_OPCODE_TYPE(response_op) == RAID_CLOSE ) {
+		raid_client_disconnect();
+	}
+	return( response_op );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_abandon
+// Description  : Give up on a request that will not be completed: its response
+//                is discarded when it arrives (the buffer is free on return)
+//
+// Inputs       : tag - the request to give up
+// Outputs      : none
+
+void client_raid_bus_abandon(RAIDRequestTag tag) {
+
+	pthread_mutex_lock(&client_lock);
+	raid_client_abandon(tag);
+	pthread_mutex_unlock(&client_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_abandon
+// Description  : client_raid_bus_abandon, with the client lock held
+//
+// Inputs       : as client_raid_bus_abandon
+// Outputs      : as client_raid_bus_abandon
+
+static void raid_client_abandon(RAIDRequestTag tag) {
+
+	RAID_CLIENT_REQUEST *request;
+	RAIDOpCode response;
+
+	if ( (tag < 0) || (RAID_TAG_CHANNEL(tag) >= num_channels) ||
+			(RAID_TAG_SEQ(tag) >= channels[RAID_TAG_CHANNEL(tag)].next_seq) ) {
+		return;
+	}
+	request = &channels[RAID_TAG_CHANNEL(tag)].requests[RAID_TAG_SEQ(tag) % RAID_CLIENT_MAX_INFLIGHT];
+	if ( request->tag != tag ) {
+		raid_client_unpark(&channels[RAID_TAG_CHANNEL(tag)], tag, &response);
+		return;
+	}
+	if ( request->state == RAID_SLOT_DONE ) {
+		request->state = RAID_SLOT_FREE;
+	} else if ( request->state == RAID_SLOT_INFLIGHT ) {
+		// responses are received whole, so none of it has reached the buffer yet
+		request->abandoned = 1;
+		request->buf = NULL;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_depth
+// Description  : Number of requests for a disk waiting for their response
+//
+// Inputs       : disk - the disk
+// Outputs      : the number of requests in flight
+
+uint64_t client_raid_bus_depth(RAIDDiskID disk) {
+
+	uint64_t result;
+
+	pthread_mutex_lock(&client_lock);
+	result = disk_inflight[disk];
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_drain
+// Description  : Wait for every request in the pipeline to be answered
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int client_raid_bus_drain(void) {
+
+	int result;
+
+	pthread_mutex_lock(&client_lock);
+	result = raid_client_drain();
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_drain
+// Description  : client_raid_bus_drain, with the client lock held
+//
+// Inputs       : as client_raid_bus_drain
+// Outputs      : as client_raid_bus_drain
 
-		// --- length transfer ---
-		data = htonll64(0);	// send 0 because buf has 0 length for INIT
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending length of buf to server.");
+static int raid_client_drain(void) {
+
+	int i;
+
+	for ( i = 0; i < num_channels; i++ ) {
+		if ( raid_channel_drain(&channels[i]) != 0 ) {
 			return(-1);
 		}
-		logMessage(LOG_INFO_LEVEL, "Network : Length sent.");
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_raid_bus_failures
+// Description  : Count the detached requests of a submitter that failed (among
+//                the responses received so far) and reset its count
+//
+// Inputs       : detached - the submitter
+// Outputs      : number of its detached requests that failed since its last call
 
-		// --- buffer transfer ---
-	//	data = htonll64(0);
-	//	if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-	//		logMessage(LOG_ERROR_LEVEL, "Network : Error sending buffer data to server.");
-	//		return(-1);
-	//	}
-	//	logMessage(LOG_INFO_LEVEL, "Network : Buffer sent.");
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully transferred data to server.");
+uint64_t client_raid_bus_failures(RAID_DETACHED_CLASS detached) {
 
+	uint64_t result;
 
-		// data transfer from server
-		logMessage(LOG_INFO_LEVEL, "Network : Starting to receive data from server....");
-		// --- opcode receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving opcode confirmation.");
+	pthread_mutex_lock(&client_lock);
+	result = raid_client_failures(detached);
+	pthread_mutex_unlock(&client_lock);
+	return( result );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_failures
+// Description  : client_raid_bus_failures, with the client lock held
+//
+// Inputs       : as client_raid_bus_failures
+// Outputs      : as client_raid_bus_failures
+
+static uint64_t raid_client_failures(RAID_DETACHED_CLASS detached) {
+
+	uint64_t failures;
+
+	if ( (detached <= RAID_ATTACHED) || (detached >= RAID_DETACHED_MAXVAL) ) {
+		return(0);
+	}
+	failures = detached_failures[detached];
+	detached_failures[detached] = 0;
+	return( failures );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_connect
+// Description  : Open the pool of connections to the RAID server
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int raid_client_connect(void) {
+
+	// Network Variables
+	char 	*ip = RAID_DEFAULT_IP;
+	struct 	sockaddr_in client_addr;
+	int	i, pool_size;
+
+	// Use the server given on the command line, if any
+	if ( raid_network_address != NULL ) {
+		ip = (char *)raid_network_address;
+	}
+	if ( raid_network_port == 0 ) {
+		raid_network_port = RAID_DEFAULT_PORT;
+	}
+	pool_size = (raid_network_connections == 0) ? RAID_DEFAULT_CONNECTIONS : raid_network_connections;
+	if ( pool_size > RAID_MAX_CONNECTIONS ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Too many connections requested (%d, max %d).", pool_size, RAID_MAX_CONNECTIONS);
+		return(-1);
+	}
+
+	logMessage(LOG_INFO_LEVEL, "Network : Initializing %d connection(s) with server %s:%u....", pool_size, ip, raid_network_port);
+
+	// get address
+	memset(&client_addr, 0, sizeof(client_addr));
+	client_addr.sin_family = AF_INET;
+	client_addr.sin_port = htons(raid_network_port);
+	if ( inet_aton(ip, &client_addr.sin_addr) == 0 ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Error getting address.");
+		return(-1);
+	}
+	logMessage(LOG_INFO_LEVEL, "Network : Address resolved.");
+
+	// Open every channel of the pool
+	for ( i = 0; i < pool_size; i++ ) {
+		if ( raid_channel_connect(&channels[i], &client_addr) != 0 ) {
+			raid_client_disconnect();
 			return(-1);
 		}
-		response_op = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Opcode received.");
-		
-		// --- length receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving length confirmation.");
+		num_channels++;
+	}
+	next_channel = 0;
+	memset(disk_channel, 0, sizeof(disk_channel));
+	memset(disk_inflight, 0, sizeof(disk_inflight));
+	logMessage(LOG_INFO_LEVEL, "Network : ....Successfully connected to server.");
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_channel_connect
+// Description  : Open one connection of the pool, with an empty pipeline
+//
+// Inputs       : ch - the channel to connect
+//                addr - the address of the server
+// Outputs      : 0 if successful, -1 if failure
+
+static int raid_channel_connect(RAID_CLIENT_CHANNEL *ch, struct sockaddr_in *addr) {
+
+	int nodelay = 1, bufsize = RAID_CLIENT_SOCKET_BUFFER;
+
+	// create a socket
+	ch->socket_fd = socket(PF_INET, SOCK_STREAM, 0);
+	if ( ch->socket_fd == -1 ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Error on socket creation.");
+		return(-1);
+	}
+	logMessage(LOG_INFO_LEVEL, "Network : Socket created.");
+
+	// Frames are flushed whole, so send them without waiting (Nagle), and leave
+	// room in the kernel for a full pipeline each way. Both are only tuning.
+	if ( setsockopt(ch->socket_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) != 0 ) {
+		logMessage(LOG_WARNING_LEVEL, "Network : Could not disable Nagle on socket.");
+	}
+	if ( (setsockopt(ch->socket_fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize)) != 0) ||
+			(setsockopt(ch->socket_fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize)) != 0) ) {
+		logMessage(LOG_WARNING_LEVEL, "Network : Could not set socket buffer sizes.");
+	}
+
+	// connect to the server
+	if ( connect(ch->socket_fd, (const struct sockaddr *)addr, sizeof(*addr)) == -1 ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Error connecting to server.");
+		close(ch->socket_fd);
+		ch->socket_fd = -1;
+		return(-1);
+	}
+
+	// Start with an empty pipeline
+	memset(ch->requests, 0, sizeof(ch->requests));
+	ch->next_seq = ch->next_response = 0;
+	ch->inflight_bytes = 0;
+	ch->tx_iovcnt = 0;
+	ch->tx_stage_used = 0;
+	ch->rx_head = ch->rx_tail = 0;
+	ch->parked_count = 0;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_probe
+// Description  : Check that the server answers every channel of the pool but
+//                the first (which answered the INIT), closing the pool if not
+//
+// Inputs       : none
+// Outputs      : 0 if every channel is answered, -1 if not
+
+static int raid_client_probe(void) {
+
+	int i;
+
+	for ( i = 1; i < num_channels; i++ ) {
+		if ( raid_channel_probe(&channels[i]) != 0 ) {
+			logMessage(LOG_ERROR_LEVEL, "Network : Connection %d of %d not answered by the server in %d ms "
+					"(does it service %d connections at once?).", i + 1, num_channels, RAID_CLIENT_PROBE_MSEC, num_channels);
+			raid_client_disconnect();
 			return(-1);
 		}
-		data = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Length received.");
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_channel_probe
+// Description  : Check that the server answers a new channel: send it a STATUS
+//                of disk 0 and wait up to RAID_CLIENT_PROBE_MSEC for the
+//                response, outside of the pipeline and the statistics
+//
+// Inputs       : ch - the channel, connected and with an empty pipeline
+// Outputs      : 0 if answered, -1 if not (or failure)
+
+static int raid_channel_probe(RAID_CLIENT_CHANNEL *ch) {
+
+	uint64_t header[2];
+	struct pollfd pfd;
+	int ready;
+
+	header[0] = htonll64(RAID_OPCODE_PUT(RAID_STATUS, RAID_OPCODE_REQTYPE));
+	header[1] = htonll64(0);
+	raid_tx_queue(ch, header, sizeof(header));
+	if ( raid_tx_flush(ch) != 0 ) {
+		return(-1);
+	}
+	pfd.fd = ch->socket_fd;
+	pfd.events = POLLIN;
+	do {
+		ready = poll(&pfd, 1, RAID_CLIENT_PROBE_MSEC);
+	} while ( (ready < 0) && (errno == EINTR) );
+	if ( (ready <= 0) || (raid_rx_bytes(ch, header, sizeof(header)) != 0) ||
+			(raid_rx_bytes(ch, NULL, ntohll64(header[1])) != 0) ) {
+		return(-1);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_disconnect
+// Description  : Close every connection of the pool
+//
+// Inputs       : none
+// Outputs      : none
+
+static void raid_client_disconnect(void) {
+
+	int i;
+
+	for ( i = 0; i < num_channels; i++ ) {
+		close(channels[i].socket_fd);
+		channels[i].socket_fd = -1;
+	}
+	num_channels = 0;
+	new_connection = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_route
+// Description  : Pick the channel a request goes out on
+//
+// Inputs       : op - the request opcode
+// Outputs      : the channel number
+
+static int raid_client_route(RAIDOpCode op) {
+
+	RAIDDiskID disk = RAID_OPCODE_DISK(op);
 
-		// --- buffer receive ---
-		if (data > 0) {
-			if ( read(socket_fd, buf, data) != data ) {
+	// Requests on the whole array go on the first channel
+	if ( (RAID_OPCODE_TYPE(op) == RAID_INIT) || (RAID_OPCODE_TYPE(op) == RAID_CLOSE) ) {
+		return(0);
+	}
+	if ( raid_network_routing == RAID_ROUTE_BY_DISK ) {
+		return( disk % num_channels );
+	}
+
+	// Round-robin, but a disk keeps its channel while it has requests in flight
+	if ( disk_inflight[disk] == 0 ) {
+		disk_channel[disk] = next_channel;
+		next_channel = (next_channel + 1) % num_channels;
+	}
+	return( disk_channel[disk] );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_receive
+// Description  : Receive the next response from the server on a channel and
+//                match it to the oldest request in its pipeline
+//
+// Inputs       : ch - the channel to receive from
+// Outputs      : 0 if successful, -1 if failure
+
+static int raid_client_receive(RAID_CLIENT_CHANNEL *ch) {
+
+	RAID_CLIENT_REQUEST *request = &ch->requests[ch->next_response % RAID_CLIENT_MAX_INFLIGHT];
+	uint64_t header[2];
+	uint64_t length;
+
+	// The request must have left before its response can arrive
+	if ( raid_tx_flush(ch) != 0 ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Error sending requests to server.");
+		return(-1);
+	}
+
+	// --- opcode and length receive ---
+	if ( raid_rx_bytes(ch, header, sizeof(header)) != 0 ) {
+		logMessage(LOG_ERROR_LEVEL, "Network : Error receiving opcode confirmation.");
+		return(-1);
+	}
+	request->response = ntohll64(header[0]);
+	length = ntohll64(header[1]);
+
+	// --- buffer receive (discarded when not wanted) ---
+	if ( length > 0 ) {
+		if ( (request->buf != NULL) && (length <= request->rxlen) ) {
+			if ( raid_rx_bytes(ch, request->buf, length) != 0 ) {
 				logMessage(LOG_ERROR_LEVEL, "Network : Error receiving buffer confirmation.");
 				return(-1);
 			}
-			data = ntohll64(data);
-			logMessage(LOG_INFO_LEVEL, "Network : Buffer received.");
+		} else if ( raid_rx_bytes(ch, NULL, length) != 0 ) {
+			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving buffer confirmation.");
+			return(-1);
 		}
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully received data from server.");
+	}
 
+	// The request is answered
+	RAID_STATS_RESPONSE(ntohll64(request->header[0]), request->response, request->sent);
+	RAID_STATS_TRACE(RAID_TRACE_RESPONSE, request->response, request->tag);
+	ch->inflight_bytes -= request->rxlen;
+	ch->next_response++;
+	disk_inflight[request->disk]--;
+	if ( (request->detached != RAID_ATTACHED) || request->abandoned ) {
+		if ( RAID_OPCODE_RESULT(request->response) && !request->abandoned ) {
+			logMessage(LOG_ERROR_LEVEL, "Network : Detached request %lld failed.", (long long)request->tag);
+			detached_failures[request->detached]++;
+		}
+		request->state = RAID_SLOT_FREE;
+	} else {
+		request->state = RAID_SLOT_DONE;
+	}
+	return(0);
+}
 
-		// Close connection with server
-		close(socket_fd);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_channel_drain
+// Description  : Wait for every request in a channel pipeline to be answered
+//
+// Inputs       : ch - the channel to drain
+// Outputs      : 0 if successful, -1 if failure
 
-		// Return response opcode
-		return( response_op );
-	
-	}
-	else {
-		// data transfer to server
-		logMessage(LOG_INFO_LEVEL, "Network : Starting data transfer to server....");
-		// --- opcode transfer ---
-		data = htonll64(op);	// convert opcode to network byte order and send it
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending opcode to server.");
-			return(-1);
-		}
-		logMessage(LOG_INFO_LEVEL, "Network : OTHER Opcode sent.");
+static int raid_channel_drain(RAID_CLIENT_CHANNEL *ch) {
 
-		// --- length transfer ---
-		data = htonll64(0);	// send 0 because buf has 0 length for INIT
-		if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error sending length of buf to server.");
+	while ( ch->next_response != ch->next_seq ) {
+		if ( raid_client_receive(ch) != 0 ) {
 			return(-1);
 		}
-		logMessage(LOG_INFO_LEVEL, "Network : Length sent.");
+	}
+	return(0);
+}
 
-		// --- buffer transfer ---
-	//	data = htonll64(0);
-	//	if ( write(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-	//		logMessage(LOG_ERROR_LEVEL, "Network : Error sending buffer data to server.");
-	//		return(-1);
-	//	}
-	//	logMessage(LOG_INFO_LEVEL, "Network : Buffer sent.");
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully transferred data to server.");
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_tx_queue
+// Description  : Add a piece of a frame to the list of bytes a channel sends
+//
+// Inputs       : ch - the channel sending the bytes
+//                buf - the memory to send (must stay valid until flushed)
+//                len - the number of bytes to send
+// Outputs      : none
+
+static void raid_tx_queue(RAID_CLIENT_CHANNEL *ch, void *buf, uint64_t len) {
+
+	// Never more than a header and a payload per request in the pipeline
+	assert(ch->tx_iovcnt < RAID_CLIENT_MAX_IOV);
+	ch->tx_iov[ch->tx_iovcnt].iov_base = buf;
+	ch->tx_iov[ch->tx_iovcnt].iov_len = len;
+	ch->tx_iovcnt++;
+}
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_tx_flush
+// Description  : Send every frame queued on a channel with as few writev()
+//                calls as the socket allows, resuming after short writes
+//
+// Inputs       : ch - the channel to flush
+// Outputs      : 0 if successful, -1 if failure
 
-		// data transfer from server
-		logMessage(LOG_INFO_LEVEL, "Network : Starting to receive data from server....");
-		// --- opcode receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving opcode confirmation.");
-			return(-1);
+static int raid_tx_flush(RAID_CLIENT_CHANNEL *ch) {
+
+	struct iovec *iov = ch->tx_iov;
+	int iovcnt = ch->tx_iovcnt;
+	ssize_t sent;
+
+	while ( iovcnt > 0 ) {
+		sent = writev(ch->socket_fd, iov, iovcnt);
+		if ( (sent < 0) && (errno == EINTR) ) {
+			continue;
 		}
-		response_op = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Opcode received.");
-		
-		// --- length receive ---
-		if ( read(socket_fd, &data, sizeof(data)) != sizeof(data) ) {
-			logMessage(LOG_ERROR_LEVEL, "Network : Error receiving length confirmation.");
+		if ( sent <= 0 ) {
 			return(-1);
 		}
-		data = ntohll64(data);
-		logMessage(LOG_INFO_LEVEL, "Network : Length received.");
 
-		// --- buffer receive ---
-		if (data > 0) {
-			if ( read(socket_fd, buf, data) != data ) {
-				logMessage(LOG_ERROR_LEVEL, "Network : Error receiving buffer confirmation.");
-				return(-1);
-			}
-			data = ntohll64(data);
-			logMessage(LOG_INFO_LEVEL, "Network : Buffer received.");
+		// Skip what was sent, the last piece may be partly sent
+		while ( (iovcnt > 0) && ((size_t)sent >= iov->iov_len) ) {
+			sent -= iov->iov_len;
+			iov++;
+			iovcnt--;
 		}
-		logMessage(LOG_INFO_LEVEL, "Network : ....Successfully received data from server.");
-
+		if ( iovcnt > 0 ) {
+			iov->iov_base = (char *)iov->iov_base + sent;
+			iov->iov_len -= sent;
+		}
+	}
+	ch->tx_iovcnt = 0;
+	ch->tx_stage_used = 0;
+	return(0);
+}
 
-		// Return response opcode
-		return( response_op );
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_rx_bytes
+// Description  : Get exactly len bytes of a channel response stream, first
+//                from the receive buffer, then from the socket. Each readv()
+//                fills the destination and whatever follows it goes to the
+//                receive buffer, so one call often brings in several responses.
+//
+// Inputs       : ch - the channel to receive from
+//                buf - the memory to receive into (NULL to discard the bytes)
+//                len - the number of bytes to receive
+// Outputs      : 0 if successful, -1 if failure
+
+static int raid_rx_bytes(RAID_CLIENT_CHANNEL *ch, void *buf, uint64_t len) {
+
+	struct iovec iov[2];
+	uint64_t chunk;
+	ssize_t got;
+	int iovcnt;
+
+	while ( len > 0 ) {
+
+		// Use up the buffered bytes first
+		if ( ch->rx_head != ch->rx_tail ) {
+			chunk = (len < ch->rx_tail - ch->rx_head) ? len : ch->rx_tail - ch->rx_head;
+			if ( buf != NULL ) {
+				memcpy(buf, &ch->rx_buf[ch->rx_head], chunk);
+				buf = (char *)buf + chunk;
+			}
+			ch->rx_head += chunk;
+			len -= chunk;
+			continue;
+		}
 
+		// Buffer is empty, read straight into the destination and spill the rest
+		ch->rx_head = ch->rx_tail = 0;
+		iovcnt = 0;
+		if ( buf != NULL ) {
+			iov[iovcnt].iov_base = buf;
+			iov[iovcnt].iov_len = len;
+			iovcnt++;
+		}
+		iov[iovcnt].iov_base = ch->rx_buf;
+		iov[iovcnt].iov_len = sizeof(ch->rx_buf);
+		iovcnt++;
+		got = readv(ch->socket_fd, iov, iovcnt);
+		if ( (got < 0) && (errno == EINTR) ) {
+			continue;
+		}
+		if ( got <= 0 ) {
+			return(-1);
+		}
+		if ( buf != NULL ) {
+			chunk = ((uint64_t)got < len) ? (uint64_t)got : len;
+			buf = (char *)buf + chunk;
+			len -= chunk;
+			got -= chunk;
+		}
+		ch->rx_tail = got;
 	}
-
 	return(0);
-
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_client_unpark
+// Description  : Take the response of a request out of the parked responses of
+//                a channel
+//
+// Inputs       : ch - the channel of the request
+//                tag - the request
+//                response - where the response opcode goes
+// Outputs      : 0 if it was parked, -1 if not
+
+static int raid_client_unpark(RAID_CLIENT_CHANNEL *ch, RAIDRequestTag tag, RAIDOpCode *response) {
 
+	int i;
 
+	for ( i = 0; i < ch->parked_count; i++ ) {
+		if ( ch->parked[i].tag == tag ) {
+			*response = ch->parked[i].response;
+			ch->parked[i] = ch->parked[--ch->parked_count];
+			return(0);
+		}
+	}
+	return(-1);
+}
@@ -0,0 +1,244 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_compress.c
+//  Description    : This is the implementation of the compression of the blocks
+//                   kept by the second tier of the cache.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Thursday, October 15th 2026
+// ****************************************************************************
+// Blocks are compressed in the LZ4 block format: a sequence of a token (the
+// number of literals in the high four bits, the length of the match less four
+// in the low four, 15 meaning more length bytes follow, each adding up to 255),
+// the literals, and the offset of the match back in the output (two bytes,
+// little endian). The last sequence has literals only, the last five bytes of
+// the input are always literals and the last match starts at least twelve bytes
+// before its end, as the format asks. Matches are found with a single probe of
+// a table of the last position of each hash of four bytes (the greedy parse of
+// LZ4 "fast"), which is as much as a 1 KiB block needs: compressing one takes
+// under a microsecond, decompressing it about half that, three orders of
+// magnitude below reading it from its disk.
+
+
+// Includes
+#include <string.h>
+
+// Project includes
+#include <raid_compress.h>
+
+// Defines
+#define LZ4_MIN_MATCH		4	// shortest match
+#define LZ4_LAST_LITERALS	5	// the input ends with literals
+#define LZ4_MATCH_LIMIT		12	// the last match starts this far from the end
+#define LZ4_MAX_OFFSET		65535	// farthest match
+#define LZ4_HASH_BITS		10	// slots of the match table (log2)
+#define LZ4_RUN_MASK		15	// length in the token that continues in bytes
+
+// Function Prototypes:
+uint32_t compress_read32(const uint8_t *p);
+uint32_t compress_hash(uint32_t word);
+uint8_t *compress_length(uint8_t *op, int length);
+// -----------------------------
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_compress
+// Description  : Compress a buffer in the LZ4 block format
+//
+// Inputs       : src - the buffer
+//                len - its length in bytes (at most 64 KiB)
+//                dst - memory for the compressed buffer
+//                max - its size
+// Outputs      : the length compressed, 0 if it does not fit in max
+
+int raid_compress(const void *src, int len, void *dst, int max) {
+
+	const uint8_t	*in = src, *ip = in, *anchor = in, *ref, *end = in + len;
+	const uint8_t	*match_limit = end - LZ4_MATCH_LIMIT, *copy_limit = end - LZ4_LAST_LITERALS;
+	uint8_t		*out = dst, *op = out, *token;
+	uint16_t	table[1 << LZ4_HASH_BITS];	// position of the last four bytes of each hash
+	uint32_t	hash;
+	int		literals, length;
+
+	if ((len < 0) || (len > LZ4_MAX_OFFSET + 1)) {
+		return(0);
+	}
+	memset(table, 0, sizeof(table));
+
+	// Find the matches, leaving the end to the last literals
+	while ((len > LZ4_MATCH_LIMIT) && (ip < match_limit)) {
+		hash = compress_hash(compress_read32(ip));
+		ref = in + table[hash];
+		table[hash] = (uint16_t)(ip - in);
+		if ((ref >= ip) || (compress_read32(ref) != compress_read32(ip))) {
+			ip++;
+			continue;
+		}
+
+		// take in the bytes before it that match too, then the bytes after
+		while ((ip > anchor) && (ref > in) && (ip[-1] == ref[-1])) {
+			ip--;
+			ref--;
+		}
+		for (length = LZ4_MIN_MATCH; (ip + length < copy_limit) && (ip[length] == ref[length]); length++);
+
+		// literals and match, if they fit (the worst case of the lengths)
+		literals = (int)(ip - anchor);
+		if ((op - out) + 1 + literals / 255 + 1 + literals + 2 + (length - LZ4_MIN_MATCH) / 255 + 1 > max) {
+			return(0);
+		}
+		token = op++;
+		*token = (uint8_t)(((literals < LZ4_RUN_MASK) ? literals : LZ4_RUN_MASK) << 4);
+		if (literals >= LZ4_RUN_MASK) {
+			op = compress_length(op, literals - LZ4_RUN_MASK);
+		}
+		memcpy(op, anchor, literals);
+		op += literals;
+		*op++ = (uint8_t)((ip - ref) & 0xFF);
+		*op++ = (uint8_t)((ip - ref) >> 8);
+		length -= LZ4_MIN_MATCH;
+		*token |= (uint8_t)((length < LZ4_RUN_MASK) ? length : LZ4_RUN_MASK);
+		if (length >= LZ4_RUN_MASK) {
+			op = compress_length(op, length - LZ4_RUN_MASK);
+		}
+		ip += length + LZ4_MIN_MATCH;
+		anchor = ip;
+	}
+
+	// The rest are the last literals
+	literals = (int)(end - anchor);
+	if ((op - out) + 1 + literals / 255 + 1 + literals > max) {
+		return(0);
+	}
+	token = op++;
+	*token = (uint8_t)(((literals < LZ4_RUN_MASK) ? literals : LZ4_RUN_MASK) << 4);
+	if (literals >= LZ4_RUN_MASK) {
+		op = compress_length(op, literals - LZ4_RUN_MASK);
+	}
+	memcpy(op, anchor, literals);
+	op += literals;
+	return((int)(op - out));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_decompress
+// Description  : Decompress a buffer in the LZ4 block format, checking every
+//                length and offset against the buffers
+//
+// Inputs       : src - the compressed buffer
+//                len - its length in bytes
+//                dst - memory for the buffer
+//                max - its size
+// Outputs      : the length decompressed, -1 if corrupt or over max
+
+int raid_decompress(const void *src, int len, void *dst, int max) {
+
+	const uint8_t	*ip = src, *end = ip + len;
+	uint8_t		*out = dst, *op = out, *ref;
+	int		token, literals, length, offset, byte;
+
+	while (ip < end) {
+		token = *ip++;
+
+		// the literals
+		literals = token >> 4;
+		if (literals == LZ4_RUN_MASK) {
+			do {
+				if (ip >= end) {
+					return(-1);
+				}
+				byte = *ip++;
+				literals += byte;
+			} while (byte == 255);
+		}
+		if ((literals > end - ip) || (literals > max - (op - out))) {
+			return(-1);
+		}
+		memcpy(op, ip, literals);
+		op += literals;
+		ip += literals;
+		if (ip == end) {
+			break;		// the last sequence has no match
+		}
+
+		// the match, which may overlap what it copies
+		if (end - ip < 2) {
+			return(-1);
+		}
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		length = token & LZ4_RUN_MASK;
+		if (length == LZ4_RUN_MASK) {
+			do {
+				if (ip >= end) {
+					return(-1);
+				}
+				byte = *ip++;
+				length += byte;
+			} while (byte == 255);
+		}
+		length += LZ4_MIN_MATCH;
+		if ((offset == 0) || (offset > op - out) || (length > max - (op - out))) {
+			return(-1);
+		}
+		ref = op - offset;
+		if (offset >= 8) {
+			for (; length >= 8; length -= 8, op += 8, ref += 8) {
+				memcpy(op, ref, 8);	// the 8 bytes copied are behind op already
+			}
+		}
+		for (; length > 0; length--) {
+			*op++ = *ref++;
+		}
+	}
+	return((int)(op - out));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compress_read32
+// Description  : Four bytes of a buffer, unaligned
+//
+// Inputs       : p - the bytes
+// Outputs      : the word
+
+uint32_t compress_read32(const uint8_t *p) {
+
+	uint32_t	word;
+
+	memcpy(&word, p, sizeof(word));
+	return(word);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compress_hash
+// Description  : Slot of four bytes in the match table (Knuth's multiplicative
+//                hash, the top bits)
+//
+// Inputs       : word - the bytes
+// Outputs      : the slot
+
+uint32_t compress_hash(uint32_t word) {
+	return((word * 2654435761U) >> (32 - LZ4_HASH_BITS));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compress_length
+// Description  : Write the rest of a length that does not fit its token
+//
+// Inputs       : op - where it goes
+//                length - the length less LZ4_RUN_MASK
+// Outputs      : the byte after it
+
+uint8_t *compress_length(uint8_t *op, int length) {
+
+	for (; length >= 255; length -= 255) {
+		*op++ = 255;
+	}
+	*op++ = (uint8_t)length;
+	return(op);
+}
@@ -0,0 +1,26 @@
+#ifndef RAID_COMPRESS_INCLUDED
+#define RAID_COMPRESS_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_compress.h
+//  Description    : This is the header file for the compression of the blocks
+//                   kept by the second tier of the cache (LZ4 block format).
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Thursday, October 15th 2026
+//
+
+// Includes
+#include <stdint.h>
+
+///
+// Compression Interfaces
+
+int raid_compress(const void *src, int len, void *dst, int max);
+	// Compress a buffer of up to 64 KiB, the length compressed or 0 if more than max
+
+int raid_decompress(const void *src, int len, void *dst, int max);
+	// Decompress a buffer, the length decompressed or -1 if it is corrupt or over max
+
+#endif
@@ -0,0 +1,184 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_map.c
+//  Description    : This is the implementation of the reverse map of the
+//                   TAGLINE driver.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+// ****************************************************************************
+// The taglines map each tagline block to the RAID blocks of its two copies;
+// this map goes the other way, so what a disk holds is found without going
+// through every tagline. Each RAID block has an entry with the tag and tagline
+// block it holds, and each disk has a bitmap of the entries in use (one bit per
+// RAID block) and a count of them. Going through a disk skips 64 unused blocks
+// per word of the bitmap, and a run of consecutive blocks in use is the stretch
+// between a set bit and the next clear one, which is what multi-block transfers
+// of the disk are made of.
+
+
+// Includes
+#include <string.h>
+
+// Project includes
+#include <cmpsc311_log.h>
+#include <raid_map.h>
+
+// Defines
+#define MAP_WORD_BITS		64				// blocks per word of a bitmap
+#define MAP_WORDS		(RAID_DISKBLOCKS / MAP_WORD_BITS)	// words of the bitmap of a disk
+
+// Data Structures Definitions
+//	Entry of a RAID block
+typedef struct {
+	TagLineNumber		tag;		// tagline the block belongs to
+	TagLineBlockNumber	bnum;		// block of the tagline
+} MAP_ENTRY;
+// -----------------------------
+
+// Function Prototypes:
+int map_next_bit(RAIDDiskID dsk, RAIDBlockID from, int set);
+// -----------------------------
+
+// Data Structures - Declarations
+static MAP_ENTRY		entries[RAID_DISKS][RAID_DISKBLOCKS];	// tagline block held by each RAID block
+static uint64_t			in_use[RAID_DISKS][MAP_WORDS];		// bit set for each entry in use
+static uint32_t			blocks_in_use[RAID_DISKS];		// entries in use of each disk
+// -----------------------------
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : init_raid_map
+// Description  : Clear the map, no RAID block holds a tagline block
+//
+// Inputs       : N/A
+// Outputs      : N/A
+void init_raid_map(void) {
+	memset(entries, 0, sizeof(entries));
+	memset(in_use, 0, sizeof(in_use));
+	memset(blocks_in_use, 0, sizeof(blocks_in_use));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_map_set
+// Description  : Record that a RAID block holds (a copy of) a tagline block
+//
+// Inputs       : dsk - this is the disk number of the RAID block
+//                blk - this is the block number of the RAID block
+//                tag - the tagline of the block it holds
+//                bnum - the block of the tagline it holds
+// Outputs      : 0 if successful, -1 if the RAID block does not exist
+int raid_map_set(RAIDDiskID dsk, RAIDBlockID blk, TagLineNumber tag, TagLineBlockNumber bnum) {
+	uint64_t bit;
+
+	if ((dsk >= RAID_DISKS) || (blk >= RAID_DISKBLOCKS)) {
+		logMessage(LOG_ERROR_LEVEL, "RAID map : no block %u on disk %u", blk, dsk);
+		return(-1);
+	}
+	bit = (uint64_t)1 << (blk % MAP_WORD_BITS);
+	if (!(in_use[dsk][blk / MAP_WORD_BITS] & bit)) {
+		in_use[dsk][blk / MAP_WORD_BITS] |= bit;
+		blocks_in_use[dsk]++;
+	}
+	entries[dsk][blk].tag = tag;
+	entries[dsk][blk].bnum = bnum;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_map_lookup
+// Description  : Find the tagline block held by a RAID block
+//
+// Inputs       : dsk - this is the disk number of the RAID block
+//                blk - this is the block number of the RAID block
+//                tag - set to the tagline of the block it holds
+//                bnum - set to the block of the tagline it holds
+// Outputs      : 0 if found, -1 if the RAID block holds no tagline block
+int raid_map_lookup(RAIDDiskID dsk, RAIDBlockID blk, TagLineNumber *tag, TagLineBlockNumber *bnum) {
+	if ((dsk >= RAID_DISKS) || (blk >= RAID_DISKBLOCKS) ||
+			!(in_use[dsk][blk / MAP_WORD_BITS] & ((uint64_t)1 << (blk % MAP_WORD_BITS)))) {
+		return(-1);
+	}
+	*tag = entries[dsk][blk].tag;
+	*bnum = entries[dsk][blk].bnum;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_map_blocks
+// Description  : Number of RAID blocks of a disk holding a tagline block
+//
+// Inputs       : dsk - this is the disk number
+// Outputs      : the number of blocks in use
+uint32_t raid_map_blocks(RAIDDiskID dsk) {
+	return((dsk < RAID_DISKS) ? blocks_in_use[dsk] : 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_map_next_run
+// Description  : Find the first run of consecutive RAID blocks holding tagline
+//                blocks that starts at or after a block of a disk
+//
+// Inputs       : dsk - this is the disk number
+//                from - the first block to look at
+//                max_blocks - the longest run to return
+//                start - set to the first block of the run
+//                blocks - set to the number of blocks of the run
+// Outputs      : 0 if a run was found, -1 if no block from there on is in use
+int raid_map_next_run(RAIDDiskID dsk, RAIDBlockID from, uint32_t max_blocks, RAIDBlockID *start, uint32_t *blocks) {
+	int first, end;
+
+	if ((dsk >= RAID_DISKS) || (max_blocks == 0)) {
+		return(-1);
+	}
+	first = map_next_bit(dsk, from, 1);
+	if (first < 0) {
+		return(-1);
+	}
+	end = map_next_bit(dsk, first, 0);
+	if (end < 0) {
+		end = RAID_DISKBLOCKS;
+	}
+	*start = first;
+	*blocks = ((uint32_t)(end - first) < max_blocks) ? (uint32_t)(end - first) : max_blocks;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : map_next_bit
+// Description  : Find the first block at or after a block of a disk whose bit
+//                in the bitmap is set (or clear), a word at a time
+//
+// Inputs       : dsk - this is the disk number
+//                from - the first block to look at
+//                set - 1 to look for a block in use, 0 for a block not in use
+// Outputs      : the block found, -1 if there is none
+int map_next_bit(RAIDDiskID dsk, RAIDBlockID from, int set) {
+	uint32_t	word;
+	uint64_t	bits;
+
+	if (from >= RAID_DISKBLOCKS) {
+		return(-1);
+	}
+	word = from / MAP_WORD_BITS;
+	// the bits of the blocks before from are masked out of the first word
+	bits = (set ? in_use[dsk][word] : ~in_use[dsk][word]) & (~(uint64_t)0 << (from % MAP_WORD_BITS));
+	while (bits == 0) {
+		if (++word == MAP_WORDS) {
+			return(-1);
+		}
+		bits = set ? in_use[dsk][word] : ~in_use[dsk][word];
+	}
+	return(word * MAP_WORD_BITS + __builtin_ctzll(bits));
+}
@@ -0,0 +1,38 @@
+#ifndef RAID_MAP_INCLUDED
+#define RAID_MAP_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_map.h
+//  Description    : This is the header file for the reverse map of the TAGLINE
+//                   driver, from the RAID blocks to the tagline blocks they hold.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+//
+
+// Includes
+#include <tagline_driver.h>
+
+///
+// Map Interfaces
+// The map has no lock of its own: the driver sets entries while scheduling
+// blocks (under its scheduling lock), and enumerates a disk with the
+// foreground reads/writes stopped.
+
+void init_raid_map(void);
+	// Clear the map, no RAID block holds a tagline block
+
+int raid_map_set(RAIDDiskID dsk, RAIDBlockID blk, TagLineNumber tag, TagLineBlockNumber bnum);
+	// Record that a RAID block holds (a copy of) a tagline block
+
+int raid_map_lookup(RAIDDiskID dsk, RAIDBlockID blk, TagLineNumber *tag, TagLineBlockNumber *bnum);
+	// Find the tagline block held by a RAID block
+
+uint32_t raid_map_blocks(RAIDDiskID dsk);
+	// Number of RAID blocks of a disk holding a tagline block
+
+int raid_map_next_run(RAIDDiskID dsk, RAIDBlockID from, uint32_t max_blocks, RAIDBlockID *start, uint32_t *blocks);
+	// Find the next run of consecutive RAID blocks of a disk holding tagline blocks
+
+#endif
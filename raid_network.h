@@ -18,10 +18,31 @@
 // Defines
 #define RAID_DEFAULT_IP "127.0.0.1"
 #define RAID_DEFAULT_PORT 19878
+#define RAID_DEFAULT_CONNECTIONS 1	// the server services one connection at a time
+#define RAID_MAX_CONNECTIONS 16		// largest pool of connections to the server
+
+// Type definitions
+typedef int64_t RAIDRequestTag;	// Identifies a request submitted to the server
+
+// Who submits a detached request (its failures are counted apart for each)
+typedef enum {
+	RAID_ATTACHED         = 0,	// not detached, completed by the caller
+	RAID_DETACHED_CACHE   = 1,	// write backs of the cache
+	RAID_DETACHED_REBUILD = 2,	// writes of a rebuild
+	RAID_DETACHED_MAXVAL  = 3,	// Max value
+} RAID_DETACHED_CLASS;
+
+// How requests pick a connection of the pool
+typedef enum {
+	RAID_ROUTE_BY_DISK     = 0,	// disk ID modulo the number of connections
+	RAID_ROUTE_ROUND_ROBIN = 1,	// next connection, unless the disk has requests in flight
+} RAID_NETWORK_ROUTING;
 
 // Address information
 extern unsigned char *raid_network_address;  // Address of RAID server
 extern unsigned short raid_network_port;     // Port of RAID server
+extern unsigned short raid_network_connections; // Connections in the pool (0 for the default)
+extern RAID_NETWORK_ROUTING raid_network_routing; // How requests pick a connection
 
 //
 // Functional Prototypes
@@ -29,4 +50,37 @@ extern unsigned short raid_network_port;     // Port of RAID server
 RAIDOpCode client_raid_bus_request(RAIDOpCode op, void *buf);
     // This is the implementation of the client operation (raid_client.c)
 
+RAIDRequestTag client_raid_bus_submit(RAIDOpCode op, void *buf, RAID_DETACHED_CLASS detached);
+    // Send a request without waiting for the response, returns its tag
+
+int client_raid_bus_flush(void);
+    // Send the submitted requests still queued on the client
+
+int client_raid_bus_poll(RAIDRequestTag tag);
+    // Collect arrived responses without blocking, 1 if the request is complete
+
+int client_raid_bus_wait(RAIDRequestTag tag, int timeout);
+    // Collect responses for up to timeout milliseconds, 1 if the request is complete
+
+int client_raid_bus_wait_either(RAIDRequestTag tag, RAIDRequestTag other, int timeout);
+    // Collect responses until either request is complete, 1 or 2 for the one that is
+
+int client_raid_bus_shares_channel(RAIDRequestTag tag, RAIDDiskID disk);
+    // 1 if a request for the disk would go out on the connection of tag
+
+void client_raid_bus_abandon(RAIDRequestTag tag);
+    // Give up on a request, its response is discarded when it arrives
+
+uint64_t client_raid_bus_depth(RAIDDiskID disk);
+    // Number of requests for a disk waiting for their response
+
+RAIDOpCode client_raid_bus_complete(RAIDRequestTag tag);
+    // Wait for the response of a submitted request and return it
+
+int client_raid_bus_drain(void);
+    // Wait for the responses of all the requests submitted
+
+uint64_t client_raid_bus_failures(RAID_DETACHED_CLASS detached);
+    // Number of detached requests of a submitter that failed since its last call
+
 #endif
@@ -0,0 +1,206 @@
+#ifndef RAID_OPCODE_INCLUDED
+#define RAID_OPCODE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_opcode.h
+//  Description    : This is the encoding and decoding of the RAID bus opcodes,
+//                   shared by the TAGLINE driver, its cache and the client.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+//
+// Everything here is inline and works on values (the request and response
+// structures live on the stack of the caller), so building or reading an
+// opcode allocates nothing and shares no state between threads.
+// The offset and width of each field of RAID_OPCODE_FIELDS (raid_bus.h) are
+// compile-time constants, so every pack and unpack is a constant shift and
+// mask; the layout is checked when compiling (the fields tile the 64 bits)
+// and by raid_opcode_check against the documented bit positions.
+
+// Includes
+#include <raid_bus.h>
+
+// Layout of the fields of an opcode, least significant bit of each and width
+enum {
+	RAID_OPCODE_REQTYPE_SHIFT = 56,	RAID_OPCODE_REQTYPE_WIDTH = 8,
+	RAID_OPCODE_BLOCKS_SHIFT  = 48,	RAID_OPCODE_BLOCKS_WIDTH  = 8,
+	RAID_OPCODE_DISKID_SHIFT  = 40,	RAID_OPCODE_DISKID_WIDTH  = 8,
+	RAID_OPCODE_UNUSED_SHIFT  = 33,	RAID_OPCODE_UNUSED_WIDTH  = 7,
+	RAID_OPCODE_STATUS_SHIFT  = 32,	RAID_OPCODE_STATUS_WIDTH  = 1,
+	RAID_OPCODE_BLOCKID_SHIFT = 0,	RAID_OPCODE_BLOCKID_WIDTH = 32,
+};
+_Static_assert(RAID_OPCODE_BLOCKID_SHIFT + RAID_OPCODE_BLOCKID_WIDTH == RAID_OPCODE_STATUS_SHIFT &&
+		RAID_OPCODE_STATUS_SHIFT + RAID_OPCODE_STATUS_WIDTH == RAID_OPCODE_UNUSED_SHIFT &&
+		RAID_OPCODE_UNUSED_SHIFT + RAID_OPCODE_UNUSED_WIDTH == RAID_OPCODE_DISKID_SHIFT &&
+		RAID_OPCODE_DISKID_SHIFT + RAID_OPCODE_DISKID_WIDTH == RAID_OPCODE_BLOCKS_SHIFT &&
+		RAID_OPCODE_BLOCKS_SHIFT + RAID_OPCODE_BLOCKS_WIDTH == RAID_OPCODE_REQTYPE_SHIFT &&
+		RAID_OPCODE_REQTYPE_SHIFT + RAID_OPCODE_REQTYPE_WIDTH == 64,
+		"the opcode fields must tile the 64 bits");
+
+// Defines
+#define RAID_OPCODE_MASK(f)		((((RAIDOpCode)1 << f##_WIDTH) - 1) << f##_SHIFT)	// bits of field f
+#define RAID_OPCODE_GET(op, f)		(((RAIDOpCode)(op) & RAID_OPCODE_MASK(f)) >> f##_SHIFT)	// value of field f
+#define RAID_OPCODE_PUT(v, f)		(((RAIDOpCode)(v) << f##_SHIFT) & RAID_OPCODE_MASK(f))	// field f holding v
+#define RAID_OPCODE_TYPE(op)		((uint8_t)RAID_OPCODE_GET(op, RAID_OPCODE_REQTYPE))	// request type field of an opcode
+#define RAID_OPCODE_NBLOCKS(op)		((uint8_t)RAID_OPCODE_GET(op, RAID_OPCODE_BLOCKS))	// number of blocks field of an opcode
+#define RAID_OPCODE_DISK(op)		((RAIDDiskID)RAID_OPCODE_GET(op, RAID_OPCODE_DISKID))	// disk ID field of an opcode
+#define RAID_OPCODE_RESULT(op)		((uint8_t)RAID_OPCODE_GET(op, RAID_OPCODE_STATUS))	// result bit of an opcode (1 is failure)
+#define RAID_OPCODE_BLOCK(op)		((RAIDBlockID)RAID_OPCODE_GET(op, RAID_OPCODE_BLOCKID))	// block ID field of an opcode
+
+// RAID bus opcode definition
+typedef struct {
+	uint8_t		request_type;		// 8 bits
+	uint8_t		number_of_blocks;	// 8 bits
+	RAIDDiskID 	disk_number;		// 8 bits
+	uint8_t		reserved;		// 7 bits
+	uint8_t		status;			// 1 bit
+	RAIDBlockID	blockid;		// 32 bits
+} RAID_REQUEST, RAID_RESPONSE;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : generate_RAIDOpCode
+// Description  : generate a raid opcode for a particular set of values
+//
+// Inputs       : opcode - pointer to a structure that contains the fields that make up the opcode
+// Outputs      : the opcode
+
+static inline RAIDOpCode generate_RAIDOpCode(const RAID_REQUEST *opcode) {
+	return( RAID_OPCODE_PUT(opcode->request_type, RAID_OPCODE_REQTYPE) |
+		RAID_OPCODE_PUT(opcode->number_of_blocks, RAID_OPCODE_BLOCKS) |
+		RAID_OPCODE_PUT(opcode->disk_number, RAID_OPCODE_DISKID) |
+		RAID_OPCODE_PUT(opcode->reserved, RAID_OPCODE_UNUSED) |
+		RAID_OPCODE_PUT(opcode->status, RAID_OPCODE_STATUS) |
+		RAID_OPCODE_PUT(opcode->blockid, RAID_OPCODE_BLOCKID) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : decode_RAIDOpCode
+// Description  : decode a raid opcode into its fields
+//
+// Inputs       : opcode - RAIDOpCode to decode
+//                response - pointer to a struct that will store the decoded values
+// Outputs      : N/A
+
+static inline void decode_RAIDOpCode(RAIDOpCode opcode, RAID_RESPONSE *response) {
+	response->request_type = RAID_OPCODE_TYPE(opcode);
+	response->number_of_blocks = RAID_OPCODE_NBLOCKS(opcode);
+	response->disk_number = RAID_OPCODE_DISK(opcode);
+	response->reserved = (uint8_t)RAID_OPCODE_GET(opcode, RAID_OPCODE_UNUSED);
+	response->status = RAID_OPCODE_RESULT(opcode);
+	response->blockid = RAID_OPCODE_BLOCK(opcode);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_opcode
+// Description  : generate the opcode of a request (status and reserved bits clear)
+//
+// Inputs       : type - the request type
+//                blocks - number of blocks (tracks for RAID_INIT)
+//                disk - the disk (number of disks for RAID_INIT)
+//                block - the first block
+// Outputs      : the opcode
+
+static inline RAIDOpCode raid_opcode(RAID_REQUEST_TYPES type, uint8_t blocks, RAIDDiskID disk, RAIDBlockID block) {
+	return( RAID_OPCODE_PUT(type, RAID_OPCODE_REQTYPE) | RAID_OPCODE_PUT(blocks, RAID_OPCODE_BLOCKS) |
+		RAID_OPCODE_PUT(disk, RAID_OPCODE_DISKID) | RAID_OPCODE_PUT(block, RAID_OPCODE_BLOCKID) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_opcode_encode
+// Description  : generate the opcodes of an array of requests (e.g., a batch
+//                going down the pipeline together)
+//
+// Inputs       : requests - the fields of the requests
+//                ops - where the opcodes go
+//                count - number of requests
+// Outputs      : N/A
+
+static inline void raid_opcode_encode(const RAID_REQUEST *requests, RAIDOpCode *ops, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		ops[i] = generate_RAIDOpCode(&requests[i]);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_opcode_decode
+// Description  : decode an array of opcodes (e.g., the responses of a batch)
+//
+// Inputs       : ops - the opcodes
+//                responses - where the decoded fields go
+//                count - number of opcodes
+// Outputs      : N/A
+
+static inline void raid_opcode_decode(const RAIDOpCode *ops, RAID_RESPONSE *responses, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		decode_RAIDOpCode(ops[i], &responses[i]);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_opcode_check
+// Description  : check the codec against the bit layout documented in raid_bus.h
+//                (each field with all its bits set lands on its documented bits,
+//                and every field survives an encode and decode)
+//
+// Inputs       : none
+// Outputs      : 0 if the layout matches, -1 if not
+
+static inline int raid_opcode_check(void) {
+	RAID_REQUEST	request = { 0xFF, 0, 0, 0, 0, 0 };
+	RAID_RESPONSE	response;
+
+	// bits 0-7 of the drawing (the most significant) are the request type, then the
+	// number of blocks and the disk number, the result bit ends the first word and
+	// the block ID is the second word
+	if (generate_RAIDOpCode(&request) != 0xFF00000000000000ULL) {
+		return(-1);
+	}
+	request.request_type = 0;
+	request.number_of_blocks = 0xFF;
+	if (generate_RAIDOpCode(&request) != 0x00FF000000000000ULL) {
+		return(-1);
+	}
+	request.number_of_blocks = 0;
+	request.disk_number = 0xFF;
+	if (generate_RAIDOpCode(&request) != 0x0000FF0000000000ULL) {
+		return(-1);
+	}
+	request.disk_number = 0;
+	request.status = 1;
+	if (generate_RAIDOpCode(&request) != 0x0000000100000000ULL) {
+		return(-1);
+	}
+	request.status = 0;
+	request.blockid = 0xFFFFFFFF;
+	if (generate_RAIDOpCode(&request) != 0x00000000FFFFFFFFULL) {
+		return(-1);
+	}
+
+	// and back
+	request.request_type = RAID_WRITE;
+	request.number_of_blocks = 0xA5;
+	request.disk_number = 0x5A;
+	request.reserved = 0x55;
+	request.status = 1;
+	request.blockid = 0xDEADBEEF;
+	decode_RAIDOpCode(generate_RAIDOpCode(&request), &response);
+	if ((response.request_type != request.request_type) || (response.number_of_blocks != request.number_of_blocks) ||
+			(response.disk_number != request.disk_number) || (response.reserved != request.reserved) ||
+			(response.status != request.status) || (response.blockid != request.blockid)) {
+		return(-1);
+	}
+	return(0);
+}
+
+#endif
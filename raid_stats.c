@@ -0,0 +1,300 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_stats.c
+//  Description    : This is the implementation of the statistics of the RAID
+//                   requests of the TAGLINE driver, and their trace.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+// ****************************************************************************
+// For each request type the number of requests, their payload and their
+// latency (from submission to response, in ticks of raid_stats_now converted to
+// nanoseconds when logged) are counted; for each disk the requests, how many
+// were waiting for it when each was submitted, and the failed responses.
+//
+// The trace is a ring of the last RAID_STATS_TRACE_SIZE events. A thread
+// recording an event takes the next position with an atomic increment and
+// publishes the event by writing its sequence number last, so the ring can be
+// dumped while it is recorded in: events being overwritten are skipped.
+
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// Project includes
+#include <cmpsc311_log.h>
+#include <raid_opcode.h>
+#include <raid_stats.h>
+
+// Global data
+int raid_stats_tracing = 0;
+
+#ifdef RAID_STATS
+
+// Data Structures Definitions
+//	Requests of a type
+typedef struct {
+	uint64_t	requests;	// requests submitted
+	uint64_t	bytes;		// payload of the reads and writes
+	uint64_t	responses;	// responses received
+	uint64_t	ticks;		// latency of all of them
+	uint64_t	max_ticks;	// the longest
+} RAID_STATS_TYPE;
+//	Requests of a disk
+typedef struct {
+	uint64_t	requests;	// requests submitted
+	uint64_t	depth;		// requests waiting for the disk when each was submitted
+	uint64_t	max_depth;	// the most of them
+	uint64_t	errors;		// failed responses
+} RAID_STATS_DISK;
+//	Event of the trace
+typedef struct {
+	uint64_t	seq;		// position of the event + 1 once written (0 while it is)
+	uint64_t	time;		// raid_stats_now when it happened
+	RAIDOpCode	op;		// request or response opcode
+	int64_t		tag;		// tag of the request
+	uint8_t		event;		// RAID_TRACE_EVENT
+} RAID_STATS_TRACE_ENTRY;
+
+static const char		*type_labels[RAID_MAXVAL] = {	// RAID_REQUEST_TYPE_LABELS is the server's
+	"RAID_INIT", "RAID_CLOSE", "RAID_FORMAT", "RAID_READ", "RAID_WRITE", "RAID_HASHBLOCK", "RAID_STATUS", "RAID_DISKFAIL"
+};
+static RAID_STATS_TYPE		type_stats[RAID_MAXVAL];
+static RAID_STATS_DISK		disk_stats[RAID_STATS_MAX_DISKS];
+static RAID_STATS_TRACE_ENTRY	trace[RAID_STATS_TRACE_SIZE];
+static uint64_t			trace_next = 0;			// position of the next event
+static uint64_t			start_ticks = 0;		// raid_stats_now at the reset
+static struct timespec		start_time;			// and the monotonic clock
+
+// Function Prototypes:
+double stats_tick_nsec(void);
+RAID_STATS_DISK *stats_disk(RAIDOpCode op);
+// -----------------------------
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_stats_reset
+// Description  : Forget every count (not the trace), and start timing
+//
+// Inputs       : none
+// Outputs      : N/A
+
+void raid_stats_reset(void) {
+	memset(type_stats, 0, sizeof(type_stats));
+	memset(disk_stats, 0, sizeof(disk_stats));
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+	start_ticks = raid_stats_now();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stats_disk
+// Description  : The counters of the disk a request goes to (RAID_INIT and
+//                RAID_CLOSE go to none, the disk field of RAID_INIT is the
+//                number of disks)
+//
+// Inputs       : op - the request opcode
+// Outputs      : the counters, NULL if the request has no disk
+
+RAID_STATS_DISK *stats_disk(RAIDOpCode op) {
+	if ((RAID_OPCODE_TYPE(op) == RAID_INIT) || (RAID_OPCODE_TYPE(op) == RAID_CLOSE)) {
+		return(NULL);
+	}
+	return(&disk_stats[RAID_OPCODE_DISK(op)]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_stats_submit
+// Description  : Count a request submitted (the client lock held)
+//
+// Inputs       : op - the request opcode
+//                depth - requests for its disk waiting for their response
+// Outputs      : N/A
+
+void raid_stats_submit(RAIDOpCode op, uint64_t depth) {
+
+	RAID_STATS_TYPE	*type = &type_stats[RAID_OPCODE_TYPE(op) % RAID_MAXVAL];
+	RAID_STATS_DISK	*disk = stats_disk(op);
+
+	type->requests++;
+	if ((RAID_OPCODE_TYPE(op) == RAID_READ) || (RAID_OPCODE_TYPE(op) == RAID_WRITE)) {
+		type->bytes += (uint64_t)RAID_OPCODE_NBLOCKS(op) * RAID_BLOCK_SIZE;
+	}
+	if (disk == NULL) {
+		return;
+	}
+	disk->requests++;
+	disk->depth += depth;
+	if (depth > disk->max_depth) {
+		disk->max_depth = depth;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_stats_response
+// Description  : Count the response to a request (the client lock held)
+//
+// Inputs       : op - the request opcode
+//                response - the response opcode
+//                ticks - time since the request was submitted
+// Outputs      : N/A
+
+void raid_stats_response(RAIDOpCode op, RAIDOpCode response, uint64_t ticks) {
+
+	RAID_STATS_TYPE	*type = &type_stats[RAID_OPCODE_TYPE(op) % RAID_MAXVAL];
+	RAID_STATS_DISK	*disk = stats_disk(op);
+
+	type->responses++;
+	type->ticks += ticks;
+	if (ticks > type->max_ticks) {
+		type->max_ticks = ticks;
+	}
+	if (RAID_OPCODE_RESULT(response) && (disk != NULL)) {
+		disk->errors++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_stats_trace
+// Description  : Record an event in the trace (any thread, no lock)
+//
+// Inputs       : event - the event
+//                op - the request or response opcode
+//                tag - the tag of the request
+// Outputs      : N/A
+
+void raid_stats_trace(RAID_TRACE_EVENT event, RAIDOpCode op, int64_t tag) {
+
+	uint64_t		seq = __atomic_fetch_add(&trace_next, 1, __ATOMIC_RELAXED);
+	RAID_STATS_TRACE_ENTRY	*entry = &trace[seq & (RAID_STATS_TRACE_SIZE - 1)];
+
+	__atomic_store_n(&entry->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	entry->time = raid_stats_now();
+	entry->op = op;
+	entry->tag = tag;
+	entry->event = event;
+	__atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_stats_log
+// Description  : Log the counts of each request type and of each disk used
+//
+// Inputs       : none
+// Outputs      : N/A
+
+void raid_stats_log(void) {
+
+	double	nsec = stats_tick_nsec();
+	int	i;
+
+	logMessage(LOG_OUTPUT_LEVEL, "** RAID Request Statistics **");
+	for (i = 0; i < RAID_MAXVAL; i++) {
+		if (type_stats[i].requests == 0) {
+			continue;
+		}
+		logMessage(LOG_OUTPUT_LEVEL, "%-12s %8lu requests, %10lu bytes, latency avg %.1f us, max %.1f us",
+				type_labels[i], (unsigned long)type_stats[i].requests, (unsigned long)type_stats[i].bytes,
+				(type_stats[i].responses > 0) ? type_stats[i].ticks * nsec / type_stats[i].responses / 1e3 : 0,
+				type_stats[i].max_ticks * nsec / 1e3);
+	}
+	for (i = 0; i < RAID_STATS_MAX_DISKS; i++) {
+		if (disk_stats[i].requests == 0) {
+			continue;
+		}
+		logMessage(LOG_OUTPUT_LEVEL, "Disk %3d     %8lu requests, queue depth avg %.1f, max %lu, %lu errors", i,
+				(unsigned long)disk_stats[i].requests, disk_stats[i].depth / (double)disk_stats[i].requests,
+				(unsigned long)disk_stats[i].max_depth, (unsigned long)disk_stats[i].errors);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_stats_trace_dump
+// Description  : Write the events in the trace to a file, oldest first, one a
+//                line: time (ns since the reset), event, request type, disk,
+//                block, blocks, tag and result
+//
+// Inputs       : filename - the file to write
+// Outputs      : 0 if successful, -1 if failure
+
+int raid_stats_trace_dump(const char *filename) {
+
+	RAID_STATS_TRACE_ENTRY	entry;
+	FILE			*fhandle;
+	double			nsec = stats_tick_nsec();
+	uint64_t		next = __atomic_load_n(&trace_next, __ATOMIC_ACQUIRE);
+	uint64_t		seq, first = (next > RAID_STATS_TRACE_SIZE) ? next - RAID_STATS_TRACE_SIZE : 0;
+
+	if ((fhandle = fopen(filename, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening the trace file [%s], error: %s.",
+			filename, strerror(errno));
+		return(-1);
+	}
+	for (seq = first; seq < next; seq++) {
+		// copy the event, and keep it only if it was not rewritten meanwhile
+		entry.seq = __atomic_load_n(&trace[seq & (RAID_STATS_TRACE_SIZE - 1)].seq, __ATOMIC_ACQUIRE);
+		entry.time = trace[seq & (RAID_STATS_TRACE_SIZE - 1)].time;
+		entry.op = trace[seq & (RAID_STATS_TRACE_SIZE - 1)].op;
+		entry.tag = trace[seq & (RAID_STATS_TRACE_SIZE - 1)].tag;
+		entry.event = trace[seq & (RAID_STATS_TRACE_SIZE - 1)].event;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if ((entry.seq != seq + 1) ||
+				(__atomic_load_n(&trace[seq & (RAID_STATS_TRACE_SIZE - 1)].seq, __ATOMIC_RELAXED) != seq + 1)) {
+			continue;
+		}
+		fprintf(fhandle, "%.0f %s %s %u %u %u %lld %u\n", (entry.time - start_ticks) * nsec,
+				(entry.event == RAID_TRACE_SUBMIT) ? "submit" : "response",
+				type_labels[RAID_OPCODE_TYPE(entry.op) % RAID_MAXVAL], RAID_OPCODE_DISK(entry.op),
+				RAID_OPCODE_BLOCK(entry.op), RAID_OPCODE_NBLOCKS(entry.op), (long long)entry.tag,
+				RAID_OPCODE_RESULT(entry.op));
+	}
+	if (fclose(fhandle) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing the trace file [%s], error: %s.",
+			filename, strerror(errno));
+		return(-1);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stats_tick_nsec
+// Description  : Nanoseconds of a tick of raid_stats_now, measured since the reset
+//
+// Inputs       : none
+// Outputs      : the nanoseconds
+
+double stats_tick_nsec(void) {
+
+	struct timespec	now;
+	uint64_t	ticks = raid_stats_now() - start_ticks;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return((ticks > 0) ? ((now.tv_sec - start_time.tv_sec) * 1e9 + (now.tv_nsec - start_time.tv_nsec)) / ticks : 0);
+}
+
+#else
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_stats_trace_dump
+// Description  : Without RAID_STATS nothing is traced
+//
+// Inputs       : filename - the file to write
+// Outputs      : -1
+
+int raid_stats_trace_dump(const char *filename) {
+	logMessage(LOG_ERROR_LEVEL, "No trace to write to [%s], the driver is built without RAID_STATS.", filename);
+	return(-1);
+}
+
+#endif
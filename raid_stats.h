@@ -0,0 +1,104 @@
+#ifndef RAID_STATS_INCLUDED
+#define RAID_STATS_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : raid_stats.h
+//  Description    : This is the header file for the statistics of the RAID
+//                   requests of the TAGLINE driver, and their trace.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+//
+// Everything here is used through the RAID_STATS_* macros, which compile to
+// nothing unless RAID_STATS is defined (the Makefile does, make STATS= does
+// not). The counters are updated by the client with its lock held; the trace
+// is a lock-free ring any thread may record in, only when raid_stats_tracing
+// is set.
+
+// Includes
+#include <stdint.h>
+#include <time.h>
+#include <raid_bus.h>
+#include <cmpsc311_log.h>
+#if defined(RAID_STATS) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+// Defines
+#define RAID_STATS_MAX_DISKS	256	// disk IDs an opcode can address
+#define RAID_STATS_TRACE_SIZE	4096	// events kept by the trace (a power of two)
+
+// Log messages of the paths run for every block, formatted only when they are logged
+#define RAID_LOG_HOT(...)	do { if (levelEnabled(LOG_INFO_LEVEL)) { logMessage(LOG_INFO_LEVEL, __VA_ARGS__); } } while (0)
+
+// Events of the trace
+typedef enum {
+	RAID_TRACE_SUBMIT   = 0,	// a request is submitted (its opcode)
+	RAID_TRACE_RESPONSE = 1,	// its response arrives (the response opcode)
+	RAID_TRACE_MAXVAL   = 2,	// Max value
+} RAID_TRACE_EVENT;
+extern int raid_stats_tracing;		// 1 when the trace records events (0 by default)
+
+///
+// Statistics Interfaces
+
+int raid_stats_trace_dump(const char *filename);
+	// Write the events in the trace to a file, oldest first
+
+#ifdef RAID_STATS
+
+void raid_stats_reset(void);
+	// Forget every count, and start timing
+
+void raid_stats_submit(RAIDOpCode op, uint64_t depth);
+	// Count a request submitted, with the requests already waiting for its disk
+
+void raid_stats_response(RAIDOpCode op, RAIDOpCode response, uint64_t ticks);
+	// Count the response to a request, ticks after it was submitted
+
+void raid_stats_trace(RAID_TRACE_EVENT event, RAIDOpCode op, int64_t tag);
+	// Record an event in the trace
+
+void raid_stats_log(void);
+	// Log the counts of each request type and each disk
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : raid_stats_now
+// Description  : the clock request latencies are measured with (the time stamp
+//                counter where there is one, nanoseconds otherwise)
+//
+// Inputs       : none
+// Outputs      : the time, in ticks
+
+static inline uint64_t raid_stats_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return(__rdtsc());
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec);
+#endif
+}
+
+#define RAID_STATS_NOW()			raid_stats_now()
+#define RAID_STATS_RESET()			raid_stats_reset()
+#define RAID_STATS_SUBMIT(op, depth)		raid_stats_submit(op, depth)
+#define RAID_STATS_RESPONSE(op, response, sent)	raid_stats_response(op, response, raid_stats_now() - (sent))
+#define RAID_STATS_TRACE(event, op, tag)	do { if (raid_stats_tracing) { raid_stats_trace(event, op, tag); } } while (0)
+#define RAID_STATS_LOG()			raid_stats_log()
+
+#else
+
+#define RAID_STATS_NOW()			0
+#define RAID_STATS_RESET()			((void)0)
+#define RAID_STATS_SUBMIT(op, depth)		((void)0)
+#define RAID_STATS_RESPONSE(op, response, sent)	((void)0)
+#define RAID_STATS_TRACE(event, op, tag)	((void)0)
+#define RAID_STATS_LOG()			((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,414 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : tagline_checkpoint.c
+//  Description    : This is the implementation of the checkpoint of the tagline
+//                   map of the TAGLINE driver, and its journal.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Thursday, October 15th 2026
+// ****************************************************************************
+// The map of every tagline block to the RAID blocks of its two copies is
+// written to a checkpoint file when the driver closes, the blocks of all the
+// taglines back to back after the number of blocks of each. Each block appended
+// to a tagline after that, or overwritten (its checksum changes), is recorded in
+// a journal next to the checkpoint, so the next start maps both files, takes the
+// blocks of the checkpoint and then the records of the journal, and resumes on
+// the disks as they are instead of formatting them. An overwrite is recorded
+// before the cache writes it back, so its record keeps the checksum of the old
+// contents too and the resume takes whichever the copies hold.
+//
+// A checkpoint is written to a temporary file renamed over the old one, so a
+// checkpoint file is always whole; its generation goes up with each one, and a
+// journal of another generation (left from before the last checkpoint) is
+// ignored. Journal records are buffered and reach the file as the buffer fills
+// and when the journal is closed, a crash loses at most the last few, as it
+// loses the blocks still dirty in the write-back cache.
+
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Project includes
+#include <cmpsc311_log.h>
+#include <tagline_checkpoint.h>
+
+// Defines
+#define CHECKPOINT_TEMP_SUFFIX	".tmp"	// a checkpoint is written to the file name and this
+#define CHECKPOINT_MAX_PATH	4096	// longest name of a checkpoint file, suffix included
+
+// Function Prototypes:
+int checkpoint_path(char *path, const char *suffix);
+void *checkpoint_map(const char *path, size_t *size);
+// -----------------------------
+
+// Data Structures - Declarations
+char				*tagline_checkpoint_file = NULL;	// checkpoint of the tagline map
+static uint32_t			generation = 0;		// generation of the checkpoint in use
+static FILE			*checkpoint_out = NULL;	// checkpoint being written
+static uint64_t			checkpoint_left = 0;	// blocks it still needs
+static FILE			*journal = NULL;	// journal of the checkpoint in use
+// -----------------------------
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_checkpoint_load
+// Description  : Map the checkpoint of a number of taglines and its journal, if
+//                there is one (of the same array geometry and taglines)
+//
+// Inputs       : taglines - the number of taglines of the driver
+//                ckpt - set to the mapped checkpoint
+// Outputs      : 0 if there is a checkpoint to resume from, -1 if not
+
+int tagline_checkpoint_load(uint32_t taglines, TAGLINE_CHECKPOINT *ckpt) {
+
+	char				path[CHECKPOINT_MAX_PATH];
+	const TAGLINE_CHECKPOINT_HEADER	*header;
+	const TAGLINE_JOURNAL_HEADER	*journal_header;
+	uint64_t			blocks = 0;
+	uint32_t			tag;
+
+	memset(ckpt, 0, sizeof(TAGLINE_CHECKPOINT));
+	if ((tagline_checkpoint_file == NULL) || (checkpoint_path(path, "") != 0)) {
+		return(-1);
+	}
+	ckpt->map = checkpoint_map(path, &ckpt->map_size);
+	if (ckpt->map == NULL) {
+		logMessage(LOG_INFO_LEVEL, "No tagline checkpoint [%s] to resume from.", path);
+		return(-1);
+	}
+
+	// the checkpoint must be of this array, these taglines and whole
+	header = ckpt->map;
+	if ((ckpt->map_size < sizeof(TAGLINE_CHECKPOINT_HEADER)) || (header->magic != TAGLINE_CHECKPOINT_MAGIC) ||
+			(header->version != TAGLINE_CHECKPOINT_VERSION) || (header->disks != RAID_DISKS) ||
+			(header->disk_blocks != RAID_DISKBLOCKS) || (header->taglines != taglines) ||
+			(ckpt->map_size != sizeof(TAGLINE_CHECKPOINT_HEADER) + (uint64_t)taglines*sizeof(uint32_t) +
+				header->blocks*sizeof(TAGLINE_CHECKPOINT_BLOCK))) {
+		logMessage(LOG_ERROR_LEVEL, "Tagline checkpoint [%s] does not match the driver, not resuming.", path);
+		tagline_checkpoint_unmap(ckpt);
+		return(-1);
+	}
+	ckpt->header = header;
+	ckpt->counts = (const uint32_t *)(header + 1);
+	ckpt->blocks = (const TAGLINE_CHECKPOINT_BLOCK *)(ckpt->counts + taglines);
+	for (tag = 0; tag < taglines; tag++) {
+		blocks += ckpt->counts[tag];
+	}
+	if (blocks != header->blocks) {
+		logMessage(LOG_ERROR_LEVEL, "Tagline checkpoint [%s] is corrupted, not resuming.", path);
+		tagline_checkpoint_unmap(ckpt);
+		return(-1);
+	}
+	generation = header->generation;
+
+	// and the journal of the blocks appended or overwritten since, if it follows this checkpoint
+	if (checkpoint_path(path, TAGLINE_JOURNAL_SUFFIX) == 0) {
+		ckpt->journal_map = checkpoint_map(path, &ckpt->journal_size);
+	}
+	journal_header = ckpt->journal_map;
+	if ((journal_header != NULL) && (ckpt->journal_size >= sizeof(TAGLINE_JOURNAL_HEADER)) &&
+			(journal_header->magic == TAGLINE_JOURNAL_MAGIC) && (journal_header->version == TAGLINE_CHECKPOINT_VERSION) &&
+			(journal_header->generation == generation)) {
+		ckpt->records = (const TAGLINE_JOURNAL_RECORD *)(journal_header + 1);
+		ckpt->record_count = (ckpt->journal_size - sizeof(TAGLINE_JOURNAL_HEADER)) / sizeof(TAGLINE_JOURNAL_RECORD);
+	}
+	logMessage(LOG_INFO_LEVEL, "Tagline checkpoint [%s]: %lu blocks of %u taglines, %u journaled since.",
+			tagline_checkpoint_file, (unsigned long)header->blocks, taglines, ckpt->record_count);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_checkpoint_unmap
+// Description  : Release a mapped checkpoint
+//
+// Inputs       : ckpt - the checkpoint
+// Outputs      : N/A
+
+void tagline_checkpoint_unmap(TAGLINE_CHECKPOINT *ckpt) {
+
+	if (ckpt->map != NULL) {
+		munmap(ckpt->map, ckpt->map_size);
+	}
+	if (ckpt->journal_map != NULL) {
+		munmap(ckpt->journal_map, ckpt->journal_size);
+	}
+	memset(ckpt, 0, sizeof(TAGLINE_CHECKPOINT));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_checkpoint_begin
+// Description  : Start writing a new checkpoint (to the temporary file), with
+//                the number of blocks of each tagline
+//
+// Inputs       : taglines - the number of taglines
+//                counts - the blocks of each tagline (NULL if they have none)
+// Outputs      : 0 if successful, -1 if failure
+
+int tagline_checkpoint_begin(uint32_t taglines, const uint32_t *counts) {
+
+	char				path[CHECKPOINT_MAX_PATH];
+	TAGLINE_CHECKPOINT_HEADER	header;
+	uint32_t			tag, zero = 0;
+
+	if ((tagline_checkpoint_file == NULL) || (checkpoint_path(path, CHECKPOINT_TEMP_SUFFIX) != 0)) {
+		return(-1);
+	}
+	memset(&header, 0, sizeof(header));
+	header.magic = TAGLINE_CHECKPOINT_MAGIC;
+	header.version = TAGLINE_CHECKPOINT_VERSION;
+	header.disks = RAID_DISKS;
+	header.disk_blocks = RAID_DISKBLOCKS;
+	header.taglines = taglines;
+	header.generation = generation + 1;
+	for (tag = 0; (counts != NULL) && (tag < taglines); tag++) {
+		header.blocks += counts[tag];
+	}
+
+	if ((checkpoint_out = fopen(path, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening the tagline checkpoint [%s], error: %s.",
+			path, strerror(errno));
+		return(-1);
+	}
+	if (fwrite(&header, sizeof(header), 1, checkpoint_out) != 1) {
+		fclose(checkpoint_out);
+		checkpoint_out = NULL;
+		logMessage(LOG_ERROR_LEVEL, "Failure writing the tagline checkpoint [%s].", path);
+		return(-1);
+	}
+	for (tag = 0; tag < taglines; tag++) {
+		if (fwrite((counts != NULL) ? &counts[tag] : &zero, sizeof(uint32_t), 1, checkpoint_out) != 1) {
+			fclose(checkpoint_out);
+			checkpoint_out = NULL;
+			logMessage(LOG_ERROR_LEVEL, "Failure writing the tagline checkpoint [%s].", path);
+			return(-1);
+		}
+	}
+	checkpoint_left = header.blocks;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_checkpoint_block
+// Description  : Write the next block of the checkpoint (the blocks of the
+//                first tagline in order, then of the next one, ...)
+//
+// Inputs       : block - where the copies of the block are
+// Outputs      : 0 if successful, -1 if failure
+
+int tagline_checkpoint_block(const TAGLINE_CHECKPOINT_BLOCK *block) {
+
+	if ((checkpoint_out == NULL) || (checkpoint_left == 0) ||
+			(fwrite(block, sizeof(TAGLINE_CHECKPOINT_BLOCK), 1, checkpoint_out) != 1)) {
+		return(-1);
+	}
+	checkpoint_left--;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_checkpoint_commit
+// Description  : Write out the new checkpoint and rename it over the old one;
+//                the journal of the old one is removed (the journal must be
+//                closed)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure (the old checkpoint is kept)
+
+int tagline_checkpoint_commit(void) {
+
+	char	path[CHECKPOINT_MAX_PATH];
+	char	temp[CHECKPOINT_MAX_PATH];
+	int	result = 0;
+
+	if ((checkpoint_out == NULL) || (checkpoint_path(path, "") != 0) ||
+			(checkpoint_path(temp, CHECKPOINT_TEMP_SUFFIX) != 0)) {
+		return(-1);
+	}
+	if ((checkpoint_left != 0) || (fflush(checkpoint_out) != 0) || (fsync(fileno(checkpoint_out)) != 0)) {
+		result = -1;
+	}
+	if ((fclose(checkpoint_out) != 0) || (result != 0) || (rename(temp, path) != 0)) {
+		checkpoint_out = NULL;
+		logMessage(LOG_ERROR_LEVEL, "Failure writing the tagline checkpoint [%s], error: %s.",
+			path, strerror(errno));
+		unlink(temp);
+		return(-1);
+	}
+	checkpoint_out = NULL;
+	generation++;
+
+	// the blocks journaled are in the checkpoint now
+	if (checkpoint_path(path, TAGLINE_JOURNAL_SUFFIX) == 0) {
+		unlink(path);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_journal_open
+// Description  : Open the journal of the checkpoint in use for appending, after
+//                the records loaded with it (dropping a torn last record), or a
+//                new one if none were
+//
+// Inputs       : records - the number of records loaded with the checkpoint
+// Outputs      : 0 if successful, -1 if failure
+
+int tagline_journal_open(uint32_t records) {
+
+	char			path[CHECKPOINT_MAX_PATH];
+	TAGLINE_JOURNAL_HEADER	header;
+
+	if ((tagline_checkpoint_file == NULL) || (checkpoint_path(path, TAGLINE_JOURNAL_SUFFIX) != 0)) {
+		return(-1);
+	}
+	if (records > 0) {
+		if ((truncate(path, sizeof(TAGLINE_JOURNAL_HEADER) + (off_t)records*sizeof(TAGLINE_JOURNAL_RECORD)) != 0) ||
+				((journal = fopen(path, "a")) == NULL)) {
+			logMessage(LOG_ERROR_LEVEL, "Failure opening the tagline journal [%s], error: %s.",
+				path, strerror(errno));
+			return(-1);
+		}
+		return(0);
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = TAGLINE_JOURNAL_MAGIC;
+	header.version = TAGLINE_CHECKPOINT_VERSION;
+	header.generation = generation;
+	if ((journal = fopen(path, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening the tagline journal [%s], error: %s.",
+			path, strerror(errno));
+		return(-1);
+	}
+	if (fwrite(&header, sizeof(header), 1, journal) != 1) {
+		fclose(journal);
+		journal = NULL;
+		logMessage(LOG_ERROR_LEVEL, "Failure writing the tagline journal [%s].", path);
+		return(-1);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_journal_append
+// Description  : Record a block appended to a tagline, or overwritten (nothing
+//                is recorded without a journal open)
+//
+// Inputs       : tag - the tagline
+//                bnum - the block appended or overwritten
+//                block - where its copies are
+//                old_checksum - checksum of the contents overwritten, NULL if
+//                               the block is appended
+// Outputs      : 0 if successful, -1 if failure
+
+int tagline_journal_append(TagLineNumber tag, TagLineBlockNumber bnum, const TAGLINE_CHECKPOINT_BLOCK *block,
+		const uint32_t *old_checksum) {
+
+	TAGLINE_JOURNAL_RECORD	record;
+
+	if (journal == NULL) {
+		return(0);
+	}
+	memset(&record, 0, sizeof(record));
+	record.tag = tag;
+	record.bnum = bnum;
+	record.block = *block;
+	if (old_checksum != NULL) {
+		record.overwrite = 1;
+		record.old_checksum = *old_checksum;
+	}
+	if (fwrite(&record, sizeof(record), 1, journal) != 1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing the tagline journal, error: %s.", strerror(errno));
+		return(-1);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_journal_close
+// Description  : Write out the records still buffered and close the journal
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int tagline_journal_close(void) {
+
+	int result = 0;
+
+	if (journal == NULL) {
+		return(0);
+	}
+	if (fclose(journal) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing the tagline journal, error: %s.", strerror(errno));
+		result = -1;
+	}
+	journal = NULL;
+	return(result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checkpoint_path
+// Description  : Make the name of a file of the checkpoint
+//
+// Inputs       : path - where the name goes (CHECKPOINT_MAX_PATH bytes)
+//                suffix - added to the name of the checkpoint file
+// Outputs      : 0 if successful, -1 if the name is too long
+
+int checkpoint_path(char *path, const char *suffix) {
+
+	if (snprintf(path, CHECKPOINT_MAX_PATH, "%s%s", tagline_checkpoint_file, suffix) >= CHECKPOINT_MAX_PATH) {
+		logMessage(LOG_ERROR_LEVEL, "Tagline checkpoint file name too long [%s].", tagline_checkpoint_file);
+		return(-1);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checkpoint_map
+// Description  : Map a file of the checkpoint, read only
+//
+// Inputs       : path - the name of the file
+//                size - set to the size of the file
+// Outputs      : the mapped file, NULL if it does not exist or is empty
+
+void *checkpoint_map(const char *path, size_t *size) {
+
+	struct stat	st;
+	void		*map;
+	int		fd;
+
+	*size = 0;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return(NULL);
+	}
+	if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		close(fd);
+		return(NULL);
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		logMessage(LOG_ERROR_LEVEL, "Failure mapping [%s], error: %s.", path, strerror(errno));
+		return(NULL);
+	}
+	*size = st.st_size;
+	return(map);
+}
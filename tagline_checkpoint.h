@@ -0,0 +1,112 @@
+#ifndef TAGLINE_CHECKPOINT_INCLUDED
+#define TAGLINE_CHECKPOINT_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : tagline_checkpoint.h
+//  Description    : This is the header file for the checkpoint of the tagline
+//                   map of the TAGLINE driver, and its journal.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Thursday, October 15th 2026
+//
+
+// Includes
+#include <stddef.h>
+#include <tagline_driver.h>
+
+// Defines
+#define TAGLINE_CHECKPOINT_MAGIC	0x4b43544c	// "LTCK", first word of a checkpoint
+#define TAGLINE_JOURNAL_MAGIC		0x4e4a544c	// "LTJN", first word of a journal
+#define TAGLINE_CHECKPOINT_VERSION	4	// 2: the blocks carry their checksum, 3: overwrites are journaled,
+						// 4: with the checksum of the contents they replace
+#define TAGLINE_JOURNAL_SUFFIX		".journal"	// the journal is the checkpoint file name and this
+
+// Where the copies of a tagline block are, and the checksum of its contents
+typedef struct {
+	RAIDDiskID		disk;		// disk of the primary
+	RAIDDiskID		backup_disk;	// disk of the backup
+	uint16_t		unused;
+	RAIDBlockID		block;		// block of the primary
+	RAIDBlockID		backup_block;	// block of the backup
+	uint32_t		checksum;	// checksum of the contents (raid_checksum)
+} TAGLINE_CHECKPOINT_BLOCK;
+
+// A checkpoint file is its header, the number of blocks of each tagline and then
+// the blocks of every tagline, one tagline after the other
+typedef struct {
+	uint32_t		magic;		// TAGLINE_CHECKPOINT_MAGIC
+	uint32_t		version;	// TAGLINE_CHECKPOINT_VERSION
+	uint32_t		disks;		// RAID_DISKS
+	uint32_t		disk_blocks;	// RAID_DISKBLOCKS
+	uint32_t		taglines;	// number of taglines
+	uint32_t		generation;	// the journal of the blocks added since carries it too
+	uint64_t		blocks;		// blocks of all the taglines
+} TAGLINE_CHECKPOINT_HEADER;
+
+// A journal file is its header and then one record for each block appended to a
+// tagline since the checkpoint, or overwritten (its copies where they were, with
+// the checksums of its new contents and of the ones they replace: the record
+// reaches the file before the cache writes the block back, so a resume may find
+// either on the disks)
+typedef struct {
+	uint32_t		magic;		// TAGLINE_JOURNAL_MAGIC
+	uint32_t		version;	// TAGLINE_CHECKPOINT_VERSION
+	uint32_t		generation;	// generation of the checkpoint it follows
+	uint32_t		unused;
+} TAGLINE_JOURNAL_HEADER;
+
+typedef struct {
+	TagLineNumber		tag;		// tagline the block was appended to (or overwritten in)
+	uint16_t		overwrite;	// 1 if the block was overwritten
+	TagLineBlockNumber	bnum;		// block of the tagline
+	TAGLINE_CHECKPOINT_BLOCK block;		// where its copies are
+	uint32_t		old_checksum;	// checksum of the contents overwritten (0 if appended)
+} TAGLINE_JOURNAL_RECORD;
+
+// A checkpoint and its journal, mapped to resume from
+typedef struct {
+	const TAGLINE_CHECKPOINT_HEADER	*header;
+	const uint32_t			*counts;	// blocks of each tagline
+	const TAGLINE_CHECKPOINT_BLOCK	*blocks;	// the blocks, tagline after tagline
+	const TAGLINE_JOURNAL_RECORD	*records;	// blocks appended since, in order
+	uint32_t			record_count;	// number of records (a torn last one is left out)
+	void				*map;		// the mapped checkpoint
+	size_t				map_size;
+	void				*journal_map;	// the mapped journal
+	size_t				journal_size;
+} TAGLINE_CHECKPOINT;
+
+extern char *tagline_checkpoint_file;	// checkpoint of the tagline map (NULL for none, the default)
+
+///
+// Checkpoint Interfaces
+// The journal has no lock of its own, the driver appends to it while scheduling
+// blocks (under its scheduling lock).
+
+int tagline_checkpoint_load(uint32_t taglines, TAGLINE_CHECKPOINT *ckpt);
+	// Map the checkpoint of a number of taglines and its journal, if there is one
+
+void tagline_checkpoint_unmap(TAGLINE_CHECKPOINT *ckpt);
+	// Release a mapped checkpoint
+
+int tagline_checkpoint_begin(uint32_t taglines, const uint32_t *counts);
+	// Start writing a new checkpoint, with the number of blocks of each tagline (NULL for none)
+
+int tagline_checkpoint_block(const TAGLINE_CHECKPOINT_BLOCK *block);
+	// Write the next block of the checkpoint
+
+int tagline_checkpoint_commit(void);
+	// Replace the checkpoint with the one written, its journal starts over
+
+int tagline_journal_open(uint32_t records);
+	// Open the journal of the checkpoint, keeping the records that were loaded
+
+int tagline_journal_append(TagLineNumber tag, TagLineBlockNumber bnum, const TAGLINE_CHECKPOINT_BLOCK *block,
+		const uint32_t *old_checksum);
+	// Record a block appended to a tagline, or overwritten (old_checksum not NULL)
+
+int tagline_journal_close(void);
+	// Write out the records still buffered and close the journal
+
+#endif
@@ -18,43 +18,72 @@
 // Include Files
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <cmpsc311_log.h>
 
 // Project Includes
 #include "raid_bus.h"
+#include "raid_opcode.h"
 #include "tagline_driver.h"
+#include "raid_map.h"
+#include "raid_alloc.h"
+#include "tagline_histogram.h"
+#include "raid_stats.h"
+#include "tagline_checkpoint.h"
+#include "raid_checksum.h"
 
 // Alias
 typedef char bitfield;
 
+// Defines
+#define TAGLINE_INITIAL_BLOCKS	16	// number of block mappings allocated the first time a tag is written
+#define RAID_EXTENT_MIN_BLOCKS	8	// blocks of the first extent of a tagline, each next one is twice as long
+#define RAID_PREFETCH_MIN_BLOCKS	4	// blocks read ahead once a tagline is read sequentially
+#define RAID_PREFETCH_MAX_BLOCKS	64	// most blocks read ahead of a sequential read
+#define RAID_PREFETCH_MAX_READS		16	// most reads of read ahead in flight (of all the taglines)
+#define RAID_REBUILD_BATCH	64	// most blocks rebuilt with one write (what a detached write can hold)
+#define RAID_SCRUB_BATCH	64	// most blocks of a tagline scrubbed at once
+
 //-----------  Declaration of Structures -------------
-// RAID bus opcode definition
+// Definition of a block mapping entry, tagline block j is stored at index j of its tagline
 typedef struct {
-	uint8_t		request_type;		// 8 bits
-	uint8_t		number_of_blocks;	// 8 bits
-	RAIDDiskID 	disk_number;		// 8 bits
-	uint8_t		reserved;		// 6 bits
-	uint8_t		status;			// 1 bit
-	RAIDBlockID	blockid;		// 31 bits
-} RAID_REQUEST, RAID_RESPONSE;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Definition of a block node for a linked-list of blocks
-typedef struct block_node {
-	TagLineBlockNumber 	block;			// block j
 	RAIDDiskID 		RAID_disk;		// RAID disk where this block is mapped to
-	RAIDBlockID 		RAID_block;		// RAID block where this block is mapped to
 	RAIDDiskID		backup_disk;		// RAID disk where the BACKUP is mapped to
+	RAIDBlockID 		RAID_block;		// RAID block where this block is mapped to
 	RAIDBlockID		backup_block;		// RAID block where the BACKUP is mapped to
-	struct block_node	*next_block;		// pointer to block j+1
+	uint32_t		checksum;		// checksum of the contents last written (raid_checksum)
 } BLOCK;
 // - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Definition of a tagline node for a linked-list of taglines
-typedef struct tag_node {
-	TagLineNumber 		tagline;		// tagline i
+// Definition of an extent, a run of RAID blocks reserved for the new blocks of a tagline
+typedef struct {
+	RAIDDiskID		disk;			// RAID disk of the extent
+	RAIDBlockID		next_block;		// next RAID block to hand out
+	RAIDBlockID		end_block;		// RAID block after the last one of the extent
+	uint32_t		length;			// number of blocks asked for the extent
+} EXTENT;
+// - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Definition of the read of a run of missed blocks of a tagline read
+typedef struct {
+	RAIDRequestTag		tag;			// tag of the read
+	TagLineBlockNumber	start;			// first block of the run, in the request
+	TagLineBlockNumber	length;			// number of blocks of the run
+	int			backup;			// 1 if the run is read from the backups
+	uint64_t		sent;			// when the read was sent (tagline_histogram_now)
+} RUN_READ;
+// - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Definition of a tagline, tagline i is stored at index i of the tagline array
+typedef struct {
 	TagLineBlockNumber 	max_start_allowed;	// last block + 1, since we can't allocate a new block after that
-	uint64_t   		blocks_in_tagline;	// number of blocks in this tagline
-	struct tag_node 	*next_tagline;		// pointer to tagline i+1
-	BLOCK 		 	*block_0;		// pointer to block 0 (of tagline i)
+	TagLineBlockNumber 	block_capacity;		// number of entries allocated in blocks
+	BLOCK 		 	*blocks;		// dense array of block mappings, indexed by tagline block number
+	EXTENT			primary_extent;		// where the primary copies of new blocks go
+	EXTENT			backup_extent;		// where their backups go (never the disk of the primary)
+	TagLineBlockNumber	stream_next;		// block a sequential read of the tag starts at
+	uint32_t		stream_window;		// blocks to read ahead (0 while not read sequentially)
+	TagLineBlockNumber	prefetch_start;		// first block read ahead for the sequential reads
+	TagLineBlockNumber	prefetch_end;		// block after the last one read ahead
+	pthread_mutex_t		lock;			// taken by every read/write of the tagline
 } TAGLINE;
 // - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Definition of a scheduled block in RAID (used to schedule a spot on the RAID array,
@@ -63,75 +92,150 @@ typedef struct {
 	RAIDDiskID	disk;				// RAID disk number
 	RAIDBlockID	block;				// RAID block number for the disk specified above
 } SCHEDULED_BLOCK, BLOCK_TO_READ;			// SCHEDULED_BLOCK: for WRITEs, BLOCK_TO_READ: for READs
+// - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Definition of a block read by a rebuild from its other copy
+typedef struct {
+	RAIDDiskID	disk;				// RAID disk of the other copy
+	RAIDBlockID	block;				// RAID block of the other copy
+	int		index;				// position of the block in the rebuilt run
+	BLOCK		*mapping;			// mapping of the block (to check what is read)
+} REBUILD_READ;
+// - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Definition of a block of a vectored read not found in the cache
+typedef struct {
+	RAIDDiskID	disk;				// RAID disk of the copy read
+	RAIDBlockID	block;				// RAID block of the copy read
+	int		backup;				// 1 if the copy read is the backup
+	BLOCK		*mapping;			// mapping of the block (cached under its primary)
+	char		*buf;				// where the block goes in the segment
+	uint32_t	slot;				// block of the read buffer it is read into
+} VECTOR_READ;
+// - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Definition of the rebuild of a formatted disk
+typedef struct {
+	int		active;				// 1 while the disk is being rebuilt
+	RAIDDiskID	disk;				// disk being rebuilt
+	RAIDBlockID	next_block;			// blocks before this one are rebuilt
+	uint32_t	blocks;				// blocks rebuilt so far
+	struct timeval	start;				// when the rebuild started
+} REBUILD;
+// - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Definition of a read ahead in flight, queued until it is completed
+typedef struct prefetch {
+	TAGLINE			*tagline;		// tagline read ahead
+	int			reads;			// number of runs read
+	RUN_READ		runs[RAID_PREFETCH_MAX_READS];	// the reads of the runs of blocks not cached
+	BLOCK_TO_READ		primary[RAID_PREFETCH_MAX_BLOCKS];	// primary of each block read ahead (its cache key)
+	uint32_t		checksum[RAID_PREFETCH_MAX_BLOCKS];	// checksum of each block read ahead
+	struct prefetch		*next;			// next read ahead in the queue
+	char			buf[RAID_PREFETCH_MAX_BLOCKS*RAID_BLOCK_SIZE];	// the blocks read ahead
+} PREFETCH;
+// - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Definition of an overwrite found in the journal, settled once the journal is read
+typedef struct {
+	TagLineNumber		tag;			// tagline of the block overwritten
+	TagLineBlockNumber	bnum;			// block overwritten
+	uint32_t		record;			// position of its record in the journal
+} RESUME_OVERWRITE;
 // ---------------------------------------------------
 
 
 // --------- Declaration of static variables ---------
-// Array of integers that contains, for each disk, the block last allocated
-static int 		last_block_added[RAID_DISKS] = { [0 ... RAID_DISKS-1] = -1 };	// intialize to -1 (since blocks are 0 indexed)
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Head node of the linked-list of taglines
-static TAGLINE 		*head_tag = NULL;
+// Array of taglines, indexed by tagline number
+static TAGLINE 		*taglines = NULL;
 // - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Stores the number of taglines currently in use
 static uint32_t 	taglines_in_use = 0;
 // - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init request
-static RAID_REQUEST 	*init = NULL;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init response
-static RAID_RESPONSE 	*init_response = NULL;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for a format request
-static RAID_REQUEST	*format = NULL;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for a format response
-static RAID_RESPONSE	*format_response = NULL;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for a read request
-static RAID_REQUEST	*read = NULL;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for a read response
-static RAID_RESPONSE	*read_response = NULL;
+// Taken while scheduling blocks (the allocator and the reverse map)
+static pthread_mutex_t schedule_lock = PTHREAD_MUTEX_INITIALIZER;
 // - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init request
-static RAID_REQUEST	*close = NULL;
+// Rebuild of a formatted disk and the totals of all the rebuilds
+static REBUILD		rebuild;
+static uint32_t		rebuild_count = 0;
+static uint64_t		rebuild_blocks = 0;
+static double		rebuild_seconds = 0;
+// Taken for writing by a rebuild, and for reading by every tagline read/write
+static pthread_rwlock_t rebuild_lock = PTHREAD_RWLOCK_INITIALIZER;
 // - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init request
-static RAID_RESPONSE	*close_response = NULL;
+// Blocks rebuilt before each read/write while a disk is rebuilt (0: all at once, the
+// reads/writes waiting meanwhile)
+uint32_t		raid_rebuild_rate = RAID_REBUILD_BATCH;
 // - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init request
-static RAID_REQUEST	*status = NULL;
+// Milliseconds a read waits before the other copy is read too (0: never)
+uint32_t		raid_hedge_msec = 0;
+static uint64_t		hedged_reads = 0;		// reads that were hedged
+static uint64_t		hedge_wins = 0;			// hedged reads answered first by the other copy
+static uint64_t		prefetched_blocks = 0;		// blocks read ahead
+static uint64_t		prefetch_hits = 0;		// blocks of sequential reads in the read ahead window found cached
+static uint64_t		checksum_errors = 0;		// copies read whose checksum did not match
+static uint64_t		checksum_repairs = 0;		// bad copies written over with the good one
+static uint64_t		checksum_losses = 0;		// blocks with no good copy left
+static pthread_mutex_t	stats_lock = PTHREAD_MUTEX_INITIALIZER;	// taken to update the counters above
 // - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init request
-static RAID_RESPONSE	*status_response = NULL;
+// Tagline blocks scrubbed before each read/write (0: only when raid_scrub is called),
+// the next block to scrub and the number of blocks scrubbed
+uint32_t		raid_scrub_rate = 0;
+static TagLineNumber	scrub_tag = 0;
+static TagLineBlockNumber scrub_block = 0;
+static uint64_t		scrubbed_blocks = 0;
+// Taken by the scrub (a foreground read/write does not wait for another thread's scrub)
+static pthread_mutex_t	scrub_lock = PTHREAD_MUTEX_INITIALIZER;
 // - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init request
-static char		*temp_buf = NULL;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init request
-static char		*buf_read = NULL;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init request
-static SCHEDULED_BLOCK	*new_scheduled_block = NULL;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Pointer to a container for an init request
-static SCHEDULED_BLOCK	*new_scheduled_block_backup = NULL;
-// - - - - - - - - - - - - - - - - - - - - - - - - - -
-// Variables to schedule blocks
-static RAIDDiskID current_disk = 0;
-static RAIDBlockID current_block = 0;
+// Read ahead in flight, oldest first, and the number of reads they are waiting for
+static PREFETCH		*prefetch_head = NULL;
+static PREFETCH		*prefetch_tail = NULL;
+static int		prefetch_reads = 0;
+// Every read ahead has at least one read in flight, so this many are ever needed,
+// the ones not in the queue are linked in the free list
+static PREFETCH		prefetch_pool[RAID_PREFETCH_MAX_READS];
+static PREFETCH		*prefetch_free = NULL;
+// Taken while the queue is used and a read ahead is added to the cache (a tagline
+// write waits for it, so older contents are not added to the cache after it)
+static pthread_mutex_t	prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
 // ---------------------------------------------------
 
 
 // ------------------ Function Prototypes ------------------
-void 	free_tag_linked_list	(TAGLINE *ptr_tag);
-void 	free_block_linked_list	(BLOCK *ptr_block); 
-int 	add_new_tag		();
-int 	RAID_scheduler		(SCHEDULED_BLOCK *ptr4, RAIDDiskID);
-void 	decode_RAIDOpCode 	(RAIDOpCode, RAID_RESPONSE *ptr3);
+void 	free_taglines		(void);
+int 	append_new_block	(TAGLINE *ptr_tag);
+int 	grow_tag_blocks		(TAGLINE *ptr_tag);
+int 	tagline_write_block	(TAGLINE *ptr_tag, TagLineBlockNumber, char *);
+int 	tagline_read_blocks	(TAGLINE *ptr_tag, TagLineBlockNumber, uint8_t, char *, uint8_t *);
+void 	tagline_read_ahead	(TAGLINE *ptr_tag, TagLineBlockNumber, uint8_t, uint8_t);
+TagLineBlockNumber tagline_prefetch	(TAGLINE *ptr_tag, TagLineBlockNumber, TagLineBlockNumber);
+void 	tagline_prefetch_complete	(TAGLINE *ptr_tag);
+void 	prefetch_complete_oldest	(void);
+void 	prefetch_finish		(struct prefetch *);
+int 	raid_disks_status	(RAID_DISK_STATE *);
+int 	raid_disks_format	(const int *);
+int 	raid_rebuild_step	(uint32_t);
+int 	raid_rebuild_run	(RAIDDiskID, RAIDBlockID, uint8_t);
+int 	raid_rebuild_advance	(void);
+int 	compare_rebuild_reads	(const void *, const void *);
+int 	compare_vector_reads	(const void *, const void *);
+int 	compare_taglines	(const void *, const void *);
+int 	tagline_lock_segments	(const TAGLINE_SEGMENT *, int, TagLineNumber *);
+void 	tagline_unlock_segments	(TagLineNumber *, int);
+int 	raid_block_copy		(BLOCK *, int, BLOCK_TO_READ *);
+int 	raid_complete_read	(BLOCK *, RUN_READ *, char *);
+int 	raid_block_verify	(BLOCK *, char *);
+int 	raid_scrub_blocks	(uint32_t);
+int 	raid_scrub_run		(TAGLINE *, TagLineBlockNumber, uint32_t);
+int 	raid_scrub_advance	(void);
+int 	raid_transfer		(RAID_REQUEST_TYPES, RAIDDiskID, RAIDBlockID, uint8_t, char *);
+int 	raid_complete		(RAIDRequestTag);
+RAIDRequestTag	raid_submit	(RAID_REQUEST_TYPES, RAIDDiskID, RAIDBlockID, uint8_t, char *);
+int 	RAID_scheduler		(EXTENT *, RAIDDiskID, SCHEDULED_BLOCK *);
+void 	RAID_unschedule		(EXTENT *, SCHEDULED_BLOCK *);
 int 	check_response 		(RAID_REQUEST *ptr0, RAID_RESPONSE *ptr1); 
-RAIDOpCode 	   generate_RAIDOpCode 		(RAID_REQUEST *ptr2); 
+int 	tagline_resume		(TAGLINE_CHECKPOINT *);
+int 	tagline_resume_block	(TagLineNumber, const TAGLINE_CHECKPOINT_BLOCK *);
+int 	tagline_resume_overwrites	(TAGLINE_CHECKPOINT *);
+void 	tagline_resume_settle	(BLOCK *, const uint32_t *, int);
+int 	compare_resume_overwrites	(const void *, const void *);
+int 	tagline_checkpoint	(void);
+int 	tagline_journal_block	(TAGLINE *, TagLineBlockNumber, const uint32_t *);
 TagLineBlockNumber get_max_start_allowed	(TagLineNumber); 
 // ---------------------------------------------------------
 
@@ -143,152 +247,359 @@ TagLineBlockNumber get_max_start_allowed	(TagLineNumber);
 // Input	: N/A
 // Output	: 0 if successful, -1 if failure
 int raid_disk_signal(void) {
-	RAIDOpCode	status_opcode = 0;
-	RAIDOpCode	status_opcode_response = 0;
+	RAID_DISK_STATE	states[RAID_DISKS];
+	RAIDDiskID disk = 0;
+	int failed[RAID_DISKS];		// 1 for each disk found failed
+	int failures = 0;
+
+	// request the status of all disks at once (the foreground reads/writes go on)
+	if (raid_disks_status(states) != 0) {
+		logMessage(LOG_INFO_LEVEL, "STATUS REQUEST FAILED!!!!");
+		return(-1);
+	}
+	for (disk = 0; disk < RAID_DISKS; disk++) {
+		failed[disk] = (states[disk] == RAID_DISK_FAILED);
+		failures += failed[disk];
+	}
+	if (failures == 0) {
+		return(0);
+	}
 
-	RAIDOpCode	format_opcode = 0;
-	RAIDOpCode	format_opcode_response = 0;
+	// no foreground read/write runs while the failed disks are formatted; their rebuild
+	// then goes on raid_rebuild_rate blocks before each read/write
+	pthread_rwlock_wrlock(&rebuild_lock);
 
-	RAIDOpCode	read_opcode = 0;
-	RAIDOpCode	read_opcode_response = 0;
+	// a rebuild whose disk failed again starts over once the disk is formatted
+	if (rebuild.active && failed[rebuild.disk]) {
+		rebuild.active = 0;
+	}
+	// 0- a rebuild still going on is finished first, the disk may hold the
+	//    only copy of the blocks it has left
+	if (rebuild.active && (raid_rebuild_step(RAID_DISKBLOCKS) != 0)) {
+		pthread_rwlock_unlock(&rebuild_lock);
+		logMessage(LOG_INFO_LEVEL, "REBUILD of FAILED DISK FAILED");
+		return(-1);
+	}
+	// 1- format the failed disks, all at once
+	if (raid_disks_format(failed) != 0) {
+		pthread_rwlock_unlock(&rebuild_lock);
+		logMessage(LOG_INFO_LEVEL, "FORMATTING for FAILING DISK FAILED");
+		return(-1);	
+	}
 
-	TAGLINE	*current_tag = NULL;
-	BLOCK 	*current_block = NULL;	
+	// loop through the failed disks
+	for (disk = 0; disk < RAID_DISKS; disk++) {
+		if (failed[disk]) {
+			// the rebuild of the disk before is finished first
+			if (rebuild.active && (raid_rebuild_step(RAID_DISKBLOCKS) != 0)) {
+				pthread_rwlock_unlock(&rebuild_lock);
+				logMessage(LOG_INFO_LEVEL, "REBUILD of FAILED DISK FAILED");
+				return(-1);
+			}
+			// 2- rebuild every block the disk held from its other copy, a few blocks
+			//    before each read/write (raid_rebuild_rate), or all at once
+			rebuild.active = 1;
+			rebuild.disk = disk;
+			rebuild.next_block = 0;
+			rebuild.blocks = 0;
+			gettimeofday(&rebuild.start, NULL);
+			if ((raid_rebuild_rate == 0) && (raid_rebuild_step(RAID_DISKBLOCKS) != 0)) {
+				pthread_rwlock_unlock(&rebuild_lock);
+				logMessage(LOG_INFO_LEVEL, "REBUILD of FAILED DISK FAILED");
+				return(-1);
+			}
+		}
+	}
+	pthread_rwlock_unlock(&rebuild_lock);
+	return(0);
+}
 
-	RAID_REQUEST_TYPES request_type_status = RAID_STATUS;
-	RAID_REQUEST_TYPES request_type_format = RAID_FORMAT;
-	RAID_REQUEST_TYPES request_type_read = RAID_READ;
 
-	char *buf = NULL;
-	buf_read = malloc(sizeof(char)*RAID_BLOCK_SIZE);
-	RAIDDiskID disk = 0;
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_disks_status
+// Description  : gets the state of every disk, the RAID_STATUS requests of all the
+//		  disks encoded and sent back to back before waiting for any of their
+//		  responses, which are decoded together
+//
+// Inputs       : states - set to the state of each disk
+// Outputs      :  0 if successful
+//		  -1 if a request failed
+int raid_disks_status(RAID_DISK_STATE *states) {
+	RAIDRequestTag	tags[RAID_DISKS];
+	RAID_REQUEST	requests[RAID_DISKS];
+	RAID_RESPONSE	responses[RAID_DISKS];
+	RAIDOpCode	ops[RAID_DISKS];
+	RAIDDiskID	disk = 0;
+	int		result = 0;
+
+	memset(requests, 0, sizeof(requests));
+	for (disk = 0; disk < RAID_DISKS; disk++) {
+		requests[disk].request_type = RAID_STATUS;
+		requests[disk].disk_number = disk;
+	}
+	raid_opcode_encode(requests, ops, RAID_DISKS);
+	for (disk = 0; disk < RAID_DISKS; disk++) {
+		tags[disk] = client_raid_bus_submit(ops[disk], NULL, RAID_ATTACHED);
+		if (tags[disk] < 0) {
+			while (disk > 0) {
+				client_raid_bus_complete(tags[--disk]);
+			}
+			return(-1);
+		}
+	}
+	client_raid_bus_flush();
+	for (disk = 0; disk < RAID_DISKS; disk++) {
+		ops[disk] = client_raid_bus_complete(tags[disk]);
+	}
+	raid_opcode_decode(ops, responses, RAID_DISKS);
+	for (disk = 0; disk < RAID_DISKS; disk++) {
+		if ((responses[disk].status != 0) || (responses[disk].request_type != RAID_STATUS) ||
+				(responses[disk].disk_number != disk)) {
+			result = -1;
+		}
+		states[disk] = responses[disk].blockid;
+	}
+	return(result);
+}
+
 
-	read->request_type = request_type_read;
-	read->number_of_blocks = 1;
-	read->status = 0;
-	read->reserved = 0;
-
-	// setup opcode for status
-	status->request_type = request_type_status;
-	status->number_of_blocks = 0;
-	status->status = 0;
-	status->reserved = 0;
-	status->blockid = 0;
-
-	// setup opcode for format
-	format->request_type = request_type_format;
-	format->number_of_blocks = 0;
-	format->status = 0;
-	format->reserved = 0;
-	format->blockid = 0;
-
-	// loop through all disks
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_disks_format
+// Description  : formats a number of disks, the RAID_FORMAT requests encoded and
+//		  sent back to back before waiting for any of their responses, which
+//		  are decoded together
+//
+// Inputs       : which - 1 for each disk to format (NULL for every disk)
+// Outputs      :  0 if successful
+//		  -1 if a disk could not be formatted
+int raid_disks_format(const int *which) {
+	RAIDRequestTag	tags[RAID_DISKS];
+	RAID_REQUEST	requests[RAID_DISKS];
+	RAID_RESPONSE	responses[RAID_DISKS];
+	RAIDOpCode	ops[RAID_DISKS];
+	int		count = 0, sent = 0, i = 0, result = 0;
+	RAIDDiskID	disk = 0;
+
+	memset(requests, 0, sizeof(requests));
 	for (disk = 0; disk < RAID_DISKS; disk++) {
-		// request disk status
-		buf = NULL;
-		status->disk_number = disk;
-		status_opcode = generate_RAIDOpCode(status);
-		status_opcode_response = client_raid_bus_request(status_opcode, buf);
-		decode_RAIDOpCode(status_opcode_response, status_response);
-		if (status_response->status != 0) {
-			logMessage(LOG_INFO_LEVEL, "STATUS REQUEST FAILED!!!!");
+		if ((which != NULL) && !which[disk]) {
+			continue;
+		}
+		requests[count].request_type = RAID_FORMAT;
+		requests[count].disk_number = disk;
+		count++;
+	}
+	raid_opcode_encode(requests, ops, count);
+	for (sent = 0; sent < count; sent++) {
+		tags[sent] = client_raid_bus_submit(ops[sent], NULL, RAID_ATTACHED);
+		if (tags[sent] < 0) {
+			result = -1;
+			break;
+		}
+	}
+	client_raid_bus_flush();
+	// then gather every response (even once one failed, so none is left in flight)
+	for (i = 0; i < sent; i++) {
+		ops[i] = client_raid_bus_complete(tags[i]);
+	}
+	raid_opcode_decode(ops, responses, sent);
+	for (i = 0; i < sent; i++) {
+		if (check_response(&requests[i], &responses[i]) != 0) {
+			logMessage(LOG_INFO_LEVEL, "RAID_FORMAT of disk %u failed.", requests[i].disk_number);
+			result = -1;
+		}
+	}
+	return(result);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_rebuild_step
+// Description  : rebuilds the next blocks of the disk being rebuilt, in runs of
+//		  up to RAID_REBUILD_BATCH blocks in use, and finishes the rebuild
+//		  once the end of the disk is reached (rebuild_lock held for writing)
+//
+// Inputs       : budget - number of blocks of the disk to go over
+// Outputs      :  0 if successful
+//		  -1 if failure
+int raid_rebuild_step(uint32_t budget) {
+	RAIDBlockID	block = 0;
+	RAIDBlockID	end = 0;
+	uint32_t	run = 0;
+	struct timeval	now;
+	double		seconds = 0;
+
+	// the read ahead in flight is completed first, a run can use all the slots of a channel
+	tagline_prefetch_complete(NULL);
+	block = rebuild.next_block;
+	end = (budget < RAID_DISKBLOCKS - block) ? block + budget : RAID_DISKBLOCKS;
+	// go through the runs of blocks in use (the others were never written, the disk is formatted)
+	while ((block < end) && (raid_map_next_run(rebuild.disk, block, RAID_REBUILD_BATCH, &block, &run) == 0) &&
+			(block < end)) {
+		if (block + run > end) {
+			run = end - block;
+		}
+		if (raid_rebuild_run(rebuild.disk, block, run) != 0) {
+			logMessage(LOG_INFO_LEVEL, "ERROR: rebuilding %u blocks of disk %u at block %u", run, rebuild.disk, block);
+			return(-1);
+		}
+		rebuild.blocks += run;
+		block += run;
+	}
+	rebuild.next_block = end;
+	if (end < RAID_DISKBLOCKS) {
+		return(0);
+	}
+
+	// all the writes of the rebuild are detached, wait for them and check none of them failed
+	if ((client_raid_bus_drain() != 0) || (client_raid_bus_failures(RAID_DETACHED_REBUILD) != 0)) {
+		logMessage(LOG_INFO_LEVEL, "ERROR: a write of the rebuild of disk %u failed", rebuild.disk);
+		return(-1);
+	}
+	gettimeofday(&now, NULL);
+	seconds = (now.tv_sec - rebuild.start.tv_sec) + (now.tv_usec - rebuild.start.tv_usec) / 1000000.0;
+	logMessage(LOG_INFO_LEVEL, "TAGLINE : rebuilt %u blocks of disk %u in %.3f seconds (%.0f blocks/s)",
+			rebuild.blocks, rebuild.disk, seconds, (seconds > 0) ? rebuild.blocks / seconds : 0);
+	rebuild_count++;
+	rebuild_blocks += rebuild.blocks;
+	rebuild_seconds += seconds;
+	rebuild.active = 0;
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_rebuild_run
+// Description  : rebuilds a run of consecutive blocks of a formatted disk: each
+//		  block is taken from the cache (its lost copy or its other copy) or
+//		  else read from its other copy, the reads sorted and merged into
+//		  multi-block reads sent back to back, and the run is written to the
+//		  disk at once (detached, the cache is left alone)
+//
+// Inputs       : disk - the disk being rebuilt
+//		  start - first block of the run
+//		  blocks - number of blocks in the run, at most RAID_REBUILD_BATCH
+// Outputs      :  0 if successful
+//		  -1 if failure
+int raid_rebuild_run(RAIDDiskID disk, RAIDBlockID start, uint8_t blocks) {
+	static char	run_buf[RAID_REBUILD_BATCH*RAID_BLOCK_SIZE];	// the rebuilt run
+	static char	read_buf[RAID_REBUILD_BATCH*RAID_BLOCK_SIZE];	// blocks read, in the order of reads
+	REBUILD_READ	reads[RAID_REBUILD_BATCH];	// blocks to read from their other copy
+	RAIDRequestTag	tags[RAID_REBUILD_BATCH];	// tag of each merged read
+	BLOCK		*lost = NULL;
+	BLOCK_TO_READ	peer;
+	TagLineNumber	tag = 0;
+	TagLineBlockNumber bnum = 0;
+	int		nreads = 0, ntags = 0, i = 0, t = 0;
+	uint8_t		run = 0;
+
+	for (i = 0; i < blocks; i++) {
+		// the other copy is the one of the tagline block that is not on this disk
+		if (raid_map_lookup(disk, start + i, &tag, &bnum) != 0) {
 			return(-1);
 		}
-		// check if failed
-		if (status_response->blockid == 2) {
-			// 1- format the disk
-
-			buf = NULL;
-			format->disk_number = disk;
-			format_opcode = generate_RAIDOpCode(format);
-			format_opcode_response = client_raid_bus_request(format_opcode, buf);
-			decode_RAIDOpCode(format_opcode_response, format_response);
-			if (format_response->status != 0) {
-				logMessage(LOG_INFO_LEVEL, "FORMATTING for FAILING DISK FAILED");
-				return(-1);	
+		lost = &taglines[tag].blocks[bnum];
+		peer.disk = (lost->RAID_disk == disk) ? lost->backup_disk : lost->RAID_disk;
+		peer.block = (lost->RAID_disk == disk) ? lost->backup_block : lost->RAID_block;
+		// the block still cached (under its primary, the lost copy or the other one)
+		// is the latest contents
+		if ((peek_raid_cache(disk, start + i, run_buf+(RAID_BLOCK_SIZE*i)) == 0) ||
+				(peek_raid_cache(peer.disk, peer.block, run_buf+(RAID_BLOCK_SIZE*i)) == 0)) {
+			continue;
+		}
+		reads[nreads].disk = peer.disk;
+		reads[nreads].block = peer.block;
+		reads[nreads].index = i;
+		reads[nreads].mapping = lost;
+		nreads++;
+	}
+
+	// the other copies of a run are spread over a few disks, read each stretch
+	// of consecutive blocks of a disk at once
+	qsort(reads, nreads, sizeof(REBUILD_READ), compare_rebuild_reads);
+	for (i = 0; i < nreads; i += run) {
+		run = 1;
+		while ((i + run < nreads) && (reads[i + run].disk == reads[i].disk) &&
+				(reads[i + run].block == reads[i].block + run)) {
+			run++;
+		}
+		tags[ntags] = raid_submit(RAID_READ, reads[i].disk, reads[i].block, run, read_buf+(RAID_BLOCK_SIZE*i));
+		if (tags[ntags] < 0) {
+			for (t = 0; t < ntags; t++) {
+				raid_complete(tags[t]);
 			}
-			// 2- loop through tags and find every single backup/primary corresponding to that disk
-			current_tag = head_tag;
-			while (current_tag != NULL) {
-				current_block = current_tag->block_0;
-				while (current_block != NULL) {
-					if (current_block->RAID_disk == disk) {
-						// primary block lost, recover`
-						// read backup_disk,backup_block into buf
-						buf = NULL;
-						// Check Cache
-						buf = get_raid_cache(current_block->backup_disk, current_block->backup_block);
-						if (buf == NULL) {
-							logMessage(LOG_INFO_LEVEL, "Primary Block not in Cache, recovery from READ");
-							// Perform a read from the disk
-							read->disk_number = current_block->backup_disk;
-							read->blockid = current_block->backup_block;
-							read_opcode = generate_RAIDOpCode(read);
-							logMessage(LOG_INFO_LEVEL, "Request Type: %d", read_opcode >> 56);
-							read_opcode_response = client_raid_bus_request(read_opcode, buf_read);
-							decode_RAIDOpCode(read_opcode_response, read_response);
-							if (read_response->status != 0) {
-								logMessage(LOG_INFO_LEVEL, "READ of RECOVERY BLOCK FAILED at primary fail");
-								return(-1);
-							}
-							//Update cache
-							if (put_raid_cache(current_block->RAID_disk, current_block->RAID_block, buf_read) != 0) {
-								logMessage(LOG_ERROR_LEVEL, "Error adding backup block from recovery of primary to cache");
-								return(-1);
-							}
-						}
-						else {
- 
-							memcpy(buf_read, buf, RAID_BLOCK_SIZE);
-
-							// Update Cache
-							if (put_raid_cache(current_block->RAID_disk, current_block->RAID_block, buf_read) != 0) {
-								logMessage(LOG_INFO_LEVEL, "RECOVER WRITE of BLOCK FAILED at primary fail");
-								return(-1);
-							}		
-						}
-					}
-					else if (current_block->backup_disk == disk) {
-						// backup block lost, recover
-						// read primary_disk,primary_block into buf
-						buf = NULL;
-											
-						// Check Cache
-						buf = get_raid_cache(current_block->RAID_disk, current_block->RAID_block);
-						if (buf == NULL) {
-							logMessage(LOG_INFO_LEVEL, "Backup Block to recover, primary not in cache");
-							read->disk_number = current_block->RAID_disk;
-							read->blockid = current_block->RAID_block;
-							read_opcode = generate_RAIDOpCode(read);
-							read_opcode_response = client_raid_bus_request(read_opcode, buf_read);
-							decode_RAIDOpCode(read_opcode_response, read_response);
-							if (read_response->status != 0) {
-								logMessage(LOG_ERROR_LEVEL, "Error reading primary from disk for backup recovery");
-								return(-1);
-							}
-							if(put_raid_cache(current_block->backup_disk, current_block->backup_block, buf_read) != 0) {
-								logMessage(LOG_ERROR_LEVEL, "Error adding updated backup to cache");
-								return(-1);
-							}
-						}
-						else {
-
-							// write buf into backup_disk,backup_block 
-							// Update Cache
-							if (put_raid_cache(current_block->backup_disk, current_block->backup_block, buf) != 0) {
-								logMessage(LOG_INFO_LEVEL, "RECOVER WRITE of BLOCK FAILED at backup fail");
-								return(-1);
-							}
-						}
-					}
-					else {
-						// the block is okay!
-					}		
-					current_block = current_block->next_block;
-				}
-				current_tag = current_tag->next_tagline;
+			return(-1);
+		}
+		ntags++;
+	}
+	for (t = 0; t < ntags; t++) {
+		if (raid_complete(tags[t]) != 0) {
+			for (t++; t < ntags; t++) {
+				raid_complete(tags[t]);
 			}
+			return(-1);
+		}
+	}
+	// the other copy is the only one left, a bad one can only be reported
+	for (i = 0; i < nreads; i++) {
+		if (raid_checksum(read_buf+(RAID_BLOCK_SIZE*i), RAID_BLOCK_SIZE) != reads[i].mapping->checksum) {
+			logMessage(LOG_INFO_LEVEL, "ERROR: block %u of disk %u is lost, its only copy (disk %u, block %u) is bad",
+					start + reads[i].index, disk, reads[i].disk, reads[i].block);
+			pthread_mutex_lock(&stats_lock);
+			checksum_errors++;
+			checksum_losses++;
+			pthread_mutex_unlock(&stats_lock);
 		}
+		memcpy(run_buf+(RAID_BLOCK_SIZE*reads[i].index), read_buf+(RAID_BLOCK_SIZE*i), RAID_BLOCK_SIZE);
+	}
+
+	// write the whole run straight to the disk (checked once the rebuild is over)
+	if (client_raid_bus_submit(raid_opcode(RAID_WRITE, blocks, disk, start), run_buf, RAID_DETACHED_REBUILD) < 0) {
+		return(-1);
+	}
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_rebuild_advance
+// Description  : rebuilds raid_rebuild_rate more blocks of the disk being rebuilt,
+//		  if any, before a foreground read/write
+//
+// Inputs       : N/A
+// Outputs      :  0 if successful
+//		  -1 if failure
+int raid_rebuild_advance(void) {
+	int result = 0;
+
+	// Without a rebuild going on, the foreground threads need not serialize here
+	if ((raid_rebuild_rate == 0) || !__atomic_load_n(&rebuild.active, __ATOMIC_RELAXED)) {
+		return(0);
+	}
+	pthread_rwlock_wrlock(&rebuild_lock);
+	if (rebuild.active) {
+		result = raid_rebuild_step(raid_rebuild_rate);
+	}
+	pthread_rwlock_unlock(&rebuild_lock);
+	return(result);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : compare_rebuild_reads
+// Description  : orders the reads of a rebuild by disk and block (qsort)
+//
+// Inputs       : a, b - the two REBUILD_READs to compare
+// Outputs      : <0, 0 or >0 if a goes before, with or after b
+int compare_rebuild_reads(const void *a, const void *b) {
+	const REBUILD_READ *x = a;
+	const REBUILD_READ *y = b;
+
+	if (x->disk != y->disk) {
+		return((x->disk < y->disk) ? -1 : 1);
+	}
+	if (x->block != y->block) {
+		return((x->block < y->block) ? -1 : 1);
 	}
 	return(0);
 }
@@ -305,36 +616,25 @@ int tagline_driver_init(uint32_t maxlines) {
 	uint64_t total_number_of_disks = 0;			// total number of disks to initialize
 	uint64_t total_number_of_tracks = 0;			// total number of tracks to initialize
 	char *buf = NULL;					// pointer to location with an int, to pass as an arg
-	RAIDDiskID disk = 0;					// counter variable to loop through the disks to format them
-	int tag = 0;				// counters to initialize RAID_bitmap_array (d,b) and add taglines to the list (tag)
-	RAID_REQUEST_TYPES request_type_init = RAID_INIT;	// variables that store the type of request: init and format
-	RAID_REQUEST_TYPES request_type_format = RAID_FORMAT;
+	TagLineNumber tag = 0;					// counter variable to loop through the taglines
+	RAID_REQUEST_TYPES request_type_init = RAID_INIT;	// variable that stores the type of request: init
 	// RAID_INIT setup variables:
+	RAID_REQUEST	init;						// fields of the RAID_INIT request
+	RAID_RESPONSE	init_response;					// fields of its response
 	RAIDOpCode 	init_opcode = 0;					// 64-bit uint to store RAID_INIT bits together defined by the fields in the struct above
 	RAIDOpCode 	init_opcode_response = 0;				// stores the response after the bus processed the request sent through init_opcode
-	// RAID_FORMAT setup variables:
-	RAIDOpCode 	format_opcode = 0;					// 64-bit uint to store RAID_FORMAT complete opcode
-	RAIDOpCode	format_opcode_response = 0;				// stores the response after the bus processed the request sent through format_opcode
-	// Tag node for the linked-list of tags
-	TAGLINE		*new_tag = malloc(sizeof(TAGLINE));
-
-	init = malloc(sizeof(RAID_REQUEST));
-	init_response = malloc(sizeof(RAID_RESPONSE));
-	format = malloc(sizeof(RAID_REQUEST));
-	format_response = malloc(sizeof(RAID_RESPONSE));
-	read = malloc(sizeof(RAID_REQUEST));
-	read_response = malloc(sizeof(RAID_RESPONSE));
-	//write = malloc(sizeof(RAID_REQUEST));
-	//write_response = malloc(sizeof(RAID_RESPONSE));
-	close = malloc(sizeof(RAID_REQUEST));
-	close_response = malloc(sizeof(RAID_RESPONSE));
-	status = malloc(sizeof(RAID_REQUEST));
-	status_response = malloc(sizeof(RAID_RESPONSE));
-	//temp_buf = malloc(sizeof(char)*RAID_BLOCK_SIZE);
-	buf_read = malloc(sizeof(char)*RAID_BLOCK_SIZE);
-	new_scheduled_block = malloc(sizeof(SCHEDULED_BLOCK));
-	new_scheduled_block_backup = malloc(sizeof(SCHEDULED_BLOCK));
-
+	// checkpoint of the tagline map
+	TAGLINE_CHECKPOINT checkpoint;					// the checkpoint mapped
+	int		resumed = 0;					// 1 if the taglines are resumed from it
+	uint32_t	records = 0;					// blocks journaled since it
+
+	// The opcodes must match the layout of the bus
+	if (raid_opcode_check() != 0) {
+		logMessage(LOG_ERROR_LEVEL, "TAGLINE : opcode encoding does not match the RAID bus layout");
+		return(-1);
+	}
+	RAID_STATS_RESET();
+	init_raid_checksum();
 
 	// Initialize Cache
 	if( init_raid_cache(TAGLINE_CACHE_SIZE) != 0 ) {
@@ -342,28 +642,6 @@ int tagline_driver_init(uint32_t maxlines) {
 		return(-1);
 	}
 
-	// check status of malloc
-	if (((init == NULL) | (init_response == NULL)) | ((format == NULL) | (format_response == NULL))) {
-		logMessage(LOG_INFO_LEVEL, "MALLOC IS NULL FOR INIT or FORMAT! \n");
-		return(-1);
-	}
-	if (((read == NULL) | (read_response == NULL)) ){  /*((write == NULL) | (write_response == NULL))*/
-		logMessage(LOG_INFO_LEVEL, "Malloc is NULL for read or write! \n");
-		return(-1);
-	}
-	if (((close == NULL) | (close_response == NULL)) | ((status == NULL) | (status_response == NULL))) {
-		logMessage(LOG_INFO_LEVEL, "Malloc is NULL for close or status! \n");
-		return(-1);
-	}
-	if (buf_read == NULL) {
-		logMessage(LOG_INFO_LEVEL, "MALLOC IS NULL FOR buf_read!");
-		return(-1);
-	}
-	if (new_tag == NULL) {
-		logMessage(LOG_INFO_LEVEL, "MALLOC IS NULL FOR NEW TAG!");
-		return(-1);
-	}
-
 // 1. Calculate the number of tracks to create: 
 	total_number_of_blocks = RAID_DISKS * RAID_DISKBLOCKS;
 	total_number_of_tracks = total_number_of_blocks / RAID_TRACK_BLOCKS;
@@ -371,57 +649,96 @@ int tagline_driver_init(uint32_t maxlines) {
 	total_number_of_disks = RAID_DISKS;
 // 3. Call RAID_INIT:
 	// Initialize init with values for each field
-	init->request_type = request_type_init;					
-	init->number_of_blocks = total_number_of_tracks;	// we send tracks because the number will fit in 8 bits 
-	init->disk_number = total_number_of_disks;
-	init->reserved = 0;
-	init->status = 0;
-	init->blockid = 0;
+	init.request_type = request_type_init;					
+	init.number_of_blocks = total_number_of_tracks;	// we send tracks because the number will fit in 8 bits 
+	init.disk_number = total_number_of_disks;
+	init.reserved = 0;
+	init.status = 0;
+	init.blockid = 0;
 	buf = NULL; 						// NULL because we don't have to reference it
 	// Generate opcode
-	init_opcode = generate_RAIDOpCode(init);		// generates opcode based on fields of the (pointer to) structure passed
+	init_opcode = generate_RAIDOpCode(&init);		// generates opcode based on fields of the (pointer to) structure passed
 	// Call raid_bus function to request RAID_INIT:
 	init_opcode_response = client_raid_bus_request(init_opcode,buf);	
 	// Decode the fields of the repsonse from above:
-	decode_RAIDOpCode(init_opcode_response,init_response);
+	decode_RAIDOpCode(init_opcode_response, &init_response);
 	// If the initialization fails, then error out
-	if (check_response(init, init_response) != 0) {
+	if (check_response(&init, &init_response) != 0) {
 		logMessage(LOG_INFO_LEVEL, "Driver initialization FAILED at RAID_INIT.");
 		return(-1);
 	}
-// 4. Format the disks initialized:
-	format->request_type = request_type_format;
-	format->number_of_blocks = 0;
-	format->reserved = 0;
-	format->status = 0;
-	format->blockid = 0;
-	buf = NULL;
-	// Format every disk allocated by RAID_INIT
-	for (disk = 0; disk < total_number_of_disks; disk++) {
-		format->disk_number = disk;			
-		// Generate RAID_FORMAT opcode
-		format_opcode = generate_RAIDOpCode(format);
-		// Request the command generated
-		format_opcode_response = client_raid_bus_request(format_opcode, buf);
-		// Decode the response
-		decode_RAIDOpCode(format_opcode_response, format_response);
-		// Check that process was successful			
-		if (check_response(format, format_response) != 0) {
-			logMessage(LOG_INFO_LEVEL, "Driver initialization failed at RAID_FORMAT of disk %d." , disk);
-			return(-1);
-		}
+// 4. Setup the array of "maxlines" tags (no blocks are allocated until they are written):
+	taglines = calloc(maxlines, sizeof(TAGLINE));
+	if (taglines == NULL && maxlines > 0) {
+		logMessage(LOG_INFO_LEVEL, "TAGLINE: intialized not complete, malloc fails when adding the taglines");
+		return(-1);	
 	}
-
-// 6. Setup linked-list for "maxlines" tags:
 	for (tag = 0; tag < maxlines; tag++) {
-		if (add_new_tag() != 0) {
-			logMessage(LOG_INFO_LEVEL, "TAGLINE: intialized not complete, malloc fails when adding a new tag");
-			return(-1);	
+		pthread_mutex_init(&taglines[tag].lock, NULL);
+	}
+	taglines_in_use = maxlines;
+	init_raid_map();
+	init_raid_alloc();
+	memset(&rebuild, 0, sizeof(rebuild));
+	rebuild_count = 0;
+	rebuild_blocks = 0;
+	rebuild_seconds = 0;
+	hedged_reads = 0;
+	hedge_wins = 0;
+	prefetched_blocks = 0;
+	prefetch_hits = 0;
+	checksum_errors = checksum_repairs = checksum_losses = 0;
+	scrub_tag = 0;
+	scrub_block = 0;
+	scrubbed_blocks = 0;
+	prefetch_head = prefetch_tail = NULL;
+	prefetch_reads = 0;
+	prefetch_free = NULL;
+	for (tag = 0; tag < RAID_PREFETCH_MAX_READS; tag++) {
+		prefetch_pool[tag].next = prefetch_free;
+		prefetch_free = &prefetch_pool[tag];
+	}
+// 5. Resume from the checkpoint of the tagline map, if there is one, on the disks as they are:
+	if (tagline_checkpoint_load(maxlines, &checkpoint) == 0) {
+		resumed = (tagline_resume(&checkpoint) == 0);
+		records = resumed ? checkpoint.record_count : 0;
+		tagline_checkpoint_unmap(&checkpoint);
+		if (! resumed) {
+			// start over with empty taglines
+			for (tag = 0; tag < maxlines; tag++) {
+				free(taglines[tag].blocks);
+				taglines[tag].blocks = NULL;
+				taglines[tag].block_capacity = taglines[tag].max_start_allowed = 0;
+			}
+			init_raid_map();
+			init_raid_alloc();
 		}
 	}
+// 6. Otherwise format the disks initialized, all at once:
+	if (! resumed && (raid_disks_format(NULL) != 0)) {
+		logMessage(LOG_INFO_LEVEL, "Driver initialization failed at RAID_FORMAT.");
+		free_taglines();
+		return(-1);
+	}
+	// the formatted disks start from an empty checkpoint, the new blocks are journaled
+	if ((tagline_checkpoint_file != NULL) &&
+			((! resumed && ((tagline_checkpoint_begin(maxlines, NULL) != 0) || (tagline_checkpoint_commit() != 0))) ||
+			 (tagline_journal_open(records) != 0))) {
+		logMessage(LOG_INFO_LEVEL, "Driver initialization failed at the tagline checkpoint.");
+		free_taglines();
+		return(-1);
+	}
+	// a disk that failed while the driver was down is rebuilt now
+	if (resumed && (raid_disk_signal() != 0)) {
+		logMessage(LOG_INFO_LEVEL, "Driver initialization failed recovering the disks.");
+		tagline_journal_close();
+		free_taglines();
+		return(-1);
+	}
+
 // 7. Free pointers
 		// Return successfully
-	logMessage(LOG_INFO_LEVEL, "TAGLINE: initialized storage (maxline=%u)", maxlines);
+	logMessage(LOG_INFO_LEVEL, "TAGLINE: initialized storage (maxline=%u%s)", maxlines, resumed ? ", resumed" : "");
 	return(0);
 }
 // ----------------------------------------------------------------------------------------------------
@@ -437,260 +754,1257 @@ int tagline_driver_init(uint32_t maxlines) {
 // Outputs      : 0 if successful, -1 if failure
 int tagline_read(TagLineNumber tag, TagLineBlockNumber bnum, uint8_t blks, char *buf) {
 
-	// declaration of variables needed
-	RAIDOpCode read_opcode;
-	RAIDOpCode read_opcode_response;
-	
-	RAID_REQUEST_TYPES request_type_read = RAID_READ;
+	int result = 0;
+	uint8_t missed = 0;
+	uint64_t start = tagline_histograms ? tagline_histogram_now() : 0;
 
-	TAGLINE *current_tag = NULL;
-	BLOCK *current_block = NULL;
+	// does the tag exist?
+	if (tag >= taglines_in_use) {
+		logMessage(LOG_INFO_LEVEL, "ERROR: Attempt to read from a non-existent tagline");
+		return(-1);
+	}
+
+	// rebuild a few blocks of a failed disk first, if one is being rebuilt, and scrub a few
+	if ((raid_rebuild_advance() != 0) || (raid_scrub_advance() != 0)) {
+		return(-1);
+	}
+
+	// other threads may read or write other taglines meanwhile
+	pthread_rwlock_rdlock(&rebuild_lock);
+	pthread_mutex_lock(&taglines[tag].lock);
+	tagline_prefetch_complete(&taglines[tag]);
+	result = tagline_read_blocks(&taglines[tag], bnum, blks, buf, &missed);
+	if (result == 0) {
+		tagline_read_ahead(&taglines[tag], bnum, blks, missed);
+	}
+	pthread_mutex_unlock(&taglines[tag].lock);
+	pthread_rwlock_unlock(&rebuild_lock);
+	if (result != 0) {
+		return(-1);
+	}
+	if (tagline_histograms) {
+		start = tagline_histogram_now() - start;
+		tagline_histogram_record(TAGLINE_HIST_READ, start);
+		tagline_histogram_record(missed ? TAGLINE_HIST_CACHE_MISS : TAGLINE_HIST_CACHE_HIT, start);
+	}
 
-	char *fixbuf = NULL;
+	// Return successfully
+	RAID_LOG_HOT("TAGLINE : read %u blocks from tagline %u, starting block %u.",
+			blks, tag, bnum);
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_read_blocks
+// Description  : Read a number of blocks of a tagline, its lock held
+//
+// Inputs       : current_tag - the tagline to read from
+//                bnum - the starting block to read from
+//                blks - the number of blocks to read
+//                buf - memory block to read the blocks into
+//                missed - set to the number of blocks not found in the cache
+// Outputs      : 0 if successful, -1 if failure
+int tagline_read_blocks(TAGLINE *current_tag, TagLineBlockNumber bnum, uint8_t blks, char *buf, uint8_t *missed) {
 
-	//logMessage(LOG_INFO_LEVEL, "Reading Tag %d and Block %d", tag, bnum);
+	// declaration of variables needed
+	BLOCK *blocks = NULL;
+	BLOCK *current_block = NULL;
 
+	int hit[RAID_MAX_XFER];		// 1 for each block of the request copied from the cache
+	BLOCK_TO_READ copy, next;	// copies of the first and the next block of a run
+	RUN_READ reads[RAID_MAX_XFER];	// read of each run of missed blocks
+	int runs = 0, r = 0;
+	int backup = 0;			// 1 if a run is read from the backups
 
 	// variables to handle more than one block
 	TagLineBlockNumber block = 0;	
+	TagLineBlockNumber run = 0;	// number of physically contiguous missed blocks read at once
+
+	// are all the blocks valid?
+	if (bnum + blks > current_tag->max_start_allowed) {
+		logMessage(LOG_INFO_LEVEL, "ERROR: Attemp to read an unallocated block");
+		return(-1);
+	}
+	blocks = &current_tag->blocks[bnum];
+	*missed = 0;
+
+	// ----  Check Cache ----
+	// copy every hit out before any miss is added to the cache (which may evict a hit),
+	// under the lock of its shard so other threads do not evict it meanwhile; both copies
+	// of a block are cached under the primary
+	for (block = 0; block < blks; block++) {
+		current_block = &blocks[block];
+		hit[block] = (copy_raid_cache(current_block->RAID_disk, current_block->RAID_block,
+				buf+(RAID_BLOCK_SIZE*block)) == 0);
+		*missed += !hit[block];
+	}
 
-	// more than 1 block?
-	if (blks > 1) {
-		for (block = 0; block < blks; block++) {
-			temp_buf = buf+(RAID_BLOCK_SIZE*block);
-			if (tagline_read(tag,bnum+block,1,temp_buf) != 0) {
-				logMessage(LOG_INFO_LEVEL, "ERROR: Failure in reading block number %d",block);
+	// ---- Read Misses ----
+	// send the reads of all the runs back to back, before waiting for any of them
+	block = 0;
+	while (block < blks) {
+		if (hit[block]) {
+			block++;
+			continue;
+		}
+		// block not found in cache, read it from the copy whose disk has fewer requests
+		// waiting (the primary if as many), unless that copy is not rebuilt yet
+		current_block = &blocks[block];
+		backup = (raid_block_copy(current_block, 0, &copy) != 0) ||
+				((raid_block_copy(current_block, 1, &next) == 0) &&
+				 (client_raid_bus_depth(current_block->backup_disk) < client_raid_bus_depth(current_block->RAID_disk)));
+		raid_block_copy(current_block, backup, &copy);
+		// and extend the read over the following missed blocks stored right after it on the same disk
+		run = 1;
+		while ((block + run < blks) && (run < RAID_MAX_XFER) && !hit[block + run] &&
+				(raid_block_copy(&blocks[block + run], backup, &next) == 0) &&
+				(next.disk == copy.disk) && (next.block == copy.block + run)) {
+			run++;
+		}
+		RAID_LOG_HOT("Blocks not found in cache, reading %u blocks.", run);
+
+		// call RAID_READ for the whole run
+		reads[runs].start = block;
+		reads[runs].length = run;
+		reads[runs].backup = backup;
+		reads[runs].sent = tagline_histogram_now();
+		reads[runs].tag = raid_submit(RAID_READ, copy.disk, copy.block, run, buf+(RAID_BLOCK_SIZE*block));
+		if (reads[runs].tag < 0) {
+			logMessage(LOG_INFO_LEVEL, "Error reading from disk");
+			for (r = 0; r < runs; r++) {
+				raid_complete(reads[r].tag);
+			}
+			return(-1);
+		}
+		runs++;
+		block += run;
+	}
+	// then collect them, checking every block read against its checksum and adding it to
+	// the cache (clean, the disk has it; under the primary, whichever copy it was read from)
+	for (r = 0; r < runs; r++) {
+		if (raid_complete_read(blocks, &reads[r], buf) != 0) {
+			logMessage(LOG_INFO_LEVEL, "Error reading from disk");
+			for (r++; r < runs; r++) {
+				raid_complete(reads[r].tag);
+			}
+			return(-1);
+		}
+		if (tagline_histograms) {
+			tagline_histogram_record(TAGLINE_HIST_RAID, tagline_histogram_now() - reads[r].sent);
+		}
+		for (block = reads[r].start; block < reads[r].start + reads[r].length; block++) {
+			if (raid_block_verify(&blocks[block], buf+(RAID_BLOCK_SIZE*block)) != 0) {
+				for (r++; r < runs; r++) {
+					raid_complete(reads[r].tag);
+				}
 				return(-1);
 			}
+			if ( fill_raid_cache(blocks[block].RAID_disk, blocks[block].RAID_block, buf+(RAID_BLOCK_SIZE*block)) != 0 ) {
+				logMessage(LOG_INFO_LEVEL, "Error adding block to cache");
+			}
 		}
-			return(0);
 	}
-	// does the tag exist?
-	if (tag >= taglines_in_use) {
-		logMessage(LOG_INFO_LEVEL, "ERROR: Attempt to read from a non-existent tagline");
-		return(-1);
+	// -----------------------
+	// Return successfully
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_read_ahead
+// Description  : follows the sequential reads of a tagline: a read starting where
+//		  the last one ended reads ahead the next stream_window blocks into the
+//		  cache, the window doubling while the blocks read ahead are hit and
+//		  halving when some were evicted before they were read
+//
+// Inputs       : current_tag - the tagline read, its lock held
+//		  bnum - the first block read
+//		  blks - the number of blocks read
+//		  missed - how many of them were not in the cache
+// Outputs      : N/A
+void tagline_read_ahead(TAGLINE *current_tag, TagLineBlockNumber bnum, uint8_t blks, uint8_t missed) {
+	TagLineBlockNumber start = 0;
+	TagLineBlockNumber end = 0;
+
+	if (bnum != current_tag->stream_next) {
+		// not sequential, forget the stream
+		current_tag->stream_window = 0;
+		current_tag->prefetch_start = current_tag->prefetch_end = 0;
 	}
-	// is starting block valid?
-	if (bnum >= get_max_start_allowed(tag)) {
-		logMessage(LOG_INFO_LEVEL, "ERROR: Attemp to read an unallocated block");
-		return(-1);
+	else if (current_tag->stream_window == 0) {
+		current_tag->stream_window = RAID_PREFETCH_MIN_BLOCKS;
 	}
-	// find the block that we want to read and retrieve RAID disk and block
-	current_tag = head_tag;
-	while (current_tag->tagline != tag) {
-		current_tag = current_tag->next_tagline;
+	else if ((bnum >= current_tag->prefetch_start) && (bnum < current_tag->prefetch_end)) {
+		pthread_mutex_lock(&stats_lock);
+		prefetch_hits += blks - missed;
+		pthread_mutex_unlock(&stats_lock);
+		if (missed == 0) {
+			current_tag->stream_window = (current_tag->stream_window * 2 < RAID_PREFETCH_MAX_BLOCKS) ?
+					current_tag->stream_window * 2 : RAID_PREFETCH_MAX_BLOCKS;
+		}
+		else {
+			current_tag->stream_window = (current_tag->stream_window / 2 > RAID_PREFETCH_MIN_BLOCKS) ?
+					current_tag->stream_window / 2 : RAID_PREFETCH_MIN_BLOCKS;
+		}
 	}
-	current_block = current_tag->block_0;
-	while (current_block->block != bnum) {
-		current_block = current_block->next_block;
+	current_tag->stream_next = bnum + blks;
+	if (current_tag->stream_window == 0) {
+		return;
 	}
 
-	// ----  Check Cache ----
-//	logMessage(LOG_INFO_LEVEL, "disk: %d block: %d to read from cache", current_block->RAID_disk, current_block->RAID_block);
-	fixbuf = get_raid_cache(current_block->RAID_disk, current_block->RAID_block);
-//	logMessage(LOG_INFO_LEVEL, "Driver buf = %c", *buf);
-	
-	if (fixbuf == NULL) {
-		logMessage(LOG_INFO_LEVEL, "Block not found in cache.");
-		// block not found in cache
-		// save the disk and block in the RAID storage to call RAID_READ
-		read->blockid = current_block->RAID_block;
-		read->disk_number = current_block->RAID_disk;
-		read->request_type = request_type_read;
-		read->number_of_blocks = 1;
-		read->reserved = 0;
-		read->status = 0;
-		//  generate opcode
-		read_opcode = generate_RAIDOpCode(read);
-		// call RAID_READ
-		read_opcode_response = client_raid_bus_request(read_opcode, buf);
-		// decode read response 
-		decode_RAIDOpCode(read_opcode_response, read_response);
-		// check if read was successful
-		if (read_response->status != 0) {
-			logMessage(LOG_INFO_LEVEL, "Error reading from disk");
-			return(-1);
-		}
-		
-		logMessage(LOG_INFO_LEVEL, "Sending to cache Disk %d and Block %d", current_block->RAID_disk, current_block->RAID_block);
+	// read ahead once less than half the window is left ahead of the stream
+	start = (current_tag->prefetch_end > current_tag->stream_next) ? current_tag->prefetch_end : current_tag->stream_next;
+	end = current_tag->stream_next + current_tag->stream_window;
+	if (end > current_tag->max_start_allowed) {
+		end = current_tag->max_start_allowed;
+	}
+	if ((start >= end) || (start - current_tag->stream_next > current_tag->stream_window / 2)) {
+		return;
+	}
+	if (current_tag->prefetch_end < current_tag->stream_next) {
+		current_tag->prefetch_start = start;
+	}
+	current_tag->prefetch_end = start + tagline_prefetch(current_tag, start, end - start);
+}
 
-		if ( put_raid_cache(current_block->RAID_disk, current_block->RAID_block, buf) != 0 ) {
-			logMessage(LOG_INFO_LEVEL, "Error adding block to cache");
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_prefetch
+// Description  : sends the reads of the blocks of a tagline not in the cache, in runs
+//		  of blocks contiguous on a disk, without waiting for them (they are
+//		  added to the cache when the read ahead is completed); the oldest read
+//		  ahead is completed first when RAID_PREFETCH_MAX_READS are in flight
+//
+// Inputs       : current_tag - the tagline, its lock held
+//		  bnum - the first block to read ahead
+//		  blks - the number of blocks to read ahead, at most RAID_PREFETCH_MAX_BLOCKS
+// Outputs      : the number of blocks read ahead from bnum on (the read ahead stops
+//		  short when it would have too many reads in flight)
+TagLineBlockNumber tagline_prefetch(TAGLINE *current_tag, TagLineBlockNumber bnum, TagLineBlockNumber blks) {
+	PREFETCH	*prefetch = NULL;
+	BLOCK		*blocks = &current_tag->blocks[bnum];
+	BLOCK_TO_READ	copy, next;
+	TagLineBlockNumber block = 0, run = 0, read_blocks = 0;
+	int		backup = 0, r = 0;
+
+	// take a read ahead from the pool, completing the oldest one if all are in flight
+	pthread_mutex_lock(&prefetch_lock);
+	if (prefetch_free == NULL) {
+		prefetch_complete_oldest();
+	}
+	prefetch = prefetch_free;
+	prefetch_free = prefetch->next;
+	prefetch->tagline = current_tag;
+	prefetch->reads = 0;
+	prefetch->next = NULL;
+
+	block = 0;
+	while (block < blks) {
+		// the blocks already cached are not read again (the cache may hold newer contents
+		// than the disk); each is looked up into its own part of the buffer, no read lands there
+		prefetch->primary[block].disk = blocks[block].RAID_disk;
+		prefetch->primary[block].block = blocks[block].RAID_block;
+		prefetch->checksum[block] = blocks[block].checksum;
+		if (peek_raid_cache(blocks[block].RAID_disk, blocks[block].RAID_block, prefetch->buf+(RAID_BLOCK_SIZE*block)) == 0) {
+			block++;
+			continue;
+		}
+		// make room for one more read in flight
+		if ((prefetch_reads + 1 > RAID_PREFETCH_MAX_READS) && (prefetch_head != NULL)) {
+			prefetch_complete_oldest();
 		}
-	} 
+		if (prefetch_reads + 1 > RAID_PREFETCH_MAX_READS) {
+			break;
+		}
+		backup = (raid_block_copy(&blocks[block], 0, &copy) != 0);
+		raid_block_copy(&blocks[block], backup, &copy);
+		run = 1;
+		while ((block + run < blks) && (raid_block_copy(&blocks[block + run], backup, &next) == 0) &&
+				(next.disk == copy.disk) && (next.block == copy.block + run) &&
+				(peek_raid_cache(blocks[block + run].RAID_disk, blocks[block + run].RAID_block,
+					prefetch->buf+(RAID_BLOCK_SIZE*(block + run))) != 0)) {
+			prefetch->primary[block + run].disk = blocks[block + run].RAID_disk;
+			prefetch->primary[block + run].block = blocks[block + run].RAID_block;
+			prefetch->checksum[block + run] = blocks[block + run].checksum;
+			run++;
+		}
+		r = prefetch->reads;
+		prefetch->runs[r].start = block;
+		prefetch->runs[r].length = run;
+		prefetch->runs[r].backup = backup;
+		prefetch->runs[r].tag = raid_submit(RAID_READ, copy.disk, copy.block, run, prefetch->buf+(RAID_BLOCK_SIZE*block));
+		if (prefetch->runs[r].tag < 0) {
+			break;
+		}
+		prefetch->reads++;
+		prefetch_reads++;
+		read_blocks += run;
+		block += run;
+	}
+
+	// queue the read ahead, to be completed by the next read or write of the tagline
+	// (or to make room for another one)
+	if (prefetch->reads == 0) {
+		prefetch->next = prefetch_free;
+		prefetch_free = prefetch;
+	}
 	else {
-		// block found in cache
-		logMessage(LOG_INFO_LEVEL, "Block found in cache");
-		memcpy(buf, fixbuf, RAID_BLOCK_SIZE);
+		client_raid_bus_flush();
+		if (prefetch_tail == NULL) {
+			prefetch_head = prefetch;
+		}
+		else {
+			prefetch_tail->next = prefetch;
+		}
+		prefetch_tail = prefetch;
 	}
-	// -----------------------
+	pthread_mutex_unlock(&prefetch_lock);
+
+	pthread_mutex_lock(&stats_lock);
+	prefetched_blocks += read_blocks;
+	pthread_mutex_unlock(&stats_lock);
+	return(block);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_prefetch_complete
+// Description  : completes the read ahead of a tagline still in flight, if any (or of
+//		  every tagline); the blocks are in the cache once it returns
+//
+// Inputs       : current_tag - the tagline, its lock held (NULL for all taglines)
+// Outputs      : N/A
+void tagline_prefetch_complete(TAGLINE *current_tag) {
+	PREFETCH *prefetch = NULL;
+	PREFETCH *previous = NULL;
+
+	pthread_mutex_lock(&prefetch_lock);
+	prefetch = prefetch_head;
+	while (prefetch != NULL) {
+		if ((current_tag != NULL) && (prefetch->tagline != current_tag)) {
+			previous = prefetch;
+			prefetch = prefetch->next;
+			continue;
+		}
+		// take it out of the queue and complete it
+		if (previous == NULL) {
+			prefetch_head = prefetch->next;
+		}
+		else {
+			previous->next = prefetch->next;
+		}
+		if (prefetch_tail == prefetch) {
+			prefetch_tail = previous;
+		}
+		prefetch_finish(prefetch);
+		prefetch = (previous == NULL) ? prefetch_head : previous->next;
+	}
+	pthread_mutex_unlock(&prefetch_lock);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : prefetch_complete_oldest
+// Description  : completes the oldest read ahead in flight (prefetch_lock held)
+//
+// Inputs       : N/A
+// Outputs      : N/A
+void prefetch_complete_oldest(void) {
+	PREFETCH *prefetch = prefetch_head;
+
+	prefetch_head = prefetch->next;
+	if (prefetch_head == NULL) {
+		prefetch_tail = NULL;
+	}
+	prefetch_finish(prefetch);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : prefetch_finish
+// Description  : waits for the reads of a read ahead taken out of the queue, adds the
+//		  blocks read to the cache (clean, under their primary) and puts it back
+//		  in the pool; a read that fails, or a block that does not match its
+//		  checksum, is just dropped, the read that asks for it repairs it
+//		  (prefetch_lock held, so the tagline is not written meanwhile)
+//
+// Inputs       : prefetch - the read ahead
+// Outputs      : N/A
+void prefetch_finish(PREFETCH *prefetch) {
+	TagLineBlockNumber block = 0;
+	int r = 0;
+
+	for (r = 0; r < prefetch->reads; r++) {
+		prefetch_reads--;
+		if (raid_complete(prefetch->runs[r].tag) != 0) {
+			continue;
+		}
+		for (block = prefetch->runs[r].start; block < prefetch->runs[r].start + prefetch->runs[r].length; block++) {
+			if (raid_checksum(prefetch->buf+(RAID_BLOCK_SIZE*block), RAID_BLOCK_SIZE) != prefetch->checksum[block]) {
+				continue;
+			}
+			fill_raid_cache(prefetch->primary[block].disk, prefetch->primary[block].block,
+					prefetch->buf+(RAID_BLOCK_SIZE*block));
+		}
+	}
+	prefetch->next = prefetch_free;
+	prefetch_free = prefetch;
+}
+// ----------------------------------------------------------------------------------------------------------
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_block_copy
+// Description  : finds where the primary or the backup of a block is, if it can be read
+//		  (not on a disk being rebuilt that has not got it yet)
+//
+// Inputs       : block - the block mapping
+//		  backup - 1 for the backup, 0 for the primary
+//		  copy - set to the disk and block of the copy
+// Outputs      :  0 if the copy can be read
+//		  -1 if not
+int raid_block_copy(BLOCK *block, int backup, BLOCK_TO_READ *copy) {
+	copy->disk = backup ? block->backup_disk : block->RAID_disk;
+	copy->block = backup ? block->backup_block : block->RAID_block;
+	if (rebuild.active && (copy->disk == rebuild.disk) && (copy->block >= rebuild.next_block)) {
+		return(-1);
+	}
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_complete_read
+// Description  : waits for the read of a run of missed blocks; once it has waited for
+//		  raid_hedge_msec, it also reads the other copies of the run (if they are
+//		  just as contiguous, and go out on another connection than the read: the
+//		  server answers a connection in order) and keeps whichever read answers
+//		  first. Both reads go to the run in the request memory, the one answered
+//		  second is given up before it reaches it
+//
+// Inputs       : blocks - the block mappings of the request
+//		  read - the read of the run
+//		  buf - the memory of the request
+// Outputs      :  0 if successful
+//		  -1 if not successful
+int raid_complete_read(BLOCK *blocks, RUN_READ *read, char *buf) {
+	BLOCK_TO_READ	copy, next;
+	RAIDRequestTag	hedge = -1, first = -1, second = -1;
+	long		waited = 0;
+	int		done = 0, result = 0, won = 0;
+	TagLineBlockNumber block = 0;
+
+	if (raid_hedge_msec == 0) {
+		return(raid_complete(read->tag));
+	}
+	waited = (tagline_histogram_now() - read->sent) / 1000000;
+	done = client_raid_bus_wait(read->tag, (waited < (long)raid_hedge_msec) ? (long)raid_hedge_msec - waited : 0);
+	if (done != 0) {
+		return(raid_complete(read->tag));
+	}
+
+	// the read is slow, can the other copies of the run be read at once (and answered before it)?
+	if ((raid_block_copy(&blocks[read->start], !read->backup, &copy) != 0) ||
+			client_raid_bus_shares_channel(read->tag, copy.disk)) {
+		return(raid_complete(read->tag));
+	}
+	for (block = 1; block < read->length; block++) {
+		if ((raid_block_copy(&blocks[read->start + block], !read->backup, &next) != 0) ||
+				(next.disk != copy.disk) || (next.block != copy.block + block)) {
+			return(raid_complete(read->tag));
+		}
+	}
+	hedge = raid_submit(RAID_READ, copy.disk, copy.block, read->length, buf+(RAID_BLOCK_SIZE*read->start));
+	if (hedge < 0) {
+		return(raid_complete(read->tag));
+	}
+
+	// wait on both connections for whichever answers first, and give up the other one
+	// (unless the first failed)
+	done = client_raid_bus_wait_either(read->tag, hedge, -1);
+	first = (done == 2) ? hedge : read->tag;
+	second = (done == 2) ? read->tag : hedge;
+	result = raid_complete(first);
+	won = (done == 2) && (result == 0);
+	if (result == 0) {
+		client_raid_bus_abandon(second);
+	}
+	else {
+		result = raid_complete(second);
+	}
+
+	pthread_mutex_lock(&stats_lock);
+	hedged_reads++;
+	hedge_wins += won;
+	pthread_mutex_unlock(&stats_lock);
+	return(result);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_block_verify
+// Description  : checks a block read from the disks against its checksum; if it does
+//		  not match, both copies are read again (a hedged read may have read
+//		  either), the one that matches replaces the block read and is written
+//		  over the copy that does not
+//
+// Inputs       : block - the block mapping
+//		  buf - the block read
+// Outputs      :  0 if the block read is good, or was replaced with a good copy
+//		  -1 if no copy of the block is good
+int raid_block_verify(BLOCK *block, char *buf) {
+	char		copies[2][RAID_BLOCK_SIZE];	// the primary and the backup read again
+	BLOCK_TO_READ	copy;
+	int		bad[2] = {0, 0};		// 1 for each copy read that is bad
+	int		good = -1, repaired = 0, c = 0;
+
+	if (raid_checksum(buf, RAID_BLOCK_SIZE) == block->checksum) {
+		return(0);
+	}
+	for (c = 0; c < 2; c++) {
+		if ((raid_block_copy(block, c, &copy) != 0) || (raid_transfer(RAID_READ, copy.disk, copy.block, 1, copies[c]) != 0)) {
+			continue;
+		}
+		if (raid_checksum(copies[c], RAID_BLOCK_SIZE) != block->checksum) {
+			bad[c] = 1;
+		}
+		else if (good < 0) {
+			good = c;
+		}
+	}
+	if (good >= 0) {
+		memcpy(buf, copies[good], RAID_BLOCK_SIZE);
+		for (c = 0; c < 2; c++) {
+			if (bad[c] && (raid_block_copy(block, c, &copy) == 0) &&
+					(raid_transfer(RAID_WRITE, copy.disk, copy.block, 1, copies[good]) == 0)) {
+				logMessage(LOG_INFO_LEVEL, "TAGLINE : repaired the bad copy of disk %u, block %u", copy.disk, copy.block);
+				repaired++;
+			}
+		}
+	}
+	else {
+		logMessage(LOG_INFO_LEVEL, "ERROR: no good copy of the block of disk %u, block %u (backup disk %u, block %u)",
+				block->RAID_disk, block->RAID_block, block->backup_disk, block->backup_block);
+	}
+
+	pthread_mutex_lock(&stats_lock);
+	checksum_errors += 1 + bad[0] + bad[1];
+	checksum_repairs += repaired;
+	checksum_losses += (good < 0);
+	pthread_mutex_unlock(&stats_lock);
+	return((good >= 0) ? 0 : -1);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_scrub
+// Description  : checks both copies of the next blocks of the taglines against their
+//		  checksums, writing the good copy over a bad one; the scrub goes on
+//		  from where the last one stopped, tagline after tagline
+//
+// Inputs       : blocks - number of tagline blocks to scrub
+// Outputs      :  0 if successful
+//		  -1 if failure
+int raid_scrub(uint32_t blocks) {
+	int result = 0;
+
+	pthread_mutex_lock(&scrub_lock);
+	result = raid_scrub_blocks(blocks);
+	pthread_mutex_unlock(&scrub_lock);
+	return(result);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_scrub_advance
+// Description  : scrubs raid_scrub_rate more blocks, if set, before a foreground
+//		  read/write (unless another thread is scrubbing already)
+//
+// Inputs       : N/A
+// Outputs      :  0 if successful
+//		  -1 if failure
+int raid_scrub_advance(void) {
+	int result = 0;
+
+	if ((raid_scrub_rate == 0) || (pthread_mutex_trylock(&scrub_lock) != 0)) {
+		return(0);
+	}
+	result = raid_scrub_blocks(raid_scrub_rate);
+	pthread_mutex_unlock(&scrub_lock);
+	return(result);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_scrub_blocks
+// Description  : scrubs a number of blocks from where the scrub is, going over every
+//		  tagline at most once (scrub_lock held); each batch is scrubbed under
+//		  the lock of its tagline, like a read
+//
+// Inputs       : budget - number of tagline blocks to scrub
+// Outputs      :  0 if successful
+//		  -1 if failure
+int raid_scrub_blocks(uint32_t budget) {
+	TAGLINE		*current_tag = NULL;
+	uint32_t	visited = 0, run = 0;
+	int		result = 0;
+
+	while ((budget > 0) && (taglines_in_use > 0) && (visited <= taglines_in_use)) {
+		if (scrub_tag >= taglines_in_use) {
+			scrub_tag = 0;
+		}
+		current_tag = &taglines[scrub_tag];
+		pthread_rwlock_rdlock(&rebuild_lock);
+		pthread_mutex_lock(&current_tag->lock);
+		if (scrub_block >= current_tag->max_start_allowed) {
+			// on to the next tagline
+			pthread_mutex_unlock(&current_tag->lock);
+			pthread_rwlock_unlock(&rebuild_lock);
+			scrub_tag++;
+			scrub_block = 0;
+			visited++;
+			continue;
+		}
+		run = current_tag->max_start_allowed - scrub_block;
+		run = (run < budget) ? run : budget;
+		run = (run < RAID_SCRUB_BATCH) ? run : RAID_SCRUB_BATCH;
+		result = raid_scrub_run(current_tag, scrub_block, run);
+		pthread_mutex_unlock(&current_tag->lock);
+		pthread_rwlock_unlock(&rebuild_lock);
+		if (result != 0) {
+			logMessage(LOG_INFO_LEVEL, "ERROR: scrubbing %u blocks of tagline %u at block %u", run, scrub_tag, scrub_block);
+			return(-1);
+		}
+		scrub_block += run;
+		budget -= run;
+		pthread_mutex_lock(&stats_lock);
+		scrubbed_blocks += run;
+		pthread_mutex_unlock(&stats_lock);
+	}
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_scrub_run
+// Description  : reads both copies of a run of blocks of a tagline (the runs of each
+//		  copy contiguous on a disk read at once, sent back to back) and checks
+//		  them against their checksums, writing the good copy over a bad one;
+//		  the blocks cached are skipped, the disks may not have their latest
+//		  contents yet (the tagline lock and scrub_lock held)
+//
+// Inputs       : current_tag - the tagline
+//		  bnum - first block of the run
+//		  blks - number of blocks, at most RAID_SCRUB_BATCH
+// Outputs      :  0 if successful (even if a block has no good copy left)
+//		  -1 if failure
+int raid_scrub_run(TAGLINE *current_tag, TagLineBlockNumber bnum, uint32_t blks) {
+	static char	copies[2][RAID_SCRUB_BATCH*RAID_BLOCK_SIZE];	// the primaries and the backups read
+	char		cached[RAID_BLOCK_SIZE];
+	int		skip[RAID_SCRUB_BATCH];			// 1 for each block found in the cache
+	int		read[2][RAID_SCRUB_BATCH];		// 1 for each copy read
+	RAIDRequestTag	tags[2*RAID_SCRUB_BATCH];		// tag of each read
+	BLOCK		*blocks = &current_tag->blocks[bnum];
+	BLOCK_TO_READ	copy, next;
+	uint32_t	block = 0, run = 0, i = 0;
+	uint64_t	errors = 0, repairs = 0, losses = 0;
+	int		ntags = 0, t = 0, c = 0, good = 0;
+
+	for (block = 0; block < blks; block++) {
+		skip[block] = (peek_raid_cache(blocks[block].RAID_disk, blocks[block].RAID_block, cached) == 0);
+	}
+	memset(read, 0, sizeof(read));
+	for (c = 0; c < 2; c++) {
+		block = 0;
+		while (block < blks) {
+			if (skip[block] || (raid_block_copy(&blocks[block], c, &copy) != 0)) {
+				block++;
+				continue;
+			}
+			run = 1;
+			while ((block + run < blks) && !skip[block + run] &&
+					(raid_block_copy(&blocks[block + run], c, &next) == 0) &&
+					(next.disk == copy.disk) && (next.block == copy.block + run)) {
+				run++;
+			}
+			tags[ntags] = raid_submit(RAID_READ, copy.disk, copy.block, run, copies[c]+(RAID_BLOCK_SIZE*block));
+			if (tags[ntags] < 0) {
+				for (t = 0; t < ntags; t++) {
+					raid_complete(tags[t]);
+				}
+				return(-1);
+			}
+			ntags++;
+			for (i = block; i < block + run; i++) {
+				read[c][i] = 1;
+			}
+			block += run;
+		}
+	}
+	for (t = 0; t < ntags; t++) {
+		if (raid_complete(tags[t]) != 0) {
+			for (t++; t < ntags; t++) {
+				raid_complete(tags[t]);
+			}
+			return(-1);
+		}
+	}
+
+	for (block = 0; block < blks; block++) {
+		// a copy read that matches the checksum is good (the primary if both are)
+		good = -1;
+		for (c = 1; c >= 0; c--) {
+			if (read[c][block] && (raid_checksum(copies[c]+(RAID_BLOCK_SIZE*block), RAID_BLOCK_SIZE) == blocks[block].checksum)) {
+				good = c;
+			}
+			else {
+				errors += read[c][block];
+			}
+		}
+		if ((good < 0) && (read[0][block] || read[1][block])) {
+			logMessage(LOG_INFO_LEVEL, "ERROR: no good copy of block %u of tagline %u", bnum + block,
+					(unsigned)(current_tag - taglines));
+			losses++;
+			continue;
+		}
+		// write the good copy over the other one, if that is bad
+		c = !good;
+		if ((good >= 0) && read[c][block] &&
+				(raid_checksum(copies[c]+(RAID_BLOCK_SIZE*block), RAID_BLOCK_SIZE) != blocks[block].checksum)) {
+			raid_block_copy(&blocks[block], c, &copy);
+			if (raid_transfer(RAID_WRITE, copy.disk, copy.block, 1, copies[good]+(RAID_BLOCK_SIZE*block)) != 0) {
+				return(-1);
+			}
+			logMessage(LOG_INFO_LEVEL, "TAGLINE : repaired the bad copy of disk %u, block %u", copy.disk, copy.block);
+			repairs++;
+		}
+	}
+
+	pthread_mutex_lock(&stats_lock);
+	checksum_errors += errors;
+	checksum_repairs += repairs;
+	checksum_losses += losses;
+	pthread_mutex_unlock(&stats_lock);
+	return(0);
+}
+
+
+
+// Function     : tagline_write
+// Description  : Write a number of blocks from the tagline driver
+//
+// Inputs       : tag - the number of the tagline to write from
+//                bnum - the starting block to write from
+//                blks - the number of blocks to write
+//                bug - the place to write the blocks into
+// Outputs      : 0 if successful, -1 if failure
+int tagline_write(TagLineNumber tag, TagLineBlockNumber bnum, uint8_t blks, char *buf) {
+
+	//variables
+	TAGLINE	*current_tag = NULL;
+
+	// variables for handling more than one block
+	TagLineBlockNumber block = 0;
+	uint64_t start = tagline_histograms ? tagline_histogram_now() : 0;
+
+	// Does the tag exist?
+	if (tag >= taglines_in_use) {
+		logMessage(LOG_INFO_LEVEL, "ERROR: Attempting to write to a nonexisting tagline");
+		return(-1);
+	}
+	current_tag = &taglines[tag];
+	// rebuild a few blocks of a failed disk first, if one is being rebuilt, and scrub a few
+	if ((raid_rebuild_advance() != 0) || (raid_scrub_advance() != 0)) {
+		return(-1);
+	}
+	// other threads may read or write other taglines meanwhile
+	pthread_rwlock_rdlock(&rebuild_lock);
+	pthread_mutex_lock(&current_tag->lock);
+	// the read ahead in flight must not add older contents to the cache after the write
+	tagline_prefetch_complete(current_tag);
+	// Does the starting block make sense?
+	if (bnum > current_tag->max_start_allowed) {
+		pthread_mutex_unlock(&current_tag->lock);
+		pthread_rwlock_unlock(&rebuild_lock);
+		logMessage(LOG_INFO_LEVEL, "ERROR: Attemping to write beyond allowed start");
+		return(-1);
+	}
+	// Write the blocks in order, so each new block is appended right after the previous one
+	for (block = 0; block < blks; block++) {
+		if (tagline_write_block(current_tag, bnum+block, buf+(RAID_BLOCK_SIZE*block)) != 0) {
+			pthread_mutex_unlock(&current_tag->lock);
+			pthread_rwlock_unlock(&rebuild_lock);
+			logMessage(LOG_INFO_LEVEL, "ERROR: Block number %d was not written properly.", block);
+			return(-1);
+		}
+	}
+	pthread_mutex_unlock(&current_tag->lock);
+	pthread_rwlock_unlock(&rebuild_lock);
+	if (tagline_histograms) {
+		tagline_histogram_record(TAGLINE_HIST_WRITE, tagline_histogram_now() - start);
+	}
+	
+	// Return successfully
+	RAID_LOG_HOT("TAGLINE : wrote %u blocks to tagline %u, starting block %u.",
+			blks, tag, bnum);
+	return(0);
+}
+// ----------------------------------------------------------------------------------------------------------
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_write_block
+// Description  : Write a single block of a tagline (appending it if it is new)
+//
+// Inputs       : current_tag - the tagline to write to
+//                bnum - the block to write, at most one past the last block of the tag
+//                buf - the block contents
+// Outputs      : 0 if successful, -1 if failure
+int tagline_write_block(TAGLINE *current_tag, TagLineBlockNumber bnum, char *buf) {
+
+	//variables
+	TagLineBlockNumber max_start = current_tag->max_start_allowed;
+	BLOCK *current_block = NULL;
+	SCHEDULED_BLOCK new_scheduled_block;		// where the primary copy of a new block goes
+	SCHEDULED_BLOCK new_scheduled_block_backup;	// where its backup goes
+	uint32_t old_checksum = 0;			// checksum of an overwritten block before the write
+
+	// Are we writing a new block or overwriting an old one?
+	// New Block:
+	if (bnum == max_start) {
+		//new = 1;
+		// room for the new block in the tag first, so its copies are not claimed for nothing
+		if (grow_tag_blocks(current_tag) != 0) {
+			logMessage(LOG_INFO_LEVEL, "ERROR: malloc fails when adding a new block to a tagline");
+			return(-1);
+		}
+	     // take the next block of the extents of the tag for both copies of the new block,
+	     // the primary staying off the disk of the backup extent (while it has blocks left)
+	     // and the backup off the disk of the primary
+		pthread_mutex_lock(&schedule_lock);
+		if (RAID_scheduler(&current_tag->primary_extent,
+				(current_tag->backup_extent.next_block < current_tag->backup_extent.end_block) ?
+				current_tag->backup_extent.disk : RAID_ALLOC_ANY_DISK, &new_scheduled_block) != 0) {
+			pthread_mutex_unlock(&schedule_lock);
+			logMessage(LOG_INFO_LEVEL, "ERROR: finding a disk and block in RAID to store new block");
+			return(-1);
+		}
+		if (RAID_scheduler(&current_tag->backup_extent, new_scheduled_block.disk, &new_scheduled_block_backup) != 0) {
+			RAID_unschedule(&current_tag->primary_extent, &new_scheduled_block);
+			pthread_mutex_unlock(&schedule_lock);
+			logMessage(LOG_INFO_LEVEL, "ERROR: finding a disk and block in RAID to store new block");
+			return(-1);
+		}
+		pthread_mutex_unlock(&schedule_lock);
+		// Update Cache, one buffer for both copies (written back to both); if it fails the
+		// blocks go back to their extents, with no entry left to be written back to them
+		if (put_raid_cache_mirrored(new_scheduled_block.disk, new_scheduled_block.block,
+				new_scheduled_block_backup.disk, new_scheduled_block_backup.block, buf) != 0) {
+			drop_raid_cache(new_scheduled_block.disk, new_scheduled_block.block);
+			pthread_mutex_lock(&schedule_lock);
+			RAID_unschedule(&current_tag->backup_extent, &new_scheduled_block_backup);
+			RAID_unschedule(&current_tag->primary_extent, &new_scheduled_block);
+			pthread_mutex_unlock(&schedule_lock);
+			logMessage(LOG_INFO_LEVEL, "ERROR : WRITE UNSUCCESSFUL");
+			return(-1);
+		}
+
+	     //UPDATE Structures
+		// append the new block at the end of the tag (grows max_start_allowed by one, there is room)
+		append_new_block(current_tag);
+		current_block = &current_tag->blocks[bnum];
+		current_block->RAID_disk = new_scheduled_block.disk;
+		current_block->RAID_block = new_scheduled_block.block;
+		// add the backup information to the new block
+		current_block->backup_disk = new_scheduled_block_backup.disk;
+		current_block->backup_block = new_scheduled_block_backup.block;
+		current_block->checksum = raid_checksum(buf, RAID_BLOCK_SIZE);
+
+		// record what both RAID blocks hold in the reverse map, and the new block in the journal
+		pthread_mutex_lock(&schedule_lock);
+		if ((raid_map_set(new_scheduled_block.disk, new_scheduled_block.block, current_tag - taglines, bnum) != 0) ||
+				(raid_map_set(new_scheduled_block_backup.disk, new_scheduled_block_backup.block, current_tag - taglines, bnum) != 0)) {
+			pthread_mutex_unlock(&schedule_lock);
+			logMessage(LOG_INFO_LEVEL, "ERROR: RAID block scheduled for new block does not exist");
+			return(-1);
+		}
+		if (tagline_journal_block(current_tag, bnum, NULL) != 0) {
+			pthread_mutex_unlock(&schedule_lock);
+			logMessage(LOG_INFO_LEVEL, "ERROR: new block could not be journaled");
+			return(-1);
+		}
+		pthread_mutex_unlock(&schedule_lock);
+	}
+	// Old Block:
+	if (bnum < max_start) {
+		// index the block we need directly
+		current_block = &current_tag->blocks[bnum];
+		old_checksum = current_block->checksum;
+		
+		// store the disk and block for the tag and block we want to modify
+		// Update Cache, one buffer for both copies (written back to both)
+		if (put_raid_cache_mirrored(current_block->RAID_disk, current_block->RAID_block,
+				current_block->backup_disk, current_block->backup_block, buf) != 0) {
+			logMessage(LOG_INFO_LEVEL, "ERROR : WRITE UNSUCCESSFUL");
+			return(-1);
+		}
+		current_block->checksum = raid_checksum(buf, RAID_BLOCK_SIZE);
+
+		// journal the new checksum and the old one, the record can reach the file before the
+		// cache writes the block back, so a resume may find either contents on the disks
+		// (only with a checkpoint, the scheduling lock stays off the overwrites otherwise)
+		if (tagline_checkpoint_file != NULL) {
+			pthread_mutex_lock(&schedule_lock);
+			if (tagline_journal_block(current_tag, bnum, &old_checksum) != 0) {
+				pthread_mutex_unlock(&schedule_lock);
+				logMessage(LOG_INFO_LEVEL, "ERROR: overwritten block could not be journaled");
+				return(-1);
+			}
+			pthread_mutex_unlock(&schedule_lock);
+		}
+	}
+	
+	// Return successfully
+	return(0);
+}
+// ----------------------------------------------------------------------------------------------------------
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_readv
+// Description  : Read the blocks of a number of segments, of any taglines, at once:
+//		  the hits are copied out of the cache, and the misses of all the
+//		  segments are sorted by disk and block, read once each (a block
+//		  asked for twice is read once) in runs of blocks contiguous on a
+//		  disk, sent back to back before waiting for any of them
+//
+// Inputs       : segs - the segments to read
+//		  count - the number of segments
+// Outputs      : 0 if successful, -1 if failure
+int tagline_readv(const TAGLINE_SEGMENT *segs, int count) {
+
+	TagLineNumber	*tags = NULL;		// taglines of the segments, each once
+	VECTOR_READ	*misses = NULL;		// blocks not found in the cache
+	RUN_READ	*reads = NULL;		// read of each run of missed blocks
+	char		*read_buf = NULL;	// blocks read, in the order of the misses
+	BLOCK		*slot_blocks = NULL;	// mapping of the block of each slot (to hedge a run)
+	BLOCK		*current_block = NULL;
+	BLOCK_TO_READ	copy, next;
+	uint64_t	total = 0, start = tagline_histograms ? tagline_histogram_now() : 0;
+	uint32_t	nmisses = 0, slots = 0, m = 0, run = 0;
+	int		ntags = 0, runs = 0, backup = 0, i = 0, r = 0, result = -1;
+	TagLineBlockNumber block = 0;
+
+	// do the tags exist?
+	for (i = 0; i < count; i++) {
+		if (segs[i].tag >= taglines_in_use) {
+			logMessage(LOG_INFO_LEVEL, "ERROR: Attempt to read from a non-existent tagline");
+			return(-1);
+		}
+		total += segs[i].blks;
+	}
+	if (total == 0) {
+		return(0);
+	}
+	tags = malloc(count*sizeof(TagLineNumber));
+	misses = malloc(total*sizeof(VECTOR_READ));
+	if ((tags == NULL) || (misses == NULL)) {
+		free(tags);
+		free(misses);
+		logMessage(LOG_INFO_LEVEL, "ERROR: malloc fails when reading %lu blocks", (unsigned long)total);
+		return(-1);
+	}
+
+	// rebuild a few blocks of a failed disk first, if one is being rebuilt, and scrub a few
+	if ((raid_rebuild_advance() != 0) || (raid_scrub_advance() != 0)) {
+		free(tags);
+		free(misses);
+		return(-1);
+	}
+	ntags = tagline_lock_segments(segs, count, tags);
+
+	// ----  Check Cache ----
+	// copy every hit out before any miss is added to the cache, and note where the
+	// misses are read from (the copy whose disk has fewer requests waiting)
+	for (i = 0; i < count; i++) {
+		if (segs[i].bnum + segs[i].blks > taglines[segs[i].tag].max_start_allowed) {
+			logMessage(LOG_INFO_LEVEL, "ERROR: Attemp to read an unallocated block");
+			goto unlock;
+		}
+		for (block = 0; block < segs[i].blks; block++) {
+			current_block = &taglines[segs[i].tag].blocks[segs[i].bnum + block];
+			if (copy_raid_cache(current_block->RAID_disk, current_block->RAID_block,
+					segs[i].buf+(RAID_BLOCK_SIZE*block)) == 0) {
+				continue;
+			}
+			backup = (raid_block_copy(current_block, 0, &copy) != 0) ||
+					((raid_block_copy(current_block, 1, &next) == 0) &&
+					 (client_raid_bus_depth(current_block->backup_disk) < client_raid_bus_depth(current_block->RAID_disk)));
+			raid_block_copy(current_block, backup, &copy);
+			misses[nmisses].disk = copy.disk;
+			misses[nmisses].block = copy.block;
+			misses[nmisses].backup = backup;
+			misses[nmisses].mapping = current_block;
+			misses[nmisses].buf = segs[i].buf+(RAID_BLOCK_SIZE*block);
+			nmisses++;
+		}
+	}
+	if (nmisses == 0) {
+		result = 0;
+		goto unlock;
+	}
+
+	// ---- Read Misses ----
+	// in disk and block order, each block gets a slot of the read buffer (shared by the
+	// misses of the same block), so a run of contiguous blocks lands in contiguous slots
+	qsort(misses, nmisses, sizeof(VECTOR_READ), compare_vector_reads);
+	for (m = 0; m < nmisses; m++) {
+		if ((m > 0) && (misses[m].disk == misses[m - 1].disk) && (misses[m].block == misses[m - 1].block)) {
+			misses[m].slot = misses[m - 1].slot;
+		}
+		else {
+			misses[m].slot = slots++;
+		}
+	}
+	reads = malloc(slots*sizeof(RUN_READ));
+	read_buf = malloc(slots*RAID_BLOCK_SIZE);
+	slot_blocks = malloc(slots*sizeof(BLOCK));
+	if ((reads == NULL) || (read_buf == NULL) || (slot_blocks == NULL)) {
+		logMessage(LOG_INFO_LEVEL, "ERROR: malloc fails when reading %u blocks", slots);
+		goto unlock;
+	}
+	for (m = 0; m < nmisses; m++) {
+		slot_blocks[misses[m].slot] = *misses[m].mapping;
+	}
+	for (m = 0; m < nmisses; m += run) {
+		// extend the read over the following blocks stored right after it on the same disk
+		// (the same copy of each, a slow run is hedged with the other copies)
+		run = 1;
+		while ((m + run < nmisses) && (misses[m + run].disk == misses[m].disk) &&
+				(misses[m + run].backup == misses[m].backup) &&
+				(misses[m + run].slot - misses[m].slot < RAID_MAX_XFER) &&
+				(misses[m + run].block == misses[m].block + (misses[m + run].slot - misses[m].slot))) {
+			run++;
+		}
+		reads[runs].start = misses[m].slot;
+		reads[runs].length = misses[m + run - 1].slot - misses[m].slot + 1;
+		reads[runs].backup = misses[m].backup;
+		reads[runs].sent = tagline_histogram_now();
+		reads[runs].tag = raid_submit(RAID_READ, misses[m].disk, misses[m].block, reads[runs].length,
+				read_buf+(RAID_BLOCK_SIZE*misses[m].slot));
+		if (reads[runs].tag < 0) {
+			logMessage(LOG_INFO_LEVEL, "Error reading from disk");
+			for (r = 0; r < runs; r++) {
+				raid_complete(reads[r].tag);
+			}
+			goto unlock;
+		}
+		runs++;
+	}
+	// then collect them all, hedging the slow ones
+	for (r = 0; r < runs; r++) {
+		if (raid_complete_read(slot_blocks, &reads[r], read_buf) != 0) {
+			logMessage(LOG_INFO_LEVEL, "Error reading from disk");
+			for (r++; r < runs; r++) {
+				raid_complete(reads[r].tag);
+			}
+			goto unlock;
+		}
+		if (tagline_histograms) {
+			tagline_histogram_record(TAGLINE_HIST_RAID, tagline_histogram_now() - reads[r].sent);
+		}
+	}
+	// and hand out the blocks read, checking each against its checksum and adding it to
+	// the cache once (clean, under its primary)
+	for (m = 0; m < nmisses; m++) {
+		if (((m == 0) || (misses[m].slot != misses[m - 1].slot)) &&
+				(raid_block_verify(misses[m].mapping, read_buf+(RAID_BLOCK_SIZE*misses[m].slot)) != 0)) {
+			goto unlock;
+		}
+		memcpy(misses[m].buf, read_buf+(RAID_BLOCK_SIZE*misses[m].slot), RAID_BLOCK_SIZE);
+		if (((m == 0) || (misses[m].slot != misses[m - 1].slot)) &&
+				(fill_raid_cache(misses[m].mapping->RAID_disk, misses[m].mapping->RAID_block, misses[m].buf) != 0)) {
+			logMessage(LOG_INFO_LEVEL, "Error adding block to cache");
+		}
+	}
+	result = 0;
+
+unlock:
+	tagline_unlock_segments(tags, ntags);
+	free(slot_blocks);
+	free(read_buf);
+	free(reads);
+	free(misses);
+	free(tags);
+	if (result != 0) {
+		return(-1);
+	}
+	if (tagline_histograms) {
+		start = tagline_histogram_now() - start;
+		tagline_histogram_record(TAGLINE_HIST_READ, start);
+		tagline_histogram_record(nmisses ? TAGLINE_HIST_CACHE_MISS : TAGLINE_HIST_CACHE_HIT, start);
+	}
+
 	// Return successfully
-	logMessage(LOG_INFO_LEVEL, "TAGLINE : read %u blocks from tagline %u, starting block %u.",
-			blks, tag, bnum);
+	RAID_LOG_HOT("TAGLINE : read %lu blocks of %d segments (%u read from %u runs).",
+			(unsigned long)total, count, slots, runs);
 	return(0);
 }
-// ----------------------------------------------------------------------------------------------------------
 
 
-
-// Function     : tagline_write
-// Description  : Write a number of blocks from the tagline driver
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_writev
+// Description  : Write the blocks of a number of segments, of any taglines, in the
+//		  order of the segments (a segment may append to the tagline right
+//		  after the one before it, and overwrite what an earlier one wrote)
 //
-// Inputs       : tag - the number of the tagline to write from
-//                bnum - the starting block to write from
-//                blks - the number of blocks to write
-//                bug - the place to write the blocks into
+// Inputs       : segs - the segments to write
+//		  count - the number of segments
 // Outputs      : 0 if successful, -1 if failure
-int tagline_write(TagLineNumber tag, TagLineBlockNumber bnum, uint8_t blks, char *buf) {
-
-	//variables
-	
-	TagLineBlockNumber max_start = 0;
-
-	TAGLINE	*current_tag = NULL;
-	BLOCK *current_block = NULL;
-	BLOCK *new_block = NULL;
-	new_block = malloc(sizeof(BLOCK));
+int tagline_writev(const TAGLINE_SEGMENT *segs, int count) {
 
-	// variables for handling more than one block
+	TagLineNumber	*tags = NULL;		// taglines of the segments, each once
+	TAGLINE		*current_tag = NULL;
 	TagLineBlockNumber block = 0;
+	uint64_t	start = tagline_histograms ? tagline_histogram_now() : 0;
+	int		ntags = 0, i = 0, result = 0;
 
-	// Valid number of blocks requested?
-	if (blks > 1) {
-		for (block = 0; block < blks; block++) {
-			temp_buf = buf+(RAID_BLOCK_SIZE*block);
-			if (tagline_write(tag,bnum+block,1,temp_buf) != 0) {
-				logMessage(LOG_INFO_LEVEL, "ERROR: Block number %d was not written properly.", block);
-				return(-1);
-			}
+	// do the tags exist?
+	for (i = 0; i < count; i++) {
+		if (segs[i].tag >= taglines_in_use) {
+			logMessage(LOG_INFO_LEVEL, "ERROR: Attempting to write to a nonexisting tagline");
+			return(-1);
 		}
-		// return successfully
-		logMessage(LOG_INFO_LEVEL, "TAGLINE : wrote %u blocks to tagline %u, starting block %u.",blks, tag, bnum);	
+	}
+	if (count == 0) {
 		return(0);
 	}
-	// Does the tag exist?
-	if (tag >= taglines_in_use) {
-		logMessage(LOG_INFO_LEVEL, "ERROR: Attempting to write to a nonexisting tagline");
+	tags = malloc(count*sizeof(TagLineNumber));
+	if (tags == NULL) {
+		logMessage(LOG_INFO_LEVEL, "ERROR: malloc fails when writing %d segments", count);
+		return(-1);
 	}
-	// Does the starting block make sense?
-	max_start = get_max_start_allowed(tag);
-	if (bnum > max_start) {
-		logMessage(LOG_INFO_LEVEL, "ERROR: Attemping to write beyond allowed start");
+
+	// rebuild a few blocks of a failed disk first, if one is being rebuilt, and scrub a few
+	if ((raid_rebuild_advance() != 0) || (raid_scrub_advance() != 0)) {
+		free(tags);
+		return(-1);
 	}
-	// Are we writing a new block or overwriting an old one?
-	// New Block:
-	if (bnum == max_start) {
-		//new = 1;
-	// --- PRIMARY BLOCK ---
-	     // look for a disk and block in the RAID array for the new block
-		if (RAID_scheduler(new_scheduled_block,-1) != 0) {
-			logMessage(LOG_INFO_LEVEL, "ERROR: finding a disk and block in RAID to store new block");
-			return(-1);
+	ntags = tagline_lock_segments(segs, count, tags);
+	for (i = 0; (i < count) && (result == 0); i++) {
+		current_tag = &taglines[segs[i].tag];
+		// Does the starting block make sense?
+		if (segs[i].bnum > current_tag->max_start_allowed) {
+			logMessage(LOG_INFO_LEVEL, "ERROR: Attemping to write beyond allowed start");
+			result = -1;
+			break;
 		}
-		// store the disk and block scheduled for this tag and block
-		// Update Cache		
-		if (put_raid_cache(new_scheduled_block->disk, new_scheduled_block->block, buf) != 0) {
-			logMessage(LOG_INFO_LEVEL, "ERROR : WRITE UNSUCCESSFUL");
-			return(-1);
-		}
-
-	     //UPDATE Structures
-		// update last_block_added[disk]
-		last_block_added[new_scheduled_block->disk]++;
-		// find the last block in the tag
-		current_tag = head_tag;
-		while(current_tag->tagline != tag) {
-			current_tag = current_tag->next_tagline;
-		}
-		// add 1 to the block count for that tag
-		current_tag->blocks_in_tagline = current_tag->blocks_in_tagline + 1;
-		current_tag->max_start_allowed = current_tag->max_start_allowed + 1;
-		// find the last block and append the new one to it
-		current_block = current_tag->block_0;
-		// check if block_0 is empty first:
-		if (current_block == NULL) {
-			new_block->block = bnum;
-			new_block->RAID_disk = new_scheduled_block->disk;
-			new_block->RAID_block = new_scheduled_block->block;
-			new_block->next_block = NULL;
-			current_block = new_block;
-			current_tag->block_0 = current_block;	
-		// if it's not empty, find the last block and append the new one to it
-		} else {
-			while (current_block->next_block != NULL) {
-				current_block = current_block->next_block;
+		for (block = 0; block < segs[i].blks; block++) {
+			if (tagline_write_block(current_tag, segs[i].bnum+block, segs[i].buf+(RAID_BLOCK_SIZE*block)) != 0) {
+				logMessage(LOG_INFO_LEVEL, "ERROR: Block number %d of segment %d was not written properly.", block, i);
+				result = -1;
+				break;
 			}
-			new_block->block = bnum;
-			new_block->RAID_disk = new_scheduled_block->disk;
-			new_block->RAID_block = new_scheduled_block->block;
-			new_block->next_block = NULL;
-			current_block->next_block = new_block;
-		}
-	// --- BACKUP BLOCK ---
-	     // look for a disk and block in the RAID array for the new block
-		if (RAID_scheduler(new_scheduled_block_backup, new_scheduled_block->disk) != 0) {
-			logMessage(LOG_INFO_LEVEL, "ERROR: finding a disk and block in RAID to store new block");
-			return(-1);
-		}
-		
-		// store the disk and block scheduled for this tag and block
-		// Update Cache
-		if (put_raid_cache(new_scheduled_block_backup->disk, new_scheduled_block_backup->block, buf) != 0) {
-			logMessage(LOG_INFO_LEVEL, "ERROR : WRITE UNSUCCESSFUL");
-			return(-1);
 		}
+	}
+	tagline_unlock_segments(tags, ntags);
+	free(tags);
+	if (result != 0) {
+		return(-1);
+	}
+	if (tagline_histograms) {
+		tagline_histogram_record(TAGLINE_HIST_WRITE, tagline_histogram_now() - start);
+	}
 
-	     //UPDATE Structures
-		// update last_block_added[disk]
-		last_block_added[new_scheduled_block_backup->disk]++;
-		// find the last block in the tag
-		current_tag = head_tag;
-		while(current_tag->tagline != tag) {
-			current_tag = current_tag->next_tagline;
-		}
-		// find the corresponding block and add the backup information
-		current_block = current_tag->block_0;
-		while (current_block->block != new_block->block) {
-			current_block = current_block->next_block;
-		}
-		new_block->backup_disk = new_scheduled_block_backup->disk;
-		new_block->backup_block = new_scheduled_block_backup->block;
+	// Return successfully
+	RAID_LOG_HOT("TAGLINE : wrote %d segments.", count);
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_lock_segments
+// Description  : takes the locks of the taglines of a number of segments for a
+//		  vectored read/write, in tagline order (so two of them never wait for
+//		  each other), and completes their read ahead still in flight
+//
+// Inputs       : segs - the segments
+//		  count - the number of segments, at least one
+//		  tags - set to the taglines locked, in order (room for count)
+// Outputs      : the number of taglines locked
+int tagline_lock_segments(const TAGLINE_SEGMENT *segs, int count, TagLineNumber *tags) {
+	int i = 0, ntags = 0;
+
+	for (i = 0; i < count; i++) {
+		tags[i] = segs[i].tag;
 	}
-	// Old Block:
-	if (bnum < max_start) {
-	// --- PRIMARY BLOCK ---
-		current_tag = head_tag;
-		// loop through the tags and find the one we need
-		while (current_tag->tagline != tag) {
-			current_tag = current_tag->next_tagline;
-		}
-		current_block = current_tag->block_0;
-		// loop through the blocks and find the one we need
-		while (current_block->block != bnum) {
-			current_block = current_block->next_block;
-		}
-		
-		// store the disk and block for the tag and block we want to modify
-		// Update Cache
-		if (put_raid_cache(current_block->RAID_disk, current_block->RAID_block, buf) != 0) {
-			logMessage(LOG_INFO_LEVEL, "ERROR : WRITE UNSUCCESSFUL");
-			return(-1);
+	qsort(tags, count, sizeof(TagLineNumber), compare_taglines);
+	for (i = 0; i < count; i++) {
+		if ((ntags == 0) || (tags[ntags - 1] != tags[i])) {
+			tags[ntags++] = tags[i];
 		}
+	}
+
+	// other threads may read or write other taglines meanwhile
+	pthread_rwlock_rdlock(&rebuild_lock);
+	for (i = 0; i < ntags; i++) {
+		pthread_mutex_lock(&taglines[tags[i]].lock);
+		tagline_prefetch_complete(&taglines[tags[i]]);
+	}
+	return(ntags);
+}
 
 
-	// --- BACKUP BLOCK ---
-		// Update Cache
-		if (put_raid_cache(current_block->backup_disk, current_block->backup_block, buf)) {
-			logMessage(LOG_INFO_LEVEL, "ERROR : WRITE UNSUCCESSFUL");
-			return(-1);
-		}	
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_unlock_segments
+// Description  : releases the locks taken by tagline_lock_segments
+//
+// Inputs       : tags - the taglines locked
+//		  ntags - the number of taglines locked
+// Outputs      : N/A
+void tagline_unlock_segments(TagLineNumber *tags, int ntags) {
+	int i = 0;
+
+	for (i = ntags - 1; i >= 0; i--) {
+		pthread_mutex_unlock(&taglines[tags[i]].lock);
+	}
+	pthread_rwlock_unlock(&rebuild_lock);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : compare_vector_reads
+// Description  : orders the missed blocks of a vectored read by disk and block (qsort)
+//
+// Inputs       : a, b - the two VECTOR_READs to compare
+// Outputs      : <0, 0 or >0 if a goes before, with or after b
+int compare_vector_reads(const void *a, const void *b) {
+	const VECTOR_READ *x = a;
+	const VECTOR_READ *y = b;
+
+	if (x->disk != y->disk) {
+		return((x->disk < y->disk) ? -1 : 1);
+	}
+	if (x->block != y->block) {
+		return((x->block < y->block) ? -1 : 1);
 	}
-	
-	// Return successfully
-	logMessage(LOG_INFO_LEVEL, "TAGLINE : wrote %u blocks to tagline %u, starting block %u.",
-			blks, tag, bnum);
 	return(0);
 }
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : compare_taglines
+// Description  : orders tagline numbers (qsort)
+//
+// Inputs       : a, b - the two TagLineNumbers to compare
+// Outputs      : <0, 0 or >0 if a goes before, with or after b
+int compare_taglines(const void *a, const void *b) {
+	const TagLineNumber *x = a;
+	const TagLineNumber *y = b;
+
+	return((int)*x - (int)*y);
+}
 // ----------------------------------------------------------------------------------------------------------
 
 
@@ -705,66 +2019,74 @@ int tagline_close(void) {
 	// variables
 	void *buf = NULL;
 	// RAID_CLOSE setup
+	RAID_REQUEST close;
+	RAID_RESPONSE close_response;
 	RAIDOpCode close_opcode;
 	RAIDOpCode close_opcode_response;
 	RAID_REQUEST_TYPES request_type_close = RAID_CLOSE;
 
+	// a disk still being rebuilt gets the rest of its blocks, and the read ahead still
+	// in flight is answered before the cache goes
+	pthread_rwlock_wrlock(&rebuild_lock);
+	if (rebuild.active && (raid_rebuild_step(RAID_DISKBLOCKS) != 0)) {
+		pthread_rwlock_unlock(&rebuild_lock);
+		logMessage(LOG_INFO_LEVEL, "ERROR: rebuild of disk %u FAILED.", rebuild.disk);
+		return(-1);
+	}
+	pthread_rwlock_unlock(&rebuild_lock);
+	tagline_prefetch_complete(NULL);
 	if (close_raid_cache() != 0) {
 		logMessage(LOG_INFO_LEVEL, "ERROR Closing Cache.");
 		return(-1);
 	}
+	if (prefetched_blocks > 0) {
+		logMessage(LOG_OUTPUT_LEVEL, "Read ahead: %lu blocks read, %lu blocks of sequential reads found cached in the read ahead window",
+				(unsigned long)prefetched_blocks, (unsigned long)prefetch_hits);
+	}
+	if (hedged_reads > 0) {
+		logMessage(LOG_OUTPUT_LEVEL, "Hedged reads: %lu (%lu answered first by the other copy)",
+				(unsigned long)hedged_reads, (unsigned long)hedge_wins);
+	}
+	if ((scrubbed_blocks > 0) || (checksum_errors > 0)) {
+		logMessage(LOG_OUTPUT_LEVEL, "Checksums: %lu blocks scrubbed, %lu bad copies found (%lu repaired, %lu blocks lost)",
+				(unsigned long)scrubbed_blocks, (unsigned long)checksum_errors,
+				(unsigned long)checksum_repairs, (unsigned long)checksum_losses);
+	}
+	if (rebuild_count > 0) {
+		logMessage(LOG_OUTPUT_LEVEL, "Rebuilds: %u disks, %lu blocks in %.3f seconds (%.0f blocks/s)",
+				rebuild_count, (unsigned long)rebuild_blocks, rebuild_seconds,
+				(rebuild_seconds > 0) ? rebuild_blocks / rebuild_seconds : 0);
+	}
 
 	// initialize close
-	close->request_type = request_type_close;
-	close->number_of_blocks = 0;
-	close->disk_number = 0;
-	close->reserved = 0;
-	close->status = 0;
-	close->blockid = 0;
+	close.request_type = request_type_close;
+	close.number_of_blocks = 0;
+	close.disk_number = 0;
+	close.reserved = 0;
+	close.status = 0;
+	close.blockid = 0;
 
 	// call RAID_CLOSE
-	close_opcode = generate_RAIDOpCode(close);
+	close_opcode = generate_RAIDOpCode(&close);
 	close_opcode_response = client_raid_bus_request(close_opcode, buf);
-	decode_RAIDOpCode(close_opcode_response, close_response);
+	decode_RAIDOpCode(close_opcode_response, &close_response);
 	// check if not successful
-	if (check_response(close, close_response) != 0) {
+	if (check_response(&close, &close_response) != 0) {
 		logMessage(LOG_INFO_LEVEL, "ERROR: TAGLINE storage device closing FAILED.");
 		return(-1);
 	}
 
-	// free the linked-lists:
-	free_tag_linked_list(head_tag);
+	RAID_STATS_LOG();
 
-	// free global containers
-	free(init);
-	init = NULL;
-	free(init_response);
-	init_response = NULL;
-	
-	free(format);
-	format = NULL;
-	free(format_response);
-	format_response = NULL;
-
-	free(read);
-	read = NULL;
-	free(read_response);
-	read_response = NULL;
-
-	free(close);
-	close = NULL;
-	free(close_response);
-	close_response = NULL;
-
-	free(status);
-	status = NULL;
-	free(status_response);
-	status_response = NULL;
-
-	//free(temp_buf);
-	//temp_buf = NULL;
-	free(buf_read);
-	buf_read = NULL;
+	// the disks have every block now, checkpoint the tagline map (the blocks journaled go in it)
+	if ((tagline_checkpoint_file != NULL) && (tagline_checkpoint() != 0)) {
+		logMessage(LOG_INFO_LEVEL, "ERROR: TAGLINE checkpoint FAILED.");
+		free_taglines();
+		return(-1);
+	}
+
+	// free the tagline arrays:
+	free_taglines();
 
 	// Return successfully
 	logMessage(LOG_INFO_LEVEL, "TAGLINE storage device: closing completed.");
@@ -773,33 +2095,311 @@ int tagline_close(void) {
 
 
 //////////////////////////////////////////////////////////////////////////////////
-// Function     : free_tag_linked_list
-// Description  : recursively go through the list, free the list of blocks associated with each node
-//		  and then free the tag
+// Function     : tagline_checkpoint
+// Description  : writes the map of every tagline to a new checkpoint, replacing the
+//		  last one and its journal
 //
-// Inputs       : tag - pointer to a tag node on the list
-// Outputs      : N/A
-void free_tag_linked_list(TAGLINE *tag) {
-	if (tag->next_tagline != NULL) {
-		free_tag_linked_list(tag->next_tagline);
+// Inputs       : N/A
+// Outputs      :  0 if successful
+//		  -1 if not successful
+int tagline_checkpoint(void) {
+	uint32_t *counts = NULL;
+	TAGLINE_CHECKPOINT_BLOCK checkpointed;
+	BLOCK *current_block = NULL;
+	TagLineNumber tag = 0;
+	TagLineBlockNumber block = 0;
+
+	if (tagline_journal_close() != 0) {
+		return(-1);
+	}
+	counts = malloc(taglines_in_use*sizeof(uint32_t) + 1);	// (there may be no taglines)
+	if (counts == NULL) {
+		return(-1);
+	}
+	for (tag = 0; tag < taglines_in_use; tag++) {
+		counts[tag] = taglines[tag].max_start_allowed;
+	}
+	if (tagline_checkpoint_begin(taglines_in_use, counts) != 0) {
+		free(counts);
+		return(-1);
+	}
+	free(counts);
+	checkpointed.unused = 0;
+	for (tag = 0; tag < taglines_in_use; tag++) {
+		for (block = 0; block < taglines[tag].max_start_allowed; block++) {
+			current_block = &taglines[tag].blocks[block];
+			checkpointed.disk = current_block->RAID_disk;
+			checkpointed.backup_disk = current_block->backup_disk;
+			checkpointed.block = current_block->RAID_block;
+			checkpointed.backup_block = current_block->backup_block;
+			checkpointed.checksum = current_block->checksum;
+			if (tagline_checkpoint_block(&checkpointed) != 0) {
+				return(-1);
+			}
+		}
+	}
+	return(tagline_checkpoint_commit());
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_journal_block
+// Description  : records a block appended to a tagline, or overwritten, in the
+//		  journal (where its copies are, and the checksum of its contents);
+//		  called under the scheduling lock
+//
+// Inputs       : current_tag - the tagline
+//		  bnum - the block
+//		  old_checksum - checksum of the contents overwritten (NULL if appended)
+// Outputs      :  0 if successful
+//		  -1 if the journal could not be written
+int tagline_journal_block(TAGLINE *current_tag, TagLineBlockNumber bnum, const uint32_t *old_checksum) {
+	TAGLINE_CHECKPOINT_BLOCK journaled;
+	BLOCK *current_block = &current_tag->blocks[bnum];
+
+	journaled.disk = current_block->RAID_disk;
+	journaled.backup_disk = current_block->backup_disk;
+	journaled.unused = 0;
+	journaled.block = current_block->RAID_block;
+	journaled.backup_block = current_block->backup_block;
+	journaled.checksum = current_block->checksum;
+	return(tagline_journal_append(current_tag - taglines, bnum, &journaled, old_checksum));
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_resume
+// Description  : rebuilds the taglines, the allocator and the reverse map from a
+//		  checkpoint and its journal, if every disk still holds what it had
+//		  (formatted, or failed and to be rebuilt)
+//
+// Inputs       : checkpoint - the mapped checkpoint
+// Outputs      :  0 if successful
+//		  -1 if the taglines can not be resumed from it
+int tagline_resume(TAGLINE_CHECKPOINT *checkpoint) {
+	RAID_DISK_STATE	states[RAID_DISKS];
+	const TAGLINE_JOURNAL_RECORD *record = NULL;
+	BLOCK		*current_block = NULL;
+	RAIDDiskID	disk = 0;
+	TagLineNumber	tag = 0;
+	uint64_t	next = 0;
+	uint32_t	r = 0, block = 0, overwrites = 0;
+
+	// a disk never formatted lost what the checkpoint says it holds
+	if (raid_disks_status(states) != 0) {
+		return(-1);
+	}
+	for (disk = 0; disk < RAID_DISKS; disk++) {
+		if (states[disk] == RAID_DISK_UNINITIALIZED) {
+			logMessage(LOG_INFO_LEVEL, "TAGLINE : disk %u is not formatted, not resuming from the checkpoint", disk);
+			return(-1);
+		}
+	}
+
+	// the blocks of the checkpoint, then the ones appended (or overwritten) since
+	for (tag = 0; tag < taglines_in_use; tag++) {
+		for (block = 0; block < checkpoint->counts[tag]; block++) {
+			if (tagline_resume_block(tag, &checkpoint->blocks[next++]) != 0) {
+				return(-1);
+			}
+		}
+	}
+	for (r = 0; r < checkpoint->record_count; r++) {
+		record = &checkpoint->records[r];
+		if (record->overwrite && (record->tag < taglines_in_use) && (record->bnum < taglines[record->tag].max_start_allowed)) {
+			// an overwrite, the copies stay where they were (which contents they hold is settled below)
+			current_block = &taglines[record->tag].blocks[record->bnum];
+			if ((record->block.disk == current_block->RAID_disk) && (record->block.block == current_block->RAID_block) &&
+					(record->block.backup_disk == current_block->backup_disk) &&
+					(record->block.backup_block == current_block->backup_block)) {
+				current_block->checksum = record->block.checksum;
+				overwrites++;
+				continue;
+			}
+		}
+		if (record->overwrite || (record->tag >= taglines_in_use) ||
+				(record->bnum != taglines[record->tag].max_start_allowed) ||
+				(tagline_resume_block(record->tag, &record->block) != 0)) {
+			logMessage(LOG_INFO_LEVEL, "TAGLINE : bad journal record %u, not resuming from the checkpoint", r);
+			return(-1);
+		}
+	}
+	if (overwrites > 0) {
+		return(tagline_resume_overwrites(checkpoint));
+	}
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_resume_overwrites
+// Description  : settles the blocks overwritten since the checkpoint: a record
+//		  reaches the journal before the cache writes the block back, so
+//		  each copy may hold the contents of any of the records of the block
+//		  (or the ones before the first)
+//
+// Inputs       : checkpoint - the mapped checkpoint, its journal already resumed
+// Outputs      :  0 if successful
+//		  -1 if the overwrites could not be gathered
+int tagline_resume_overwrites(TAGLINE_CHECKPOINT *checkpoint) {
+	RESUME_OVERWRITE *overwrites = NULL;
+	uint32_t	*chain = NULL;
+	uint32_t	r = 0, count = 0, first = 0, next = 0;
+
+	// the overwrites of each block together, in the order they were journaled
+	overwrites = malloc(checkpoint->record_count * sizeof(RESUME_OVERWRITE));
+	chain = malloc((checkpoint->record_count + 1) * sizeof(uint32_t));
+	if ((overwrites == NULL) || (chain == NULL)) {
+		free(overwrites);
+		free(chain);
+		logMessage(LOG_INFO_LEVEL, "ERROR: no memory to settle the overwritten blocks");
+		return(-1);
+	}
+	for (r = 0; r < checkpoint->record_count; r++) {
+		if (checkpoint->records[r].overwrite) {
+			overwrites[count].tag = checkpoint->records[r].tag;
+			overwrites[count].bnum = checkpoint->records[r].bnum;
+			overwrites[count].record = r;
+			count++;
+		}
+	}
+	qsort(overwrites, count, sizeof(RESUME_OVERWRITE), compare_resume_overwrites);
+
+	// the checksums each block went through, oldest first
+	for (first = 0; first < count; first = next) {
+		chain[0] = checkpoint->records[overwrites[first].record].old_checksum;
+		for (next = first; (next < count) && (overwrites[next].tag == overwrites[first].tag) &&
+				(overwrites[next].bnum == overwrites[first].bnum); next++) {
+			chain[next - first + 1] = checkpoint->records[overwrites[next].record].block.checksum;
+		}
+		tagline_resume_settle(&taglines[overwrites[first].tag].blocks[overwrites[first].bnum], chain, next - first + 1);
+	}
+	free(overwrites);
+	free(chain);
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_resume_settle
+// Description  : reads both copies of an overwritten block and keeps the newest
+//		  contents either holds (of the checksums journaled for it), writing
+//		  them over the other copy if it holds older ones
+//
+// Inputs       : current_block - the block
+//		  chain - the checksums of its contents, oldest first
+//		  length - number of checksums
+// Outputs      : N/A (if neither copy holds journaled contents the newest checksum
+//		  is kept, and reads of the block fail its checks)
+void tagline_resume_settle(BLOCK *current_block, const uint32_t *chain, int length) {
+	char		primary[RAID_BLOCK_SIZE], backup[RAID_BLOCK_SIZE];
+	uint32_t	primary_checksum = 0, backup_checksum = 0;
+	int		primary_rank = -1, backup_rank = -1;
+
+	// the position of what each copy holds in the chain (-1 if not in it, or not read)
+	if (raid_transfer(RAID_READ, current_block->RAID_disk, current_block->RAID_block, 1, primary) == 0) {
+		primary_checksum = raid_checksum(primary, RAID_BLOCK_SIZE);
+		for (primary_rank = length - 1; (primary_rank >= 0) && (chain[primary_rank] != primary_checksum); primary_rank--);
+	}
+	if (raid_transfer(RAID_READ, current_block->backup_disk, current_block->backup_block, 1, backup) == 0) {
+		backup_checksum = raid_checksum(backup, RAID_BLOCK_SIZE);
+		for (backup_rank = length - 1; (backup_rank >= 0) && (chain[backup_rank] != backup_checksum); backup_rank--);
+	}
+	if ((primary_rank < 0) && (backup_rank < 0)) {
+		logMessage(LOG_INFO_LEVEL, "TAGLINE : no copy of RAID block %u on disk %u holds journaled contents",
+				current_block->RAID_block, current_block->RAID_disk);
+		return;
+	}
+
+	// keep the newest contents, copied over the other copy if it is behind (a failed disk is left to its rebuild)
+	if (primary_rank >= backup_rank) {
+		current_block->checksum = primary_checksum;
+		if ((primary_rank != backup_rank) &&
+				(raid_transfer(RAID_WRITE, current_block->backup_disk, current_block->backup_block, 1, primary) != 0)) {
+			logMessage(LOG_INFO_LEVEL, "TAGLINE : backup of RAID block %u on disk %u not settled",
+					current_block->RAID_block, current_block->RAID_disk);
+		}
+	} else {
+		current_block->checksum = backup_checksum;
+		if (raid_transfer(RAID_WRITE, current_block->RAID_disk, current_block->RAID_block, 1, backup) != 0) {
+			logMessage(LOG_INFO_LEVEL, "TAGLINE : RAID block %u on disk %u not settled",
+					current_block->RAID_block, current_block->RAID_disk);
+		}
 	}
-	free_block_linked_list(tag->block_0);
-	free(tag);
 	return;
 }
 
 
 //////////////////////////////////////////////////////////////////////////////////
-// Function     : free_block_linked_list
-// Description  : recursively goes thorugh the blocks, free a block and go back to the previous until block_0 
+// Function     : compare_resume_overwrites
+// Description  : orders the overwrites of the journal by tagline and block, the
+//		  ones of a block in the order they were journaled (for qsort)
+//
+// Inputs       : a, b - the overwrites compared
+// Outputs      : <0, 0 or >0 as a goes before, with or after b
+int compare_resume_overwrites(const void *a, const void *b) {
+	const RESUME_OVERWRITE *first = a, *second = b;
+
+	if (first->tag != second->tag) {
+		return((first->tag < second->tag) ? -1 : 1);
+	}
+	if (first->bnum != second->bnum) {
+		return((first->bnum < second->bnum) ? -1 : 1);
+	}
+	return((first->record < second->record) ? -1 : (first->record > second->record));
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : tagline_resume_block
+// Description  : appends a block of a checkpoint to its tagline, allocating both
+//		  of its copies and recording them in the reverse map
+//
+// Inputs       : tag - the tagline
+//		  checkpointed - where the copies of the block are
+// Outputs      :  0 if successful
+//		  -1 if the copies are not free RAID blocks
+int tagline_resume_block(TagLineNumber tag, const TAGLINE_CHECKPOINT_BLOCK *checkpointed) {
+	BLOCK *current_block = NULL;
+	TagLineBlockNumber bnum = taglines[tag].max_start_allowed;
+
+	if ((checkpointed->disk == checkpointed->backup_disk) ||
+			(raid_alloc_claim(checkpointed->disk, checkpointed->block) != 0) ||
+			(raid_alloc_claim(checkpointed->backup_disk, checkpointed->backup_block) != 0) ||
+			(append_new_block(&taglines[tag]) != 0)) {
+		return(-1);
+	}
+	current_block = &taglines[tag].blocks[bnum];
+	current_block->RAID_disk = checkpointed->disk;
+	current_block->RAID_block = checkpointed->block;
+	current_block->backup_disk = checkpointed->backup_disk;
+	current_block->backup_block = checkpointed->backup_block;
+	current_block->checksum = checkpointed->checksum;
+	raid_map_set(checkpointed->disk, checkpointed->block, tag, bnum);
+	raid_map_set(checkpointed->backup_disk, checkpointed->backup_block, tag, bnum);
+	return(0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : free_taglines
+// Description  : free the array of blocks of every tagline, and then the array of taglines
 //
-// Inputs       : block - pointer to a block node on the list
-// Outputs      : N/A 
-void free_block_linked_list(BLOCK *block) {
-	if (block->next_block != NULL) {
-		free_block_linked_list(block->next_block);
+// Inputs       : N/A
+// Outputs      : N/A
+void free_taglines(void) {
+	TagLineNumber tag = 0;
+
+	if (taglines == NULL) {
+		return;
+	}
+	for (tag = 0; tag < taglines_in_use; tag++) {
+		free(taglines[tag].blocks);
+		pthread_mutex_destroy(&taglines[tag].lock);
 	}
-	free(block);
+	free(taglines);
+	taglines = NULL;
+	taglines_in_use = 0;
 	return;
 }
 
@@ -840,180 +2440,171 @@ int check_response (RAID_REQUEST *request, RAID_RESPONSE *response) {
 
 
 //////////////////////////////////////////////////////////////////////////////////
-// Function     : generate_RAIDOpCode
-// Description  : generate a raid opcode for a particular set of values
+// Function     : raid_transfer
+// Description  : reads/writes a run of consecutive blocks of a RAID disk with a single
+//		  RAID_READ/RAID_WRITE (up to RAID_MAX_XFER blocks), and waits for it
 //
-// Inputs       : opcode - pointer to a structure that contains the fields that make up the opcode
-// Outputs      : generated_opcode - RAIDOpCode type that has the final opcode bits
-RAIDOpCode generate_RAIDOpCode (RAID_REQUEST *opcode) {
-	RAIDOpCode generated_opcode = 0;
-		
-	// add request type
-	generated_opcode = opcode->request_type;			// 0000 0000 0000 0012
-	generated_opcode = generated_opcode << 8;			// 0000 0000 0000 1200
-	generated_opcode = generated_opcode + opcode->number_of_blocks; // 0000 0000 0000 1234
-	generated_opcode = generated_opcode << 8;			// 0000 0000 0012 3400
-	generated_opcode = generated_opcode + opcode->disk_number;	// 0000 0000 0012 3456
-	generated_opcode = generated_opcode << 7;			// 0000 0000 1234 5600
-	generated_opcode = generated_opcode + opcode->reserved;		// 0000 0000 1234 5678
-	generated_opcode = generated_opcode << 1;			// 0000 0000 2468 xxxx
-	generated_opcode = generated_opcode + opcode->status;		// 0000 0000 xxxx xxxx
-	generated_opcode = generated_opcode << 32;			// xxxx xxxx 0000 0000
-	generated_opcode = generated_opcode + opcode->blockid;
-	//generated_opcode = 0x0080050000000000;
-
-	return(generated_opcode);
+// Inputs       : type - RAID_READ or RAID_WRITE
+//		  disk, block - the first RAID block of the run
+//		  blocks - number of blocks in the run
+//		  buf - memory holding blocks*RAID_BLOCK_SIZE bytes to read into/write from
+// Outputs      :  0 if successful
+//		  -1 if not successful
+int raid_transfer(RAID_REQUEST_TYPES type, RAIDDiskID disk, RAIDBlockID block, uint8_t blocks, char *buf) {
+	uint64_t start = tagline_histograms ? tagline_histogram_now() : 0;
+	RAIDRequestTag tag = raid_submit(type, disk, block, blocks, buf);
+	int result = 0;
+
+	if (tag < 0) {
+		return(-1);
+	}
+	result = raid_complete(tag);
+	if (tagline_histograms) {
+		tagline_histogram_record(TAGLINE_HIST_RAID, tagline_histogram_now() - start);
+	}
+	return(result);
 }
 
 
 //////////////////////////////////////////////////////////////////////////////////
-// Function     : decode_RAIDOpCode
-// Description  : decode a raid opcode into its fields
+// Function     : raid_submit
+// Description  : sends a RAID_READ/RAID_WRITE of a run of consecutive blocks of a RAID
+//		  disk, without waiting for the response
 //
-// Inputs       : opcode - RAIDOpCode to decode
-//		  response - pointer to a struct that will store the decoded values
-// Outputs      : N/A
-void decode_RAIDOpCode (RAIDOpCode opcode, RAID_RESPONSE *response) {
+// Inputs       : type - RAID_READ or RAID_WRITE
+//		  disk, block - the first RAID block of the run
+//		  blocks - number of blocks in the run
+//		  buf - memory holding blocks*RAID_BLOCK_SIZE bytes to read into/write from,
+//			must stay valid until the transfer is completed
+// Outputs      : tag of the transfer, -1 if not successful
+RAIDRequestTag raid_submit(RAID_REQUEST_TYPES type, RAIDDiskID disk, RAIDBlockID block, uint8_t blocks, char *buf) {
+	return(client_raid_bus_submit(raid_opcode(type, blocks, disk, block), buf, RAID_ATTACHED));
+}
 
-	// 0x00 80 05 00 000000
-	
-	// extract block ID
-	response->blockid = opcode & 0x00000000FFFFFFFF;	// get the value of the last 31 bits and store it in block ID
-	opcode = opcode >> 32;					// move left by 31 bits to get rid of bits already read
 
-	// extract status
-	response->status = opcode & 0x0000000000000001;		// get the value of the last bit and store it in status
-	opcode = opcode >> 1;
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : raid_complete
+// Description  : waits for a transfer sent by raid_submit and checks its response
+//
+// Inputs       : tag - the tag of the transfer
+// Outputs      :  0 if successful
+//		  -1 if not successful
+int raid_complete(RAIDRequestTag tag) {
+	RAID_RESPONSE	response;
 
-	// extract reserved
-	response->reserved = opcode & 0x000000000000003F;	// get the last 6 bits and store them in reserved
-	opcode = opcode >> 7;
+	decode_RAIDOpCode(client_raid_bus_complete(tag), &response);
+	if (response.status != 0) {
+		logMessage(LOG_INFO_LEVEL, "ERROR: transfer of %u blocks at disk %u block %u failed",
+				response.number_of_blocks, response.disk_number, response.blockid);
+		return(-1);
+	}
+	return(0);
+}
 
-	// extract disk number
-	response->disk_number = opcode & 0x00000000000000FF;	// get the last 8 bits and store them in disk number
-	opcode = opcode >> 8;
-	
-	// extract number of blocks
-	response->number_of_blocks = opcode & 0x00000000000000FF;	// get the last 8 bits and store them in number of blocks
-	opcode = opcode >> 8;
 
-	// extract request type
-	response->request_type = opcode;					// no need to mask since it will only take the last 8 bits anyway
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : append_new_block 
+// Description  : adds a new block at the end of the array of blocks of a tag, doubling
+//		  the array when it is full so appends are O(1) (amortized)
+//
+// Inputs       : tag - pointer to the tag to add the block to
+// Outputs      : 0 if successful, -1 if something goes wrong
+int append_new_block(TAGLINE *tag) {
+	// is there room for one more block?
+	if (grow_tag_blocks(tag) != 0) {
+		return(-1);
+	}
+	// initialize fields of the new block
+	memset(&tag->blocks[tag->max_start_allowed], 0, sizeof(BLOCK));
+	// add 1 to the number of blocks in the tag
+	tag->max_start_allowed++;
+	// Return successfully
+	return(0);
 }
 
+
 //////////////////////////////////////////////////////////////////////////////////
-// Function     : add_new_tag 
-// Description  : adds a new tag to the linked-list of tags, if the list is empty
-//		  it adds the first tag, otherwise it finds the last tag and appends
-//		  the new tag to it
+// Function     : grow_tag_blocks
+// Description  : makes room for one more block at the end of the array of blocks of
+//		  a tag, doubling the array when it is full
 //
-// Inputs       : N/A
+// Inputs       : tag - pointer to the tag
 // Outputs      : 0 if successful, -1 if something goes wrong
-int add_new_tag() {
-	// create a new pointer to a tag
-	TAGLINE *new_tag = malloc(sizeof(TAGLINE));
-	TAGLINE *current = NULL;
-	int tag_counter = 0;						
+int grow_tag_blocks(TAGLINE *tag) {
+	TagLineBlockNumber new_capacity = 0;
+	BLOCK *new_blocks = NULL;
+
+	if (tag->max_start_allowed < tag->block_capacity) {
+		return(0);
+	}
+	new_capacity = (tag->block_capacity == 0) ? TAGLINE_INITIAL_BLOCKS : tag->block_capacity * 2;
+	new_blocks = realloc(tag->blocks, sizeof(BLOCK)*new_capacity);
 	// malloc successful?
-	if (new_tag == NULL) {
-		logMessage(LOG_INFO_LEVEL, "Malloc returns NULL when trying to allocate a new tag!");
+	if (new_blocks == NULL) {
+		logMessage(LOG_INFO_LEVEL, "Malloc returns NULL when trying to grow the blocks of a tag!");
 		return(-1);
 	}
-	// initialize fields
-	new_tag->tagline = tag_counter;
-	new_tag->max_start_allowed = 0;
-	new_tag->blocks_in_tagline = 0;
-	new_tag->next_tagline = NULL;
-	new_tag->block_0 = NULL;
-	// if head is null (in other words, list is empty), then point head to the new tag
-	if (head_tag == NULL) {
-		head_tag = new_tag;
-	}
-	// otherwise, find the last tag and add the new tag to it
-	else {
-		current = head_tag;			// start iterating from the first tag
-		tag_counter = 0;			// current points to tag 0 initially
-		while (current->next_tagline != NULL) {		// iterate until we find last tag (last tag will have pointer next to NULL)
-			current = current->next_tagline;
-			tag_counter++;	
-		}
-		new_tag->tagline = tag_counter + 1;	// tag_counter contains the number of the last tag, so the new tag added will be +1
-		current->next_tagline = new_tag;
-	}
-	// add 1 to the number of tags in use
-	taglines_in_use++;
-	// Return successfully
+	tag->blocks = new_blocks;
+	tag->block_capacity = new_capacity;
 	return(0);
 }
 
 
 //////////////////////////////////////////////////////////////////////////////////
 // Function     : RAID_scheduler
-// Description  : finds a disk and block ID corresponding to the RAID array for a new block to be written
+// Description  : finds a disk and block ID corresponding to the RAID array for a new block to be written,
+//		  the next block of an extent of its tag, reserving a new extent (twice as long as the
+//		  last one, up to RAID_MAX_XFER blocks) when it is used up or on the disk to avoid
 //
-// Inputs       : new_scheduled_block - pointer to a block that stores a disk and block to store it in
+// Inputs       : extent - the extent of the tag to take the block from
+//		  avoid - disk the block can not go on, or RAID_ALLOC_ANY_DISK
+//		  new_scheduled_block - pointer to a block that stores a disk and block to store it in
 // Outputs      : 0 if successful
 //		 -1 if no space on RAID for this block
-int RAID_scheduler(SCHEDULED_BLOCK *new_scheduled_block, RAIDDiskID primary_disk) {
-//	int disk = 0;
-//	int capacity = RAID_DISKBLOCKS - 1;
-//	if (primary_disk == -1) {
-//		for (disk = 0; disk < RAID_DISKS; disk++) {
-//			if (last_block_added[disk] < (capacity - 1)) {
-//				new_scheduled_block->disk = disk;
-//				new_scheduled_block->block = last_block_added[disk] + 1;
-//				return(0);
-//			}
-//		}
-//	}
-///	else {
-//		for (disk = 0; disk < RAID_DISKS; disk++) {
-//			if (disk != primary_disk) {
-//				if (last_block_added[disk] < (capacity - 1)) {
-//					new_scheduled_block->disk = disk;
-//					new_scheduled_block->block = last_block_added[disk] + 1;
-//					return(0);
-//				}
-//			}
-//		}
-//	}
-//	logMessage(LOG_INFO_LEVEL, "ERROR: RAID disks ran out of space");
-//	return(-1);
-
-	if (current_block == RAID_DISKBLOCKS && current_disk == RAID_DISKS) {
-		logMessage(LOG_ERROR_LEVEL, "Tagline : All Disks are full!");
-		return(-1);
-	}
-
-	if (current_block == RAID_DISKBLOCKS-1 && current_disk == RAID_DISKS) {
-		new_scheduled_block->disk = current_disk;
-		new_scheduled_block->block = current_block;
-		current_disk++;
-		current_block++;
-		return(0);
-	}
-
-	if (current_disk == RAID_DISKS-1) {
-		new_scheduled_block->disk = current_disk;
-		new_scheduled_block->block = current_block;
-		current_disk = 0;
-		if (current_block == RAID_DISKBLOCKS) {
-			current_block = 0;
+int RAID_scheduler(EXTENT *extent, RAIDDiskID avoid, SCHEDULED_BLOCK *new_scheduled_block) {
+	RAIDDiskID	disk = 0;
+	RAIDBlockID	start = 0;
+	uint32_t	blocks = 0;
+
+	while (1) {
+		if ((extent->next_block < extent->end_block) && (extent->disk != avoid)) {
+			if (raid_alloc_claim(extent->disk, extent->next_block) == 0) {
+				new_scheduled_block->disk = extent->disk;
+				new_scheduled_block->block = extent->next_block;
+				extent->next_block++;
+				return(0);
+			}
+			// another extent took the block once the disks filled up, give this one up
 		}
-		else {
-			current_block++;
+		raid_alloc_release(extent->disk, extent->next_block, extent->end_block);
+
+		// reserve a new extent
+		extent->length = (extent->length == 0) ? RAID_EXTENT_MIN_BLOCKS :
+				((extent->length * 2 < RAID_MAX_XFER) ? extent->length * 2 : RAID_MAX_XFER);
+		if (raid_alloc_extent(avoid, extent->length, &disk, &start, &blocks) != 0) {
+			extent->next_block = extent->end_block = 0;
+			return(-1);
 		}
-		return(0);
-	}
-	else {
-		new_scheduled_block->disk = current_disk;
-		new_scheduled_block->block = current_block;
-		current_disk++;
-		return(0);
+		extent->disk = disk;
+		extent->next_block = start;
+		extent->end_block = start + blocks;
 	}
+}
 
-	return(0);
 
+//////////////////////////////////////////////////////////////////////////////////
+// Function     : RAID_unschedule
+// Description  : gives back the block RAID_scheduler just took from an extent, for a
+//		  write that failed: the extent hands it out again next
+//
+// Inputs       : extent - the extent the block was taken from
+//		  scheduled_block - the block
+// Outputs      : N/A
+void RAID_unschedule(EXTENT *extent, SCHEDULED_BLOCK *scheduled_block) {
+	raid_alloc_unclaim(scheduled_block->disk, scheduled_block->block);
+	if ((extent->disk == scheduled_block->disk) && (extent->next_block == scheduled_block->block + 1)) {
+		extent->next_block--;
+	}
 }
 
 
@@ -1024,10 +2615,5 @@ int RAID_scheduler(SCHEDULED_BLOCK *new_scheduled_block, RAIDDiskID primary_disk
 // Inputs       : tag - number of the tag to read/write a block from/to
 // Outputs      : max_start_allowed - max block number to read/write
 TagLineBlockNumber get_max_start_allowed(TagLineNumber tag) {
-	TAGLINE *current = NULL;
-	current = head_tag;
-	while (current->tagline != tag) {
-		current = current->next_tagline;
-	}
-	return current->max_start_allowed;
+	return taglines[tag].max_start_allowed;
 }
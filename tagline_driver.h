@@ -26,6 +26,24 @@
 typedef uint16_t TagLineNumber;
 typedef uint32_t TagLineBlockNumber;
 
+// A run of blocks of a tagline, one of the segments of a vectored read/write
+typedef struct {
+	TagLineNumber		tag;	// the tagline
+	TagLineBlockNumber	bnum;	// first block of the run
+	uint8_t			blks;	// number of blocks of the run
+	char			*buf;	// memory of the blocks
+} TAGLINE_SEGMENT;
+
+// Blocks of a failed disk rebuilt before each read/write (64 by default, 0 to rebuild it all
+// on the failure, the reads/writes waiting meanwhile)
+extern uint32_t raid_rebuild_rate;
+
+// Milliseconds a read of a missed block waits before its other copy is read too (0 to never)
+extern uint32_t raid_hedge_msec;
+
+// Blocks of the taglines scrubbed (both copies checked) before each read/write (0 to scrub only with raid_scrub)
+extern uint32_t raid_scrub_rate;
+
 //
 // Interface functions
 
@@ -38,10 +56,19 @@ int tagline_read(TagLineNumber tag, TagLineBlockNumber bnum, uint8_t blks, char
 int tagline_write(TagLineNumber tag, TagLineBlockNumber bnum, uint8_t blks, char *buf);
 	// Write a number of blocks from the tagline driver
 
+int tagline_readv(const TAGLINE_SEGMENT *segs, int count);
+	// Read the blocks of a number of segments, of any taglines, at once
+
+int tagline_writev(const TAGLINE_SEGMENT *segs, int count);
+	// Write the blocks of a number of segments, of any taglines, in order
+
 int tagline_close(void);
 	// Close the tagline interface
 
 int raid_disk_signal(void);
 	// A disk has failed which needs to be recovered
 
+int raid_scrub(uint32_t blocks);
+	// Check both copies of the next blocks of the taglines, repairing a bad one
+
 #endif /* RAID_DRIVER_INCLUDED */
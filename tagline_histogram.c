@@ -0,0 +1,253 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : tagline_histogram.c
+//  Description    : This is the implementation of the latency histograms of the
+//                   TAGLINE driver.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+// ****************************************************************************
+// The histograms are log-linear, like HDR histograms: latencies under
+// 2*TAGLINE_HIST_SUB_BUCKETS nanoseconds have a bucket each, and every power of
+// two above is split into TAGLINE_HIST_SUB_BUCKETS buckets, so a bucket is
+// never wider than about 3% of the latencies it holds, from nanoseconds to
+// hours, in a fixed array. A percentile is the highest latency of the bucket
+// it falls in.
+
+
+// Includes
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// Project includes
+#include <cmpsc311_log.h>
+#include <tagline_histogram.h>
+
+// Data Structures Definitions
+typedef struct {
+	uint64_t	counts[TAGLINE_HIST_BUCKETS];	// latencies in each bucket
+	uint64_t	total;				// latencies recorded
+	uint64_t	sum;				// nanoseconds of all of them
+	uint64_t	max;				// the longest
+} TAGLINE_HISTOGRAM;
+
+// Global data
+const char *TAGLINE_HIST_LABELS[TAGLINE_HIST_MAXVAL] = {
+	"tagline_read", "tagline_write", "cache_hit", "cache_miss", "raid_round_trip"
+};
+int tagline_histograms = 0;
+static TAGLINE_HISTOGRAM histograms[TAGLINE_HIST_MAXVAL];
+
+// Function Prototypes:
+int histogram_bucket(uint64_t nsec);
+uint64_t histogram_bucket_highest(int bucket);
+void histogram_save_string(FILE *fhandle, const char *str);
+// -----------------------------
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_histogram_record
+// Description  : Record a latency
+//
+// Inputs       : type - the histogram
+//                nsec - the latency, in nanoseconds
+// Outputs      : N/A
+
+void tagline_histogram_record(TAGLINE_HIST_TYPE type, uint64_t nsec) {
+
+	TAGLINE_HISTOGRAM	*hist = &histograms[type];
+	uint64_t		max;
+
+	__atomic_fetch_add(&hist->counts[histogram_bucket(nsec)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->total, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->sum, nsec, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+	while ((nsec > max) && !__atomic_compare_exchange_n(&hist->max, &max, nsec, 0,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_histogram_count
+// Description  : Number of latencies recorded in a histogram
+//
+// Inputs       : type - the histogram
+// Outputs      : the number of latencies
+
+uint64_t tagline_histogram_count(TAGLINE_HIST_TYPE type) {
+	return(__atomic_load_n(&histograms[type].total, __ATOMIC_RELAXED));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_histogram_percentile
+// Description  : Latency under which a percentile of the latencies of a
+//                histogram are
+//
+// Inputs       : type - the histogram
+//                percentile - the percentile (e.g., 99.9)
+// Outputs      : the latency, in nanoseconds (0 if none was recorded)
+
+uint64_t tagline_histogram_percentile(TAGLINE_HIST_TYPE type, double percentile) {
+
+	TAGLINE_HISTOGRAM	*hist = &histograms[type];
+	uint64_t		rank, seen = 0, highest;
+	int			i;
+
+	if (hist->total == 0) {
+		return(0);
+	}
+	rank = (uint64_t)(percentile / 100.0 * hist->total + 0.5);
+	rank = (rank < 1) ? 1 : (rank > hist->total) ? hist->total : rank;
+	for (i = 0; i < TAGLINE_HIST_BUCKETS; i++) {
+		seen += hist->counts[i];
+		if (seen >= rank) {
+			highest = histogram_bucket_highest(i);
+			return((highest < hist->max) ? highest : hist->max);
+		}
+	}
+	return(hist->max);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_histogram_reset
+// Description  : Forget every latency recorded (no thread may be recording)
+//
+// Inputs       : none
+// Outputs      : N/A
+
+void tagline_histogram_reset(void) {
+	memset(histograms, 0, sizeof(histograms));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_histogram_log
+// Description  : Log the percentiles of every histogram with latencies
+//
+// Inputs       : none
+// Outputs      : N/A
+
+void tagline_histogram_log(void) {
+
+	int	i;
+
+	logMessage(LOG_OUTPUT_LEVEL, "** Latency Histograms **");
+	for (i = 0; i < TAGLINE_HIST_MAXVAL; i++) {
+		if (histograms[i].total == 0) {
+			continue;
+		}
+		logMessage(LOG_OUTPUT_LEVEL, "%-16s %8lu, avg %.1f us, p50 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us",
+				TAGLINE_HIST_LABELS[i], (unsigned long)histograms[i].total,
+				histograms[i].sum / (double)histograms[i].total / 1e3,
+				tagline_histogram_percentile(i, 50) / 1e3, tagline_histogram_percentile(i, 99) / 1e3,
+				tagline_histogram_percentile(i, 99.9) / 1e3, histograms[i].max / 1e3);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_histogram_save
+// Description  : Append the results of a run to a file, as a line of JSON with
+//                the throughput and, for each histogram, the number of latencies
+//                and their percentiles in nanoseconds
+//
+// Inputs       : filename - the file to append to
+//                workload - the workload replayed
+//                threads - threads it was replayed with
+//                ops - operations replayed
+//                seconds - time the replay took
+// Outputs      : 0 if successful, -1 if failure
+
+int tagline_histogram_save(const char *filename, const char *workload, int threads, uint64_t ops, double seconds) {
+
+	FILE	*fhandle;
+	int	i;
+
+	if ((fhandle = fopen(filename, "a")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening the results file [%s], error: %s.",
+			filename, strerror(errno));
+		return(-1);
+	}
+	fprintf(fhandle, "{\"workload\": ");
+	histogram_save_string(fhandle, workload);
+	fprintf(fhandle, ", \"threads\": %d, \"ops\": %lu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"latency_ns\": {",
+			threads, (unsigned long)ops, seconds, (seconds > 0) ? ops / seconds : 0);
+	for (i = 0; i < TAGLINE_HIST_MAXVAL; i++) {
+		fprintf(fhandle, "%s\"%s\": {\"count\": %lu, \"mean\": %.0f, \"p50\": %lu, \"p99\": %lu, \"p999\": %lu, \"max\": %lu}",
+				(i > 0) ? ", " : "", TAGLINE_HIST_LABELS[i], (unsigned long)histograms[i].total,
+				(histograms[i].total > 0) ? histograms[i].sum / (double)histograms[i].total : 0,
+				(unsigned long)tagline_histogram_percentile(i, 50), (unsigned long)tagline_histogram_percentile(i, 99),
+				(unsigned long)tagline_histogram_percentile(i, 99.9), (unsigned long)histograms[i].max);
+	}
+	fprintf(fhandle, "}}\n");
+	if (fclose(fhandle) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing the results file [%s], error: %s.",
+			filename, strerror(errno));
+		return(-1);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : histogram_bucket
+// Description  : Find the bucket of a latency
+//
+// Inputs       : nsec - the latency
+// Outputs      : the bucket
+
+int histogram_bucket(uint64_t nsec) {
+
+	int	shift;
+
+	if (nsec < 2 * TAGLINE_HIST_SUB_BUCKETS) {
+		return((int)nsec);
+	}
+	// the top TAGLINE_HIST_SUB_BITS+1 bits of the latency pick the bucket
+	shift = 63 - __builtin_clzll(nsec) - TAGLINE_HIST_SUB_BITS;
+	return(shift * TAGLINE_HIST_SUB_BUCKETS + (int)(nsec >> shift));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : histogram_bucket_highest
+// Description  : Highest latency of a bucket
+//
+// Inputs       : bucket - the bucket
+// Outputs      : the latency
+
+uint64_t histogram_bucket_highest(int bucket) {
+
+	int	shift;
+
+	if (bucket < 2 * TAGLINE_HIST_SUB_BUCKETS) {
+		return((uint64_t)bucket);
+	}
+	shift = bucket / TAGLINE_HIST_SUB_BUCKETS - 1;
+	return((((uint64_t)(bucket - shift * TAGLINE_HIST_SUB_BUCKETS) + 1) << shift) - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : histogram_save_string
+// Description  : Write a string as a JSON string
+//
+// Inputs       : fhandle - the file
+//                str - the string
+// Outputs      : N/A
+
+void histogram_save_string(FILE *fhandle, const char *str) {
+
+	fputc('"', fhandle);
+	for (; *str != 0; str++) {
+		if ((*str == '"') || (*str == '\\')) {
+			fputc('\\', fhandle);
+		}
+		fputc(((unsigned char)*str < ' ') ? ' ' : *str, fhandle);
+	}
+	fputc('"', fhandle);
+}
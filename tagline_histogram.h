@@ -0,0 +1,73 @@
+#ifndef TAGLINE_HISTOGRAM_INCLUDED
+#define TAGLINE_HISTOGRAM_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : tagline_histogram.h
+//  Description    : This is the header file for the latency histograms of the
+//                   TAGLINE driver, used to benchmark it.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+//
+
+// Includes
+#include <stdint.h>
+#include <time.h>
+
+// Defines
+#define TAGLINE_HIST_SUB_BITS		5	// 32 buckets for each power of two (about 3% apart)
+#define TAGLINE_HIST_SUB_BUCKETS	(1 << TAGLINE_HIST_SUB_BITS)
+#define TAGLINE_HIST_BUCKETS		((65 - TAGLINE_HIST_SUB_BITS) * TAGLINE_HIST_SUB_BUCKETS)
+
+// Latencies recorded
+typedef enum {
+	TAGLINE_HIST_READ       = 0,	// tagline_read
+	TAGLINE_HIST_WRITE      = 1,	// tagline_write
+	TAGLINE_HIST_CACHE_HIT  = 2,	// tagline_read with every block in the cache
+	TAGLINE_HIST_CACHE_MISS = 3,	// tagline_read with some block read from the disks
+	TAGLINE_HIST_RAID       = 4,	// RAID request, from sending it to its response
+	TAGLINE_HIST_MAXVAL     = 5,	// Max value
+} TAGLINE_HIST_TYPE;
+extern const char *TAGLINE_HIST_LABELS[TAGLINE_HIST_MAXVAL];
+extern int tagline_histograms;		// 1 when latencies are recorded (0 by default)
+
+///
+// Histogram Interfaces
+// Recording is lock free (atomic counters), so every thread records in the same
+// histograms.
+
+void tagline_histogram_record(TAGLINE_HIST_TYPE type, uint64_t nsec);
+	// Record a latency, in nanoseconds
+
+uint64_t tagline_histogram_count(TAGLINE_HIST_TYPE type);
+	// Number of latencies recorded
+
+uint64_t tagline_histogram_percentile(TAGLINE_HIST_TYPE type, double percentile);
+	// Latency under which percentile % of the latencies are, in nanoseconds
+
+void tagline_histogram_reset(void);
+	// Forget every latency recorded
+
+void tagline_histogram_log(void);
+	// Log the percentiles of every histogram
+
+int tagline_histogram_save(const char *filename, const char *workload, int threads, uint64_t ops, double seconds);
+	// Append the results of a run to a file, as one line of JSON
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_histogram_now
+// Description  : the time latencies are measured with
+//
+// Inputs       : none
+// Outputs      : nanoseconds of the monotonic clock
+
+static inline uint64_t tagline_histogram_now(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
+#endif
@@ -21,6 +21,10 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <signal.h>
 
 // Project Includes
 #include <cmpsc311_log.h>
@@ -29,11 +33,17 @@
 #include <raid_cache.h>
 #include <raid_network.h>
 #include <tagline_driver.h>
+#include <tagline_workload.h>
+#include <tagline_histogram.h>
+#include <raid_stats.h>
+#include <tagline_checkpoint.h>
 
 // Defines
-#define TLINE_ARGUMENTS "hvfl:a:p:"
+#define TLINE_ARGUMENTS "hvfl:a:p:c:rP:s:b:H:W:t:j:T:C:S:DM:R:w:"
+#define TLINE_MAX_THREADS 64
+#define TLINE_MAX_WRITE_BATCH 64
 #define USAGE \
-	"USAGE: tagline_client [-h] [-v] [-l <logfile>] [-a <ip addr>] [-p <port>] [-f] <workload-file>\n" \
+	"USAGE: tagline_client [-h] [-v] [-l <logfile>] [-a <ip addr>] [-p <port>] [-c <connections>] [-r] [-P <policy>] [-s <shards>] [-D] [-M <KiB>] [-R <KiB>] [-b <blocks>] [-H <msec>] [-W <binary-file>] [-t <threads>] [-j <results-file>] [-T <trace-file>] [-C <checkpoint-file>] [-S <blocks>] [-w <ops>] [-f] <workload-file>\n" \
 	"\n" \
 	"where:\n" \
 	"    -h - help mode (display this message)\n" \
@@ -41,25 +51,83 @@
 	"    -l - write log messages to the filename <logfile>\n" \
 	"    -a - IP address of server to connect to.\n" \
 	"    -p - port number of server to connect to.\n" \
+	"    -c - number of connections to the server (default 1; the bundled server only services\n" \
+	"         one, INIT fails if a connection is not answered).\n" \
+	"    -r - spread requests over the connections round-robin, not by disk.\n" \
+	"    -P - cache replacement policy: lru (default), clock or 2q.\n" \
+	"    -s - number of shards the cache is split in (default 1).\n" \
+	"    -D - blocks of the cache with the same contents share one buffer.\n" \
+	"    -M - memory of the cache in KiB, split between blocks as they are and blocks compressed\n" \
+	"         (default 0, a cache of 1024 blocks as they are).\n" \
+	"    -R - resize the cache to <KiB> (at most its memory) once half of the workload is replayed.\n" \
+	"    -b - blocks of a failed disk rebuilt before each read/write (default 64; 0 rebuilds it\n" \
+	"         all at once, the reads and writes waiting meanwhile: otherwise a disk failing before\n" \
+	"         the rebuild is over loses what it had left).\n" \
+	"    -H - read the other copy of a block when a read takes more than <msec> (default 0, never;\n" \
+	"         only a copy going out on another connection than the read, see -c).\n" \
+	"    -W - compile the workload into the binary workload file <binary-file> and exit\n" \
+	"         (a binary workload is replayed like a text one, without parsing it).\n" \
+	"    -t - threads replaying the workload, each on its share of the taglines (default 1).\n" \
+	"    -j - record latency histograms, and append the results of the run to <results-file>\n" \
+	"         (one line of JSON a run).\n" \
+	"    -T - trace the RAID requests, written to <trace-file> at the end of the run and\n" \
+	"         whenever the simulator gets SIGUSR1 (needs a driver built with RAID_STATS).\n" \
+	"    -C - checkpoint the tagline map to <checkpoint-file> when the driver closes, and\n" \
+	"         resume from it (without formatting the disks) when it is initialized.\n" \
+	"    -S - blocks of the taglines scrubbed (both copies checked against their checksum)\n" \
+	"         before each read/write (default 0, never).\n" \
+	"    -w - write runs of up to <ops> consecutive writes of a thread with one vectored\n" \
+	"         write (default 1, each on its own).\n" \
 	"    -f - disable disk failures\n" \
 	"\n" \
-	"    <workload-file> - file contain the workload to simulate\n" \
+	"    <workload-file> - file contain the workload to simulate, or gen:<generator> for a\n" \
+	"         synthetic one, <uniform|zipf|scan|mix>[:<operations>[:<read percent>]]\n" \
 	"\n" \
 
 //
 // Global Data
 int verbose = 0;
 int disk_failures = 1;
-char rdbuf[TAGLINE_BLOCK_SIZE*MAX_TAGLINE_BLOCK_NUMBER]; // workload simulator read buffer
-char wrbuf[TAGLINE_BLOCK_SIZE*MAX_TAGLINE_BLOCK_NUMBER]; // workload simulator write buffer
-char tmbuf[TAGLINE_BLOCK_SIZE*MAX_TAGLINE_BLOCK_NUMBER]; // workload simulator temporary buffer
+char *binary_workload = NULL; // binary workload file to compile the workload into
+int sim_threads = 1; // threads replaying the workload
+int sim_write_batch = 1; // consecutive writes of a thread written with one vectored write
+size_t sim_cache_resize = 0; // memory the cache is resized to half way through the replay (0 for none)
+char *results_file = NULL; // file the benchmark results are appended to
+char *trace_file = NULL; // file the trace of the RAID requests is written to
+volatile sig_atomic_t trace_requested = 0; // set by SIGUSR1, the next operation writes the trace
+
+//
+// Type definitions
+
+// A thread replaying the workload, with its own buffers and statistics
+typedef struct {
+	int id; // thread number, it replays the taglines with tag % sim_threads == id
+	pthread_t thread;
+	const TAGLINE_WORKLOAD *workload;
+	uint32_t first, last; // run of operations replayed, [first, last)
+	int err; // 1 if an operation failed
+	uint64_t ops; // operations replayed
+	double latency_total, latency_max; // seconds spent in (the longest of) them
+	char wrbuf[TAGLINE_BLOCK_SIZE*MAX_TAGLINE_BLOCK_NUMBER]; // workload simulator write buffer
+	char tmbuf[TAGLINE_BLOCK_SIZE*MAX_TAGLINE_BLOCK_NUMBER]; // workload simulator temporary buffer
+	char wrfill[MAX_TAGLINE_BLOCK_NUMBER]; // character each block of the write buffer is filled with
+	const TAGLINE_OP **writes; // the writes of a vectored write (sim_write_batch of them)
+	TAGLINE_SEGMENT *segs; // their segments
+	char *wvbuf; // their blocks, MAX_TAGLINE_BLOCK_NUMBER for each
+	char *wvfill; // character each block of wvbuf is filled with
+} TAGLINE_REPLAYER;
 
 //
 // Functional Prototypes
 
 int simulate_TagLines(char *wload);
-int tagline_read_block_validate(TagLineNumber tagnum, TagLineBlockNumber blocknum,
-		uint16_t num_blocks, char *text);
+void *replay_TagLines(void *arg);
+void request_trace(int sig);
+int replay_operation(TAGLINE_REPLAYER *replayer, const TAGLINE_OP *op, const char *text);
+int replay_writes(TAGLINE_REPLAYER *replayer, int count);
+uint64_t report_TagLines(TAGLINE_REPLAYER *replayers, uint64_t barrier_ops, double seconds);
+int compile_TagLines(char *wload, char *binfile);
+int tagline_blocks_match(const char *buf, uint16_t num_blocks, const char *text);
 int remote_raid_fail_disk(RAIDDiskID dsk);
 
 //
@@ -115,6 +183,113 @@ int main(int argc, char *argv[]) {
 			}
             break;
 
+		case 'c': // Set the size of the connection pool
+			if ( (sscanf(optarg, "%hu", &raid_network_connections) != 1) ||
+					(raid_network_connections == 0) || (raid_network_connections > RAID_MAX_CONNECTIONS) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad number of connections [%s]", optarg );
+				return(-1);
+			}
+			break;
+
+		case 'r': // Route requests round-robin
+			raid_network_routing = RAID_ROUTE_ROUND_ROBIN;
+			break;
+
+		case 'P': // Set the cache replacement policy
+			for (raid_cache_policy = 0; raid_cache_policy < RAID_CACHE_POLICY_MAXVAL; raid_cache_policy++) {
+				if (strcmp(optarg, RAID_CACHE_POLICY_LABELS[raid_cache_policy]) == 0) {
+					break;
+				}
+			}
+			if (raid_cache_policy == RAID_CACHE_POLICY_MAXVAL) {
+				logMessage( LOG_ERROR_LEVEL, "Bad cache policy [%s]", optarg );
+				return(-1);
+			}
+			break;
+
+		case 's': // Set the number of cache shards
+			if ( (sscanf(optarg, "%hu", &raid_cache_shards) != 1) ||
+					(raid_cache_shards == 0) || (raid_cache_shards > RAID_CACHE_MAX_SHARDS) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad number of cache shards [%s]", optarg );
+				return(-1);
+			}
+			break;
+
+		case 'D': // Share the cache buffers of blocks with the same contents
+			raid_cache_dedup = 1;
+			break;
+
+		case 'M': // Set the memory budget of the cache
+			if ( (sscanf(optarg, "%zu", &raid_cache_memory) != 1) || (raid_cache_memory == 0) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad cache memory [%s]", optarg );
+				return(-1);
+			}
+			raid_cache_memory *= 1024;
+			break;
+
+		case 'R': // Resize the cache half way through
+			if ( (sscanf(optarg, "%zu", &sim_cache_resize) != 1) || (sim_cache_resize == 0) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad cache resize [%s]", optarg );
+				return(-1);
+			}
+			sim_cache_resize *= 1024;
+			break;
+
+		case 'b': // Set the rebuild rate
+			if ( sscanf(optarg, "%u", &raid_rebuild_rate) != 1 ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad rebuild rate [%s]", optarg );
+				return(-1);
+			}
+			break;
+
+		case 'H': // Set the hedging delay of reads
+			if ( sscanf(optarg, "%u", &raid_hedge_msec) != 1 ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad hedging delay [%s]", optarg );
+				return(-1);
+			}
+			break;
+
+		case 'W': // Compile the workload into a binary workload
+			binary_workload = optarg;
+			break;
+
+		case 'j': // Record latencies, and save the results
+			results_file = optarg;
+			tagline_histograms = 1;
+			break;
+
+		case 'T': // Trace the RAID requests
+			trace_file = optarg;
+			raid_stats_tracing = 1;
+			break;
+
+		case 'C': // Checkpoint the tagline map
+			tagline_checkpoint_file = optarg;
+			break;
+
+		case 'S': // Set the scrub rate
+			if ( sscanf(optarg, "%u", &raid_scrub_rate) != 1 ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad scrub rate [%s]", optarg );
+				return(-1);
+			}
+			break;
+
+		case 'w': // Set the number of writes of a vectored write
+			if ( (sscanf(optarg, "%d", &sim_write_batch) != 1) ||
+					(sim_write_batch <= 0) || (sim_write_batch > TLINE_MAX_WRITE_BATCH) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad number of writes a batch [%s]", optarg );
+				return(-1);
+			}
+			break;
+
+		case 't': // Set the number of replay threads
+			if ( (sscanf(optarg, "%d", &sim_threads) != 1) ||
+					(sim_threads <= 0) || (sim_threads > TLINE_MAX_THREADS) ) {
+				logMessage( LOG_ERROR_LEVEL, "Bad number of threads [%s]", optarg );
+				return(-1);
+			}
+			break;
+
 		default:  // Default (unknown)
 			fprintf(stderr, "Unknown command line option (%c), aborting.\n", ch);
 			return( -1 );
@@ -132,6 +307,9 @@ int main(int argc, char *argv[]) {
 	if (disk_failures == 0) {
 		logMessage(LOG_INFO_LEVEL, "Disabling disk failures.");
 	}
+	if (trace_file != NULL) {
+		signal(SIGUSR1, request_trace);
+	}
 
 	// The filename should be the next option
 	if (optind >= argc) {
@@ -142,6 +320,11 @@ int main(int argc, char *argv[]) {
 
 	}
 
+	// Convert the workload
+	if (binary_workload != NULL) {
+		return( compile_TagLines(argv[optind], binary_workload) );
+	}
+
 	// Run the simulation
 	if (simulate_TagLines(argv[optind]) == 0) {
 		logMessage(LOG_INFO_LEVEL, "Tagline simulation completed successfully.\n\n");
@@ -157,228 +340,488 @@ int main(int argc, char *argv[]) {
 //
 // Function     : simulate_Taglines
 // Description  : The main control loop for the processing of the Tagline
-//                simulation and associated drivers.
+//                simulation and associated drivers: the workload is compiled
+//                first, then its operations are replayed. With more than one
+//                thread, the reads, writes and validations between two of the
+//                other operations (INIT, CLOSE and DISKFAIL, which run alone)
+//                are split between the threads by tagline, so each tagline
+//                still sees its operations in order
 //
-// Inputs       : wload - the name of the workload file
+// Inputs       : wload - the name of the workload file (text or binary)
 // Outputs      : 0 if successful test, -1 if failure
 
 int simulate_TagLines(char *wload) {
 
 	// Local variables
-	char line[1024], command[128], text[1204], txt[5];
-	FILE *fhandle = NULL;
-	int32_t err=0, linecount, i;
-	uint16_t num_blocks;
-	TagLineNumber tagnum;
-	TagLineBlockNumber blocknum;
-
-	// Open the workload file
-	linecount = 0;
-	if ((fhandle=fopen(wload, "r")) == NULL) {
-		logMessage(LOG_ERROR_LEVEL, "Failure opening the workload file [%s], error: %s.\n",
-			wload, strerror(errno));
+	TAGLINE_WORKLOAD workload;
+	TAGLINE_REPLAYER *replayers;
+	struct timeval start, end;
+	uint32_t first, last;
+	uint64_t barrier_ops = 0, ops;
+	double seconds;
+	int i, err = 0;
+
+	// Map and compile the workload file
+	if (load_tagline_workload(wload, &workload) != 0) {
 		return(-1);
 	}
+	replayers = calloc(sim_threads, sizeof(TAGLINE_REPLAYER));
+	if (replayers == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure allocating %d replay threads", sim_threads);
+		close_tagline_workload(&workload);
+		return(-1);
+	}
+	for (i = 0; (i < sim_threads) && !err; i++) {
+		replayers[i].id = i;
+		replayers[i].workload = &workload;
+		if (sim_write_batch > 1) {
+			replayers[i].writes = malloc(sim_write_batch*sizeof(const TAGLINE_OP *));
+			replayers[i].segs = malloc(sim_write_batch*sizeof(TAGLINE_SEGMENT));
+			replayers[i].wvbuf = malloc((size_t)sim_write_batch*MAX_TAGLINE_BLOCK_NUMBER*TAGLINE_BLOCK_SIZE);
+			replayers[i].wvfill = calloc(sim_write_batch, MAX_TAGLINE_BLOCK_NUMBER);
+			if ((replayers[i].writes == NULL) || (replayers[i].segs == NULL) ||
+					(replayers[i].wvbuf == NULL) || (replayers[i].wvfill == NULL)) {
+				logMessage(LOG_ERROR_LEVEL, "Failure allocating the write batches of replay thread %d", i);
+				err = 1;
+			}
+		}
+	}
 
-	// While file not done
-	while (!feof(fhandle)) {
-
-		// Get the line and bail out on fail
-		if (fgets(line, 1024, fhandle) != NULL) {
+	// Replay the operations, a run of partitioned operations then the one after it
+	tagline_histogram_reset();
+	gettimeofday(&start, NULL);
+	for (first = 0; (first < workload.header.op_count) && !err; first = last + 1) {
+		for (last = first; (last < workload.header.op_count) && (workload.ops[last].type != TAGLINE_OP_INIT) &&
+				(workload.ops[last].type != TAGLINE_OP_CLOSE) && (workload.ops[last].type != TAGLINE_OP_DISKFAIL); last++);
+
+		if (last > first) {
+			for (i = 0; i < sim_threads; i++) {
+				replayers[i].first = first;
+				replayers[i].last = last;
+			}
+			if (sim_threads == 1) {
+				replay_TagLines(&replayers[0]);
+			} else {
+				for (i = 0; i < sim_threads; i++) {
+					if (pthread_create(&replayers[i].thread, NULL, replay_TagLines, &replayers[i]) != 0) {
+						logMessage(LOG_ERROR_LEVEL, "Failure starting replay thread %d", i);
+						replayers[i].err = 1;
+					}
+				}
+				for (i = 0; i < sim_threads; i++) {
+					if (! replayers[i].err) {
+						pthread_join(replayers[i].thread, NULL);
+					}
+				}
+			}
+			for (i = 0; i < sim_threads; i++) {
+				err |= replayers[i].err;
+			}
+		}
 
-			// Parse out the string
-			linecount ++;
-			if (sscanf(line, "%s %hu %hu %u %s", command, &tagnum, &num_blocks, &blocknum, text) != 5) {
+		if ((last < workload.header.op_count) && !err) {
+			err = (replay_operation(&replayers[0], &workload.ops[last], &workload.texts[workload.ops[last].text]) != 0);
+			barrier_ops++;
+		}
+	}
+	gettimeofday(&end, NULL);
 
-				// Bad data, error out
-				logMessage(LOG_ERROR_LEVEL, "Tagline un-parsable workload string, aborting [%s], line %d",
-						line, linecount);
-				fclose(fhandle);
-				return(-1);
+	// Check for the virtual level failing
+	if (err) {
+		logMessage(LOG_ERROR_LEVEL, "RAID system failed, aborting [%d]", err);
+	} else {
+		seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+		ops = report_TagLines(replayers, barrier_ops, seconds);
+		if (results_file != NULL) {
+			tagline_histogram_log();
+			if (tagline_histogram_save(results_file, wload, sim_threads, ops, seconds) != 0) {
+				err = 1;
+			}
+		}
+	}
 
-			} else {
+	// Write the trace of the end of the run
+	if ((trace_file != NULL) && (raid_stats_trace_dump(trace_file) != 0)) {
+		err = 1;
+	}
 
-				// Just log the contents
-				logMessage(LOG_INFO_LEVEL, "INPUT cmd=%s tag=%u #blks=%u start-blk=%u data=%s",
-						command, tagnum, num_blocks, blocknum, text);
+	// Release the workload
+	for (i = 0; i < sim_threads; i++) {
+		free(replayers[i].writes);
+		free(replayers[i].segs);
+		free(replayers[i].wvbuf);
+		free(replayers[i].wvfill);
+	}
+	free(replayers);
+	close_tagline_workload(&workload);
+	return(err ? -1 : 0);
+}
 
-				// If there is write processing to perform
-				if (strncmp(command, "INIT", 5) == 0) {
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replay_TagLines
+// Description  : Replay the operations of a run of the workload on the taglines
+//                of a thread (tagline modulo the number of threads), timing each
+//                (a batch of writes replayed together is timed as a whole)
+//
+// Inputs       : arg - the TAGLINE_REPLAYER of the thread
+// Outputs      : NULL
 
-					// Call the initialize function for the tagline storae
-					if (tagline_driver_init(tagnum)) {
-						// Error out
-						logMessage(LOG_ERROR_LEVEL, "INIT failed on raid array (%d tags)", tagnum);
-						err = 1;
-					}
+void *replay_TagLines(void *arg) {
 
-				} else if (strncmp(command, "CLOSE", 5) == 0) {
+	// Local variables
+	TAGLINE_REPLAYER *replayer = arg;
+	const TAGLINE_WORKLOAD *workload = replayer->workload;
+	const TAGLINE_OP *op;
+	struct timeval start, end;
+	double latency;
+	uint32_t opnum, next;
+	int count = 1, result;
+
+	for (opnum = replayer->first; opnum < replayer->last; opnum++) {
+		op = &workload->ops[opnum];
+		if (trace_requested && (replayer->id == 0)) {
+			trace_requested = 0;
+			raid_stats_trace_dump(trace_file);
+		}
+		if ((replayer->id == 0) && (sim_cache_resize != 0) && (opnum >= workload->header.op_count / 2)) {
+			logMessage(LOG_OUTPUT_LEVEL, "Resizing the cache to %lu KiB at operation %u",
+					(unsigned long)(sim_cache_resize / 1024), opnum);
+			if (resize_raid_cache(sim_cache_resize) != 0) {
+				replayer->err = 1;
+				break;
+			}
+			sim_cache_resize = 0;
+		}
+		if (op->tag % sim_threads != replayer->id) {
+			continue;
+		}
+		gettimeofday(&start, NULL);
+		if ((sim_write_batch > 1) && (op->type == TAGLINE_OP_WRITE)) {
+			// the writes of the thread up to its next other operation, as many as a batch takes
+			for (count = 0, next = opnum; (next < replayer->last) && (count < sim_write_batch); next++) {
+				if (workload->ops[next].tag % sim_threads != replayer->id) {
+					continue;
+				}
+				if (workload->ops[next].type != TAGLINE_OP_WRITE) {
+					break;
+				}
+				replayer->writes[count++] = &workload->ops[next];
+			}
+			opnum = next - 1;
+			result = replay_writes(replayer, count);
+		} else {
+			count = 1;
+			result = replay_operation(replayer, op, &workload->texts[op->text]);
+		}
+		if (result != 0) {
+			replayer->err = 1;
+			break;
+		}
+		gettimeofday(&end, NULL);
+		latency = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+		replayer->ops += count;
+		replayer->latency_total += latency;
+		if (latency > replayer->latency_max) {
+			replayer->latency_max = latency;
+		}
+	}
+	return(NULL);
+}
 
-					// Close the tagline storage device
-					if (tagline_close()) {
-						// Error out
-						logMessage(LOG_ERROR_LEVEL, "Close failed on raid array.");
-						err = 1;
-					}
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replay_operation
+// Description  : Perform one operation of the workload, checking what is read
+//
+// Inputs       : replayer - the thread replaying it (its buffers are used)
+//                op - the operation
+//                text - the text of the operation
+// Outputs      : 0 if successful, -1 if failure
 
-				} else if (strncmp(command, "READ", 6) == 0) {
-
-					// First check to make sure our input is sane
-					if (strlen(text) != num_blocks) {
-						// Error out
-						logMessage(LOG_ERROR_LEVEL, "Text/number blocks mismatch in input data");
-						err = 1;
-					} else {
-
-						// Setup the read block to check against
-						for (i=0; i<num_blocks; i++) {
-							memset(&rdbuf[i*TAGLINE_BLOCK_SIZE], text[i], TAGLINE_BLOCK_SIZE);
-						}
-
-						// Read the blocks from the tagline
-						if (tagline_read(tagnum, blocknum, num_blocks, tmbuf)) {
-							// Error out
-							logMessage(LOG_ERROR_LEVEL, "READ failed on tagline storage device (%u)", tagnum);
-							err = 1;
-						}
-
-						// Now compare the read bytes to see if it is correct
-						if (memcmp(rdbuf, tmbuf, num_blocks*TAGLINE_BLOCK_SIZE)) {
-							// Error out
-							logMessage(LOG_ERROR_LEVEL, "Read blocks data mismatch return from tagline storage.");
-							logMessage(LOG_ERROR_LEVEL, "Mismatch [%d] != [%d]", (int)rdbuf[0], (int)tmbuf[0]);
-							err = 1;
-						}
-
-						// Log the confirmation
-						logMessage(LOG_INFO_LEVEL, "Read confirmation: tagline=%d, start=%d, blocks=%d",
-								tagnum, blocknum, num_blocks);
+int replay_operation(TAGLINE_REPLAYER *replayer, const TAGLINE_OP *op, const char *text) {
 
-					}
+	// Local variables
+	TAGLINE_SEGMENT segs[MAX_TAGLINE_BLOCK_NUMBER];
+	int i, j, batch;
 
-				}  else if (strncmp(command, "WRITE", 6) == 0) {
+	// Just log the contents
+	RAID_LOG_HOT("INPUT op=%u tag=%u #blks=%u start-blk=%u data=%.*s",
+			op->type, op->tag, op->blocks, op->block, (int)op->text_length, text);
 
-					// Setup the write block to send to storage device
-					for (i=0; i<num_blocks; i++) {
-						CMPSC_ASSERT0((text[i]!=0x0), "Bad write data from source files.");
-						memset(&wrbuf[i*TAGLINE_BLOCK_SIZE], text[i], TAGLINE_BLOCK_SIZE);
-					}
+	switch (op->type) {
+	case TAGLINE_OP_INIT:
+		// Call the initialize function for the tagline storae
+		if (tagline_driver_init(op->tag)) {
+			// Error out
+			logMessage(LOG_ERROR_LEVEL, "INIT failed on raid array (%d tags)", op->tag);
+			return(-1);
+		}
+		break;
 
-					// Call the block write function
-					if (tagline_write(tagnum, blocknum, num_blocks, wrbuf)) {
-						// Error out
-						logMessage(LOG_ERROR_LEVEL, "WRITE failed on tagline storage (%d)");
-						err = 1;
-					}
+	case TAGLINE_OP_CLOSE:
+		// Close the tagline storage device
+		if (tagline_close()) {
+			// Error out
+			logMessage(LOG_ERROR_LEVEL, "Close failed on raid array.");
+			return(-1);
+		}
+		break;
 
-				} else if (strncmp(command, "DISKFAIL", 8) == 0) {
+	case TAGLINE_OP_READ:
+		// First check to make sure our input is sane
+		if ((op->text_length != op->blocks) || (op->blocks > MAX_TAGLINE_BLOCK_NUMBER)) {
+			// Error out
+			logMessage(LOG_ERROR_LEVEL, "Text/number blocks mismatch in input data");
+			return(-1);
+		}
 
-					// Check if the failure are enabled
-					if (disk_failures) {
+		// Read the blocks from the tagline
+		if (tagline_read(op->tag, op->block, op->blocks, replayer->tmbuf)) {
+			// Error out
+			logMessage(LOG_ERROR_LEVEL, "READ failed on tagline storage device (%u)", op->tag);
+			return(-1);
+		}
 
-						// Call the disk failure in the RAID interface
-						logMessage(LOG_INFO_LEVEL, "Failing disk [%d] on raid array ...", tagnum);
-						if (remote_raid_fail_disk((RAIDDiskID)tagnum) || (raid_disk_signal())) {
-							logMessage(LOG_ERROR_LEVEL, "Simulation failed failing disk [%d] ... WAT?", tagnum);
-							return(-1);
-						}
+		// Now compare the read bytes to see if it is correct
+		if (tagline_blocks_match(replayer->tmbuf, op->blocks, text) != 0) {
+			// Error out
+			logMessage(LOG_ERROR_LEVEL, "Read blocks data mismatch return from tagline storage.");
+			logMessage(LOG_ERROR_LEVEL, "Mismatch [%d] != [%d]", (int)text[0], (int)replayer->tmbuf[0]);
+			return(-1);
+		}
 
-					} else {
-						// Just log it
-						logMessage(LOG_INFO_LEVEL, "Ignoring disabled disk failure  on disk [%d]", tagnum);
-					}
+		// Log the confirmation
+		RAID_LOG_HOT("Read confirmation: tagline=%d, start=%d, blocks=%d",
+				op->tag, op->block, op->blocks);
+		break;
 
-				} else if (strncmp(command, "tagline", 7) == 0) {
+	case TAGLINE_OP_WRITE:
+		if ((op->text_length < op->blocks) || (op->blocks > MAX_TAGLINE_BLOCK_NUMBER)) {
+			logMessage(LOG_ERROR_LEVEL, "Text/number blocks mismatch in input data");
+			return(-1);
+		}
 
-					// Need to save some data here!
-					logMessage(LOG_INFO_LEVEL, "Getting tagline final data (%s)", command);
+		// Setup the write block to send to storage device, the blocks already
+		// holding their character are left alone
+		for (i=0; i<op->blocks; i++) {
+			CMPSC_ASSERT0((text[i]!=0x0), "Bad write data from source files.");
+			if (replayer->wrfill[i] != text[i]) {
+				memset(&replayer->wrbuf[i*TAGLINE_BLOCK_SIZE], text[i], TAGLINE_BLOCK_SIZE);
+				replayer->wrfill[i] = text[i];
+			}
+		}
 
-					// TODO: this single block reads are only for first version
-					// do a bunch of reads to make sure that the data matches workload indicators
-					for (i=0; i<strlen(text); i++) {
+		// Call the block write function
+		if (tagline_write(op->tag, op->block, op->blocks, replayer->wrbuf)) {
+			// Error out
+			logMessage(LOG_ERROR_LEVEL, "WRITE failed on tagline storage (%d)", op->tag);
+			return(-1);
+		}
+		break;
 
-						// Setup text, then request validation
-						txt[0] = text[i];
-						txt[1] = 0x0;
-						if (tagline_read_block_validate(tagnum, i, 1, txt)) {
-							logMessage(LOG_ERROR_LEVEL, "Tagline validation failed for tag line [%d], aborting.", tagnum);
-							return(-1);
-						} else {
-							logMessage(LOG_INFO_LEVEL, "Tagline validation successful for tag line [%d]", tagnum);
-						}
-					}
+	case TAGLINE_OP_DISKFAIL:
+		// Check if the failure are enabled
+		if (disk_failures) {
 
-					// Finished validating, success!!!
-					logMessage(LOG_INFO_LEVEL, "Tagline validation successful for all taglines, success!!!!");
-				}
+			// Call the disk failure in the RAID interface
+			logMessage(LOG_INFO_LEVEL, "Failing disk [%d] on raid array ...", op->tag);
+			if (remote_raid_fail_disk((RAIDDiskID)op->tag) || (raid_disk_signal())) {
+				logMessage(LOG_ERROR_LEVEL, "Simulation failed failing disk [%d] ... WAT?", op->tag);
+				return(-1);
+			}
 
+		} else {
+			// Just log it
+			logMessage(LOG_INFO_LEVEL, "Ignoring disabled disk failure  on disk [%d]", op->tag);
+		}
+		break;
+
+	case TAGLINE_OP_VALIDATE:
+		// Need to save some data here!
+		logMessage(LOG_INFO_LEVEL, "Getting tagline final data (%u)", op->tag);
+
+		// read the blocks in batches of single block segments, one vectored read each
+		for (i=0; i<op->text_length; i+=batch) {
+			batch = (op->text_length - i < MAX_TAGLINE_BLOCK_NUMBER) ? op->text_length - i : MAX_TAGLINE_BLOCK_NUMBER;
+			for (j=0; j<batch; j++) {
+				segs[j].tag = op->tag;
+				segs[j].bnum = i + j;
+				segs[j].blks = 1;
+				segs[j].buf = &replayer->tmbuf[j*TAGLINE_BLOCK_SIZE];
 			}
 
-			// Check for the virtual level failing
-			if (err) {
-				logMessage(LOG_ERROR_LEVEL, "RAID system failed, aborting [%d]", err);
-				fclose(fhandle);
+			// Request validation of each block
+			if (tagline_readv(segs, batch) || tagline_blocks_match(replayer->tmbuf, batch, &text[i])) {
+				logMessage(LOG_ERROR_LEVEL, "Tagline validation failed for tag line [%d], aborting.", op->tag);
 				return(-1);
+			} else {
+				RAID_LOG_HOT("Tagline validation successful for tag line [%d]", op->tag);
 			}
 		}
+
+		// Finished validating, success!!!
+		logMessage(LOG_INFO_LEVEL, "Tagline validation successful for all taglines, success!!!!");
+		break;
 	}
 
-	// Close the workload file, successfully
-	fclose(fhandle);
+	// Return successfully
 	return(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : tagline_read_block_read
-// Description  : The perform a read and validate the result by extracting the
-//                data and comparing the memory bytes.
+// Function     : replay_writes
+// Description  : Perform a batch of write operations of the workload with one
+//                vectored write, a segment each (in the order of the workload)
 //
-// Inputs       : tagnum - the tag line number
-//                blocknum - the block number of the tagline to read
-//                bum_blocks - the number of blocks to read
-//                text - the block contents to validate
-// Outputs      : 0 if successful test, -1 if failure
+// Inputs       : replayer - the thread replaying them (replayer->writes)
+//                count - the number of writes
+// Outputs      : 0 if successful, -1 if failure
 
-int tagline_read_block_validate(TagLineNumber tagnum, TagLineBlockNumber blocknum,
-		uint16_t num_blocks, char *text) {
+int replay_writes(TAGLINE_REPLAYER *replayer, int count) {
 
 	// Local variables
-	int i;
+	const TAGLINE_OP *op;
+	const char *text;
+	char *buf, *fill;
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		op = replayer->writes[i];
+		text = &replayer->workload->texts[op->text];
+		RAID_LOG_HOT("INPUT op=%u tag=%u #blks=%u start-blk=%u data=%.*s",
+				op->type, op->tag, op->blocks, op->block, (int)op->text_length, text);
+		if ((op->text_length < op->blocks) || (op->blocks > MAX_TAGLINE_BLOCK_NUMBER)) {
+			logMessage(LOG_ERROR_LEVEL, "Text/number blocks mismatch in input data");
+			return(-1);
+		}
 
-	// First check to make sure our input is sane
-	if (strlen(text) != num_blocks) {
+		// Setup the blocks of its segment, the ones already holding their character are left alone
+		buf = &replayer->wvbuf[(size_t)i*MAX_TAGLINE_BLOCK_NUMBER*TAGLINE_BLOCK_SIZE];
+		fill = &replayer->wvfill[i*MAX_TAGLINE_BLOCK_NUMBER];
+		for (j=0; j<op->blocks; j++) {
+			CMPSC_ASSERT0((text[j]!=0x0), "Bad write data from source files.");
+			if (fill[j] != text[j]) {
+				memset(&buf[j*TAGLINE_BLOCK_SIZE], text[j], TAGLINE_BLOCK_SIZE);
+				fill[j] = text[j];
+			}
+		}
+		replayer->segs[i].tag = op->tag;
+		replayer->segs[i].bnum = op->block;
+		replayer->segs[i].blks = op->blocks;
+		replayer->segs[i].buf = buf;
+	}
 
-		// Error out
-		logMessage(LOG_ERROR_LEVEL, "Text/number blocks mismatch in input data");
+	// Call the vectored write function
+	if (tagline_writev(replayer->segs, count)) {
+		logMessage(LOG_ERROR_LEVEL, "WRITE failed on tagline storage (%d writes from tag %d)", count, replayer->segs[0].tag);
 		return(-1);
+	}
+	return(0);
+}
 
-	} else {
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : report_TagLines
+// Description  : Log the operations per second and latencies of every replay
+//                thread, and of the whole replay
+//
+// Inputs       : replayers - the replay threads
+//                barrier_ops - operations run alone (INIT, CLOSE, DISKFAIL)
+//                seconds - time the replay took
+// Outputs      : the number of operations replayed
 
-		// Setup the read block to check against
-		for (i = 0; i < num_blocks; i++) {
-			memset(&rdbuf[i * TAGLINE_BLOCK_SIZE], text[i], TAGLINE_BLOCK_SIZE);
-		}
+uint64_t report_TagLines(TAGLINE_REPLAYER *replayers, uint64_t barrier_ops, double seconds) {
 
-		// Read the blocks from the tagline
-		if (tagline_read(tagnum, blocknum, num_blocks, tmbuf)) {
-			// Error out
-			logMessage(LOG_ERROR_LEVEL,
-					"READ failed on tagline storage device (%u)", tagnum);
-			return(-1);
-		}
+	// Local variables
+	uint64_t ops = barrier_ops;
+	double latency_total = 0, latency_max = 0;
+	int i;
 
-		// Now compare the read bytes to see if it is correct
-		if (memcmp(rdbuf, tmbuf, num_blocks * TAGLINE_BLOCK_SIZE)) {
-			// Error out
-			logMessage(LOG_ERROR_LEVEL,
-					"Read blocks data mismatch return from tagline storage.");
-			return(-1);
+	logMessage(LOG_OUTPUT_LEVEL, "** Replay Statistics **");
+	for (i = 0; i < sim_threads; i++) {
+		if (sim_threads > 1) {
+			logMessage(LOG_OUTPUT_LEVEL, "Thread %d: %lu ops, %.0f ops/s, latency avg %.1f us, max %.1f us", i,
+					(unsigned long)replayers[i].ops, (seconds > 0) ? replayers[i].ops / seconds : 0,
+					(replayers[i].ops > 0) ? replayers[i].latency_total / replayers[i].ops * 1e6 : 0,
+					replayers[i].latency_max * 1e6);
+		}
+		ops += replayers[i].ops;
+		latency_total += replayers[i].latency_total;
+		if (replayers[i].latency_max > latency_max) {
+			latency_max = replayers[i].latency_max;
 		}
+	}
+	logMessage(LOG_OUTPUT_LEVEL, "Replay: %lu ops in %.3f seconds, %.0f ops/s (%d threads)", (unsigned long)ops, seconds,
+			(seconds > 0) ? ops / seconds : 0, sim_threads);
+	logMessage(LOG_OUTPUT_LEVEL, "Replay latency: avg %.1f us, max %.1f us (reads, writes and validations)",
+			(ops > barrier_ops) ? latency_total / (ops - barrier_ops) * 1e6 : 0, latency_max * 1e6);
+	return(ops);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : request_trace
+// Description  : SIGUSR1 handler, the trace is written by the replay (not in
+//                the handler) before its next operation
+//
+// Inputs       : sig - the signal
+// Outputs      : N/A
 
+void request_trace(int sig) {
+	trace_requested = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compile_TagLines
+// Description  : Compile a workload into a binary workload file
+//
+// Inputs       : wload - the name of the workload file
+//                binfile - the name of the binary workload file to write
+// Outputs      : 0 if successful, -1 if failure
+
+int compile_TagLines(char *wload, char *binfile) {
+
+	// Local variables
+	TAGLINE_WORKLOAD workload;
+	int result;
+
+	if (load_tagline_workload(wload, &workload) != 0) {
+		return(-1);
+	}
+	result = save_tagline_workload(&workload, binfile);
+	if (result == 0) {
+		logMessage(LOG_OUTPUT_LEVEL, "Compiled workload [%s] into [%s]: %u operations, %u bytes of text",
+				wload, binfile, workload.header.op_count, workload.header.text_bytes);
 	}
+	close_tagline_workload(&workload);
+	return(result);
+}
 
-	// Return successfully
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tagline_blocks_match
+// Description  : Check that each block read is filled with its character of the
+//                text, without building the expected blocks (a block is filled
+//                with its first byte if it matches itself shifted by one byte)
+//
+// Inputs       : buf - the blocks read
+//                num_blocks - the number of blocks
+//                text - the character of each block
+// Outputs      : 0 if they match, -1 if not
+
+int tagline_blocks_match(const char *buf, uint16_t num_blocks, const char *text) {
+
+	// Local variables
+	int i;
+
+	for (i = 0; i < num_blocks; i++, buf += TAGLINE_BLOCK_SIZE) {
+		if ((buf[0] != text[i]) || (memcmp(buf, buf + 1, TAGLINE_BLOCK_SIZE - 1) != 0)) {
+			return(-1);
+		}
+	}
 	return(0);
 }
 
@@ -0,0 +1,606 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : tagline_workload.c
+//  Description    : This is the implementation of the workloads replayed by the
+//                   TAGLINE simulator.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+// ****************************************************************************
+// A workload is compiled into an array of fixed-size operations before it is
+// replayed, so the replay only measures the driver. A text workload (one
+// "COMMAND tag blocks start-block text" line per operation) is mapped in memory
+// and tokenized in place in a single pass, the texts of all the operations being
+// copied back to back into one pool. A binary workload is the compiled array as
+// written by save_tagline_workload: it is mapped and used as is, with no parsing
+// and no copy, which is what very large traces are converted to. A workload
+// named "gen:<generator>" is not a file: it is made up by a synthetic generator
+// (uniform, Zipfian or sequential extents, or a read/write mix) for benchmarks.
+
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <math.h>
+
+// Project includes
+#include <cmpsc311_log.h>
+#include <tagline_workload.h>
+
+// Defines
+#define WORKLOAD_MAX_COMMAND	128	// longest command word
+#define WORKLOAD_GEN_PREFIX	"gen:"	// name of a generated workload
+#define WORKLOAD_GEN_TAGLINES	64	// taglines of a generated workload (four times the default cache)
+#define WORKLOAD_GEN_BLOCKS	64	// blocks of each of them
+#define WORKLOAD_GEN_MAX_XFER	8	// blocks of a generated read or write (an extent)
+#define WORKLOAD_GEN_EXTENTS	(WORKLOAD_GEN_TAGLINES * WORKLOAD_GEN_BLOCKS / WORKLOAD_GEN_MAX_XFER)
+#define WORKLOAD_GEN_OPS	100000	// operations, unless the generator says
+#define WORKLOAD_GEN_ZIPF_SKEW	0.99	// exponent of the Zipf distribution
+#define WORKLOAD_GEN_SCATTER	61	// spreads the popular extents (prime to WORKLOAD_GEN_EXTENTS)
+#define WORKLOAD_GEN_SEED	0x9E3779B97F4A7C15ULL
+
+// Access patterns of the generators
+typedef enum {
+	WORKLOAD_GEN_UNIFORM = 0,	// any extent, as likely
+	WORKLOAD_GEN_ZIPF    = 1,	// a few extents most of the time
+	WORKLOAD_GEN_SCAN    = 2,	// every extent in turn
+	WORKLOAD_GEN_MIX     = 3,	// uniform, half the operations writes
+	WORKLOAD_GEN_MAXVAL  = 4,	// Max value
+} WORKLOAD_GEN_PATTERN;
+
+// State of a generator
+typedef struct {
+	TAGLINE_WORKLOAD	*wl;		// the workload generated
+	uint32_t		count;		// operations so far
+	uint32_t		textpos;	// text so far
+	uint64_t		random;		// state of the pseudo-random sequence
+	char			contents[WORKLOAD_GEN_TAGLINES][WORKLOAD_GEN_BLOCKS];	// last written character of each block
+} WORKLOAD_GENERATOR;
+
+// Function Prototypes:
+int compile_text_workload(TAGLINE_WORKLOAD *wl, const char *text, size_t size);
+int map_binary_workload(TAGLINE_WORKLOAD *wl);
+const char *workload_token(const char *p, const char *end, const char **token, size_t *length);
+int workload_number(const char *token, size_t length, uint32_t max, uint32_t *value);
+int workload_command(const char *token, size_t length);
+void generator_op(WORKLOAD_GENERATOR *gen, TAGLINE_OP_TYPE type, uint32_t tag, uint32_t blocks,
+		uint32_t block, const char *text, uint32_t length);
+void generator_write(WORKLOAD_GENERATOR *gen, uint32_t tag, uint32_t block, uint32_t blocks, char *text);
+uint32_t generator_random(WORKLOAD_GENERATOR *gen);
+uint32_t generator_zipf(WORKLOAD_GENERATOR *gen, const double *cdf, uint32_t count);
+// -----------------------------
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_tagline_workload
+// Description  : Map a workload file and compile it into operations, a binary
+//                workload (starting with TAGLINE_WORKLOAD_MAGIC) is used in place
+//                and a "gen:" workload is generated
+//
+// Inputs       : filename - the workload file
+//                wl - the workload to fill
+// Outputs      : 0 if successful, -1 if failure
+
+int load_tagline_workload(const char *filename, TAGLINE_WORKLOAD *wl) {
+
+	struct stat	st;
+	int		fd;
+
+	memset(wl, 0, sizeof(TAGLINE_WORKLOAD));
+	if (strncmp(filename, WORKLOAD_GEN_PREFIX, strlen(WORKLOAD_GEN_PREFIX)) == 0) {
+		if (generate_tagline_workload(wl, filename + strlen(WORKLOAD_GEN_PREFIX)) != 0) {
+			return(-1);
+		}
+		logMessage(LOG_INFO_LEVEL, "Workload [%s]: %u operations, %u bytes of text", filename,
+				wl->header.op_count, wl->header.text_bytes);
+		return(0);
+	}
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening the workload file [%s], error: %s.",
+			filename, strerror(errno));
+		return(-1);
+	}
+	if (fstat(fd, &st) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "Failure reading the workload file [%s], error: %s.",
+			filename, strerror(errno));
+		close(fd);
+		return(-1);
+	}
+
+	// an empty workload has no operations (and cannot be mapped)
+	wl->map_size = st.st_size;
+	if (wl->map_size > 0) {
+		wl->map = mmap(NULL, wl->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (wl->map == MAP_FAILED) {
+			logMessage(LOG_ERROR_LEVEL, "Failure mapping the workload file [%s], error: %s.",
+				filename, strerror(errno));
+			wl->map = NULL;
+			close(fd);
+			return(-1);
+		}
+		madvise(wl->map, wl->map_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	if ((wl->map_size >= sizeof(TAGLINE_WORKLOAD_HEADER)) &&
+			(((const TAGLINE_WORKLOAD_HEADER *)wl->map)->magic == TAGLINE_WORKLOAD_MAGIC)) {
+		if (map_binary_workload(wl) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "Bad binary workload file [%s]", filename);
+			close_tagline_workload(wl);
+			return(-1);
+		}
+	}
+	else if (compile_text_workload(wl, wl->map, wl->map_size) != 0) {
+		close_tagline_workload(wl);
+		return(-1);
+	}
+
+	logMessage(LOG_INFO_LEVEL, "Workload [%s]: %u operations, %u bytes of text", filename,
+			wl->header.op_count, wl->header.text_bytes);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : map_binary_workload
+// Description  : Use the operations and text pool of a mapped binary workload
+//
+// Inputs       : wl - the workload, its file mapped
+// Outputs      : 0 if successful, -1 if failure
+
+int map_binary_workload(TAGLINE_WORKLOAD *wl) {
+
+	const char	*base = wl->map;
+	uint32_t	i;
+
+	memcpy(&wl->header, base, sizeof(TAGLINE_WORKLOAD_HEADER));
+	if ((wl->header.version != TAGLINE_WORKLOAD_VERSION) ||
+			(wl->map_size != sizeof(TAGLINE_WORKLOAD_HEADER) + (size_t)wl->header.op_count * sizeof(TAGLINE_OP) +
+			 wl->header.text_bytes)) {
+		return(-1);
+	}
+	wl->ops = (const TAGLINE_OP *)(base + sizeof(TAGLINE_WORKLOAD_HEADER));
+	wl->texts = base + sizeof(TAGLINE_WORKLOAD_HEADER) + (size_t)wl->header.op_count * sizeof(TAGLINE_OP);
+
+	// every operation must stay within the pool
+	for (i = 0; i < wl->header.op_count; i++) {
+		if ((wl->ops[i].type >= TAGLINE_OP_MAXVAL) ||
+				((uint64_t)wl->ops[i].text + wl->ops[i].text_length > wl->header.text_bytes)) {
+			return(-1);
+		}
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compile_text_workload
+// Description  : Tokenize a text workload into operations, one per line (lines
+//                of a command the simulator does not know are skipped)
+//
+// Inputs       : wl - the workload to fill
+//                text - the contents of the workload file
+//                size - its size
+// Outputs      : 0 if successful, -1 if failure
+
+int compile_text_workload(TAGLINE_WORKLOAD *wl, const char *text, size_t size) {
+
+	const char	*p = text, *end = text + size, *eol, *token[5];
+	size_t		length[5], lines = 1, textpos = 0;
+	uint32_t	tag, blocks, block, count = 0, linecount = 0;
+	int		type, i;
+
+	// size the operations by the lines, the pool by the file
+	for (eol = p; (eol = memchr(eol, '\n', end - eol)) != NULL; eol++) {
+		lines++;
+	}
+	wl->op_buf = malloc(lines * sizeof(TAGLINE_OP));
+	wl->text_buf = malloc(size + 1);
+	if ((wl->op_buf == NULL) || (wl->text_buf == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "Failure allocating a workload of %lu lines", (unsigned long)lines);
+		return(-1);
+	}
+
+	while (p < end) {
+		eol = memchr(p, '\n', end - p);
+		if (eol == NULL) {
+			eol = end;
+		}
+		linecount++;
+
+		// command, tag, number of blocks, first block and text
+		for (i = 0; i < 5; i++) {
+			p = workload_token(p, eol, &token[i], &length[i]);
+			if (length[i] == 0) {
+				break;
+			}
+		}
+		if ((i == 0) && (p == eol)) {
+			p = eol + 1;		// blank line
+			continue;
+		}
+		if ((i < 5) || (length[0] >= WORKLOAD_MAX_COMMAND) ||
+				(workload_number(token[1], length[1], UINT16_MAX, &tag) != 0) ||
+				(workload_number(token[2], length[2], UINT16_MAX, &blocks) != 0) ||
+				(workload_number(token[3], length[3], UINT32_MAX, &block) != 0) ||
+				(length[4] > UINT16_MAX)) {
+			logMessage(LOG_ERROR_LEVEL, "Tagline un-parsable workload string, aborting [%.*s], line %u",
+					(int)(eol - token[0]), token[0], linecount);
+			return(-1);
+		}
+		p = eol + 1;
+
+		type = workload_command(token[0], length[0]);
+		if (type < 0) {
+			logMessage(LOG_INFO_LEVEL, "Skipping workload command [%.*s], line %u", (int)length[0], token[0], linecount);
+			continue;
+		}
+		wl->op_buf[count].type = type;
+		wl->op_buf[count].unused = 0;
+		wl->op_buf[count].tag = tag;
+		wl->op_buf[count].blocks = blocks;
+		wl->op_buf[count].block = block;
+		wl->op_buf[count].text = textpos;
+		wl->op_buf[count].text_length = length[4];
+		memcpy(&wl->text_buf[textpos], token[4], length[4]);
+		textpos += length[4];
+		count++;
+	}
+
+	wl->header.magic = TAGLINE_WORKLOAD_MAGIC;
+	wl->header.version = TAGLINE_WORKLOAD_VERSION;
+	wl->header.op_count = count;
+	wl->header.text_bytes = textpos;
+	wl->ops = wl->op_buf;
+	wl->texts = wl->text_buf;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : workload_token
+// Description  : Find the next blank-separated token of a line
+//
+// Inputs       : p - where to start
+//                end - the end of the line
+//                token - set to the start of the token
+//                length - set to its length (0 if the line has no more tokens)
+// Outputs      : where the token ends
+
+const char *workload_token(const char *p, const char *end, const char **token, size_t *length) {
+
+	while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\r'))) {
+		p++;
+	}
+	*token = p;
+	while ((p < end) && (*p != ' ') && (*p != '\t') && (*p != '\r')) {
+		p++;
+	}
+	*length = p - *token;
+	return(p);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : workload_number
+// Description  : Convert a token holding a decimal number
+//
+// Inputs       : token - the token
+//                length - its length
+//                max - the largest value allowed
+//                value - set to the number
+// Outputs      : 0 if successful, -1 if not a number or too large
+
+int workload_number(const char *token, size_t length, uint32_t max, uint32_t *value) {
+
+	uint64_t	n = 0;
+	size_t		i;
+
+	if ((length == 0) || (length > 10)) {
+		return(-1);
+	}
+	for (i = 0; i < length; i++) {
+		if ((token[i] < '0') || (token[i] > '9')) {
+			return(-1);
+		}
+		n = n * 10 + (token[i] - '0');
+	}
+	if (n > max) {
+		return(-1);
+	}
+	*value = n;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : workload_command
+// Description  : Find the operation of a command word (DISKFAIL and tagline
+//                match any word they start, as the simulator always did)
+//
+// Inputs       : token - the command word
+//                length - its length
+// Outputs      : the TAGLINE_OP_TYPE, -1 if the command is unknown
+
+int workload_command(const char *token, size_t length) {
+
+	if ((length == 4) && (memcmp(token, "INIT", 4) == 0)) {
+		return(TAGLINE_OP_INIT);
+	}
+	if ((length == 5) && (memcmp(token, "CLOSE", 5) == 0)) {
+		return(TAGLINE_OP_CLOSE);
+	}
+	if ((length == 4) && (memcmp(token, "READ", 4) == 0)) {
+		return(TAGLINE_OP_READ);
+	}
+	if ((length == 5) && (memcmp(token, "WRITE", 5) == 0)) {
+		return(TAGLINE_OP_WRITE);
+	}
+	if ((length >= 8) && (memcmp(token, "DISKFAIL", 8) == 0)) {
+		return(TAGLINE_OP_DISKFAIL);
+	}
+	if ((length >= 7) && (memcmp(token, "tagline", 7) == 0)) {
+		return(TAGLINE_OP_VALIDATE);
+	}
+	return(-1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : generate_tagline_workload
+// Description  : Make a synthetic workload from a generator specification,
+//                "<pattern>[:<operations>[:<read percent>]]": the taglines are
+//                written in full first, then the operations read or overwrite
+//                extents of them picked by the pattern (uniform, zipf, scan or
+//                mix, which is uniform with half writes by default), and every
+//                tagline is validated at the end. Each read carries the contents
+//                it must find, so a generated workload checks the driver as the
+//                workload files do. The same specification always makes the same
+//                workload.
+//
+// Inputs       : wl - the workload to fill
+//                spec - the generator specification
+// Outputs      : 0 if successful, -1 if failure
+
+int generate_tagline_workload(TAGLINE_WORKLOAD *wl, const char *spec) {
+
+	const char	*patterns[WORKLOAD_GEN_MAXVAL] = { "uniform", "zipf", "scan", "mix" };
+	WORKLOAD_GENERATOR gen;
+	double		zipf[WORKLOAD_GEN_EXTENTS];
+	char		text[WORKLOAD_GEN_MAX_XFER];
+	uint32_t	ops = WORKLOAD_GEN_OPS, reads = 100, extent = 0, blocks, block, tag, i, j;
+	int		pattern, length;
+
+	// Parse the specification
+	for (pattern = 0; pattern < WORKLOAD_GEN_MAXVAL; pattern++) {
+		length = strlen(patterns[pattern]);
+		if ((strncmp(spec, patterns[pattern], length) == 0) && ((spec[length] == 0) || (spec[length] == ':'))) {
+			break;
+		}
+	}
+	if (pattern == WORKLOAD_GEN_MIX) {
+		reads = 50;
+	}
+	if ((pattern == WORKLOAD_GEN_MAXVAL) ||
+			((spec[length] == ':') && (sscanf(&spec[length + 1], "%u:%u", &ops, &reads) < 1)) ||
+			(ops == 0) || (reads > 100)) {
+		logMessage(LOG_ERROR_LEVEL, "Bad workload generator [%s], use <uniform|zipf|scan|mix>[:<ops>[:<read%%>]]", spec);
+		return(-1);
+	}
+
+	// Room for the INIT, the first writes, the operations, the validations and the CLOSE
+	memset(&gen, 0, sizeof(gen));
+	gen.wl = wl;
+	gen.random = WORKLOAD_GEN_SEED;
+	wl->op_buf = malloc((1 + WORKLOAD_GEN_EXTENTS + (size_t)ops + WORKLOAD_GEN_TAGLINES + 1) * sizeof(TAGLINE_OP));
+	wl->text_buf = malloc(2 * WORKLOAD_GEN_TAGLINES * WORKLOAD_GEN_BLOCKS + (size_t)ops * WORKLOAD_GEN_MAX_XFER + 2);
+	if ((wl->op_buf == NULL) || (wl->text_buf == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "Failure allocating a generated workload of %u operations", ops);
+		close_tagline_workload(wl);
+		return(-1);
+	}
+
+	// Zipf distribution of the extents, the most popular first (scattered over the taglines)
+	zipf[0] = 1.0;
+	for (i = 1; i < WORKLOAD_GEN_EXTENTS; i++) {
+		zipf[i] = zipf[i - 1] + pow(i + 1, -WORKLOAD_GEN_ZIPF_SKEW);
+	}
+
+	// Write every tagline in full
+	generator_op(&gen, TAGLINE_OP_INIT, WORKLOAD_GEN_TAGLINES, 0, 0, "X", 1);
+	for (i = 0; i < WORKLOAD_GEN_EXTENTS; i++) {
+		tag = i / (WORKLOAD_GEN_BLOCKS / WORKLOAD_GEN_MAX_XFER);
+		block = (i % (WORKLOAD_GEN_BLOCKS / WORKLOAD_GEN_MAX_XFER)) * WORKLOAD_GEN_MAX_XFER;
+		generator_write(&gen, tag, block, WORKLOAD_GEN_MAX_XFER, text);
+	}
+
+	// Then read or overwrite the pattern extents
+	for (i = 0; i < ops; i++) {
+		switch (pattern) {
+		case WORKLOAD_GEN_ZIPF:
+			extent = generator_zipf(&gen, zipf, WORKLOAD_GEN_EXTENTS);
+			extent = (extent * WORKLOAD_GEN_SCATTER) % WORKLOAD_GEN_EXTENTS;
+			// fall through
+		case WORKLOAD_GEN_SCAN:
+			tag = extent / (WORKLOAD_GEN_BLOCKS / WORKLOAD_GEN_MAX_XFER);
+			block = (extent % (WORKLOAD_GEN_BLOCKS / WORKLOAD_GEN_MAX_XFER)) * WORKLOAD_GEN_MAX_XFER;
+			blocks = WORKLOAD_GEN_MAX_XFER;
+			extent = (extent + 1) % WORKLOAD_GEN_EXTENTS;
+			break;
+
+		default:
+			tag = generator_random(&gen) % WORKLOAD_GEN_TAGLINES;
+			blocks = 1 + generator_random(&gen) % WORKLOAD_GEN_MAX_XFER;
+			block = generator_random(&gen) % (WORKLOAD_GEN_BLOCKS - blocks + 1);
+			break;
+		}
+		if (generator_random(&gen) % 100 < reads) {
+			generator_op(&gen, TAGLINE_OP_READ, tag, blocks, block, &gen.contents[tag][block], blocks);
+		} else {
+			generator_write(&gen, tag, block, blocks, text);
+		}
+	}
+
+	// Check the taglines hold what was written last
+	for (j = 0; j < WORKLOAD_GEN_TAGLINES; j++) {
+		generator_op(&gen, TAGLINE_OP_VALIDATE, j, 0, 0, gen.contents[j], WORKLOAD_GEN_BLOCKS);
+	}
+	generator_op(&gen, TAGLINE_OP_CLOSE, 0, 0, 0, "X", 1);
+
+	wl->header.magic = TAGLINE_WORKLOAD_MAGIC;
+	wl->header.version = TAGLINE_WORKLOAD_VERSION;
+	wl->header.op_count = gen.count;
+	wl->header.text_bytes = gen.textpos;
+	wl->ops = wl->op_buf;
+	wl->texts = wl->text_buf;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : generator_op
+// Description  : Add an operation to a generated workload
+//
+// Inputs       : gen - the generator
+//                type, tag, blocks, block - the operation
+//                text - its text
+//                length - characters of the text
+// Outputs      : N/A
+
+void generator_op(WORKLOAD_GENERATOR *gen, TAGLINE_OP_TYPE type, uint32_t tag, uint32_t blocks,
+		uint32_t block, const char *text, uint32_t length) {
+
+	TAGLINE_OP	*op = &gen->wl->op_buf[gen->count++];
+
+	op->type = type;
+	op->unused = 0;
+	op->tag = tag;
+	op->blocks = blocks;
+	op->block = block;
+	op->text = gen->textpos;
+	op->text_length = length;
+	memcpy(&gen->wl->text_buf[gen->textpos], text, length);
+	gen->textpos += length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : generator_write
+// Description  : Add a write of new contents to a generated workload
+//
+// Inputs       : gen - the generator
+//                tag, block, blocks - the blocks written
+//                text - memory for the text of the write
+// Outputs      : N/A
+
+void generator_write(WORKLOAD_GENERATOR *gen, uint32_t tag, uint32_t block, uint32_t blocks, char *text) {
+
+	const char	*alphabet = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+	uint32_t	i;
+
+	for (i = 0; i < blocks; i++) {
+		text[i] = alphabet[generator_random(gen) % 62];
+		gen->contents[tag][block + i] = text[i];
+	}
+	generator_op(gen, TAGLINE_OP_WRITE, tag, blocks, block, text, blocks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : generator_random
+// Description  : Next number of the generator sequence (xorshift64*)
+//
+// Inputs       : gen - the generator
+// Outputs      : a pseudo-random 32 bit number
+
+uint32_t generator_random(WORKLOAD_GENERATOR *gen) {
+
+	gen->random ^= gen->random >> 12;
+	gen->random ^= gen->random << 25;
+	gen->random ^= gen->random >> 27;
+	return((uint32_t)((gen->random * 0x2545F4914F6CDD1DULL) >> 32));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : generator_zipf
+// Description  : Pick a rank by a (cumulative) distribution
+//
+// Inputs       : gen - the generator
+//                cdf - the cumulative weights of the ranks
+//                count - the number of ranks
+// Outputs      : the rank
+
+uint32_t generator_zipf(WORKLOAD_GENERATOR *gen, const double *cdf, uint32_t count) {
+
+	double		x = cdf[count - 1] * (generator_random(gen) / 4294967296.0);
+	uint32_t	low = 0, high = count - 1, mid;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (cdf[mid] <= x) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return(low);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : save_tagline_workload
+// Description  : Write a compiled workload as a binary workload file
+//
+// Inputs       : wl - the workload
+//                filename - the binary workload file to write
+// Outputs      : 0 if successful, -1 if failure
+
+int save_tagline_workload(const TAGLINE_WORKLOAD *wl, const char *filename) {
+
+	FILE	*fhandle;
+	int	result = 0;
+
+	if ((fhandle = fopen(filename, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening the binary workload file [%s], error: %s.",
+			filename, strerror(errno));
+		return(-1);
+	}
+	if ((fwrite(&wl->header, sizeof(TAGLINE_WORKLOAD_HEADER), 1, fhandle) != 1) ||
+			(fwrite(wl->ops, sizeof(TAGLINE_OP), wl->header.op_count, fhandle) != wl->header.op_count) ||
+			(fwrite(wl->texts, 1, wl->header.text_bytes, fhandle) != wl->header.text_bytes)) {
+		result = -1;
+	}
+	if ((fclose(fhandle) != 0) || (result != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing the binary workload file [%s], error: %s.",
+			filename, strerror(errno));
+		return(-1);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : close_tagline_workload
+// Description  : Release a loaded workload
+//
+// Inputs       : wl - the workload
+// Outputs      : N/A
+
+void close_tagline_workload(TAGLINE_WORKLOAD *wl) {
+
+	if (wl->map != NULL) {
+		munmap(wl->map, wl->map_size);
+	}
+	free(wl->op_buf);
+	free(wl->text_buf);
+	memset(wl, 0, sizeof(TAGLINE_WORKLOAD));
+}
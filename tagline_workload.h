@@ -0,0 +1,78 @@
+#ifndef TAGLINE_WORKLOAD_INCLUDED
+#define TAGLINE_WORKLOAD_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : tagline_workload.h
+//  Description    : This is the header file for the workloads replayed by the
+//                   TAGLINE simulator, compiled into an array of operations.
+//
+//  Author         : Raquel Alvarez
+//  Last Modified  : Wednesday, October 14th 2026
+//
+
+// Includes
+#include <tagline_driver.h>
+
+// Defines
+#define TAGLINE_WORKLOAD_MAGIC		0x424c5754	// "TWLB", first word of a binary workload
+#define TAGLINE_WORKLOAD_VERSION	1
+
+// Commands of a workload
+typedef enum {
+	TAGLINE_OP_INIT     = 0,	// initialize the driver (tag is the number of taglines)
+	TAGLINE_OP_CLOSE    = 1,	// close the driver
+	TAGLINE_OP_READ     = 2,	// read and check blocks of a tagline
+	TAGLINE_OP_WRITE    = 3,	// write blocks of a tagline
+	TAGLINE_OP_DISKFAIL = 4,	// fail a disk (tag is the disk)
+	TAGLINE_OP_VALIDATE = 5,	// check every block of a tagline, one at a time
+	TAGLINE_OP_MAXVAL   = 6,	// Max value
+} TAGLINE_OP_TYPE;
+
+// An operation: each block of a read, write or validation is filled with one
+// character of the text of the operation (text bytes at offset text of the pool)
+typedef struct {
+	uint8_t			type;		// TAGLINE_OP_TYPE
+	uint8_t			unused;
+	uint16_t		blocks;		// number of blocks
+	TagLineNumber		tag;		// tagline (disk for DISKFAIL, taglines for INIT)
+	uint16_t		text_length;	// characters of the text
+	TagLineBlockNumber	block;		// first block
+	uint32_t		text;		// offset of the text in the text pool
+} TAGLINE_OP;
+
+// A compiled workload; a binary workload file is its header, the operations and
+// then the text pool (in the byte order of the machine that wrote it)
+typedef struct {
+	uint32_t		magic;		// TAGLINE_WORKLOAD_MAGIC
+	uint32_t		version;	// TAGLINE_WORKLOAD_VERSION
+	uint32_t		op_count;	// number of operations
+	uint32_t		text_bytes;	// size of the text pool
+} TAGLINE_WORKLOAD_HEADER;
+
+typedef struct {
+	TAGLINE_WORKLOAD_HEADER	header;
+	const TAGLINE_OP	*ops;		// the operations, in order
+	const char		*texts;		// the text pool
+	void			*map;		// the mapped file
+	size_t			map_size;
+	TAGLINE_OP		*op_buf;	// memory compiled into (NULL for a binary file)
+	char			*text_buf;
+} TAGLINE_WORKLOAD;
+
+///
+// Workload Interfaces
+
+int load_tagline_workload(const char *filename, TAGLINE_WORKLOAD *wl);
+	// Map a workload file, text or binary, and compile it into operations
+
+int generate_tagline_workload(TAGLINE_WORKLOAD *wl, const char *spec);
+	// Make a synthetic workload, "<uniform|zipf|scan|mix>[:<operations>[:<read percent>]]"
+
+int save_tagline_workload(const TAGLINE_WORKLOAD *wl, const char *filename);
+	// Write a compiled workload as a binary workload file
+
+void close_tagline_workload(TAGLINE_WORKLOAD *wl);
+	// Release a loaded workload
+
+#endif